@@ -70,6 +70,19 @@ public:
     return nullptr;
   }
 
+  /**
+   * @brief Writes the signal of sourceFile to a new GDF file.
+   *
+   * The samples are stored as 32-bit floats in records of about one second.
+   * The physical and digital ranges are the same, so the values are read back
+   * unchanged. The events of the montages marked 'save' are written to the
+   * event table.
+   *
+   * The signal is read sequentially from the start, so sourceFile can produce
+   * it on the fly.
+   */
+  static void saveAs(const std::string &filePath, DataFile *sourceFile);
+
 private:
   std::fstream file;
   double samplingFrequency;
@@ -61,6 +61,18 @@ public:
     return labels[channel];
   }
 
+  /**
+   * @brief Writes the signal of sourceFile to a new MAT file (version 7.3).
+   *
+   * The variables are named like the defaults in MATvars. The samples are
+   * stored as singles, and the events of the montages marked 'save' are
+   * written to the out structure.
+   *
+   * The signal is read sequentially from the start and appended to the file
+   * in chunks, so sourceFile can produce it on the fly.
+   */
+  static void saveAs(const std::string &filePath, DataFile *sourceFile);
+
 private:
   void openMatFile(const std::string &filePath);
   void construct();
@@ -0,0 +1,138 @@
+#ifndef ALENKAFILE_SYNTHETICFILE_H
+#define ALENKAFILE_SYNTHETICFILE_H
+
+#include "datafile.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace AlenkaFile {
+
+/**
+ * @brief The parameters of a SyntheticFile recording.
+ *
+ * The amplitudes are in microvolts, the durations in seconds.
+ */
+struct SyntheticSettings {
+  unsigned int channels = 32;
+  double samplingFrequency = 256;
+  double duration = 60;
+  std::uint64_t seed = 1;
+
+  double noiseAmplitude = 10; // Pink noise.
+  double alphaAmplitude = 20;
+  double alphaFrequency = 10;
+
+  double spikesPerMinute = 6;
+  double spikeAmplitude = 150;
+  double spikeDuration = 0.07;
+  int spikeSpread = 2; // How many neighbouring channels on each side.
+
+  double artifactsPerHour = 30;
+  double artifactAmplitude = 300;
+};
+
+/**
+ * @brief A generated event with the exact position in samples.
+ */
+struct SyntheticEvent {
+  enum Type { Spike, Blink, Muscle, TypeCount };
+
+  Type type;
+  std::int64_t position, duration;
+  int channel; // -1 means all channels.
+};
+
+/**
+ * @brief A DataFile that computes a realistic EEG-like signal on the fly.
+ *
+ * The signal is a sum of pink noise, alpha rhythm waxing and waning, and
+ * epileptic spikes and artifacts (blinks on the first channels, and bursts of
+ * muscle activity) at random times. The positions of the spikes and artifacts
+ * are known, so they can be used as the ground truth for detectors.
+ *
+ * Every sample is a function of the settings only (the random numbers don't
+ * depend on the standard library), so the same settings give the same signal,
+ * and any part of the recording can be read without computing what is before
+ * it. Only the list of events is kept in
+ * memory. Together with GDF2::saveAs(), EDF::saveAs() and MAT::saveAs(),
+ * which read the source file sequentially, this can produce recordings of any
+ * length.
+ *
+ * The samples are limited to ±getPhysicalMaximum().
+ */
+class SyntheticFile : public DataFile {
+  SyntheticSettings settings;
+  std::uint64_t samplesRecorded;
+  std::vector<SyntheticEvent> events; // Sorted by position.
+  std::int64_t longestEvent;
+  double limit;
+
+public:
+  /**
+   * @brief SyntheticFile constructor.
+   * @param filePath Used only for the secondary files.
+   */
+  SyntheticFile(const SyntheticSettings &settings,
+                const std::string &filePath = "");
+
+  double getSamplingFrequency() const override {
+    return settings.samplingFrequency;
+  }
+  unsigned int getChannelCount() const override { return settings.channels; }
+  uint64_t getSamplesRecorded() const override { return samplesRecorded; }
+  double getStartDate() const override { return daysUpTo1970; }
+
+  /**
+   * @brief Adds the events to the first montage, and marks it 'save', so that
+   * the events are written by saveAs().
+   */
+  bool load() override;
+
+  void readChannels(std::vector<float *> dataChannels, uint64_t firstSample,
+                    uint64_t lastSample) override {
+    readChannelsFloatDouble(dataChannels, firstSample, lastSample);
+  }
+  void readChannels(std::vector<double *> dataChannels, uint64_t firstSample,
+                    uint64_t lastSample) override {
+    readChannelsFloatDouble(dataChannels, firstSample, lastSample);
+  }
+
+  double getPhysicalMaximum(unsigned int /*channel*/) override {
+    return limit;
+  }
+  double getPhysicalMinimum(unsigned int /*channel*/) override {
+    return -limit;
+  }
+  std::string getLabel(unsigned int channel) override {
+    return "Ch" + std::to_string(channel + 1);
+  }
+
+  const SyntheticSettings &getSettings() const { return settings; }
+
+  /**
+   * @brief Returns the spikes and artifacts sorted by position.
+   */
+  const std::vector<SyntheticEvent> &getGroundTruth() const { return events; }
+
+  /**
+   * @brief Writes the ground truth as CSV with the times in seconds.
+   */
+  void saveGroundTruth(const std::string &filePath) const;
+
+  static std::string typeName(SyntheticEvent::Type type);
+
+private:
+  void generateEvents();
+  double eventSample(const SyntheticEvent &e, int channel,
+                     std::int64_t sample) const;
+
+  template <typename T>
+  void readChannelsFloatDouble(std::vector<T *> dataChannels,
+                               uint64_t firstSample, uint64_t lastSample);
+};
+
+} // namespace AlenkaFile
+
+#endif // ALENKAFILE_SYNTHETICFILE_H
@@ -61,6 +61,17 @@ void writeFile(fstream &file, const T *val, unsigned int elements = 1) {
   }
 }
 
+void writePadding(fstream &file, int64_t bytes) {
+  const vector<char> zeros(static_cast<size_t>(bytes), 0);
+  file.write(zeros.data(), bytes);
+}
+
+void writeString(fstream &file, const string &str, int size) {
+  const int length = min(static_cast<int>(str.size()), size);
+  file.write(str.data(), length);
+  writePadding(file, size - length);
+}
+
 #ifndef NDEBUG
 streampos tellFile(fstream &file, bool isGet = true) {
   return isGet ? file.tellg() : file.tellp();
@@ -123,6 +134,73 @@ void calibrateSamples(double *samples, int n, double digitalMinimum,
   }
 }
 
+/**
+ * @brief Writes the event table of dataFile at the current position.
+ *
+ * Events are collected from the montages marked 'save'.
+ */
+void writeEventTable(fstream &file, DataFile *dataFile) {
+  // Collect events from montages marked 'save'.
+  vector<uint32_t> positions;
+  vector<uint16_t> types;
+  vector<uint16_t> channels;
+  vector<uint32_t> durations;
+
+  AbstractMontageTable *montageTable = dataFile->getDataModel()->montageTable();
+
+  for (int i = 0; i < montageTable->rowCount(); ++i) {
+    if (montageTable->row(i).save) {
+      AbstractEventTable *eventTable = montageTable->eventTable(i);
+
+      for (int j = 0; j < eventTable->rowCount(); ++j) {
+        Event e = eventTable->row(j);
+
+        // Skip events belonging to tracks greater thatn the number of channels
+        // in the file. TODO: Perhaps make a warning about this?
+        if (-1 <= e.channel &&
+            e.channel < static_cast<int>(dataFile->getChannelCount()) &&
+            e.type >= 0) {
+          positions.push_back(e.position + 1);
+          types.push_back(static_cast<uint16_t>(
+              dataFile->getDataModel()->eventTypeTable()->row(e.type).id));
+          channels.push_back(
+              static_cast<uint16_t>(e.channel + 1)); // TODO: Make a warning if
+                                                     // these values cannot be
+                                                     // converted properly.
+          durations.push_back(e.duration);
+        }
+      }
+    }
+  }
+
+  // Write mode, NEV and SR.
+  uint8_t eventTableMode = 3;
+  writeFile(file, &eventTableMode);
+
+  int numberOfEvents = min(
+      static_cast<int>(positions.size()),
+      (1 << 24) - 1); // 2^24 - 1 is the maximum length of the gdf event table
+  uint8_t nev[3];
+  int tmp = numberOfEvents;
+  nev[0] = static_cast<uint8_t>(tmp % 256);
+  tmp >>= 8;
+  nev[1] = static_cast<uint8_t>(tmp % 256);
+  tmp >>= 8;
+  nev[2] = static_cast<uint8_t>(tmp % 256);
+  if (isLittleEndian == false)
+    DataFile::changeEndianness(reinterpret_cast<char *>(nev), 3);
+  writeFile(file, nev, 3);
+
+  float sr = static_cast<float>(dataFile->getSamplingFrequency());
+  writeFile(file, &sr);
+
+  // Write the events to the gdf event table.
+  writeFile(file, positions.data(), numberOfEvents);
+  writeFile(file, types.data(), numberOfEvents);
+  writeFile(file, channels.data(), numberOfEvents);
+  writeFile(file, durations.data(), numberOfEvents);
+}
+
 } // namespace
 
 // TODO: handle fstream exceptions in a clear and more informative way
@@ -296,73 +374,116 @@ GDF2::GDF2(const string &filePath, bool uncalibrated) : DataFile(filePath) {
 void GDF2::save() {
   saveSecondaryFile();
 
-  // Collect events from montages marked 'save'.
-  vector<uint32_t> positions;
-  vector<uint16_t> types;
-  vector<uint16_t> channels;
-  vector<uint32_t> durations;
-
-  AbstractMontageTable *montageTable = getDataModel()->montageTable();
-
-  for (int i = 0; i < montageTable->rowCount(); ++i) {
-    if (montageTable->row(i).save) {
-      AbstractEventTable *eventTable = montageTable->eventTable(i);
-
-      for (int j = 0; j < eventTable->rowCount(); ++j) {
-        Event e = eventTable->row(j);
-
-        // Skip events belonging to tracks greater thatn the number of channels
-        // in the file. TODO: Perhaps make a warning about this?
-        if (-1 <= e.channel &&
-            e.channel < static_cast<int>(getChannelCount()) && e.type >= 0) {
-          positions.push_back(e.position + 1);
-          types.push_back(static_cast<uint16_t>(
-              getDataModel()->eventTypeTable()->row(e.type).id));
-          channels.push_back(
-              static_cast<uint16_t>(e.channel + 1)); // TODO: Make a warning if
-                                                     // these values cannot be
-                                                     // converted properly.
-          durations.push_back(e.duration);
-        }
-      }
-    }
-  }
-
   // Make a backup copy.
   filesystem::path backupPath = getFilePath() + ".backup";
   if (!filesystem::exists(backupPath))
     filesystem::copy(getFilePath(), backupPath);
 
-  // Write mode, NEV and SR.
   seekFile(file, startOfEventTable, true);
+  writeEventTable(file, this);
 
-  uint8_t eventTableMode = 3;
-  writeFile(file, &eventTableMode);
+  file.sync();
+}
 
-  int numberOfEvents = min(
-      static_cast<int>(positions.size()),
-      (1 << 24) - 1); // 2^24 - 1 is the maximum length of the gdf event table
-  uint8_t nev[3];
-  int tmp = numberOfEvents;
-  nev[0] = static_cast<uint8_t>(tmp % 256);
-  tmp >>= 8;
-  nev[1] = static_cast<uint8_t>(tmp % 256);
-  tmp >>= 8;
-  nev[2] = static_cast<uint8_t>(tmp % 256);
-  if (isLittleEndian == false)
-    changeEndianness(reinterpret_cast<char *>(nev), 3);
-  writeFile(file, nev, 3);
+void GDF2::saveAs(const string &filePath, DataFile *sourceFile) {
+  fstream file(filePath, file.out | file.binary | file.trunc);
 
-  float sr = static_cast<float>(getSamplingFrequency());
-  writeFile(file, &sr);
+  if (!file.is_open())
+    throwDetailed(runtime_error("File '" + filePath +
+                                "' could not be opened for writing"));
 
-  // Write the events to the gdf event table.
-  writeFile(file, positions.data(), numberOfEvents);
-  writeFile(file, types.data(), numberOfEvents);
-  writeFile(file, channels.data(), numberOfEvents);
-  writeFile(file, durations.data(), numberOfEvents);
+  file.exceptions(ifstream::failbit | ifstream::badbit);
 
-  file.sync();
+  const unsigned int channelCount = sourceFile->getChannelCount();
+  if (0xFFFF <= channelCount)
+    throwDetailed(runtime_error("Too many channels for GDF2"));
+
+  const double samplingFrequency = sourceFile->getSamplingFrequency();
+  const uint64_t samplesRecorded = sourceFile->getSamplesRecorded();
+
+  // Records of about one second. The last one is padded with zeros.
+  const uint32_t samplesPerRecord =
+      max<uint32_t>(1, static_cast<uint32_t>(round(samplingFrequency)));
+  const int64_t numberOfDataRecords =
+      (samplesRecorded + samplesPerRecord - 1) / samplesPerRecord;
+  const double duration = samplesPerRecord / samplingFrequency;
+
+  double date = sourceFile->getStartDate();
+  if (date == INVALID_DATE)
+    date = static_cast<double>(sourceFile->getStandardStartDate()) / 86400 +
+           daysUpTo1970;
+  const double days = floor(date);
+  const uint32_t startDate[2] = {
+      static_cast<uint32_t>(min(ldexp(date - days, 32), 4294967295.)),
+      static_cast<uint32_t>(days)};
+
+  // Write fixed header.
+  writeString(file, "GDF 2.51", 8);
+  writeString(file, "X", 66); // Patient ID.
+  writePadding(file, 10 + 4); // Reserved and patient details.
+  writePadding(file, 64 + 16); // Recording ID and location.
+  writeFile(file, startDate, 2);
+  writePadding(file, 8); // Birthday.
+
+  const uint16_t headerLength = static_cast<uint16_t>(1 + channelCount);
+  writeFile(file, &headerLength);
+
+  // ICD, equipment provider ID, reserved, head size and electrode positions.
+  writePadding(file, 6 + 8 + 6 + 6 + 12 + 12);
+
+  writeFile(file, &numberOfDataRecords);
+  writeFile(file, &duration);
+
+  const uint16_t numberOfChannels = static_cast<uint16_t>(channelCount);
+  writeFile(file, &numberOfChannels);
+  writePadding(file, 2);
+
+  assert(tellFile(file, false) == streampos(256) &&
+         "Make sure we wrote all of the fixed header.");
+
+  // Write variable header.
+  const vector<string> labels = sourceFile->getLabels();
+  for (const auto &e : labels)
+    writeString(file, e, 16);
+
+  writePadding(file, (80 + 6) * channelCount); // Sensor type and dimension.
+
+  const vector<uint16_t> physicalDimensionCode(channelCount, 0);
+  writeFile(file, physicalDimensionCode.data(), channelCount);
+
+  // With the same physical and digital range the calibration does nothing.
+  const double range = 1000 * 1000;
+  const vector<double> minimum(channelCount, -range);
+  const vector<double> maximum(channelCount, range);
+  writeFile(file, minimum.data(), channelCount);
+  writeFile(file, maximum.data(), channelCount);
+  writeFile(file, minimum.data(), channelCount);
+  writeFile(file, maximum.data(), channelCount);
+
+  // Reserved, time offset and the filter frequencies.
+  writePadding(file, (64 + 4 * 4) * channelCount);
+
+  const vector<uint32_t> samples(channelCount, samplesPerRecord);
+  writeFile(file, samples.data(), channelCount);
+
+  const vector<uint32_t> typeOfData(channelCount, 16); // float32
+  writeFile(file, typeOfData.data(), channelCount);
+
+  writePadding(file, (12 + 20) * channelCount); // Sensor position and info.
+
+  assert(tellFile(file, false) == streampos(256 + 256 * channelCount) &&
+         "Make sure we wrote all of the variable header.");
+
+  // Write the data records; the channels are stored one after another.
+  vector<float> buffer(samplesPerRecord * channelCount);
+
+  for (int64_t i = 0; i < numberOfDataRecords; ++i) {
+    const int64_t first = i * samplesPerRecord;
+    sourceFile->readSignal(buffer.data(), first, first + samplesPerRecord - 1);
+    writeFile(file, buffer.data(), static_cast<unsigned int>(buffer.size()));
+  }
+
+  writeEventTable(file, sourceFile);
 }
 
 bool GDF2::load() {
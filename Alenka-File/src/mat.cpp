@@ -6,6 +6,7 @@
 #include <cmath>
 #include <cstdint>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
 
 #include <detailedexception.h>
@@ -107,6 +108,84 @@ vector<double> readDoubleArray(mat_t *file, matvar_t *var) {
   return doubleArray;
 }
 
+void writeVar(mat_t *file, matvar_t *var) {
+  int err = Mat_VarWrite(file, var, MAT_COMPRESSION_NONE);
+  Mat_VarFree(var);
+
+  if (err != 0)
+    throwDetailed(runtime_error("Mat_VarWrite failed"));
+}
+
+matvar_t *createDoubleArray(const char *name, vector<double> values) {
+  size_t dims[2] = {values.size(), 1};
+  return Mat_VarCreate(name, MAT_C_DOUBLE, MAT_T_DOUBLE, 2, dims,
+                       values.data(), 0);
+}
+
+matvar_t *createStruct(const char *name, const vector<const char *> &fields) {
+  size_t dims[2] = {1, 1};
+  return Mat_VarCreateStruct(name, 2, dims,
+                             const_cast<const char **>(fields.data()),
+                             static_cast<unsigned int>(fields.size()));
+}
+
+void writeLabels(mat_t *file, DataFile *sourceFile) {
+  const vector<string> labels = sourceFile->getLabels();
+
+  size_t dims[2] = {1, labels.size()};
+  matvar_t *cell = Mat_VarCreate("label", MAT_C_CELL, MAT_T_CELL, 2, dims,
+                                 nullptr, 0);
+
+  for (size_t i = 0; i < labels.size(); ++i) {
+    size_t labelDims[2] = {1, labels[i].size()};
+    matvar_t *label =
+        Mat_VarCreate(nullptr, MAT_C_CHAR, MAT_T_UINT8, 2, labelDims,
+                      const_cast<char *>(labels[i].data()), 0);
+    Mat_VarSetCell(cell, static_cast<int>(i), label);
+  }
+
+  matvar_t *header = createStruct("header", {"label"});
+  Mat_VarSetStructFieldByName(header, "label", 0, cell);
+  writeVar(file, header);
+}
+
+void writeEvents(mat_t *file, DataFile *sourceFile) {
+  const double fs = sourceFile->getSamplingFrequency();
+  const int channelCount = static_cast<int>(sourceFile->getChannelCount());
+  vector<double> positions, durations, channels;
+
+  const AbstractMontageTable *montageTable =
+      sourceFile->getDataModel()->montageTable();
+
+  for (int i = 0; i < montageTable->rowCount(); ++i) {
+    if (montageTable->row(i).save) {
+      const AbstractEventTable *eventTable = montageTable->eventTable(i);
+
+      for (int j = 0; j < eventTable->rowCount(); ++j) {
+        Event e = eventTable->row(j);
+
+        if (-1 <= e.channel && e.channel < channelCount && e.type >= 0) {
+          positions.push_back(e.position / fs);
+          durations.push_back(e.duration / fs);
+          channels.push_back(e.channel + 1); // 0 means all channels.
+        }
+      }
+    }
+  }
+
+  if (positions.empty())
+    return;
+
+  matvar_t *out = createStruct("out", {"pos", "dur", "chan"});
+  Mat_VarSetStructFieldByName(out, "pos", 0,
+                              createDoubleArray("pos", positions));
+  Mat_VarSetStructFieldByName(out, "dur", 0,
+                              createDoubleArray("dur", durations));
+  Mat_VarSetStructFieldByName(out, "chan", 0,
+                              createDoubleArray("chan", channels));
+  writeVar(file, out);
+}
+
 } // namespace
 
 namespace AlenkaFile {
@@ -136,6 +215,47 @@ MAT::~MAT() {
 
 void MAT::save() { DataFile::save(); }
 
+void MAT::saveAs(const string &filePath, DataFile *sourceFile) {
+  mat_t *file = Mat_CreateVer(filePath.c_str(), nullptr, MAT_FT_MAT73);
+
+  if (!file)
+    throwDetailed(runtime_error("File '" + filePath +
+                                "' could not be opened for writing"));
+
+  unique_ptr<mat_t, int (*)(mat_t *)> fileCloser(file, &Mat_Close);
+
+  const size_t channelCount = sourceFile->getChannelCount();
+  const uint64_t samplesRecorded = sourceFile->getSamplesRecorded();
+
+  double fs = sourceFile->getSamplingFrequency();
+  size_t scalarDims[2] = {1, 1};
+  writeVar(file, Mat_VarCreate("fs", MAT_C_DOUBLE, MAT_T_DOUBLE, 2,
+                               scalarDims, &fs, 0));
+
+  // The channels are in columns, which is the layout of the buffer filled by
+  // readSignal(). About 4 MB is appended at a time.
+  const uint64_t chunkLength =
+      max<uint64_t>(1, (1 << 20) / max<size_t>(1, channelCount));
+  vector<float> buffer(chunkLength * channelCount);
+
+  for (uint64_t first = 0; first < samplesRecorded; first += chunkLength) {
+    const uint64_t length = min(chunkLength, samplesRecorded - first);
+    sourceFile->readSignal(buffer.data(), first, first + length - 1);
+
+    size_t dims[2] = {static_cast<size_t>(length), channelCount};
+    matvar_t *d = Mat_VarCreate("d", MAT_C_SINGLE, MAT_T_SINGLE, 2, dims,
+                                buffer.data(), MAT_F_DONT_COPY_DATA);
+    int err = Mat_VarWriteAppend(file, d, MAT_COMPRESSION_NONE, 1);
+    Mat_VarFree(d);
+
+    if (err != 0)
+      throwDetailed(runtime_error("Mat_VarWriteAppend failed"));
+  }
+
+  writeLabels(file, sourceFile);
+  writeEvents(file, sourceFile);
+}
+
 bool MAT::load() {
   if (DataFile::loadSecondaryFile() == false) {
     if (getDataModel()->montageTable()->rowCount() == 0)
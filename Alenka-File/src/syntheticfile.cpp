@@ -0,0 +1,332 @@
+#include "../include/AlenkaFile/syntheticfile.h"
+
+#include "../include/AlenkaFile/abstractdatamodel.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+#include <detailedexception.h>
+
+using namespace std;
+using namespace AlenkaFile;
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+
+// The number of octaves of the pink noise. The lowest one changes every 2^15
+// samples.
+const int OCTAVES = 16;
+
+const double BLINK_DURATION = 0.4;
+const int BLINK_CHANNELS = 4;
+
+// Tags that make the random streams independent.
+enum Stream : uint64_t {
+  NoiseStream = 1,
+  MuscleStream,
+  PhaseStream,
+  EventStream
+};
+
+uint64_t splitmix64(uint64_t x) {
+  x += 0x9E3779B97F4A7C15;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EB;
+  return x ^ (x >> 31);
+}
+
+uint64_t mix(uint64_t seed, uint64_t stream, uint64_t a, uint64_t b = 0) {
+  return splitmix64(splitmix64(splitmix64(seed ^ stream << 56) ^ a) ^ b);
+}
+
+// Returns a value in [0, 1) computed from the top 53 bits.
+double uniform(uint64_t h) { return ldexp(static_cast<double>(h >> 11), -53); }
+
+// Returns a value in [-1, 1).
+double symmetric(uint64_t h) { return 2 * uniform(h) - 1; }
+
+int64_t toSamples(double seconds, double fs) {
+  return max<int64_t>(1, static_cast<int64_t>(round(seconds * fs)));
+}
+
+} // namespace
+
+namespace AlenkaFile {
+
+SyntheticFile::SyntheticFile(const SyntheticSettings &settings,
+                             const string &filePath)
+    : DataFile(filePath), settings(settings) {
+  if (settings.channels == 0 || settings.samplingFrequency <= 0 ||
+      settings.duration <= 0)
+    throwDetailed(invalid_argument("Bad SyntheticFile settings"));
+
+  samplesRecorded = static_cast<uint64_t>(
+      toSamples(settings.duration, settings.samplingFrequency));
+
+  // Pink noise rarely exceeds 4 times its standard deviation.
+  limit = 4 * settings.noiseAmplitude + settings.alphaAmplitude +
+          settings.spikeAmplitude + settings.artifactAmplitude;
+
+  generateEvents();
+
+  longestEvent = 0;
+  for (const SyntheticEvent &e : events)
+    longestEvent = max(longestEvent, e.duration);
+}
+
+bool SyntheticFile::load() {
+  if (DataFile::loadSecondaryFile())
+    return true;
+
+  AbstractMontageTable *montageTable = getDataModel()->montageTable();
+  if (montageTable->rowCount() == 0)
+    montageTable->insertRows(0);
+  fillDefaultMontage(0);
+
+  Montage montage = montageTable->row(0);
+  montage.save = true;
+  montageTable->row(0, montage);
+
+  AbstractEventTypeTable *eventTypeTable = getDataModel()->eventTypeTable();
+  eventTypeTable->insertRows(0, SyntheticEvent::TypeCount);
+
+  for (int i = 0; i < SyntheticEvent::TypeCount; ++i) {
+    EventType et = eventTypeTable->row(i);
+    et.name = typeName(static_cast<SyntheticEvent::Type>(i));
+    eventTypeTable->row(i, et);
+  }
+
+  AbstractEventTable *eventTable = montageTable->eventTable(0);
+  const int count = static_cast<int>(events.size());
+  eventTable->insertRows(0, count);
+
+  for (int i = 0; i < count; ++i) {
+    Event e = eventTable->row(i);
+
+    e.label = typeName(events[i].type);
+    e.type = events[i].type;
+    e.position = static_cast<int>(events[i].position);
+    e.duration = static_cast<int>(events[i].duration);
+    e.channel = events[i].channel;
+
+    eventTable->row(i, e);
+  }
+
+  return false;
+}
+
+void SyntheticFile::saveGroundTruth(const string &filePath) const {
+  ofstream file(filePath);
+
+  if (!file.is_open())
+    throwDetailed(runtime_error("File '" + filePath +
+                                "' could not be opened for writing"));
+
+  const double fs = settings.samplingFrequency;
+  file << "type,position,duration,channel\n";
+
+  for (const SyntheticEvent &e : events) {
+    file << typeName(e.type) << ',' << e.position / fs << ','
+         << e.duration / fs << ',' << e.channel << '\n';
+  }
+}
+
+string SyntheticFile::typeName(SyntheticEvent::Type type) {
+  switch (type) {
+  case SyntheticEvent::Spike:
+    return "Spike";
+  case SyntheticEvent::Blink:
+    return "Blink";
+  case SyntheticEvent::Muscle:
+    return "Muscle";
+  default:
+    assert(false);
+    return "";
+  }
+}
+
+void SyntheticFile::generateEvents() {
+  const double fs = settings.samplingFrequency;
+  const int channels = static_cast<int>(settings.channels);
+  uint64_t counter = 0;
+  auto next = [this, &counter]() {
+    return uniform(mix(settings.seed, EventStream, counter++));
+  };
+
+  // The intervals between events are exponentially distributed.
+  auto addEvents = [&](double perSecond, auto makeEvent) {
+    if (perSecond <= 0)
+      return;
+
+    double t = 0;
+    while (true) {
+      t += -log(1 - next()) / perSecond;
+
+      SyntheticEvent e = makeEvent();
+      e.position = static_cast<int64_t>(t * fs);
+      if (static_cast<int64_t>(samplesRecorded) <= e.position + e.duration)
+        break;
+
+      events.push_back(e);
+    }
+  };
+
+  addEvents(settings.spikesPerMinute / 60, [&]() {
+    SyntheticEvent e;
+    e.type = SyntheticEvent::Spike;
+    // The spike is followed by a slow wave three times as long.
+    e.duration = toSamples(4 * settings.spikeDuration, fs);
+    e.channel = min(channels - 1, static_cast<int>(next() * channels));
+    return e;
+  });
+
+  addEvents(settings.artifactsPerHour / 3600, [&]() {
+    SyntheticEvent e;
+
+    if (next() < 0.5) {
+      e.type = SyntheticEvent::Blink;
+      e.duration = toSamples(BLINK_DURATION, fs);
+      e.channel = -1;
+    } else {
+      e.type = SyntheticEvent::Muscle;
+      e.duration = toSamples(0.5 + 1.5 * next(), fs);
+      e.channel = min(channels - 1, static_cast<int>(next() * channels));
+    }
+
+    return e;
+  });
+
+  stable_sort(events.begin(), events.end(), [](const auto &a, const auto &b) {
+    return a.position < b.position;
+  });
+}
+
+double SyntheticFile::eventSample(const SyntheticEvent &e, int channel,
+                                  int64_t sample) const {
+  const double fs = settings.samplingFrequency;
+  const double t = (sample - e.position) / fs;
+  const double length = e.duration / fs;
+  const int distance = abs(channel - e.channel);
+
+  switch (e.type) {
+  case SyntheticEvent::Spike: {
+    if (settings.spikeSpread < distance)
+      return 0;
+
+    const double d = settings.spikeDuration;
+    const double x = (t - d / 2) / (d / 6);
+    double value = -exp(-x * x / 2);
+    if (d <= t)
+      value += 0.3 * sin(PI * (t - d) / (3 * d));
+
+    return ldexp(settings.spikeAmplitude * value, -distance);
+  }
+  case SyntheticEvent::Blink: {
+    if (BLINK_CHANNELS <= channel)
+      return 0;
+
+    const double s = sin(PI * t / length);
+    return (1 - 0.2 * channel) * settings.artifactAmplitude * s * s;
+  }
+  case SyntheticEvent::Muscle: {
+    if (2 < distance)
+      return 0;
+
+    const double noise =
+        symmetric(mix(settings.seed, MuscleStream,
+                      static_cast<uint64_t>(channel),
+                      static_cast<uint64_t>(sample)));
+    const double value =
+        0.3 * settings.artifactAmplitude * noise * sin(PI * t / length);
+    return ldexp(value, -distance);
+  }
+  default:
+    assert(false);
+    return 0;
+  }
+}
+
+template <typename T>
+void SyntheticFile::readChannelsFloatDouble(vector<T *> dataChannels,
+                                            uint64_t firstSample,
+                                            uint64_t lastSample) {
+  assert(firstSample <= lastSample && "Bad parameter order.");
+
+  if (getSamplesRecorded() <= lastSample)
+    throwDetailed(invalid_argument("SyntheticFile: reading out of bounds"));
+  if (dataChannels.size() < getChannelCount())
+    throwDetailed(invalid_argument("SyntheticFile: too few dataChannels"));
+
+  const double fs = settings.samplingFrequency;
+  const int channels = static_cast<int>(settings.channels);
+  const int64_t first = firstSample, last = lastSample;
+
+  // The events overlapping the range.
+  auto eventsBegin = lower_bound(
+      events.begin(), events.end(), first - longestEvent,
+      [](const SyntheticEvent &e, int64_t p) { return e.position < p; });
+  auto eventsEnd = upper_bound(
+      eventsBegin, events.end(), last,
+      [](int64_t p, const SyntheticEvent &e) { return p < e.position; });
+
+  const double noiseScale = settings.noiseAmplitude * sqrt(3. / OCTAVES);
+
+  for (int j = 0; j < channels; ++j) {
+    T *out = dataChannels[j];
+    const uint64_t channelKey = static_cast<uint64_t>(j) << 32;
+
+    // Voss-McCartney pink noise: octave k changes every 2^k samples. Every
+    // value is given by its index, so any range gives the same samples.
+    double octaves[OCTAVES];
+    auto octave = [&](int k, int64_t i) {
+      return symmetric(mix(settings.seed, NoiseStream,
+                            channelKey | static_cast<uint64_t>(k),
+                            static_cast<uint64_t>(i >> k)));
+    };
+
+    for (int k = 0; k < OCTAVES; ++k)
+      octaves[k] = octave(k, first);
+
+    // The alpha rhythm is stronger towards the last (occipital) channels.
+    const double weight = channels < 2 ? 1 : 0.3 + 0.7 * j / (channels - 1);
+    const double phase =
+        2 * PI * uniform(mix(settings.seed, PhaseStream, channelKey));
+    const double alpha = settings.alphaAmplitude * weight;
+
+    for (int64_t i = first; i <= last; ++i) {
+      for (int k = 0; i != first && k < OCTAVES && (i & ((1 << k) - 1)) == 0;
+           ++k) {
+        octaves[k] = octave(k, i);
+      }
+
+      double noise = 0;
+      for (double e : octaves)
+        noise += e;
+
+      const double t = i / fs;
+      const double envelope = 0.5 + 0.5 * sin(2 * PI * 0.1 * t + phase);
+      const double value =
+          noiseScale * noise +
+          alpha * envelope * sin(2 * PI * settings.alphaFrequency * t + phase);
+
+      out[i - first] = static_cast<T>(value);
+    }
+
+    for (auto it = eventsBegin; it != eventsEnd; ++it) {
+      const int64_t from = max(first, it->position);
+      const int64_t to = min(last, it->position + it->duration - 1);
+
+      for (int64_t i = from; i <= to; ++i)
+        out[i - first] += static_cast<T>(eventSample(*it, j, i));
+    }
+
+    for (int64_t i = 0; i <= last - first; ++i)
+      out[i] = max(static_cast<T>(-limit), min(static_cast<T>(limit), out[i]));
+  }
+}
+
+} // namespace AlenkaFile
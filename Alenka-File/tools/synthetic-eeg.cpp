@@ -0,0 +1,150 @@
+// Generates a synthetic EEG recording for testing Alenka at scale.
+//
+// Usage: synthetic-eeg [options] OUTPUT_FILE
+//
+// The format is selected by the suffix of OUTPUT_FILE: .gdf, .edf or .mat.
+// The spikes and artifacts are stored as events in the file, and also written
+// to OUTPUT_FILE.truth.csv. The signal is written as it is generated, so even
+// a 24 hour recording with hundreds of channels needs little memory.
+
+#include "../include/AlenkaFile/datamodel.h"
+#include "../include/AlenkaFile/edf.h"
+#include "../include/AlenkaFile/gdf2.h"
+#include "../include/AlenkaFile/mat.h"
+#include "../include/AlenkaFile/syntheticfile.h"
+
+#include <boost/algorithm/string.hpp>
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+using namespace AlenkaFile;
+
+namespace {
+
+void printUsage() {
+  SyntheticSettings s;
+  cerr << "Usage: synthetic-eeg [options] OUTPUT_FILE\n"
+       << "The format is given by the suffix: .gdf, .edf or .mat\n\n"
+       << "  --channels N       channel count (" << s.channels << ")\n"
+       << "  --fs F             sampling frequency in Hz ("
+       << s.samplingFrequency << ")\n"
+       << "  --duration T       length in seconds; suffix m or h for minutes "
+       << "or hours (" << s.duration << ")\n"
+       << "  --seed N           the same seed gives the same signal ("
+       << s.seed << ")\n"
+       << "  --noise A          pink noise amplitude in uV ("
+       << s.noiseAmplitude << ")\n"
+       << "  --alpha A          alpha rhythm amplitude in uV ("
+       << s.alphaAmplitude << ")\n"
+       << "  --spikes R         spikes per minute (" << s.spikesPerMinute
+       << ")\n"
+       << "  --spikeAmplitude A spike amplitude in uV (" << s.spikeAmplitude
+       << ")\n"
+       << "  --artifacts R      artifacts per hour (" << s.artifactsPerHour
+       << ")\n";
+}
+
+double parseDuration(string value) {
+  double multiplier = 1;
+
+  if (boost::ends_with(value, "h"))
+    multiplier = 3600;
+  else if (boost::ends_with(value, "m"))
+    multiplier = 60;
+  else if (!boost::ends_with(value, "s"))
+    return stod(value);
+
+  value.pop_back();
+  return stod(value) * multiplier;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  SyntheticSettings settings;
+  string outputFile;
+
+  const map<string, function<void(const string &)>> options = {
+      {"--channels",
+       [&](const string &v) { settings.channels = stoi(v); }},
+      {"--fs", [&](const string &v) { settings.samplingFrequency = stod(v); }},
+      {"--duration",
+       [&](const string &v) { settings.duration = parseDuration(v); }},
+      {"--seed", [&](const string &v) { settings.seed = stoull(v); }},
+      {"--noise", [&](const string &v) { settings.noiseAmplitude = stod(v); }},
+      {"--alpha", [&](const string &v) { settings.alphaAmplitude = stod(v); }},
+      {"--spikes",
+       [&](const string &v) { settings.spikesPerMinute = stod(v); }},
+      {"--spikeAmplitude",
+       [&](const string &v) { settings.spikeAmplitude = stod(v); }},
+      {"--artifacts",
+       [&](const string &v) { settings.artifactsPerHour = stod(v); }}};
+
+  try {
+    for (int i = 1; i < argc; ++i) {
+      const string arg = argv[i];
+      auto it = options.find(arg);
+
+      if (it != options.end() && i + 1 < argc) {
+        it->second(argv[++i]);
+      } else if (outputFile.empty() && !boost::starts_with(arg, "--")) {
+        outputFile = arg;
+      } else {
+        printUsage();
+        return 1;
+      }
+    }
+  } catch (const logic_error &) {
+    printUsage();
+    return 1;
+  }
+
+  if (outputFile.empty()) {
+    printUsage();
+    return 1;
+  }
+
+  try {
+    auto start = chrono::steady_clock::now();
+
+    SyntheticFile file(settings, outputFile);
+    DataModel dataModel(make_unique<EventTypeTable>(),
+                        make_unique<MontageTable>());
+    file.setDataModel(&dataModel);
+    file.load();
+
+    const string suffix = boost::to_lower_copy(
+        outputFile.substr(min(outputFile.size(), outputFile.rfind('.'))));
+
+    if (suffix == ".gdf") {
+      GDF2::saveAs(outputFile, &file);
+    } else if (suffix == ".edf") {
+      EDF::saveAs(outputFile, &file);
+    } else if (suffix == ".mat") {
+      MAT::saveAs(outputFile, &file);
+    } else {
+      cerr << "Unknown file type '" << suffix << "'" << endl;
+      return 1;
+    }
+
+    file.saveGroundTruth(outputFile + ".truth.csv");
+
+    chrono::duration<double> time = chrono::steady_clock::now() - start;
+    cerr << "Wrote " << file.getChannelCount() << " channels x "
+         << file.getSamplesRecorded() << " samples and "
+         << file.getGroundTruth().size() << " events in " << time.count()
+         << " s" << endl;
+  } catch (const exception &e) {
+    cerr << "Error: " << e.what() << endl;
+    return 1;
+  }
+
+  return 0;
+}
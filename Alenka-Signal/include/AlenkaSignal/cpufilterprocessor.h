@@ -0,0 +1,60 @@
+#ifndef ALENKASIGNAL_CPUFILTERPROCESSOR_H
+#define ALENKASIGNAL_CPUFILTERPROCESSOR_H
+
+#include <complex>
+#include <memory>
+#include <vector>
+
+namespace AlenkaSignal {
+
+/**
+ * @brief Filters data blocks on the host instead of an OpenCL device.
+ *
+ * This gives the same result as FilterProcessor: every row is transformed by
+ * one real FFT of blockLength samples, multiplied by the spectrum of the
+ * zero-padded coefficients, and transformed back. So the first
+ * discardSamples() samples of the output are invalid in the same way.
+ *
+ * The FFT is Eigen's (kissfft), and the spectral product is done by Eigen
+ * arrays, which are vectorized. The rows are distributed over OpenMP threads;
+ * every thread has its own FFT object and scratch buffers.
+ *
+ * The filter must not be longer than the block.
+ */
+template <class T> class CpuFilterProcessor {
+  struct Workspace;
+
+  unsigned int blockLength, blockChannels;
+  int M = 1;
+  bool coefficientsChanged = false;
+  std::vector<T> coefficients;
+  std::vector<std::complex<T>> spectrum;
+  std::vector<std::unique_ptr<Workspace>> workspaces;
+
+public:
+  CpuFilterProcessor(unsigned int blockLength, unsigned int blockChannels);
+  ~CpuFilterProcessor();
+
+  /**
+   * @brief Filters the rows of input and stores the result in output.
+   * @param channels The number of rows to filter; 0 means blockChannels. The
+   * rows are blockLength + 2 samples apart, as in FilterProcessor.
+   *
+   * The buffers must not overlap.
+   */
+  void process(const T *input, T *output, unsigned int channels = 0);
+
+  void changeFilter(const std::vector<T> &coefficients);
+
+  int delaySamples() const { return (M - 1) / 2; }
+  int discardSamples() const { return M - 1; }
+
+  const std::vector<T> &getCoefficients() const { return coefficients; }
+
+private:
+  void updateSpectrum();
+};
+
+} // namespace AlenkaSignal
+
+#endif // ALENKASIGNAL_CPUFILTERPROCESSOR_H
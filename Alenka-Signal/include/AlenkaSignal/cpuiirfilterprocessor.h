@@ -0,0 +1,58 @@
+#ifndef ALENKASIGNAL_CPUIIRFILTERPROCESSOR_H
+#define ALENKASIGNAL_CPUIIRFILTERPROCESSOR_H
+
+#include "filter.h"
+
+#include <vector>
+
+namespace AlenkaSignal {
+
+/**
+ * @brief Zero-phase IIR filtering of data blocks on the host instead of an
+ * OpenCL device.
+ *
+ * This gives the same result as IirFilterProcessor: every row is filtered by
+ * the cascade of biquads forward and then backward, both passes start in the
+ * steady state for the edge sample, and the output is delayed by
+ * delaySamples(). So the first discardSamples() samples of the output are
+ * invalid in the same way.
+ *
+ * The rows are distributed over OpenMP threads. The state is kept in double
+ * precision.
+ */
+template <class T> class CpuIirFilterProcessor {
+  unsigned int blockLength, blockChannels;
+  int discard = 0;
+  std::vector<Biquad> sections;
+
+public:
+  CpuIirFilterProcessor(unsigned int blockLength, unsigned int blockChannels)
+      : blockLength(blockLength), blockChannels(blockChannels) {}
+
+  /**
+   * @brief Filters the rows of input and stores the result in output.
+   * @param channels The number of rows to filter; 0 means blockChannels. The
+   * rows are blockLength + 2 samples apart, as in IirFilterProcessor.
+   *
+   * The buffers can be the same.
+   */
+  void process(const T *input, T *output, unsigned int channels = 0);
+
+  /**
+   * @brief Sets a new cascade of sections and the number of samples to
+   * discard. The output is delayed by half of that.
+   */
+  void changeFilter(const std::vector<Biquad> &sections, int discard);
+
+  int delaySamples() const { return discard / 2; }
+  int discardSamples() const { return discard; }
+
+  /**
+   * @brief Returns the same as IirFilterProcessor::impulseResponse().
+   */
+  std::vector<T> impulseResponse() const;
+};
+
+} // namespace AlenkaSignal
+
+#endif // ALENKASIGNAL_CPUIIRFILTERPROCESSOR_H
@@ -0,0 +1,159 @@
+#ifndef ALENKASIGNAL_CPUMONTAGE_H
+#define ALENKASIGNAL_CPUMONTAGE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace AlenkaSignal {
+
+/**
+ * @brief A montage track evaluated on the host instead of by an OpenCL kernel.
+ *
+ * The formula is compiled into a compact bytecode for a stack machine whose
+ * values are whole rows of samples. So every instruction is executed once per
+ * block as a vectorized loop, instead of interpreting the formula for every
+ * sample. No compiler is needed, and compilation takes microseconds, so this
+ * is suitable for code that changes constantly, e.g. while it is being typed.
+ *
+ * A subset of OpenCL C used in montages is supported:
+ * - assignments to out (=, +=, -=, *=, /=), and float variables;
+ * - arithmetic, comparisons, logical operators, the conditional operator and
+ * casts;
+ * - in(), x(), y(), z(), INDEX, IN_COUNT and labels like in("Fp1");
+ * - the functions of the default montage header: sum(), sumAll(), average(),
+ * dist(), distAverage(), distAverageLinear() and label();
+ * - math functions: sqrt, fabs, exp, log, log10, sin, cos, tan, floor, ceil,
+ * pow, pown, fmin, fmax, min and max.
+ *
+ * For example:
+ * ```
+ * float ref = average();
+ * out = in("Fp1") - ref;
+ * out *= 0.5;
+ * ```
+ *
+ * Constant subexpressions are folded, and the channel arguments must be
+ * constant. Control statements, arrays, user-defined header functions and
+ * integer variables are rejected; such tracks must be computed by Montage.
+ *
+ * The header functions always have their default meaning. So this can only
+ * replace Montage if hasDefaultBuiltins() is true for the header in use.
+ */
+template <class T> class CpuMontage {
+public:
+  /**
+   * @brief Scratch memory for evaluate(); one is needed per thread.
+   */
+  struct Workspace {
+    std::vector<std::vector<T>> stack, variables;
+  };
+
+private:
+  enum class OpCode {
+    // Push a row.
+    Constant,
+    In,
+    InCount,
+    X,
+    Y,
+    Z,
+    Dist,
+    Sum,
+    Average,
+    DistAverage,
+    DistAverageLinear,
+    Load,
+    // Pop the top row into a variable.
+    Store,
+    // Modify the top row.
+    AddIn,
+    AddConstant,
+    SubtractConstant,
+    MultiplyConstant,
+    DivideConstant,
+    ConstantSubtract,
+    ConstantDivide,
+    Negate,
+    Not,
+    Abs,
+    Sqrt,
+    Exp,
+    Log,
+    Log10,
+    Sin,
+    Cos,
+    Tan,
+    Floor,
+    Ceil,
+    // Replace the two top rows with one.
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Pow,
+    Min,
+    Max,
+    Less,
+    LessEqual,
+    Greater,
+    GreaterEqual,
+    Equal,
+    NotEqual,
+    And,
+    Or,
+    // Replace the three top rows with one.
+    Select
+  };
+
+  struct Instruction {
+    OpCode op;
+    int a, b;
+    T value;
+  };
+
+  template <class U> friend class CpuMontageCompiler;
+
+  std::vector<Instruction> code;
+  int stackSize = 0, variableCount = 1;
+  int montageIndex = -1;
+
+public:
+  /**
+   * @brief Compiles the formula of one track.
+   * @param labels The labels used to resolve in("label"). The same as for
+   * Montage.
+   * @param montageIndex The value of INDEX.
+   * @param errorMessage [out] If not nullptr and the formula is not supported,
+   * the reason is stored here.
+   * @return Nullptr if the formula is not supported.
+   */
+  static std::unique_ptr<CpuMontage>
+  parse(const std::string &source,
+        const std::vector<std::string> &labels = std::vector<std::string>(),
+        int montageIndex = -1, std::string *errorMessage = nullptr);
+
+  /**
+   * @brief Computes length samples of the track.
+   *
+   * The arguments have the same meaning as for the kernels. Channels out of
+   * range read as zeros. xyz must have 3*inputRowCount values.
+   */
+  void evaluate(const T *input, int inputRowLength, int inputRowCount,
+                int inputRowOffset, const T *xyz, T *output, int length,
+                Workspace *workspace) const;
+
+  int getMontageIndex() const { return montageIndex; }
+
+  /**
+   * @brief Returns the number of bytecode instructions.
+   */
+  int size() const { return static_cast<int>(code.size()); }
+
+private:
+  CpuMontage() = default;
+};
+
+} // namespace AlenkaSignal
+
+#endif // ALENKASIGNAL_CPUMONTAGE_H
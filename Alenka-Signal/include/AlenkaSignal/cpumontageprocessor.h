@@ -0,0 +1,66 @@
+#ifndef ALENKASIGNAL_CPUMONTAGEPROCESSOR_H
+#define ALENKASIGNAL_CPUMONTAGEPROCESSOR_H
+
+#include <type_traits>
+#include <vector>
+
+#include "cpumontage.h"
+
+namespace AlenkaSignal {
+
+/**
+ * @brief Computes montages on the host.
+ *
+ * The input and output layout is the same as for MontageProcessor, so the
+ * result can be uploaded to the buffers used for drawing as it is. The tracks
+ * are distributed over OpenMP threads, and the bytecode of every track is
+ * executed for the whole row at once.
+ */
+template <class T> class CpuMontageProcessor {
+  int inputRowLength, inputRowCount, outputCopyCount;
+
+public:
+  CpuMontageProcessor(unsigned int inputRowLength, int inputRowCount,
+                      int outputCopyCount = 1)
+      : inputRowLength(inputRowLength), inputRowCount(inputRowCount),
+        outputCopyCount(outputCopyCount) {}
+
+  /**
+   * @brief Computes the tracks and stores them in output.
+   *
+   * A range of iterators or pointers is expected. If you dereference
+   * montageBegin twice, you should get a CpuMontage<T> object. Null pointers
+   * are skipped, and their rows of the output are left unchanged.
+   *
+   * The output must have room for outputRowLength * outputCopyCount samples
+   * per track. xyz holds the coordinates of the input channels, 3 values for
+   * each.
+   */
+  template <class Iter>
+  void process(Iter montageBegin, Iter montageEnd, const T *input, T *output,
+               const T *xyz, int outputRowLength, int inputRowOffset = 0) {
+    static_assert(
+        std::is_same<typename std::remove_cv<typename std::remove_reference<
+                         decltype(**montageBegin)>::type>::type,
+                     CpuMontage<T>>::value,
+        "An iterator/pointer to 'CpuMontage<T> *' is expected");
+
+    std::vector<const CpuMontage<T> *> tracks;
+    for (Iter it = montageBegin; it != montageEnd; ++it) {
+      const auto &mont = *it;
+      tracks.push_back(mont ? &*mont : nullptr);
+    }
+
+    processTracks(tracks, input, output, xyz, outputRowLength,
+                  inputRowOffset);
+  }
+
+private:
+  void processTracks(const std::vector<const CpuMontage<T> *> &tracks,
+                     const T *input, T *output, const T *xyz,
+                     int outputRowLength, int inputRowOffset);
+};
+
+} // namespace AlenkaSignal
+
+#endif // ALENKASIGNAL_CPUMONTAGEPROCESSOR_H
@@ -0,0 +1,63 @@
+#ifndef ALENKASIGNAL_DEVICESET_H
+#define ALENKASIGNAL_DEVICESET_H
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace AlenkaSignal {
+
+class OpenCLContext;
+
+/**
+ * @brief A group of OpenCL devices that share batch work.
+ *
+ * Every device gets its own OpenCLContext, because the devices can come from
+ * different platforms. So all OpenCL objects (queues, buffers, programs) must
+ * be created separately for each device. The first device is the primary one,
+ * usually the one used for rendering; the object doesn't own its context.
+ *
+ * Use ThroughputBalancer to decide which device gets the next block.
+ */
+class DeviceSet {
+  std::vector<OpenCLContext *> contexts;
+  std::vector<std::unique_ptr<OpenCLContext>> ownedContexts;
+
+public:
+  /**
+   * @brief Creates contexts for the extra devices.
+   * @param extraDevices Pairs of platform and device indexes. Devices
+   * already in the set (e.g. the primary one) are skipped.
+   */
+  DeviceSet(OpenCLContext *primary,
+            const std::vector<std::pair<unsigned int, unsigned int>>
+                &extraDevices = {});
+  ~DeviceSet();
+
+  unsigned int size() const {
+    return static_cast<unsigned int>(contexts.size());
+  }
+  OpenCLContext *context(unsigned int device) const {
+    return contexts[device];
+  }
+
+  /**
+   * @brief Replaces the primary context, e.g. when it gets recreated with GL
+   * sharing.
+   */
+  void setPrimary(OpenCLContext *primary) { contexts[0] = primary; }
+
+  /**
+   * @brief Parses a list like "0:1 1:0" into pairs of platform and device
+   * indexes.
+   *
+   * Throws an exception if the format is wrong.
+   */
+  static std::vector<std::pair<unsigned int, unsigned int>>
+  parseDeviceList(const std::string &list);
+};
+
+} // namespace AlenkaSignal
+
+#endif // ALENKASIGNAL_DEVICESET_H
@@ -7,6 +7,21 @@
 
 namespace AlenkaSignal {
 
+/**
+ * @brief Selects how the display filter is realized.
+ *
+ * FIR uses the frequency-sampled coefficients and FilterProcessor. IIR uses
+ * the Butterworth biquad cascade and IirFilterProcessor.
+ */
+enum class FilterDesign { FIR, IIR };
+
+/**
+ * @brief Coefficients of a second order IIR section normalized so that a0 = 1.
+ */
+struct Biquad {
+  double b0, b1, b2, a1, a2;
+};
+
 /**
  * @brief A class for computing FIR filter coefficients.
  *
@@ -21,6 +36,10 @@ namespace AlenkaSignal {
  * The filter can be configured by the appropriate set functions.
  *
  * The coefficients are computed using the frequency-sampling method.
+ *
+ * Alternatively the same settings can be realized by a cascade of biquads:
+ * Butterworth low-pass and high-pass filters and a notch at the base frequency
+ * (the harmonics are not suppressed in this case).
  */
 template <class T> class Filter {
   unsigned int M;
@@ -42,6 +61,15 @@ public:
    */
   std::vector<T> computeSamples();
 
+  /**
+   * @brief Returns the IIR sections for the current settings.
+   * @param order The order of the Butterworth filters; must be even.
+   *
+   * The cut-off frequencies are the -3 dB points of a single pass. When the
+   * sections are run forward and backward, the attenuation there is -6 dB.
+   */
+  std::vector<Biquad> computeBiquads(unsigned int order = 4) const;
+
   bool isAllpass() { return !(m_lowpassOn || m_highpassOn || m_notchOn); }
 
   bool lowpassOn() const { return m_lowpassOn; }
@@ -8,52 +8,162 @@
 #endif
 
 #include <cassert>
+#include <list>
+#include <map>
 #include <vector>
 
 typedef size_t clfftPlanHandle;
 
 namespace AlenkaSignal {
 
+class KernelProfiler;
 class OpenCLContext;
 
 enum class WindowFunction { None, Hamming, Blackman };
 
 /**
  * @brief This class handles filtering of data blocks.
+ *
+ * Normally the whole block is filtered by one FFT of blockLength samples. When
+ * the filter is longer than half of the block, or when clFFT cannot transform
+ * blocks of blockLength samples, uniformly partitioned convolution is used
+ * instead: the filter is split into partitions of L samples, the block into
+ * segments of L samples, and every segment's spectrum (FFT size 2L) is
+ * multiplied by the partition spectra of a frequency-domain delay line made of
+ * the preceding segments. This way the FFT size doesn't depend on the filter
+ * length, and the block length doesn't need to be a size supported by clFFT.
+ *
+ * In both cases the first discardSamples() samples of the output are invalid.
+ *
+ * Several blocks can be packed one after another in the buffers and filtered
+ * in one batch of transforms. The FFT plans for every batch size are created
+ * when first needed, and all batches share the same filter spectrum.
+ *
+ * The spectra of the last few filters are kept on the device. Switching back
+ * to one of them only selects its buffer, and no transform is needed.
  */
 template <class T> class FilterProcessor {
+  struct BatchPlans {
+    clfftPlanHandle forward, inverse;
+  };
+
+  struct Spectrum {
+    std::vector<T> coefficients;
+    cl_mem buffer;
+  };
+
   unsigned int blockLength, blockChannels;
   int M;
   bool coefficientsChanged = false;
   std::vector<T> coefficients;
+  cl_context clContext;
 
   cl_kernel filterKernel;
   cl_kernel zeroKernel;
-  cl_mem filterBuffer;
+  cl_kernel segmentKernel;
+  cl_kernel accumulateKernel;
+  cl_kernel gatherKernel;
+  std::list<Spectrum> spectra; // The spectrum in use is the first one.
 
   clfftPlanHandle fftPlan;
-  clfftPlanHandle fftPlanBatch;
-  clfftPlanHandle ifftPlanBatch;
+  std::map<unsigned int, BatchPlans> batchPlans;
+
+  unsigned int partitionLength = 0, partitionCount = 0, segmentCount = 0;
+  cl_mem segmentBuffer = nullptr;
+  cl_mem accumulatorBuffer = nullptr;
+  clfftPlanHandle partitionPlan;
+  std::map<unsigned int, BatchPlans> segmentPlans;
+
+  KernelProfiler *profiler = nullptr;
 
 public:
+  /**
+   * @brief The number of filter spectra kept on the device.
+   */
+  static const unsigned int SPECTRUM_CACHE_SIZE = 8;
+
   FilterProcessor(unsigned int blockLength, unsigned int blockChannels,
                   OpenCLContext *context);
   ~FilterProcessor();
 
-  void process(cl_mem inBuffer, cl_mem outBuffer, cl_command_queue queue);
+  /**
+   * @brief Filters the rows of inBuffer and stores the result in outBuffer.
+   * @param channels The number of rows to filter; 0 means blockChannels. The
+   * rows are blockLength + 2 samples apart.
+   */
+  void process(cl_mem inBuffer, cl_mem outBuffer, cl_command_queue queue,
+               unsigned int channels = 0);
+
+  /**
+   * @brief Records the commands enqueued by process() in profiler; nullptr
+   * turns this off.
+   */
+  void setProfiler(KernelProfiler *profiler) { this->profiler = profiler; }
 
   void changeFilter(const std::vector<T> &coefficients) {
     coefficientsChanged = true;
     M = static_cast<int>(coefficients.size());
     this->coefficients = coefficients;
   }
-  void changeSampleFilter(int M, const std::vector<T> &samples);
-  void applyWindow(WindowFunction windowFunction);
+  void changeSampleFilter(int M, const std::vector<T> &samples) {
+    changeFilter(sampleFilterCoefficients(M, samples));
+  }
+  void applyWindow(WindowFunction windowFunction) {
+    coefficientsChanged = true;
+    applyWindow(&coefficients, windowFunction);
+  }
+
+  /**
+   * @brief Returns the M coefficients of the FIR filter with the frequency
+   * response sampled by samples.
+   *
+   * This is what changeSampleFilter() uses. It doesn't need a device, so the
+   * filter can also be designed for CpuFilterProcessor.
+   */
+  static std::vector<T> sampleFilterCoefficients(int M,
+                                                 const std::vector<T> &samples);
+  static void applyWindow(std::vector<T> *coefficients,
+                          WindowFunction windowFunction);
 
   int delaySamples() const { return (M - 1) / 2; }
   int discardSamples() const { return M - 1; }
 
   const std::vector<T> &getCoefficients() const { return coefficients; }
+
+  /**
+   * @brief Returns true if the current filter uses partitioned convolution.
+   */
+  bool partitioned() const {
+    return blockLength < 2 * static_cast<unsigned int>(M) ||
+           !fftSizeSupported(blockLength);
+  }
+
+  /**
+   * @brief Returns true if clFFT can make a plan for transforms of size n,
+   * i.e. n has no prime factors other than 2, 3, 5 and 7.
+   */
+  static bool fftSizeSupported(unsigned int n) {
+    if (n == 0)
+      return false;
+
+    for (unsigned int p : {2, 3, 5, 7}) {
+      while (n % p == 0)
+        n /= p;
+    }
+
+    return n == 1;
+  }
+
+private:
+  void processWhole(cl_mem inBuffer, cl_mem outBuffer, cl_command_queue queue,
+                    unsigned int channels);
+  void processPartitioned(cl_mem inBuffer, cl_mem outBuffer,
+                          cl_command_queue queue, unsigned int channels);
+  const BatchPlans &getBatchPlans(unsigned int channels);
+  const BatchPlans &getSegmentPlans(unsigned int channels);
+  bool selectSpectrum(size_t size);
+  void createPartitions(unsigned int length);
+  void releasePartitions();
 };
 
 } // namespace AlenkaSignal
@@ -0,0 +1,112 @@
+#ifndef ALENKASIGNAL_IIRFILTERPROCESSOR_H
+#define ALENKASIGNAL_IIRFILTERPROCESSOR_H
+
+#ifdef __APPLE__
+#include <OpenCL/cl_gl.h>
+#else
+#include <CL/cl_gl.h>
+#endif
+
+#include "filter.h"
+
+#include <vector>
+
+namespace AlenkaSignal {
+
+class KernelProfiler;
+class OpenCLContext;
+
+/**
+ * @brief This class handles zero-phase IIR filtering of data blocks.
+ *
+ * The rows are filtered by a cascade of biquads (see Filter::computeBiquads())
+ * forward and then backward, so that the phase shifts cancel out. One
+ * work-item processes one row, and the work is linear in the block length
+ * regardless of the sampling frequency. No FFT is needed.
+ *
+ * Both passes start in the steady state for the first sample they see, which
+ * is the same as padding the row with its edge values. To be interchangeable
+ * with FilterProcessor, the output is delayed by delaySamples(), and the first
+ * discardSamples() samples of it are invalid. The delay must be long enough
+ * for the transients of the filter to die out, see warmUpSamples().
+ */
+template <class T> class IirFilterProcessor {
+  unsigned int blockLength, blockChannels;
+  int discard = 0;
+  std::vector<Biquad> sections;
+  bool sectionsChanged = false;
+  cl_context clContext;
+
+  cl_kernel filtfiltKernel;
+  cl_mem sectionBuffer;
+  KernelProfiler *profiler = nullptr;
+
+public:
+  /**
+   * @brief The maximum number of sections supported by the kernel (the same as
+   * IIR_MAX_SECTIONS in kernels.cl).
+   */
+  static const int MAX_SECTIONS = 8;
+
+  IirFilterProcessor(unsigned int blockLength, unsigned int blockChannels,
+                     OpenCLContext *context);
+  ~IirFilterProcessor();
+
+  /**
+   * @brief Filters the rows of inBuffer and stores the result in outBuffer.
+   * @param channels The number of rows to filter; 0 means blockChannels. The
+   * rows are blockLength + 2 samples apart.
+   */
+  void process(cl_mem inBuffer, cl_mem outBuffer, cl_command_queue queue,
+               unsigned int channels = 0);
+
+  /**
+   * @brief Records the commands enqueued by process() in profiler; nullptr
+   * turns this off.
+   */
+  void setProfiler(KernelProfiler *profiler) { this->profiler = profiler; }
+
+  /**
+   * @brief Sets a new cascade of sections and the number of samples to
+   * discard. The output is delayed by half of that.
+   */
+  void changeFilter(const std::vector<Biquad> &sections, int discard);
+
+  /**
+   * @brief Returns the number of samples it takes the transients of the
+   * sections to die out.
+   *
+   * This is derived from the slowest pole: it is the time it takes to decay
+   * to 1e-3, i.e. about 7 time constants. Each pass needs this many samples,
+   * so the discard should be at least twice as long. Low cut-off frequencies
+   * need a lot more than the FIR filter of the same sampling frequency.
+   */
+  static int warmUpSamples(const std::vector<Biquad> &sections);
+
+  int delaySamples() const { return discard / 2; }
+  int discardSamples() const { return discard; }
+
+  /**
+   * @brief Returns the response to a unit impulse in the middle of
+   * 2*delaySamples() + 1 samples.
+   *
+   * This is the FIR filter the IIR filter is equivalent to, as far as the
+   * result after discarding is concerned. It is useful for plotting the
+   * frequency response.
+   */
+  std::vector<T> impulseResponse() const {
+    return impulseResponse(sections, delaySamples());
+  }
+
+  /**
+   * @brief Returns the impulse response of sections for the given delay.
+   *
+   * No device is needed, so CpuIirFilterProcessor uses this too.
+   */
+  static std::vector<T> impulseResponse(const std::vector<Biquad> &sections,
+                                        int delay);
+};
+
+} // namespace AlenkaSignal
+
+#endif // ALENKASIGNAL_IIRFILTERPROCESSOR_H
@@ -0,0 +1,116 @@
+#ifndef ALENKASIGNAL_KERNELPROFILER_H
+#define ALENKASIGNAL_KERNELPROFILER_H
+
+#ifdef __APPLE__
+#include <OpenCL/cl_gl.h>
+#else
+#include <CL/cl_gl.h>
+#endif
+
+#include <deque>
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace AlenkaSignal {
+
+/**
+ * @brief Measures how long the commands enqueued by the processors take on the
+ * device.
+ *
+ * The processors ask for an event slot for every command they enqueue, and the
+ * durations are read from the events later by collect(). The times are added up
+ * per stage (e.g. "upload", "fft" or "montage") and per track, so that an
+ * expensive montage formula can be told apart from the rest.
+ *
+ * The queues must be created with CL_QUEUE_PROFILING_ENABLE. This class is not
+ * thread-safe.
+ */
+class KernelProfiler {
+  struct Record {
+    std::string stage;
+    int track;
+    bool sincePrevious;
+    cl_event event = nullptr;
+  };
+
+  struct Stat {
+    int count = 0;
+    double total = 0, max = 0; // In seconds.
+  };
+
+  std::deque<Record> records;
+  std::map<std::pair<std::string, std::string>, Stat> stats;
+
+public:
+  KernelProfiler() = default;
+  ~KernelProfiler();
+
+  KernelProfiler(const KernelProfiler &) = delete;
+  KernelProfiler &operator=(const KernelProfiler &) = delete;
+
+  /**
+   * @brief Returns where the event of the command about to be enqueued should
+   * be stored. The profiler takes ownership of the event.
+   * @param track The index of the track, or -1 for stages not related to any.
+   */
+  cl_event *record(const std::string &stage, int track = -1);
+
+  /**
+   * @brief Like record(), but the command is timed from the end of the command
+   * recorded just before it instead of from its own start.
+   *
+   * This is needed for clFFT transforms: they can be made of several kernels,
+   * but only the event of the last one is returned. Both commands must be in
+   * the same in-order queue.
+   */
+  cl_event *recordSincePrevious(const std::string &stage);
+
+  /**
+   * @brief Adds an event of a command enqueued elsewhere. The event is
+   * retained, so the caller still owns its reference.
+   */
+  void record(const std::string &stage, cl_event event, int track = -1);
+
+  /**
+   * @brief Waits for the recorded commands and adds up their durations.
+   * @param trackNames The names used for the tracks; the index is used for
+   * tracks beyond these.
+   */
+  void collect(const std::vector<std::string> &trackNames =
+                   std::vector<std::string>());
+
+  /**
+   * @brief Returns the total number of seconds measured for stage and track.
+   */
+  double total(const std::string &stage,
+               const std::string &track = std::string()) const;
+
+  /**
+   * @brief Returns how many commands were measured for stage and track.
+   */
+  int count(const std::string &stage,
+            const std::string &track = std::string()) const;
+
+  /**
+   * @brief Prints a CSV table with one row per stage and track. The times are
+   * in milliseconds.
+   * @param processor If not empty, it is added as the first column, so that
+   * the tables of several profilers can be appended to one file.
+   * @param header Whether to print the line with the column names.
+   */
+  void printCsv(std::ostream &out,
+                const std::string &processor = std::string(),
+                bool header = true) const;
+
+  /**
+   * @brief Discards the measurements and the recorded events.
+   */
+  void clear();
+};
+
+} // namespace AlenkaSignal
+
+#endif // ALENKASIGNAL_KERNELPROFILER_H
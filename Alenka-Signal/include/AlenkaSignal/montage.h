@@ -11,11 +11,30 @@
 
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace AlenkaSignal {
 
 enum MontageType { NormalMontage, IdentityMontage, CopyMontage };
 
+/**
+ * @brief Sizes that can be fixed in montage kernels at compile time.
+ *
+ * A zero means the value is taken from the kernel argument. Otherwise it must
+ * be the same as the one MontageProcessor passes. The input row offset changes
+ * with every block, so it is always an argument.
+ */
+struct MontageLayout {
+  int inputRowLength = 0;
+  int inputRowCount = 0;
+  int outputCopyCount = 0;
+
+  bool fixed() const {
+    return 0 < inputRowLength || 0 < inputRowCount || 0 < outputCopyCount;
+  }
+};
+
 /**
  * @brief A class for creating kernel programs for montage computation.
  *
@@ -27,6 +46,11 @@ enum MontageType { NormalMontage, IdentityMontage, CopyMontage };
  * the final representation of the code. After the kernel object is retrieved
  * this object can be safely destroyed.
  *
+ * If separate compilation is enabled in the context, the header is compiled
+ * once into a library, and only the kernel function is compiled for each track
+ * and linked with it. Kernels with a fixed MontageLayout are always compiled
+ * whole, so that the helper functions are specialized too.
+ *
  * @todo Prohibit copying of this object.
  * @todo Rename to montage track.
  * @todo Split this class to a container for the track kernel, and to source
@@ -36,6 +60,7 @@ template <class T> class Montage {
   OpenCLContext *context = nullptr;
   MontageType montageType = NormalMontage;
   std::string source;
+  std::string librarySource, trackSource;
   std::unique_ptr<OpenCLProgram> program;
   cl_kernel kernel = nullptr;
   cl_int copyIndex = -1;
@@ -45,10 +70,13 @@ public:
   /**
    * @brief Montage constructor.
    * @param sources OpenCL source code of the montage.
+   * @param layout The sizes compiled into the kernel as constants. Identity
+   * and copy montages use shared kernels, and ignore it.
    */
   Montage(const std::string &source, OpenCLContext *context,
           const std::string &headerSource = "",
-          const std::vector<std::string> &labels = std::vector<std::string>());
+          const std::vector<std::string> &labels = std::vector<std::string>(),
+          const MontageLayout &layout = MontageLayout());
   ~Montage();
 
   /**
@@ -97,6 +125,20 @@ public:
                          const std::string &headerSource,
                          std::string *errorMessage = nullptr);
 
+  /**
+   * @brief A quick syntax check of a track formula that doesn't need OpenCL.
+   * @param source String formula for one track.
+   * @param errorMessage [out] If not nullptr and an error is detected, an error
+   * message with the line and column is stored here.
+   * @return False if the formula certainly cannot compile.
+   *
+   * Only lexical errors and the most common mistakes (unbalanced brackets,
+   * missing operands, misplaced labels, a missing semicolon) are detected.
+   * Passing this check doesn't mean the code will compile.
+   */
+  static bool checkSyntax(const std::string &source,
+                          std::string *errorMessage = nullptr);
+
   /**
    * @brief Removes single line and block comments from OpenCL code.
    */
@@ -108,10 +150,45 @@ private:
   std::string preprocessSource(const std::string &source,
                                const std::vector<std::string> &labels);
   void buildProgram();
+  std::unique_ptr<OpenCLProgram> buildLinkedProgram();
   void buildCopyProgram();
   void buildIdentityProgram();
 };
 
+/**
+ * @brief Returns the source of the default montage header.
+ */
+const std::string &defaultMontageHeader();
+
+/**
+ * @brief Tests whether the header defines the built-in montage functions like
+ * the default header does.
+ *
+ * CpuMontage and shareSums() implement sum(), average(), dist() and the other
+ * functions of the default header themselves, so they can only be used when
+ * this returns true. Other functions can be added freely, and comments and
+ * whitespace don't matter.
+ */
+bool hasDefaultBuiltins(const std::string &headerSource);
+
+/**
+ * @brief Replaces channel sums used by several tracks with precomputed ones.
+ *
+ * The calls of sum(), sumAll() and average() from the default montage header
+ * with constant arguments are found in the code of all tracks. Every range of
+ * channels used by at least two tracks is replaced by _sharedSum_(k), where k
+ * is its index in the returned vector. MontageProcessor then computes each of
+ * these sums once per block instead of once per track.
+ *
+ * @param code [in,out] The simplified code of the tracks.
+ * @param labels The labels used to resolve sum("label", "label").
+ * @param inputRowCount The number of input channels.
+ * @return The ranges of channels [first, second] of the shared sums.
+ */
+std::vector<std::pair<int, int>>
+shareSums(std::vector<std::string> *code,
+          const std::vector<std::string> &labels, int inputRowCount);
+
 } // namespace AlenkaSignal
 
 #endif // ALENKASIGNAL_MONTAGE_H
@@ -7,17 +7,26 @@
 #include <CL/cl_gl.h>
 #endif
 
+#include <cstddef>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "montage.h"
 
 namespace AlenkaSignal {
+
+class KernelProfiler;
+class OpenCLContext;
+
 /**
  * @brief This class handles computation of montages.
  */
 template <class T> class MontageProcessor {
   cl_int inputRowLength, inputRowCount, outputCopyCount;
+  std::vector<std::pair<int, int>> sharedSums;
+  cl_kernel sharedSumKernel = nullptr;
+  KernelProfiler *profiler = nullptr;
 
 public:
   /**
@@ -27,6 +36,52 @@ public:
                    int outputCopyCount = 1)
       : inputRowLength(inputRowLength), inputRowCount(inputRowCount),
         outputCopyCount(outputCopyCount) {}
+  ~MontageProcessor();
+
+  MontageProcessor(const MontageProcessor &) = delete;
+  MontageProcessor &operator=(const MontageProcessor &) = delete;
+
+  /**
+   * @brief Sets the sums of channels needed by the tracks.
+   *
+   * These are the ranges returned by shareSums() for the code of the tracks.
+   * They are computed at the beginning of every process() call, which then
+   * needs a buffer for them.
+   */
+  void setSharedSums(const std::vector<std::pair<int, int>> &ranges,
+                     OpenCLContext *context);
+
+  /**
+   * @brief Records the commands enqueued by process() in profiler; nullptr
+   * turns this off.
+   *
+   * Every kernel of a track is recorded under the index of the track in the
+   * range passed to process().
+   */
+  void setProfiler(KernelProfiler *profiler) { this->profiler = profiler; }
+
+  /**
+   * @brief Returns the number of rows of outputRowLength samples needed in
+   * the shared sum buffer.
+   */
+  int sharedSumCount() const { return static_cast<int>(sharedSums.size()); }
+
+  /**
+   * @brief Returns the number of values needed in the xyz buffer.
+   */
+  static size_t xyzBufferSize(int inputRowCount) {
+    return 3 * inputRowCount + inputRowCount * inputRowCount;
+  }
+
+  /**
+   * @brief Builds the content of the xyz buffer from channel coordinates.
+   *
+   * The coordinates (3 values per channel) are followed by a table of
+   * distances between all pairs of channels. The kernels read distances from
+   * this table instead of computing them for every sample. Channels missing
+   * in xyz are placed at the origin.
+   */
+  static std::vector<T> buildXyzBuffer(std::vector<T> xyz, int inputRowCount);
 
   /**
    * @brief Enqueues all commands required for montage computation.
@@ -34,38 +89,59 @@ public:
    * A range of iterators or pointers is expected. If you dereference
    * montageBegin twice, you should get a Montage<T> object. So you can use a
    * container of raw pointers or unique pointers.
+   *
+   * Null pointers are skipped, and their rows of the output buffer are left
+   * unchanged. This is used for tracks that are still being compiled.
+   *
+   * sharedSumBuffer is used only if sharedSumCount() is not zero. It must not
+   * be used concurrently by another queue.
    */
   template <class Iter>
   void process(Iter montageBegin, Iter montageEnd, cl_mem inBuffer,
                cl_mem outBuffer, cl_mem xyzBuffer, cl_command_queue queue,
-               cl_int outputRowLength, cl_int inputRowOffset = 0) {
+               cl_int outputRowLength, cl_int inputRowOffset = 0,
+               cl_mem sharedSumBuffer = nullptr) {
     static_assert(
         std::is_same<
             typename std::remove_reference<decltype(**montageBegin)>::type,
             Montage<T>>::value,
         "An iterator/pointer to 'Montage<T> *' is expected");
 
-    checkBufferSizes(inBuffer, outBuffer, xyzBuffer, outputRowLength,
-                     std::distance(montageBegin, montageEnd));
+    checkBufferSizes(inBuffer, outBuffer, xyzBuffer, sharedSumBuffer,
+                     outputRowLength, std::distance(montageBegin, montageEnd));
+
+    if (!sharedSums.empty())
+      computeSharedSums(inBuffer, sharedSumBuffer, queue, outputRowLength,
+                        inputRowOffset);
 
     int i = 0;
     for (Iter it = montageBegin; it != montageEnd; ++it) {
       const auto &mont = *it;
+      if (!mont) {
+        ++i;
+        continue;
+      }
+
       int copyIndex =
           CopyMontage == mont->getMontageType() ? mont->copyMontageIndex() : -1;
-      processOneMontage(inBuffer, outBuffer, xyzBuffer, queue, outputRowLength,
-                        inputRowOffset, i++, mont->getMontageIndex(),
-                        mont->getKernel(), copyIndex);
+      processOneMontage(inBuffer, outBuffer, xyzBuffer, sharedSumBuffer,
+                        queue, outputRowLength, inputRowOffset, i++,
+                        mont->getMontageIndex(), mont->getKernel(), copyIndex);
     }
   }
 
 private:
   void checkBufferSizes(cl_mem inBuffer, cl_mem outBuffer, cl_mem xyzBuffer,
-                        cl_int outputRowLength, size_t montageSize);
-  void processOneMontage(cl_mem inBuffer, cl_mem outBuffer, cl_mem xyzBuffer,
+                        cl_mem sharedSumBuffer, cl_int outputRowLength,
+                        size_t montageSize);
+  void computeSharedSums(cl_mem inBuffer, cl_mem sharedSumBuffer,
                          cl_command_queue queue, cl_int outputRowLength,
-                         cl_int inputRowOffset, cl_int index,
-                         cl_int montageIndex, cl_kernel kernel, int copyIndex);
+                         cl_int inputRowOffset);
+  void processOneMontage(cl_mem inBuffer, cl_mem outBuffer, cl_mem xyzBuffer,
+                         cl_mem sharedSumBuffer, cl_command_queue queue,
+                         cl_int outputRowLength, cl_int inputRowOffset,
+                         cl_int index, cl_int montageIndex, cl_kernel kernel,
+                         int copyIndex);
 };
 
 } // namespace AlenkaSignal
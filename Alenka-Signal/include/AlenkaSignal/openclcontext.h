@@ -9,7 +9,9 @@
 #include <CL/cl_gl.h>
 #endif
 
+#include <map>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -39,6 +41,9 @@ class OpenCLContext {
   cl_device_id deviceId;
   std::unique_ptr<OpenCLProgram> identityProgramFloat, identityProgramDouble,
       copyOnlyProgramFloat, copyOnlyProgramDouble;
+  bool separateCompilation = false;
+  std::mutex libraryMutex;
+  std::map<std::string, std::shared_ptr<OpenCLProgram>> libraries;
 
 public:
   /**
@@ -71,6 +76,37 @@ public:
    */
   cl_device_id getCLDevice() const { return deviceId; }
 
+  /**
+   * @brief Turns on compiling the montage header separately from the tracks.
+   *
+   * This uses clCompileProgram() and clLinkProgram() from OpenCL 1.2, and so
+   * it is off by default.
+   */
+  void setSeparateCompilation(bool value) { separateCompilation = value; }
+  bool getSeparateCompilation() const { return separateCompilation; }
+
+  /**
+   * @brief Returns a library compiled from source with
+   * OpenCLProgram::compileLibrary().
+   *
+   * A few of the most recently used libraries are kept, so that the same source
+   * is compiled only once. This method is thread-safe.
+   */
+  std::shared_ptr<OpenCLProgram> library(const std::string &source);
+
+  /**
+   * @brief Returns a string identifying the platform, device and driver
+   * version.
+   *
+   * Program binaries built for one fingerprint shouldn't be used with another.
+   */
+  std::string deviceFingerprint() const;
+
+  /**
+   * @brief Returns true if the device supports the extension name.
+   */
+  bool hasExtension(const std::string &name) const;
+
   bool hasIdentityKernelFloat() const {
     return identityProgramFloat.get() != nullptr;
   }
@@ -132,6 +168,11 @@ public:
   static std::string getDeviceInfo(unsigned int platformIndex,
                                    unsigned int deviceIndex);
 
+  /**
+   * @brief Returns the number of devices of the selected platform.
+   */
+  static unsigned int getDeviceCount(unsigned int platformIndex);
+
   static void CCEC(cl_int val, std::string message, const char *file, int line);
   static std::string clErrorCodeToString(cl_int code);
   static void clfftInit();
@@ -58,14 +58,45 @@ public:
   std::vector<unsigned char> *getBinary() const;
   std::string sourceCode() const { return source; }
 
+  /**
+   * @brief Creates a program from a binary returned by getBinary().
+   *
+   * If the binary is not valid for the context's device, compileStatus()
+   * returns CL_INVALID_BINARY instead of throwing an exception.
+   */
   static OpenCLProgram *fromBinary(const std::vector<unsigned char> *binary,
                                    OpenCLContext *context) {
     return new OpenCLProgram(binary, context);
   }
 
+  /**
+   * @brief Compiles source into a library that other programs can be linked
+   * against.
+   *
+   * Requires OpenCL 1.2. If this fails, compileStatus() of the returned object
+   * is not CL_SUCCESS.
+   */
+  static OpenCLProgram *compileLibrary(const std::string &source,
+                                       OpenCLContext *context);
+
+  /**
+   * @brief Compiles source and links it with library into an executable
+   * program.
+   *
+   * Requires OpenCL 1.2. If this fails, compileStatus() of the returned object
+   * is not CL_SUCCESS.
+   */
+  static OpenCLProgram *compileAndLink(const std::string &source,
+                                       const OpenCLProgram &library,
+                                       OpenCLContext *context);
+
 private:
   OpenCLProgram(const std::vector<unsigned char> *binary,
                 OpenCLContext *context);
+  OpenCLProgram(cl_program program, cl_int buildError, OpenCLContext *context,
+                const std::string &source)
+      : program(program), buildError(buildError), context(context),
+        source(source) {}
 
   void build();
 };
@@ -0,0 +1,62 @@
+#ifndef ALENKASIGNAL_THROUGHPUTBALANCER_H
+#define ALENKASIGNAL_THROUGHPUTBALANCER_H
+
+#include <vector>
+
+namespace AlenkaSignal {
+
+/**
+ * @brief Decides which device should process the next piece of work.
+ *
+ * The throughput of every device is measured from the finished work, and
+ * smoothed by an exponential moving average. For every device an estimate of
+ * when it would finish all the work given to it is kept, and the next piece
+ * goes to the device that would finish it the soonest. So the work gets split
+ * in the ratio of the throughputs.
+ *
+ * A device that hasn't been measured yet gets work only when it is idle, so
+ * that all devices get measured early on without guessing their speed.
+ *
+ * The units of work are up to the user (e.g. samples or blocks); only the
+ * ratios matter. This class does no OpenCL calls and is not thread-safe.
+ */
+class ThroughputBalancer {
+  struct Device {
+    double throughput = 0; // Work per second; 0 means not measured yet.
+    double finishTime = 0;
+    double pending = 0;
+  };
+
+  std::vector<Device> devices;
+  double smoothing;
+
+public:
+  /**
+   * @param smoothing The weight of the latest measurement in the average.
+   */
+  explicit ThroughputBalancer(unsigned int deviceCount,
+                              double smoothing = 0.25);
+
+  /**
+   * @brief Returns the device for a new piece of work, and counts it as
+   * pending there.
+   */
+  unsigned int pick(double work);
+
+  /**
+   * @brief Reports that a piece of work given by pick() finished in seconds.
+   */
+  void finished(unsigned int device, double work, double seconds);
+
+  double throughput(unsigned int device) const {
+    return devices[device].throughput;
+  }
+  double pending(unsigned int device) const { return devices[device].pending; }
+  unsigned int size() const {
+    return static_cast<unsigned int>(devices.size());
+  }
+};
+
+} // namespace AlenkaSignal
+
+#endif // ALENKASIGNAL_THROUGHPUTBALANCER_H
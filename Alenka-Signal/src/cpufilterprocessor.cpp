@@ -0,0 +1,125 @@
+#include "../include/AlenkaSignal/cpufilterprocessor.h"
+
+#include <Eigen/Core>
+#include <unsupported/Eigen/FFT>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include <string>
+
+#include <detailedexception.h>
+
+using namespace std;
+
+namespace {
+
+int threadCount() {
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+int threadNumber() {
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+} // namespace
+
+namespace AlenkaSignal {
+
+template <class T> struct CpuFilterProcessor<T>::Workspace {
+  Eigen::FFT<T> fft;
+  vector<complex<T>> bins;
+
+  explicit Workspace(unsigned int blockLength) : bins(blockLength / 2 + 1) {
+    fft.SetFlag(Eigen::FFT<T>::HalfSpectrum);
+  }
+};
+
+template <class T>
+CpuFilterProcessor<T>::CpuFilterProcessor(unsigned int blockLength,
+                                          unsigned int blockChannels)
+    : blockLength(blockLength), blockChannels(blockChannels),
+      spectrum(blockLength / 2 + 1) {
+  assert(blockLength % 2 == 0);
+}
+
+// Defined here, where Workspace is complete.
+template <class T> CpuFilterProcessor<T>::~CpuFilterProcessor() = default;
+
+template <class T>
+void CpuFilterProcessor<T>::process(const T *input, T *output,
+                                    unsigned int channels) {
+  assert(input != output && "Input and output bufferes cannot be the same");
+
+  if (channels == 0)
+    channels = blockChannels;
+  assert(channels <= blockChannels);
+
+  const int count = threadCount();
+  while (static_cast<int>(workspaces.size()) < count)
+    workspaces.push_back(make_unique<Workspace>(blockLength));
+
+  if (coefficientsChanged)
+    updateSpectrum();
+
+  using Bins = Eigen::Array<complex<T>, Eigen::Dynamic, 1>;
+  const Eigen::Map<const Bins> filter(spectrum.data(), spectrum.size());
+
+  const size_t rowLength = blockLength + 2;
+  const int rows = static_cast<int>(channels);
+
+#pragma omp parallel for schedule(static)
+  for (int j = 0; j < rows; ++j) {
+    Workspace &w = *workspaces[threadNumber()];
+
+    w.fft.fwd(w.bins.data(), input + j * rowLength, blockLength);
+
+    Eigen::Map<Bins> bins(w.bins.data(), w.bins.size());
+    bins *= filter;
+
+    // The inverse transform is scaled by 1/blockLength like clFFT's.
+    w.fft.inv(output + j * rowLength, w.bins.data(), blockLength);
+  }
+}
+
+template <class T>
+void CpuFilterProcessor<T>::changeFilter(const vector<T> &coefficients) {
+  if (blockLength < coefficients.size()) {
+    const string msg = "The filter is longer than the block: " +
+                       to_string(coefficients.size()) + " > " +
+                       to_string(blockLength);
+    throwDetailed(runtime_error(msg));
+  }
+
+  coefficientsChanged = true;
+  M = static_cast<int>(coefficients.size());
+  this->coefficients = coefficients;
+}
+
+template <class T> void CpuFilterProcessor<T>::updateSpectrum() {
+  if (workspaces.empty())
+    workspaces.push_back(make_unique<Workspace>(blockLength));
+
+  vector<T> padded(blockLength, 0);
+  copy(coefficients.begin(), coefficients.end(), padded.begin());
+
+  workspaces[0]->fft.fwd(spectrum.data(), padded.data(), blockLength);
+  coefficientsChanged = false;
+}
+
+template class CpuFilterProcessor<float>;
+template class CpuFilterProcessor<double>;
+
+} // namespace AlenkaSignal
@@ -0,0 +1,94 @@
+#include "../include/AlenkaSignal/cpuiirfilterprocessor.h"
+
+#include "../include/AlenkaSignal/iirfilterprocessor.h"
+
+#include <cassert>
+
+using namespace std;
+
+namespace {
+
+// Sets the state of a transposed direct form II biquad to the steady state for
+// a constant input x. Returns the output in that state. The same as
+// iirSteadyState() in kernels.cl.
+double steadyState(const AlenkaSignal::Biquad &c, double x, double *z1,
+                   double *z2) {
+  const double y = x * (c.b0 + c.b1 + c.b2) / (1 + c.a1 + c.a2);
+  *z1 = y - c.b0 * x;
+  *z2 = c.b2 * x - c.a2 * y;
+  return y;
+}
+
+void startPass(const vector<AlenkaSignal::Biquad> &sections, double level,
+               double *z1, double *z2) {
+  for (unsigned int s = 0; s < sections.size(); ++s)
+    level = steadyState(sections[s], level, z1 + s, z2 + s);
+}
+
+// Runs one sample through the cascade of biquads.
+double step(const vector<AlenkaSignal::Biquad> &sections, double x, double *z1,
+            double *z2) {
+  for (unsigned int s = 0; s < sections.size(); ++s) {
+    const AlenkaSignal::Biquad &c = sections[s];
+    const double y = c.b0 * x + z1[s];
+    z1[s] = c.b1 * x - c.a1 * y + z2[s];
+    z2[s] = c.b2 * x - c.a2 * y;
+    x = y;
+  }
+  return x;
+}
+
+} // namespace
+
+namespace AlenkaSignal {
+
+template <class T>
+void CpuIirFilterProcessor<T>::process(const T *input, T *output,
+                                       unsigned int channels) {
+  if (channels == 0)
+    channels = blockChannels;
+  assert(channels <= blockChannels);
+
+  const size_t rowLength = blockLength + 2;
+  const int rows = static_cast<int>(channels);
+  const int length = static_cast<int>(blockLength), delay = delaySamples();
+  const vector<Biquad> &sections = this->sections;
+
+  // The same as the iirFiltfilt kernel: the backward pass writes sample i to
+  // i + delay, which has already been read.
+#pragma omp parallel for schedule(static)
+  for (int j = 0; j < rows; ++j) {
+    const T *x = input + j * rowLength;
+    T *y = output + j * rowLength;
+    vector<double> z1(sections.size()), z2(sections.size());
+
+    startPass(sections, x[0], z1.data(), z2.data());
+    for (int i = 0; i < length; ++i)
+      y[i] = static_cast<T>(step(sections, x[i], z1.data(), z2.data()));
+
+    startPass(sections, y[length - 1], z1.data(), z2.data());
+    for (int i = length - 1; 0 <= i; --i) {
+      const double value = step(sections, y[i], z1.data(), z2.data());
+      if (i + delay < length)
+        y[i + delay] = static_cast<T>(value);
+    }
+  }
+}
+
+template <class T>
+void CpuIirFilterProcessor<T>::changeFilter(const vector<Biquad> &sections,
+                                            int discard) {
+  assert(0 <= discard && discard < static_cast<int>(blockLength));
+
+  this->sections = sections;
+  this->discard = discard;
+}
+
+template <class T> vector<T> CpuIirFilterProcessor<T>::impulseResponse() const {
+  return IirFilterProcessor<T>::impulseResponse(sections, delaySamples());
+}
+
+template class CpuIirFilterProcessor<float>;
+template class CpuIirFilterProcessor<double>;
+
+} // namespace AlenkaSignal
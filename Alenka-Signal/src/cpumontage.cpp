@@ -0,0 +1,948 @@
+#include "../include/AlenkaSignal/cpumontage.h"
+
+#include "montagetokenizer.h"
+
+#include <Eigen/Core>
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+using AlenkaSignal::Token;
+
+class ParseError : public runtime_error {
+public:
+  ParseError(const Token &t, const string &message)
+      : runtime_error(AlenkaSignal::positionString(t.line, t.column) +
+                      message) {}
+};
+
+bool isNumberInteger(const string &text) {
+  if (text.size() > 1 && text[0] == '0' && tolower(text[1]) == 'x')
+    return text.find_first_of(".pP") == string::npos;
+
+  return text.find_first_of(".eEfF") == string::npos;
+}
+
+double parseNumber(const Token &t) {
+  const char *begin = t.text.c_str();
+  char *end;
+  const double value = strtod(begin, &end);
+
+  // Allow the suffixes of float, unsigned and long literals.
+  while (*end != '\0' && string("fFuUlL").find(*end) != string::npos)
+    ++end;
+
+  if (end == begin || *end != '\0')
+    throw ParseError(t, "invalid number '" + t.text + "'");
+
+  return value;
+}
+
+} // namespace
+
+namespace AlenkaSignal {
+
+/**
+ * @brief Translates the track code into the bytecode of CpuMontage.
+ *
+ * A recursive descent parser with the usual C precedence. Every expression is
+ * either a constant, which is folded right away, or a sequence of instructions
+ * that leaves one row on the stack. Constant operands of binary operators
+ * become immediate values of the instruction, and terms like 'w*in(i)' are
+ * merged into AddIn, which is the only instruction a bipolar or weighted
+ * reference track needs besides In.
+ */
+template <class T> class CpuMontageCompiler {
+  using OpCode = typename CpuMontage<T>::OpCode;
+  using Instruction = typename CpuMontage<T>::Instruction;
+
+  struct Value {
+    bool constant = false;
+    bool integer = false;
+    double number = 0;
+    vector<Instruction> code;
+  };
+
+  const vector<Token> &tokens;
+  const vector<string> &labels;
+  const int montageIndex;
+  size_t i = 0;
+  map<string, int> variables;
+  vector<Instruction> program;
+
+public:
+  CpuMontageCompiler(const vector<Token> &tokens, const vector<string> &labels,
+                     int montageIndex)
+      : tokens(tokens), labels(labels), montageIndex(montageIndex) {
+    variables["out"] = 0;
+  }
+
+  void compile(CpuMontage<T> *montage) {
+    while (i < tokens.size())
+      statement();
+
+    montage->code = program;
+    montage->variableCount = static_cast<int>(variables.size());
+    montage->montageIndex = montageIndex;
+
+    int depth = 0;
+    for (const Instruction &e : program) {
+      depth += stackEffect(e.op);
+      montage->stackSize = max(montage->stackSize, depth);
+    }
+  }
+
+private:
+  // Token access.
+
+  const Token &peek() const {
+    if (i < tokens.size())
+      return tokens[i];
+
+    static const Token end{Token::Punctuator, "", 0, 0};
+    throw ParseError(tokens.empty() ? end : tokens.back(),
+                     "unexpected end of the code");
+  }
+
+  const Token &next() {
+    const Token &t = peek();
+    ++i;
+    return t;
+  }
+
+  bool check(const string &text, size_t offset = 0) const {
+    return i + offset < tokens.size() &&
+           tokens[i + offset].kind != Token::String &&
+           tokens[i + offset].text == text;
+  }
+
+  bool accept(const string &text) {
+    if (check(text)) {
+      ++i;
+      return true;
+    }
+    return false;
+  }
+
+  void expect(const string &text) {
+    const Token &t = next();
+    if (t.kind == Token::String || t.text != text)
+      throw ParseError(t, "expected '" + text + "'");
+  }
+
+  // Statements.
+
+  void statement() {
+    if (accept(";"))
+      return;
+
+    const Token &t = next();
+
+    if (t.text == "float" || t.text == "double") {
+      const Token &name = next();
+      if (name.kind != Token::Identifier || variables.count(name.text))
+        throw ParseError(name, "invalid variable name '" + name.text + "'");
+
+      expect("=");
+      Value value = expression();
+      expect(";");
+
+      const int slot = static_cast<int>(variables.size());
+      variables[name.text] = slot;
+      store(value, slot);
+      return;
+    }
+
+    auto it = variables.find(t.text);
+    if (t.kind != Token::Identifier || it == variables.end())
+      throw ParseError(t, "'" + t.text + "' is not supported");
+
+    const Token &op = next();
+    Value value = expression();
+    expect(";");
+
+    if (op.text != "=") {
+      const map<string, OpCode> compound = {{"+=", OpCode::Add},
+                                            {"-=", OpCode::Subtract},
+                                            {"*=", OpCode::Multiply},
+                                            {"/=", OpCode::Divide}};
+      auto opIt = compound.find(op.text);
+      if (opIt == compound.end())
+        throw ParseError(op, "unsupported assignment '" + op.text + "'");
+
+      value = binary(instruction(OpCode::Load, it->second), value,
+                     opIt->second, op);
+    }
+
+    store(value, it->second);
+  }
+
+  void store(const Value &value, int slot) {
+    append(&program, value);
+    program.push_back(Instruction{OpCode::Store, slot, 0, 0});
+  }
+
+  // Expressions.
+
+  Value expression() {
+    Value condition = logicalOr();
+
+    if (!accept("?"))
+      return condition;
+
+    Value a = expression();
+    expect(":");
+    Value b = expression();
+
+    if (condition.constant)
+      return condition.number != 0 ? a : b;
+
+    Value result;
+    append(&result, condition);
+    append(&result, a);
+    append(&result, b);
+    result.code.push_back(Instruction{OpCode::Select, 0, 0, 0});
+    return result;
+  }
+
+  Value logicalOr() {
+    Value result = logicalAnd();
+    while (check("||")) {
+      const Token &t = next();
+      result = binary(result, logicalAnd(), OpCode::Or, t);
+    }
+    return result;
+  }
+
+  Value logicalAnd() {
+    Value result = equality();
+    while (check("&&")) {
+      const Token &t = next();
+      result = binary(result, equality(), OpCode::And, t);
+    }
+    return result;
+  }
+
+  Value equality() {
+    Value result = relational();
+    while (check("==") || check("!=")) {
+      const Token &t = next();
+      result = binary(result, relational(),
+                      t.text == "==" ? OpCode::Equal : OpCode::NotEqual, t);
+    }
+    return result;
+  }
+
+  Value relational() {
+    Value result = additive();
+    while (check("<") || check("<=") || check(">") || check(">=")) {
+      const Token &t = next();
+      OpCode op = t.text == "<" ? OpCode::Less
+                                : t.text == "<=" ? OpCode::LessEqual
+                                                 : t.text == ">"
+                                                       ? OpCode::Greater
+                                                       : OpCode::GreaterEqual;
+      result = binary(result, additive(), op, t);
+    }
+    return result;
+  }
+
+  Value additive() {
+    Value result = multiplicative();
+    while (check("+") || check("-")) {
+      const Token &t = next();
+      result = binary(result, multiplicative(),
+                      t.text == "+" ? OpCode::Add : OpCode::Subtract, t);
+    }
+    return result;
+  }
+
+  Value multiplicative() {
+    Value result = unary();
+    while (check("*") || check("/") || check("%")) {
+      const Token &t = next();
+      Value operand = unary();
+
+      if (t.text == "%") {
+        if (!result.constant || !operand.constant || !result.integer ||
+            !operand.integer)
+          throw ParseError(t, "'%' is supported only for integer constants");
+        if (operand.number == 0)
+          throw ParseError(t, "division by zero");
+
+        result.number = fmod(result.number, operand.number);
+      } else {
+        result = binary(result, operand,
+                        t.text == "*" ? OpCode::Multiply : OpCode::Divide, t);
+      }
+    }
+    return result;
+  }
+
+  Value unary() {
+    if (accept("+"))
+      return unary();
+
+    if (check("-") || check("!")) {
+      const Token &t = next();
+      Value value = unary();
+      const OpCode op = t.text == "-" ? OpCode::Negate : OpCode::Not;
+
+      if (value.constant) {
+        value.number = op == OpCode::Negate ? -value.number
+                                            : value.number == 0 ? 1 : 0;
+        value.integer = value.integer || op == OpCode::Not;
+        return value;
+      }
+
+      value.code.push_back(Instruction{op, 0, 0, 0});
+      return value;
+    }
+
+    // A cast like (float)x.
+    if (check("(") && (check("float", 1) || check("double", 1) ||
+                       check("int", 1)) &&
+        check(")", 2)) {
+      ++i;
+      const Token &type = next();
+      ++i;
+
+      Value value = unary();
+      if (type.text == "int") {
+        if (!value.constant)
+          throw ParseError(type, "only constants can be cast to int");
+        value.number = trunc(value.number);
+      }
+      value.integer = type.text == "int";
+      return value;
+    }
+
+    return primary();
+  }
+
+  Value primary() {
+    const Token &t = next();
+
+    if (t.kind == Token::Number)
+      return constant(parseNumber(t), isNumberInteger(t.text));
+
+    if (t.kind == Token::Punctuator && t.text == "(") {
+      Value value = expression();
+      expect(")");
+      return value;
+    }
+
+    if (t.kind != Token::Identifier)
+      throw ParseError(t, "unexpected '" + t.text + "'");
+
+    if (check("("))
+      return call(t);
+
+    if (t.text == "INDEX")
+      return constant(montageIndex, true);
+    if (t.text == "M_PI")
+      return constant(M_PI, false);
+
+    if (t.text == "IN_COUNT") {
+      Value value = instruction(OpCode::InCount);
+      value.integer = true;
+      return value;
+    }
+
+    auto it = variables.find(t.text);
+    if (it != variables.end())
+      return instruction(OpCode::Load, it->second);
+
+    throw ParseError(t, "'" + t.text + "' is not supported");
+  }
+
+  Value call(const Token &name) {
+    expect("(");
+
+    vector<Value> arguments;
+    vector<const Token *> argumentTokens;
+
+    if (!accept(")")) {
+      do {
+        argumentTokens.push_back(&peek());
+
+        if (peek().kind == Token::String)
+          arguments.push_back(constant(labelIndex(next()), true));
+        else
+          arguments.push_back(expression());
+      } while (accept(","));
+
+      expect(")");
+    }
+
+    const string &f = name.text;
+    auto argumentCount = [&](size_t n) {
+      if (arguments.size() != n)
+        throw ParseError(name, f + "() expects " + to_string(n) +
+                                   " arguments");
+    };
+    auto integer = [&](size_t k) {
+      if (!arguments[k].constant)
+        throw ParseError(*argumentTokens[k],
+                         "the arguments of " + f + "() must be constants");
+      return static_cast<int>(arguments[k].number);
+    };
+
+    if (f == "in" || f == "x" || f == "y" || f == "z") {
+      argumentCount(1);
+      const OpCode op = f == "in" ? OpCode::In
+                                  : f == "x" ? OpCode::X
+                                             : f == "y" ? OpCode::Y : OpCode::Z;
+      return instruction(op, integer(0));
+    }
+    if (f == "label") {
+      argumentCount(1);
+      return constant(integer(0), true);
+    }
+    if (f == "dist") {
+      argumentCount(2);
+      return instruction(OpCode::Dist, integer(0), integer(1));
+    }
+    if (f == "sum") {
+      argumentCount(2);
+      return instruction(OpCode::Sum, integer(0), integer(1));
+    }
+    if (f == "sumAll") {
+      argumentCount(0);
+      return instruction(OpCode::Sum, 0, INT_MAX);
+    }
+    if (f == "average") {
+      argumentCount(0);
+      return instruction(OpCode::Average);
+    }
+    if (f == "distAverage" || f == "distAverageLinear") {
+      argumentCount(2);
+      return instruction(f == "distAverage" ? OpCode::DistAverage
+                                            : OpCode::DistAverageLinear,
+                         integer(0), integer(1));
+    }
+
+    const map<string, pair<OpCode, function<double(double)>>> unaryFunctions =
+        {{"fabs", {OpCode::Abs, [](double x) { return fabs(x); }}},
+         {"sqrt", {OpCode::Sqrt, [](double x) { return sqrt(x); }}},
+         {"exp", {OpCode::Exp, [](double x) { return exp(x); }}},
+         {"log", {OpCode::Log, [](double x) { return log(x); }}},
+         {"log10", {OpCode::Log10, [](double x) { return log10(x); }}},
+         {"sin", {OpCode::Sin, [](double x) { return sin(x); }}},
+         {"cos", {OpCode::Cos, [](double x) { return cos(x); }}},
+         {"tan", {OpCode::Tan, [](double x) { return tan(x); }}},
+         {"floor", {OpCode::Floor, [](double x) { return floor(x); }}},
+         {"ceil", {OpCode::Ceil, [](double x) { return ceil(x); }}}};
+
+    auto unaryIt = unaryFunctions.find(f);
+    if (unaryIt != unaryFunctions.end()) {
+      argumentCount(1);
+      Value value = arguments[0];
+
+      if (value.constant)
+        return constant(unaryIt->second.second(value.number), false);
+
+      value.integer = false;
+      value.code.push_back(Instruction{unaryIt->second.first, 0, 0, 0});
+      return value;
+    }
+
+    const map<string, OpCode> binaryFunctions = {
+        {"pow", OpCode::Pow},  {"pown", OpCode::Pow}, {"fmin", OpCode::Min},
+        {"fmax", OpCode::Max}, {"min", OpCode::Min},  {"max", OpCode::Max}};
+
+    auto binaryIt = binaryFunctions.find(f);
+    if (binaryIt != binaryFunctions.end()) {
+      argumentCount(2);
+      return binary(arguments[0], arguments[1], binaryIt->second, name);
+    }
+
+    throw ParseError(name, "function " + f + "() is not supported");
+  }
+
+  int labelIndex(const Token &t) const {
+    const string label = t.text.substr(1, t.text.size() - 2);
+    auto it = find(labels.begin(), labels.end(), label);
+
+    return it == labels.end() ? -1
+                              : static_cast<int>(distance(labels.begin(), it));
+  }
+
+  // Code generation.
+
+  static Value constant(double number, bool integer) {
+    Value value;
+    value.constant = true;
+    value.integer = integer;
+    value.number = number;
+    return value;
+  }
+
+  static Value instruction(OpCode op, int a = 0, int b = 0) {
+    Value value;
+    value.code.push_back(Instruction{op, a, b, 0});
+    return value;
+  }
+
+  static void append(vector<Instruction> *code, const Value &value) {
+    if (value.constant) {
+      code->push_back(Instruction{OpCode::Constant, 0, 0,
+                                  static_cast<T>(value.number)});
+    } else {
+      code->insert(code->end(), value.code.begin(), value.code.end());
+    }
+  }
+
+  static void append(Value *destination, const Value &value) {
+    append(&destination->code, value);
+  }
+
+  // Returns true and the channel and weight if value is 'in(i)' or
+  // 'in(i)*w'.
+  static bool isWeightedInput(const Value &value, int *channel, T *weight) {
+    const auto &code = value.code;
+
+    if (value.constant || code.empty() || 2 < code.size() ||
+        code[0].op != OpCode::In)
+      return false;
+
+    if (code.size() == 2 && code[1].op != OpCode::MultiplyConstant)
+      return false;
+
+    *channel = code[0].a;
+    *weight = code.size() == 2 ? code[1].value : 1;
+    return true;
+  }
+
+  static double fold(OpCode op, const Value &a, const Value &b,
+                     const Token &t) {
+    const double x = a.number, y = b.number;
+
+    switch (op) {
+    case OpCode::Add:
+      return x + y;
+    case OpCode::Subtract:
+      return x - y;
+    case OpCode::Multiply:
+      return x * y;
+    case OpCode::Divide:
+      if (a.integer && b.integer) {
+        if (y == 0)
+          throw ParseError(t, "division by zero");
+        return trunc(x / y);
+      }
+      return x / y;
+    case OpCode::Pow:
+      return pow(x, y);
+    case OpCode::Min:
+      return min(x, y);
+    case OpCode::Max:
+      return max(x, y);
+    case OpCode::Less:
+      return x < y;
+    case OpCode::LessEqual:
+      return x <= y;
+    case OpCode::Greater:
+      return x > y;
+    case OpCode::GreaterEqual:
+      return x >= y;
+    case OpCode::Equal:
+      return x == y;
+    case OpCode::NotEqual:
+      return x != y;
+    case OpCode::And:
+      return x != 0 && y != 0;
+    case OpCode::Or:
+      return x != 0 || y != 0;
+    default:
+      throw ParseError(t, "unexpected operator");
+    }
+  }
+
+  // The instruction for 'row op constant'.
+  static OpCode immediateRight(OpCode op) {
+    switch (op) {
+    case OpCode::Add:
+      return OpCode::AddConstant;
+    case OpCode::Subtract:
+      return OpCode::SubtractConstant;
+    case OpCode::Multiply:
+      return OpCode::MultiplyConstant;
+    default:
+      return OpCode::DivideConstant;
+    }
+  }
+
+  // The instruction for 'constant op row'.
+  static OpCode immediateLeft(OpCode op) {
+    switch (op) {
+    case OpCode::Add:
+      return OpCode::AddConstant;
+    case OpCode::Subtract:
+      return OpCode::ConstantSubtract;
+    case OpCode::Multiply:
+      return OpCode::MultiplyConstant;
+    default:
+      return OpCode::ConstantDivide;
+    }
+  }
+
+  static bool isArithmetic(OpCode op) {
+    return op == OpCode::Add || op == OpCode::Subtract ||
+           op == OpCode::Multiply || op == OpCode::Divide;
+  }
+
+  Value binary(const Value &a, const Value &b, OpCode op, const Token &t) {
+    if (a.constant && b.constant) {
+      const bool integer =
+          (a.integer && b.integer) || !(isArithmetic(op) || op == OpCode::Pow ||
+                                        op == OpCode::Min ||
+                                        op == OpCode::Max);
+      return constant(fold(op, a, b, t), integer);
+    }
+
+    // Only IN_COUNT can make an integer row, and integer division would be
+    // needed for it.
+    if (op == OpCode::Divide && a.integer && b.integer)
+      throw ParseError(t, "integer division is not supported");
+
+    Value result;
+    result.integer = a.integer && b.integer && isArithmetic(op);
+
+    if (isArithmetic(op) && b.constant) {
+      result.code = a.code;
+      result.code.push_back(
+          Instruction{immediateRight(op), 0, 0, static_cast<T>(b.number)});
+      return result;
+    }
+
+    if (isArithmetic(op) && a.constant) {
+      result.code = b.code;
+      result.code.push_back(
+          Instruction{immediateLeft(op), 0, 0, static_cast<T>(a.number)});
+      return result;
+    }
+
+    int channel;
+    T weight;
+
+    if (op == OpCode::Add || op == OpCode::Subtract) {
+      const T sign = op == OpCode::Add ? 1 : -1;
+
+      if (isWeightedInput(b, &channel, &weight)) {
+        result.code = a.code;
+        result.code.push_back(
+            Instruction{OpCode::AddIn, channel, 0, sign * weight});
+        return result;
+      }
+
+      if (op == OpCode::Add && isWeightedInput(a, &channel, &weight)) {
+        result.code = b.code;
+        result.code.push_back(Instruction{OpCode::AddIn, channel, 0, weight});
+        return result;
+      }
+    }
+
+    append(&result, a);
+    append(&result, b);
+    result.code.push_back(Instruction{op, 0, 0, 0});
+    return result;
+  }
+
+  static int stackEffect(OpCode op) {
+    if (op <= OpCode::Load)
+      return 1;
+    if (op == OpCode::Store)
+      return -1;
+    if (op < OpCode::Add)
+      return 0;
+    if (op < OpCode::Select)
+      return -1;
+    return -2;
+  }
+};
+
+template <class T>
+unique_ptr<CpuMontage<T>> CpuMontage<T>::parse(const string &source,
+                                               const vector<string> &labels,
+                                               int montageIndex,
+                                               string *errorMessage) {
+  vector<Token> tokens;
+  string error;
+
+  if (!tokenize(source, &tokens, &error)) {
+    if (errorMessage)
+      *errorMessage = "Syntax error:\n" + error;
+    return nullptr;
+  }
+
+  unique_ptr<CpuMontage<T>> montage(new CpuMontage<T>());
+
+  try {
+    CpuMontageCompiler<T>(tokens, labels, montageIndex).compile(montage.get());
+  } catch (const ParseError &e) {
+    if (errorMessage)
+      *errorMessage = "Not supported by the CPU backend:\n" + string(e.what());
+    return nullptr;
+  }
+
+  return montage;
+}
+
+template <class T>
+void CpuMontage<T>::evaluate(const T *input, int inputRowLength,
+                             int inputRowCount, int inputRowOffset,
+                             const T *xyz, T *output, int length,
+                             Workspace *workspace) const {
+  using Row = Eigen::Array<T, Eigen::Dynamic, 1>;
+  using RowMap = Eigen::Map<Row>;
+  using InputMap = Eigen::Map<const Row>;
+
+  auto &stack = workspace->stack;
+  auto &variables = workspace->variables;
+
+  stack.resize(stackSize);
+  variables.resize(variableCount);
+  for (auto &e : stack)
+    e.resize(length);
+  for (auto &e : variables)
+    e.resize(length);
+
+  fill(variables[0].begin(), variables[0].end(), 0); // out = 0;
+
+  auto row = [&](int i) { return RowMap(stack[i].data(), length); };
+  auto valid = [&](int i) { return 0 <= i && i < inputRowCount; };
+  auto channel = [&](int i) {
+    return InputMap(input + inputRowLength * i + inputRowOffset, length);
+  };
+  auto coordinate = [&](int i, int k) -> T {
+    return valid(i) ? xyz[3 * i + k] : 0;
+  };
+  auto distance = [&](int i, int j) -> T {
+    T sum = 0;
+    for (int k = 0; k < 3; ++k) {
+      const T d = coordinate(i, k) - coordinate(j, k);
+      sum += d * d;
+    }
+    return sqrt(sum);
+  };
+
+  // Sums the channels with weights. The weight of channel i is minus the
+  // sum of the others, i.e. the track is a sum of w_j*(in(i) - in(j)).
+  auto weightedDifference = [&](RowMap r, int i, function<T(int)> weight) {
+    r.setZero();
+    T total = 0;
+
+    for (int j = 0; j < inputRowCount; ++j) {
+      const T w = weight(j);
+      if (j != i && w != 0) {
+        r -= w * channel(j);
+        total += w;
+      }
+    }
+
+    if (valid(i))
+      r += total * channel(i);
+  };
+
+  int top = -1;
+
+  for (const Instruction &e : code) {
+    switch (e.op) {
+    case OpCode::Constant:
+      row(++top).setConstant(e.value);
+      break;
+    case OpCode::In:
+      if (valid(e.a))
+        row(++top) = channel(e.a);
+      else
+        row(++top).setZero();
+      break;
+    case OpCode::InCount:
+      row(++top).setConstant(static_cast<T>(inputRowCount));
+      break;
+    case OpCode::X:
+    case OpCode::Y:
+    case OpCode::Z: {
+      const int axis = static_cast<int>(e.op) - static_cast<int>(OpCode::X);
+      row(++top).setConstant(coordinate(e.a, axis));
+      break;
+    }
+    case OpCode::Dist:
+      row(++top).setConstant(distance(e.a, e.b));
+      break;
+    case OpCode::Sum:
+    case OpCode::Average: {
+      RowMap r = row(++top);
+      r.setZero();
+
+      const int from = e.op == OpCode::Sum ? max(0, e.a) : 0;
+      const int to = e.op == OpCode::Sum ? min(e.b, inputRowCount - 1)
+                                         : inputRowCount - 1;
+      for (int j = from; j <= to; ++j)
+        r += channel(j);
+
+      if (e.op == OpCode::Average)
+        r /= static_cast<T>(inputRowCount);
+      break;
+    }
+    case OpCode::DistAverage:
+      weightedDifference(row(++top), e.a, [&](int j) -> T {
+        return 1 / (distance(e.a, j) * e.b + 1);
+      });
+      break;
+    case OpCode::DistAverageLinear:
+      weightedDifference(row(++top), e.a, [&](int j) -> T {
+        const T d = distance(e.a, j);
+        return d < e.b ? -(d / e.b) + 1 : 0;
+      });
+      break;
+    case OpCode::Load:
+      row(++top) = RowMap(variables[e.a].data(), length);
+      break;
+    case OpCode::Store:
+      variables[e.a].swap(stack[top--]);
+      break;
+    case OpCode::AddIn:
+      if (valid(e.a))
+        row(top) += e.value * channel(e.a);
+      break;
+    case OpCode::AddConstant:
+      row(top) += e.value;
+      break;
+    case OpCode::SubtractConstant:
+      row(top) -= e.value;
+      break;
+    case OpCode::MultiplyConstant:
+      row(top) *= e.value;
+      break;
+    case OpCode::DivideConstant:
+      row(top) /= e.value;
+      break;
+    case OpCode::ConstantSubtract:
+      row(top) = e.value - row(top);
+      break;
+    case OpCode::ConstantDivide: {
+      const T value = e.value;
+      row(top) = row(top).unaryExpr([value](T x) { return value / x; });
+      break;
+    }
+    case OpCode::Negate:
+      row(top) = -row(top);
+      break;
+    case OpCode::Not:
+      row(top) = row(top).unaryExpr([](T x) -> T { return x == 0; });
+      break;
+    case OpCode::Abs:
+      row(top) = row(top).abs();
+      break;
+    case OpCode::Sqrt:
+      row(top) = row(top).sqrt();
+      break;
+    case OpCode::Exp:
+      row(top) = row(top).exp();
+      break;
+    case OpCode::Log:
+      row(top) = row(top).log();
+      break;
+    case OpCode::Log10:
+      row(top) = row(top).unaryExpr([](T x) { return log10(x); });
+      break;
+    case OpCode::Sin:
+      row(top) = row(top).sin();
+      break;
+    case OpCode::Cos:
+      row(top) = row(top).cos();
+      break;
+    case OpCode::Tan:
+      row(top) = row(top).unaryExpr([](T x) { return tan(x); });
+      break;
+    case OpCode::Floor:
+      row(top) = row(top).unaryExpr([](T x) { return floor(x); });
+      break;
+    case OpCode::Ceil:
+      row(top) = row(top).unaryExpr([](T x) { return ceil(x); });
+      break;
+    case OpCode::Select: {
+      RowMap c = row(top - 2), a = row(top - 1), b = row(top);
+      for (int k = 0; k < length; ++k)
+        c[k] = c[k] != 0 ? a[k] : b[k];
+      top -= 2;
+      break;
+    }
+    default: {
+      RowMap b = row(top--), a = row(top);
+
+      switch (e.op) {
+      case OpCode::Add:
+        a += b;
+        break;
+      case OpCode::Subtract:
+        a -= b;
+        break;
+      case OpCode::Multiply:
+        a *= b;
+        break;
+      case OpCode::Divide:
+        a /= b;
+        break;
+      case OpCode::Pow:
+        a = a.binaryExpr(b, [](T x, T y) { return pow(x, y); });
+        break;
+      case OpCode::Min:
+        a = a.min(b);
+        break;
+      case OpCode::Max:
+        a = a.max(b);
+        break;
+      case OpCode::Less:
+        a = a.binaryExpr(b, [](T x, T y) -> T { return x < y; });
+        break;
+      case OpCode::LessEqual:
+        a = a.binaryExpr(b, [](T x, T y) -> T { return x <= y; });
+        break;
+      case OpCode::Greater:
+        a = a.binaryExpr(b, [](T x, T y) -> T { return x > y; });
+        break;
+      case OpCode::GreaterEqual:
+        a = a.binaryExpr(b, [](T x, T y) -> T { return x >= y; });
+        break;
+      case OpCode::Equal:
+        a = a.binaryExpr(b, [](T x, T y) -> T { return x == y; });
+        break;
+      case OpCode::NotEqual:
+        a = a.binaryExpr(b, [](T x, T y) -> T { return x != y; });
+        break;
+      case OpCode::And:
+        a = a.binaryExpr(b, [](T x, T y) -> T { return x != 0 && y != 0; });
+        break;
+      case OpCode::Or:
+        a = a.binaryExpr(b, [](T x, T y) -> T { return x != 0 || y != 0; });
+        break;
+      default:
+        assert(false && "Unexpected instruction");
+        break;
+      }
+      break;
+    }
+    }
+  }
+
+  assert(top == -1);
+  copy(variables[0].begin(), variables[0].end(), output);
+}
+
+template class CpuMontage<float>;
+template class CpuMontage<double>;
+
+} // namespace AlenkaSignal
@@ -0,0 +1,44 @@
+#include "../include/AlenkaSignal/cpumontageprocessor.h"
+
+#include <Eigen/Core>
+
+using namespace std;
+
+namespace AlenkaSignal {
+
+template <class T>
+void CpuMontageProcessor<T>::processTracks(
+    const vector<const CpuMontage<T> *> &tracks, const T *input, T *output,
+    const T *xyz, int outputRowLength, int inputRowOffset) {
+  using Row = Eigen::Array<T, Eigen::Dynamic, 1>;
+  using OutputRow = Eigen::Map<Row, 0, Eigen::InnerStride<>>;
+
+  const int trackCount = static_cast<int>(tracks.size());
+
+#pragma omp parallel
+  {
+    typename CpuMontage<T>::Workspace workspace;
+    Row out(outputRowLength);
+
+#pragma omp for schedule(dynamic)
+    for (int drawIndex = 0; drawIndex < trackCount; ++drawIndex) {
+      const CpuMontage<T> *track = tracks[drawIndex];
+      if (!track)
+        continue;
+
+      track->evaluate(input, inputRowLength, inputRowCount, inputRowOffset,
+                      xyz, out.data(), outputRowLength, &workspace);
+
+      T *outputRow = output + outputCopyCount * outputRowLength * drawIndex;
+      for (int i = 0; i < outputCopyCount; ++i) {
+        OutputRow(outputRow + i, outputRowLength,
+                  Eigen::InnerStride<>(outputCopyCount)) = out;
+      }
+    }
+  }
+}
+
+template class CpuMontageProcessor<float>;
+template class CpuMontageProcessor<double>;
+
+} // namespace AlenkaSignal
@@ -0,0 +1,58 @@
+#include "../include/AlenkaSignal/deviceset.h"
+
+#include "../include/AlenkaSignal/openclcontext.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include <detailedexception.h>
+
+using namespace std;
+
+namespace AlenkaSignal {
+
+DeviceSet::DeviceSet(
+    OpenCLContext *primary,
+    const vector<pair<unsigned int, unsigned int>> &extraDevices)
+    : contexts{primary} {
+  for (const auto &e : extraDevices) {
+    auto context = make_unique<OpenCLContext>(e.first, e.second);
+
+    const bool duplicate =
+        any_of(contexts.begin(), contexts.end(), [&context](auto c) {
+          return c->getCLDevice() == context->getCLDevice();
+        });
+    if (duplicate)
+      continue;
+
+    context->setSeparateCompilation(primary->getSeparateCompilation());
+    contexts.push_back(context.get());
+    ownedContexts.push_back(move(context));
+  }
+}
+
+DeviceSet::~DeviceSet() = default;
+
+vector<pair<unsigned int, unsigned int>>
+DeviceSet::parseDeviceList(const string &list) {
+  vector<pair<unsigned int, unsigned int>> devices;
+  stringstream ss(list);
+  string item;
+
+  while (ss >> item) {
+    stringstream itemStream(item);
+    unsigned int platform, device;
+    char colon;
+
+    if (!(itemStream >> platform >> colon >> device) || colon != ':' ||
+        !itemStream.eof())
+      throwDetailed(runtime_error("Bad OpenCL device '" + item +
+                                  "'; expected PLATFORM:DEVICE."));
+
+    devices.emplace_back(platform, device);
+  }
+
+  return devices;
+}
+
+} // namespace AlenkaSignal
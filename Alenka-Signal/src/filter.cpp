@@ -1,9 +1,38 @@
 #include "../include/AlenkaSignal/filter.h"
 
+#include <cassert>
 #include <complex>
 
 using namespace std;
 
+namespace {
+
+// These are the low-pass and high-pass formulas from the Audio EQ Cookbook.
+// With the Q of the individual pole pairs they give an exact Butterworth
+// filter, as the bilinear transform is prewarped at the cut-off frequency.
+AlenkaSignal::Biquad butterworthSection(double w0, double Q, bool highpass) {
+  const double alpha = sin(w0) / (2 * Q), c = cos(w0), a0 = 1 + alpha;
+  const double b1 = highpass ? -(1 + c) : 1 - c;
+
+  return {fabs(b1) / 2 / a0, b1 / a0, fabs(b1) / 2 / a0, -2 * c / a0,
+          (1 - alpha) / a0};
+}
+
+AlenkaSignal::Biquad notchSection(double w0, double Q) {
+  const double alpha = sin(w0) / (2 * Q), c = cos(w0), a0 = 1 + alpha;
+  return {1 / a0, -2 * c / a0, 1 / a0, -2 * c / a0, (1 - alpha) / a0};
+}
+
+void addButterworth(vector<AlenkaSignal::Biquad> *sections, unsigned int order,
+                    double w0, bool highpass) {
+  for (unsigned int k = 0; k < order / 2; ++k) {
+    const double Q = 1 / (2 * sin(M_PI * (2 * k + 1) / (2 * order)));
+    sections->push_back(butterworthSection(w0, Q, highpass));
+  }
+}
+
+} // namespace
+
 namespace AlenkaSignal {
 
 template <class T> vector<T> Filter<T>::computeSamples() {
@@ -36,6 +65,29 @@ template <class T> vector<T> Filter<T>::computeSamples() {
   return samples;
 }
 
+template <class T>
+vector<Biquad> Filter<T>::computeBiquads(unsigned int order) const {
+  assert(order % 2 == 0);
+  vector<Biquad> sections;
+
+  // The frequencies are stored relative to the Nyquist frequency. Sections
+  // with the cut-off outside of (0, Fs/2) would be unstable, and they would
+  // have no effect anyway.
+  if (m_lowpassOn && 0 < m_lowpass && m_lowpass < 1)
+    addButterworth(&sections, order, M_PI * m_lowpass, false);
+
+  if (m_highpassOn && 0 < m_highpass && m_highpass < 1)
+    addButterworth(&sections, order, M_PI * m_highpass, true);
+
+  if (m_notchOn && 0 < m_notch && m_notch < 1) {
+    // notchWidth is the bandwidth in Hz.
+    const double Q = m_notch * Fs / 2 / notchWidth;
+    sections.push_back(notchSection(M_PI * m_notch, Q));
+  }
+
+  return sections;
+}
+
 template class Filter<float>;
 template class Filter<double>;
 
@@ -1,5 +1,6 @@
 #include "../include/AlenkaSignal/filterprocessor.h"
 
+#include "../include/AlenkaSignal/kernelprofiler.h"
 #include "../include/AlenkaSignal/openclcontext.h"
 #include "../include/AlenkaSignal/openclprogram.h"
 
@@ -83,6 +84,78 @@ void CFCEC(clfftStatus val, const string &message, const char *file, int line) {
     CFCEC(val_, ss.str(), __FILE__, __LINE__);                                 \
   }
 
+// Partitions of about a quarter of the filter keep the delay line short, while
+// the FFTs stay small.
+const unsigned int MIN_PARTITION_LENGTH = 256;
+const unsigned int PARTITIONS_PER_FILTER = 4;
+
+unsigned int partitionLengthFor(int M) {
+  unsigned int length = MIN_PARTITION_LENGTH;
+
+  while (length * PARTITIONS_PER_FILTER < static_cast<unsigned int>(M))
+    length *= 2;
+
+  return length;
+}
+
+/**
+ * @brief Creates a batched real FFT plan.
+ * @param distance The distance between the rows in real numbers.
+ */
+clfftPlanHandle createBatchPlan(cl_context context, size_t size,
+                                clfftPrecision precision, bool forward,
+                                clfftResultLocation location, size_t batchSize,
+                                size_t distance) {
+  clfftPlanHandle plan;
+  clfftStatus errFFT;
+
+  errFFT = clfftCreateDefaultPlan(&plan, context, CLFFT_1D, &size);
+  checkClfftErrorCode(errFFT, "clfftCreateDefaultPlan()");
+  errFFT = clfftSetPlanPrecision(plan, precision);
+  checkClfftErrorCode(errFFT, "clfftSetPlanPrecision()");
+
+  if (forward)
+    errFFT = clfftSetLayout(plan, CLFFT_REAL, CLFFT_HERMITIAN_INTERLEAVED);
+  else
+    errFFT = clfftSetLayout(plan, CLFFT_HERMITIAN_INTERLEAVED, CLFFT_REAL);
+  checkClfftErrorCode(errFFT, "clfftSetLayout()");
+
+  errFFT = clfftSetResultLocation(plan, location);
+  checkClfftErrorCode(errFFT, "clfftSetResultLocation()");
+  errFFT = clfftSetPlanBatchSize(plan, batchSize);
+  checkClfftErrorCode(errFFT, "clfftSetPlanBatchSize()");
+
+  if (forward)
+    errFFT = clfftSetPlanDistance(plan, distance, distance / 2);
+  else
+    errFFT = clfftSetPlanDistance(plan, distance / 2, distance);
+  checkClfftErrorCode(errFFT, "clfftSetPlanDistance()");
+
+  return plan;
+}
+
+template <class Plans> void destroyPlans(Plans *plans) {
+  clfftStatus errFFT;
+
+  for (auto &e : *plans) {
+    errFFT = clfftDestroyPlan(&e.second.forward);
+    checkClfftErrorCode(errFFT, "clfftDestroyPlan()");
+    errFFT = clfftDestroyPlan(&e.second.inverse);
+    checkClfftErrorCode(errFFT, "clfftDestroyPlan()");
+  }
+
+  plans->clear();
+}
+
+template <class T> clfftPrecision precisionOf() {
+  return is_same<double, T>::value ? CLFFT_DOUBLE : CLFFT_SINGLE;
+}
+
+template <class T> void setKernelArg(cl_kernel kernel, cl_uint index, T value) {
+  cl_int err = clSetKernelArg(kernel, index, sizeof(T), &value);
+  checkClErrorCode(err, "clSetKernelArg()");
+}
+
 } // namespace
 
 namespace AlenkaSignal {
@@ -91,10 +164,10 @@ template <class T>
 FilterProcessor<T>::FilterProcessor(unsigned int blockLength,
                                     unsigned int channels,
                                     OpenCLContext *context)
-    : blockLength(blockLength), blockChannels(channels) {
+    : blockLength(blockLength), blockChannels(channels),
+      clContext(context->getCLContext()) {
   assert(blockLength % 2 == 0);
 
-  cl_int err;
   clfftStatus errFFT;
 
   clfftPrecision precision = CLFFT_SINGLE;
@@ -115,15 +188,13 @@ FilterProcessor<T>::FilterProcessor(unsigned int blockLength,
 
   filterKernel = program.createKernel("filter");
   zeroKernel = program.createKernel("zero");
+  segmentKernel = program.createKernel("partitionSegments");
+  accumulateKernel = program.createKernel("partitionAccumulate");
+  gatherKernel = program.createKernel("partitionGather");
 
-  cl_mem_flags flags = CL_MEM_READ_WRITE;
-  filterBuffer = clCreateBuffer(context->getCLContext(), flags,
-                                (blockLength + 2) * sizeof(T), nullptr, &err);
-  checkClErrorCode(err, "clCreateBuffer");
-
-  // Construct the fft plans.
+  // Construct the fft plan for the filter. The plans for the data are made
+  // in getBatchPlans().
   size_t size = blockLength;
-  size_t bufferDistance = size + 2;
 
   errFFT = clfftCreateDefaultPlan(&fftPlan, context->getCLContext(), CLFFT_1D,
                                   &size);
@@ -137,38 +208,6 @@ FilterProcessor<T>::FilterProcessor(unsigned int blockLength,
   errFFT = clfftSetPlanBatchSize(fftPlan, 1);
   checkClfftErrorCode(errFFT, "clfftSetPlanBatchSize()");
   // clfftSetPlanDistance(fftPlan, bufferDistance, bufferDistance/2);
-
-  errFFT = clfftCreateDefaultPlan(&fftPlanBatch, context->getCLContext(),
-                                  CLFFT_1D, &size);
-  checkClfftErrorCode(errFFT, "clfftCreateDefaultPlan()");
-  errFFT = clfftSetPlanPrecision(fftPlanBatch, precision);
-  checkClfftErrorCode(errFFT, "clfftSetPlanPrecision()");
-  errFFT =
-      clfftSetLayout(fftPlanBatch, CLFFT_REAL, CLFFT_HERMITIAN_INTERLEAVED);
-  checkClfftErrorCode(errFFT, "clfftSetLayout()");
-  errFFT = clfftSetResultLocation(fftPlanBatch, CLFFT_OUTOFPLACE);
-  checkClfftErrorCode(errFFT, "clfftSetResultLocation()");
-  errFFT = clfftSetPlanBatchSize(fftPlanBatch, blockChannels);
-  checkClfftErrorCode(errFFT, "clfftSetPlanBatchSize()");
-  errFFT =
-      clfftSetPlanDistance(fftPlanBatch, bufferDistance, bufferDistance / 2);
-  checkClfftErrorCode(errFFT, "clfftSetPlanDistance()");
-
-  errFFT = clfftCreateDefaultPlan(&ifftPlanBatch, context->getCLContext(),
-                                  CLFFT_1D, &size);
-  checkClfftErrorCode(errFFT, "clfftCreateDefaultPlan()");
-  errFFT = clfftSetPlanPrecision(ifftPlanBatch, precision);
-  checkClfftErrorCode(errFFT, "clfftSetPlanPrecision()");
-  errFFT =
-      clfftSetLayout(ifftPlanBatch, CLFFT_HERMITIAN_INTERLEAVED, CLFFT_REAL);
-  checkClfftErrorCode(errFFT, "clfftSetLayout()");
-  errFFT = clfftSetResultLocation(ifftPlanBatch, CLFFT_INPLACE);
-  checkClfftErrorCode(errFFT, "clfftSetResultLocation()");
-  errFFT = clfftSetPlanBatchSize(ifftPlanBatch, blockChannels);
-  checkClfftErrorCode(errFFT, "clfftSetPlanBatchSize()");
-  errFFT =
-      clfftSetPlanDistance(ifftPlanBatch, bufferDistance / 2, bufferDistance);
-  checkClfftErrorCode(errFFT, "clfftSetPlanDistance()");
 }
 
 template <class T> FilterProcessor<T>::~FilterProcessor() {
@@ -177,37 +216,40 @@ template <class T> FilterProcessor<T>::~FilterProcessor() {
   checkClErrorCode(err, "clReleaseKernel()");
   err = clReleaseKernel(zeroKernel);
   checkClErrorCode(err, "clReleaseKernel()");
-  err = clReleaseMemObject(filterBuffer);
-  checkClErrorCode(err, "clReleaseMemObject()");
+  err = clReleaseKernel(segmentKernel);
+  checkClErrorCode(err, "clReleaseKernel()");
+  err = clReleaseKernel(accumulateKernel);
+  checkClErrorCode(err, "clReleaseKernel()");
+  err = clReleaseKernel(gatherKernel);
+  checkClErrorCode(err, "clReleaseKernel()");
+
+  for (const auto &e : spectra) {
+    err = clReleaseMemObject(e.buffer);
+    checkClErrorCode(err, "clReleaseMemObject()");
+  }
 
   clfftStatus errFFT;
   errFFT = clfftDestroyPlan(&fftPlan);
   checkClfftErrorCode(errFFT, "clfftDestroyPlan()");
-  errFFT = clfftDestroyPlan(&fftPlanBatch);
-  checkClfftErrorCode(errFFT, "clfftDestroyPlan()");
-  errFFT = clfftDestroyPlan(&ifftPlanBatch);
-  checkClfftErrorCode(errFFT, "clfftDestroyPlan()");
-}
+  destroyPlans(&batchPlans);
 
-// This version preserves input. TODO: Make another "destructive" version that
-// uses outBuffer as a temporary buffer
-// and copies the result back to inBuffer. This new vesion could then be used
-// with multiple parallel queues at once.
-// This would also require to handle filterBuffer differently: it must be
-// updated before process is used
-// and not wait until it is used for the first time. Then it could be too late
-// as, while it is updating,
-// another parallel queue will already need the buffer.
+  releasePartitions();
+}
 
+// This version preserves input.
 template <class T>
 void FilterProcessor<T>::process(cl_mem inBuffer, cl_mem outBuffer,
-                                 cl_command_queue queue) {
+                                 cl_command_queue queue,
+                                 unsigned int channels) {
   assert(inBuffer != outBuffer &&
          "Input and output bufferes cannot be the same");
 
+  if (channels == 0)
+    channels = blockChannels;
+  assert(channels <= blockChannels);
+
   cl_int err;
-  clfftStatus errFFT;
-  const size_t minSize = (blockLength + 2) * blockChannels * sizeof(T);
+  const size_t minSize = (blockLength + 2) * channels * sizeof(T);
 
   size_t inSize;
   err = clGetMemObjectInfo(inBuffer, CL_MEM_SIZE, sizeof(size_t), &inSize,
@@ -231,7 +273,23 @@ void FilterProcessor<T>::process(cl_mem inBuffer, cl_mem outBuffer,
     throwDetailed(runtime_error(msg));
   }
 
-  if (coefficientsChanged) {
+  if (partitioned())
+    processPartitioned(inBuffer, outBuffer, queue, channels);
+  else
+    processWhole(inBuffer, outBuffer, queue, channels);
+}
+
+template <class T>
+void FilterProcessor<T>::processWhole(cl_mem inBuffer, cl_mem outBuffer,
+                                      cl_command_queue queue,
+                                      unsigned int channels) {
+  cl_int err;
+  clfftStatus errFFT;
+
+  if (coefficientsChanged &&
+      !selectSpectrum((blockLength + 2) * sizeof(T))) {
+    cl_mem filterBuffer = spectra.front().buffer;
+
     err = clEnqueueWriteBuffer(queue, filterBuffer, CL_TRUE, 0, M * sizeof(T),
                                coefficients.data(), 0, nullptr, nullptr);
     checkClErrorCode(err, "clEnqueueWriteBuffer()");
@@ -256,13 +314,17 @@ void FilterProcessor<T>::process(cl_mem inBuffer, cl_mem outBuffer,
 
     // printBuffer("after_filterBuffer.txt", filterBuffer, queue);
   }
+  coefficientsChanged = false;
 
   // OpenCLContext::printBuffer("before_fft.txt", inBuffer, queue);
 
-  // FFT.
-  errFFT =
-      clfftEnqueueTransform(fftPlanBatch, CLFFT_FORWARD, 1, &queue, 0, nullptr,
-                            nullptr, &inBuffer, &outBuffer, nullptr);
+  const BatchPlans &plans = getBatchPlans(channels);
+
+  // FFT. A new filter spectrum computed above is counted in this stage too.
+  errFFT = clfftEnqueueTransform(
+      plans.forward, CLFFT_FORWARD, 1, &queue, 0, nullptr,
+      profiler ? profiler->recordSincePrevious("fft") : nullptr, &inBuffer,
+      &outBuffer, nullptr);
   checkClfftErrorCode(errFFT, "clfftEnqueueTransform");
 
   // OpenCLContext::printBuffer("after_fft.txt", outBuffer, queue);
@@ -271,35 +333,254 @@ void FilterProcessor<T>::process(cl_mem inBuffer, cl_mem outBuffer,
   err = clSetKernelArg(filterKernel, 0, sizeof(cl_mem), &outBuffer);
   checkClErrorCode(err, "clSetKernelArg()");
 
-  err = clSetKernelArg(filterKernel, 1, sizeof(cl_mem), &filterBuffer);
+  err = clSetKernelArg(filterKernel, 1, sizeof(cl_mem),
+                       &spectra.front().buffer);
   checkClErrorCode(err, "clSetKernelArg()");
 
-  size_t globalWorkSize[2] = {blockLength / 2 + 1, blockChannels};
+  size_t globalWorkSize[2] = {blockLength / 2 + 1, channels};
 
-  err = clEnqueueNDRangeKernel(queue, filterKernel, 2, nullptr, globalWorkSize,
-                               nullptr, 0, nullptr, nullptr);
+  err = clEnqueueNDRangeKernel(
+      queue, filterKernel, 2, nullptr, globalWorkSize, nullptr, 0, nullptr,
+      profiler ? profiler->record("multiply") : nullptr);
   checkClErrorCode(err, "clEnqueueNDRangeKernel()");
 
   // OpenCLContext::printBuffer("after_multiply.txt", outBuffer, queue);
 
   // IFFT.
-  errFFT =
-      clfftEnqueueTransform(ifftPlanBatch, CLFFT_BACKWARD, 1, &queue, 0,
-                            nullptr, nullptr, &outBuffer, nullptr, nullptr);
+  errFFT = clfftEnqueueTransform(
+      plans.inverse, CLFFT_BACKWARD, 1, &queue, 0, nullptr,
+      profiler ? profiler->recordSincePrevious("ifft") : nullptr, &outBuffer,
+      nullptr, nullptr);
   checkClfftErrorCode(errFFT, "clfftEnqueueTransform");
 
   // OpenCLContext::printBuffer("after_ifft.txt", outBuffer, queue);
 }
 
 template <class T>
-void FilterProcessor<T>::changeSampleFilter(int M,
-                                            const std::vector<T> &samples) {
+void FilterProcessor<T>::processPartitioned(cl_mem inBuffer, cl_mem outBuffer,
+                                            cl_command_queue queue,
+                                            unsigned int channels) {
+  cl_int err;
+  clfftStatus errFFT;
+
+  if (coefficientsChanged) {
+    const unsigned int length = partitionLengthFor(M);
+
+    if (length != partitionLength ||
+        (M + length - 1) / length != partitionCount)
+      createPartitions(length);
+
+    const unsigned int distance = 2 * partitionLength + 2;
+
+    if (!selectSpectrum(partitionCount * distance * sizeof(T))) {
+      // Zero-pad every partition to the FFT size, and transform them all.
+      cl_mem partitionBuffer = spectra.front().buffer;
+      vector<T> partitions(partitionCount * distance, 0);
+
+      for (int i = 0; i < M; ++i)
+        partitions[i / partitionLength * distance + i % partitionLength] =
+            coefficients[i];
+
+      err = clEnqueueWriteBuffer(queue, partitionBuffer, CL_TRUE, 0,
+                                 partitions.size() * sizeof(T),
+                                 partitions.data(), 0, nullptr, nullptr);
+      checkClErrorCode(err, "clEnqueueWriteBuffer()");
+
+      errFFT = clfftEnqueueTransform(partitionPlan, CLFFT_FORWARD, 1, &queue,
+                                     0, nullptr, nullptr, &partitionBuffer,
+                                     nullptr, nullptr);
+      checkClfftErrorCode(errFFT, "clfftEnqueueTransform");
+    }
+
+    coefficientsChanged = false;
+  }
+
+  const cl_int length = blockLength, L = partitionLength,
+               P = partitionCount;
+
+  // Split the input into overlapping segments.
+  setKernelArg(segmentKernel, 0, inBuffer);
+  setKernelArg(segmentKernel, 1, segmentBuffer);
+  setKernelArg(segmentKernel, 2, length);
+  setKernelArg(segmentKernel, 3, L);
+
+  size_t segmentSize[3] = {2 * partitionLength, segmentCount, channels};
+  err = clEnqueueNDRangeKernel(
+      queue, segmentKernel, 3, nullptr, segmentSize, nullptr, 0, nullptr,
+      profiler ? profiler->record("segment") : nullptr);
+  checkClErrorCode(err, "clEnqueueNDRangeKernel()");
+
+  const BatchPlans &plans = getSegmentPlans(channels);
+
+  // FFT.
+  errFFT = clfftEnqueueTransform(
+      plans.forward, CLFFT_FORWARD, 1, &queue, 0, nullptr,
+      profiler ? profiler->recordSincePrevious("fft") : nullptr, &segmentBuffer,
+      nullptr, nullptr);
+  checkClfftErrorCode(errFFT, "clfftEnqueueTransform");
+
+  // Multiply and accumulate.
+  setKernelArg(accumulateKernel, 0, segmentBuffer);
+  setKernelArg(accumulateKernel, 1, spectra.front().buffer);
+  setKernelArg(accumulateKernel, 2, accumulatorBuffer);
+  setKernelArg(accumulateKernel, 3, P);
+
+  size_t binSize[3] = {partitionLength + 1, segmentCount, channels};
+  err = clEnqueueNDRangeKernel(
+      queue, accumulateKernel, 3, nullptr, binSize, nullptr, 0, nullptr,
+      profiler ? profiler->record("multiply") : nullptr);
+  checkClErrorCode(err, "clEnqueueNDRangeKernel()");
+
+  // IFFT.
+  errFFT = clfftEnqueueTransform(
+      plans.inverse, CLFFT_BACKWARD, 1, &queue, 0, nullptr,
+      profiler ? profiler->recordSincePrevious("ifft") : nullptr,
+      &accumulatorBuffer, nullptr, nullptr);
+  checkClfftErrorCode(errFFT, "clfftEnqueueTransform");
+
+  // Put the valid parts of the segments together.
+  setKernelArg(gatherKernel, 0, accumulatorBuffer);
+  setKernelArg(gatherKernel, 1, outBuffer);
+  setKernelArg(gatherKernel, 2, length);
+  setKernelArg(gatherKernel, 3, L);
+
+  size_t gatherSize[3] = {partitionLength, segmentCount, channels};
+  err = clEnqueueNDRangeKernel(queue, gatherKernel, 3, nullptr, gatherSize,
+                               nullptr, 0, nullptr,
+                               profiler ? profiler->record("gather") : nullptr);
+  checkClErrorCode(err, "clEnqueueNDRangeKernel()");
+}
+
+template <class T>
+void FilterProcessor<T>::createPartitions(unsigned int length) {
+  releasePartitions();
+
+  partitionLength = length;
+  partitionCount = (M + length - 1) / length;
+  segmentCount = (blockLength + length - 1) / length;
+
+  cl_int err;
+  const size_t distance = 2 * length + 2;
+  const size_t segmentRows = segmentCount * blockChannels;
+
+  segmentBuffer =
+      clCreateBuffer(clContext, CL_MEM_READ_WRITE,
+                     segmentRows * distance * sizeof(T), nullptr, &err);
+  checkClErrorCode(err, "clCreateBuffer");
+
+  accumulatorBuffer =
+      clCreateBuffer(clContext, CL_MEM_READ_WRITE,
+                     segmentRows * distance * sizeof(T), nullptr, &err);
+  checkClErrorCode(err, "clCreateBuffer");
+
+  partitionPlan = createBatchPlan(clContext, 2 * length, precisionOf<T>(),
+                                  true, CLFFT_INPLACE, partitionCount,
+                                  distance);
+}
+
+template <class T>
+const typename FilterProcessor<T>::BatchPlans &
+FilterProcessor<T>::getBatchPlans(unsigned int channels) {
+  auto it = batchPlans.find(channels);
+
+  if (it == batchPlans.end()) {
+    const size_t distance = blockLength + 2;
+    BatchPlans plans;
+
+    plans.forward =
+        createBatchPlan(clContext, blockLength, precisionOf<T>(), true,
+                        CLFFT_OUTOFPLACE, channels, distance);
+    plans.inverse =
+        createBatchPlan(clContext, blockLength, precisionOf<T>(), false,
+                        CLFFT_INPLACE, channels, distance);
+
+    it = batchPlans.emplace(channels, plans).first;
+  }
+
+  return it->second;
+}
+
+template <class T>
+const typename FilterProcessor<T>::BatchPlans &
+FilterProcessor<T>::getSegmentPlans(unsigned int channels) {
+  auto it = segmentPlans.find(channels);
+
+  if (it == segmentPlans.end()) {
+    const size_t size = 2 * partitionLength, distance = size + 2,
+                 batchSize = segmentCount * channels;
+    BatchPlans plans;
+
+    plans.forward = createBatchPlan(clContext, size, precisionOf<T>(), true,
+                                    CLFFT_INPLACE, batchSize, distance);
+    plans.inverse = createBatchPlan(clContext, size, precisionOf<T>(), false,
+                                    CLFFT_INPLACE, batchSize, distance);
+
+    it = segmentPlans.emplace(channels, plans).first;
+  }
+
+  return it->second;
+}
+
+template <class T> bool FilterProcessor<T>::selectSpectrum(size_t size) {
+  for (auto it = spectra.begin(); it != spectra.end(); ++it) {
+    if (it->coefficients == coefficients) {
+      spectra.splice(spectra.begin(), spectra, it);
+      return true;
+    }
+  }
+
+  // The buffers of all spectra have the same size for the same M and
+  // blockLength, so the least recently used one can be recycled.
+  cl_mem buffer = nullptr;
+  if (SPECTRUM_CACHE_SIZE <= spectra.size()) {
+    size_t oldSize;
+    cl_int err = clGetMemObjectInfo(spectra.back().buffer, CL_MEM_SIZE,
+                                    sizeof(size_t), &oldSize, nullptr);
+    checkClErrorCode(err, "clGetMemObjectInfo");
+
+    if (oldSize == size) {
+      buffer = spectra.back().buffer;
+    } else {
+      err = clReleaseMemObject(spectra.back().buffer);
+      checkClErrorCode(err, "clReleaseMemObject()");
+    }
+
+    spectra.pop_back();
+  }
+
+  if (!buffer) {
+    cl_int err;
+    buffer = clCreateBuffer(clContext, CL_MEM_READ_WRITE, size, nullptr, &err);
+    checkClErrorCode(err, "clCreateBuffer");
+  }
+
+  spectra.push_front(Spectrum{coefficients, buffer});
+  return false;
+}
+
+template <class T> void FilterProcessor<T>::releasePartitions() {
+  if (!segmentBuffer)
+    return;
+
+  cl_int err;
+  err = clReleaseMemObject(segmentBuffer);
+  checkClErrorCode(err, "clReleaseMemObject()");
+  err = clReleaseMemObject(accumulatorBuffer);
+  checkClErrorCode(err, "clReleaseMemObject()");
+  segmentBuffer = accumulatorBuffer = nullptr;
+
+  clfftStatus errFFT = clfftDestroyPlan(&partitionPlan);
+  checkClfftErrorCode(errFFT, "clfftDestroyPlan()");
+  destroyPlans(&segmentPlans);
+}
+
+template <class T>
+vector<T>
+FilterProcessor<T>::sampleFilterCoefficients(int M,
+                                             const std::vector<T> &samples) {
   assert((int)samples.size() == (M + 1) / 2 &&
          "Assure the right number of samples was provided.");
 
-  coefficientsChanged = true;
-  this->M = M;
-
   int cM = 1 + M / 2;
 
   alglib::complex_1d_array inArray;
@@ -338,23 +619,24 @@ void FilterProcessor<T>::changeSampleFilter(int M,
   outArray.setlength(M);
   alglib::fftr1dinv(inArray, M, outArray);
 
-  coefficients.resize(M);
+  vector<T> coefficients(M);
   for (int i = 0; i < M; ++i)
     coefficients[i] = static_cast<T>(outArray[i]);
+
+  return coefficients;
 }
 
 template <class T>
-void FilterProcessor<T>::applyWindow(WindowFunction windowFunction) {
-  // TODO: Perhaps apply the window function on the GPU as an optimization.
-  assert(static_cast<int>(coefficients.size()) == M);
-  coefficientsChanged = true;
+void FilterProcessor<T>::applyWindow(vector<T> *coefficients,
+                                     WindowFunction windowFunction) {
+  const int M = static_cast<int>(coefficients->size());
 
   if (windowFunction == WindowFunction::Hamming) {
     for (int i = 0; i < M; ++i)
-      coefficients[i] *= hammingWindow<T>(i, M);
+      (*coefficients)[i] *= hammingWindow<T>(i, M);
   } else if (windowFunction == WindowFunction::Blackman) {
     for (int i = 0; i < M; ++i)
-      coefficients[i] *= blackmanWindow<T>(i, M);
+      (*coefficients)[i] *= blackmanWindow<T>(i, M);
   }
 }
 
@@ -0,0 +1,209 @@
+#include "../include/AlenkaSignal/iirfilterprocessor.h"
+
+#include "../include/AlenkaSignal/kernelprofiler.h"
+#include "../include/AlenkaSignal/openclcontext.h"
+#include "../include/AlenkaSignal/openclprogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+#include <detailedexception.h>
+
+using namespace std;
+
+namespace {
+
+// Defines const char* KERNELS_SOURCE.
+#include "kernels.cl"
+
+// The same as the kernel, but with zero initial state.
+void filterForward(const vector<AlenkaSignal::Biquad> &sections,
+                   vector<double> *signal) {
+  for (const auto &c : sections) {
+    double z1 = 0, z2 = 0;
+
+    for (double &e : *signal) {
+      const double x = e, y = c.b0 * x + z1;
+      z1 = c.b1 * x - c.a1 * y + z2;
+      z2 = c.b2 * x - c.a2 * y;
+      e = y;
+    }
+  }
+}
+
+// Returns the larger magnitude of the roots of z^2 + a1*z + a2.
+double poleRadius(const AlenkaSignal::Biquad &c) {
+  const double discriminant = c.a1 * c.a1 - 4 * c.a2;
+
+  if (discriminant < 0)
+    return sqrt(c.a2); // A complex conjugate pair.
+
+  const double root = sqrt(discriminant);
+  return max(fabs(-c.a1 + root), fabs(-c.a1 - root)) / 2;
+}
+
+template <class T> void setKernelArg(cl_kernel kernel, cl_uint index, T value) {
+  cl_int err = clSetKernelArg(kernel, index, sizeof(T), &value);
+  checkClErrorCode(err, "clSetKernelArg()");
+}
+
+} // namespace
+
+namespace AlenkaSignal {
+
+template <class T>
+IirFilterProcessor<T>::IirFilterProcessor(unsigned int blockLength,
+                                          unsigned int channels,
+                                          OpenCLContext *context)
+    : blockLength(blockLength), blockChannels(channels),
+      clContext(context->getCLContext()) {
+  string kernelsSource;
+
+  if (is_same<double, T>::value)
+    kernelsSource = "#define float double\n#define float2 double2\n\n";
+
+  kernelsSource += KERNELS_SOURCE;
+  OpenCLProgram program(kernelsSource, context);
+
+  if (CL_SUCCESS != program.compileStatus()) {
+    const string msg = "IIR filter processor kernels";
+    throwDetailed(runtime_error(program.makeErrorMessage(msg)));
+  }
+
+  filtfiltKernel = program.createKernel("iirFiltfilt");
+
+  cl_int err;
+  sectionBuffer =
+      clCreateBuffer(clContext, CL_MEM_READ_ONLY,
+                     5 * MAX_SECTIONS * sizeof(T), nullptr, &err);
+  checkClErrorCode(err, "clCreateBuffer");
+}
+
+template <class T> IirFilterProcessor<T>::~IirFilterProcessor() {
+  cl_int err;
+  err = clReleaseKernel(filtfiltKernel);
+  checkClErrorCode(err, "clReleaseKernel()");
+  err = clReleaseMemObject(sectionBuffer);
+  checkClErrorCode(err, "clReleaseMemObject()");
+}
+
+template <class T>
+void IirFilterProcessor<T>::process(cl_mem inBuffer, cl_mem outBuffer,
+                                    cl_command_queue queue,
+                                    unsigned int channels) {
+  if (channels == 0)
+    channels = blockChannels;
+  assert(channels <= blockChannels);
+
+  cl_int err;
+  const size_t minSize = (blockLength + 2) * channels * sizeof(T);
+
+  size_t inSize;
+  err = clGetMemObjectInfo(inBuffer, CL_MEM_SIZE, sizeof(size_t), &inSize,
+                           nullptr);
+  checkClErrorCode(err, "clGetMemObjectInfo");
+
+  if (inSize < minSize) {
+    const string msg = "The input buffer is too small: expected at least " +
+                       to_string(minSize) + ", got " + to_string(inSize);
+    throwDetailed(runtime_error(msg));
+  }
+
+  size_t outSize;
+  err = clGetMemObjectInfo(outBuffer, CL_MEM_SIZE, sizeof(size_t), &outSize,
+                           nullptr);
+  checkClErrorCode(err, "clGetMemObjectInfo");
+
+  if (outSize < minSize) {
+    const string msg = "The output buffer is too small: expected at least " +
+                       to_string(minSize) + ", got " + to_string(outSize);
+    throwDetailed(runtime_error(msg));
+  }
+
+  if (sectionsChanged) {
+    sectionsChanged = false;
+
+    vector<T> coefficients;
+    for (const auto &e : sections) {
+      for (double c : {e.b0, e.b1, e.b2, e.a1, e.a2})
+        coefficients.push_back(static_cast<T>(c));
+    }
+
+    if (!coefficients.empty()) {
+      err = clEnqueueWriteBuffer(queue, sectionBuffer, CL_TRUE, 0,
+                                 coefficients.size() * sizeof(T),
+                                 coefficients.data(), 0, nullptr, nullptr);
+      checkClErrorCode(err, "clEnqueueWriteBuffer()");
+    }
+  }
+
+  const cl_int sectionCount = static_cast<cl_int>(sections.size()),
+               length = blockLength, delay = delaySamples();
+
+  setKernelArg(filtfiltKernel, 0, inBuffer);
+  setKernelArg(filtfiltKernel, 1, outBuffer);
+  setKernelArg(filtfiltKernel, 2, sectionBuffer);
+  setKernelArg(filtfiltKernel, 3, sectionCount);
+  setKernelArg(filtfiltKernel, 4, length);
+  setKernelArg(filtfiltKernel, 5, delay);
+
+  size_t globalWorkSize = channels;
+  err = clEnqueueNDRangeKernel(queue, filtfiltKernel, 1, nullptr,
+                               &globalWorkSize, nullptr, 0, nullptr,
+                               profiler ? profiler->record("iir") : nullptr);
+  checkClErrorCode(err, "clEnqueueNDRangeKernel()");
+}
+
+template <class T>
+void IirFilterProcessor<T>::changeFilter(const vector<Biquad> &sections,
+                                         int discard) {
+  if (MAX_SECTIONS < static_cast<int>(sections.size()))
+    throwDetailed(runtime_error("Too many IIR filter sections: " +
+                                to_string(sections.size())));
+
+  assert(0 <= discard && discard < static_cast<int>(blockLength));
+
+  this->sections = sections;
+  this->discard = discard;
+  sectionsChanged = true;
+}
+
+template <class T>
+int IirFilterProcessor<T>::warmUpSamples(const vector<Biquad> &sections) {
+  const double RESIDUE = 1e-3;
+
+  double radius = 0;
+  for (const auto &e : sections)
+    radius = max(radius, poleRadius(e));
+
+  if (radius <= 0)
+    return 0;
+  if (1 <= radius)
+    return numeric_limits<int>::max(); // Unstable; it never dies out.
+
+  const double samples = ceil(log(RESIDUE) / log(radius));
+  return static_cast<int>(
+      min(samples, static_cast<double>(numeric_limits<int>::max())));
+}
+
+template <class T>
+vector<T> IirFilterProcessor<T>::impulseResponse(const vector<Biquad> &sections,
+                                                 int delay) {
+  // The impulse needs a margin of delay samples on both sides, the same as
+  // the samples kept from a block.
+  vector<double> signal(4 * delay + 1, 0);
+  signal[2 * delay] = 1;
+
+  filterForward(sections, &signal);
+  reverse(signal.begin(), signal.end());
+  filterForward(sections, &signal);
+
+  return vector<T>(signal.begin() + delay, signal.end() - delay);
+}
+
+template class IirFilterProcessor<float>;
+template class IirFilterProcessor<double>;
+
+} // namespace AlenkaSignal
@@ -0,0 +1,154 @@
+#include "../include/AlenkaSignal/kernelprofiler.h"
+
+#include "../include/AlenkaSignal/openclcontext.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+cl_ulong profilingInfo(cl_event event, cl_profiling_info name) {
+  cl_ulong value;
+  cl_int err =
+      clGetEventProfilingInfo(event, name, sizeof(cl_ulong), &value, nullptr);
+  checkClErrorCode(err, "clGetEventProfilingInfo()");
+  return value;
+}
+
+string quoteCsv(const string &field) {
+  if (field.find_first_of(",\"\n") == string::npos)
+    return field;
+
+  string quoted = "\"";
+  for (char c : field) {
+    if (c == '"')
+      quoted += '"';
+    quoted += c;
+  }
+  return quoted + '"';
+}
+
+} // namespace
+
+namespace AlenkaSignal {
+
+KernelProfiler::~KernelProfiler() { clear(); }
+
+cl_event *KernelProfiler::record(const string &stage, int track) {
+  records.push_back(Record{stage, track, false});
+  return &records.back().event;
+}
+
+cl_event *KernelProfiler::recordSincePrevious(const string &stage) {
+  records.push_back(Record{stage, -1, true});
+  return &records.back().event;
+}
+
+void KernelProfiler::record(const string &stage, cl_event event, int track) {
+  cl_int err = clRetainEvent(event);
+  checkClErrorCode(err, "clRetainEvent()");
+
+  *record(stage, track) = event;
+}
+
+void KernelProfiler::collect(const vector<string> &trackNames) {
+  vector<cl_event> events;
+  for (const Record &r : records) {
+    if (r.event)
+      events.push_back(r.event);
+  }
+
+  if (!events.empty()) {
+    cl_int err = clWaitForEvents(static_cast<cl_uint>(events.size()),
+                                 events.data());
+    checkClErrorCode(err, "clWaitForEvents()");
+  }
+
+  cl_ulong previousEnd = 0;
+
+  for (const Record &r : records) {
+    // The command failed to enqueue, so there is nothing to measure.
+    if (!r.event) {
+      previousEnd = 0;
+      continue;
+    }
+
+    cl_ulong start = profilingInfo(r.event, CL_PROFILING_COMMAND_START);
+    const cl_ulong end = profilingInfo(r.event, CL_PROFILING_COMMAND_END);
+
+    if (r.sincePrevious && 0 < previousEnd && previousEnd < start)
+      start = previousEnd;
+    previousEnd = end;
+
+    string track;
+    if (0 <= r.track) {
+      if (r.track < static_cast<int>(trackNames.size()))
+        track = trackNames[r.track];
+      else
+        track = to_string(r.track);
+    }
+
+    Stat &s = stats[make_pair(r.stage, track)];
+    const double seconds = (end - start) / 1e9;
+    ++s.count;
+    s.total += seconds;
+    s.max = max(s.max, seconds);
+  }
+
+  for (cl_event e : events) {
+    cl_int err = clReleaseEvent(e);
+    checkClErrorCode(err, "clReleaseEvent()");
+  }
+  records.clear();
+}
+
+double KernelProfiler::total(const string &stage, const string &track) const {
+  auto it = stats.find(make_pair(stage, track));
+  return it == stats.end() ? 0 : it->second.total;
+}
+
+int KernelProfiler::count(const string &stage, const string &track) const {
+  auto it = stats.find(make_pair(stage, track));
+  return it == stats.end() ? 0 : it->second.count;
+}
+
+void KernelProfiler::printCsv(ostream &out, const string &processor,
+                              bool header) const {
+  // The most expensive rows go first.
+  vector<const pair<const pair<string, string>, Stat> *> rows;
+  for (const auto &e : stats)
+    rows.push_back(&e);
+
+  sort(rows.begin(), rows.end(), [](const auto *a, const auto *b) {
+    return a->second.total > b->second.total;
+  });
+
+  const string prefix = processor.empty() ? "" : quoteCsv(processor) + ',';
+
+  if (header) {
+    out << (processor.empty() ? "" : "processor,")
+        << "stage,track,count,total_ms,mean_ms,max_ms\n";
+  }
+
+  for (const auto *e : rows) {
+    const Stat &s = e->second;
+    out << prefix << quoteCsv(e->first.first) << ',' << quoteCsv(e->first.second) << ','
+        << s.count << ',' << 1000 * s.total << ','
+        << 1000 * s.total / s.count << ',' << 1000 * s.max << '\n';
+  }
+}
+
+void KernelProfiler::clear() {
+  for (const Record &r : records) {
+    if (r.event) {
+      cl_int err = clReleaseEvent(r.event);
+      checkClErrorCode(err, "clReleaseEvent()");
+    }
+  }
+
+  records.clear();
+  stats.clear();
+}
+
+} // namespace AlenkaSignal
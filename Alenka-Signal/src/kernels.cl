@@ -1,5 +1,6 @@
 /**
- * @brief Source code for the kernel fuctions used by FilterProcessor.
+ * @brief Source code for the kernel fuctions used by FilterProcessor,
+ * IirFilterProcessor and MontageProcessor.
  *
  * This is included and used as a verbatim string.
  * So everything must be enclosed in R\"()\".
@@ -28,10 +29,152 @@ __kernel void filter(__global float2* a, __global float2* b)
   a[id] = complexMultiply(a[id], b[id0]);
 }
 
+// Copies overlapping segments of 2*L samples with hop L from every input row
+// to separate rows of output, so that they can be transformed in one batch.
+// Samples outside of the input row are set to zero. The rows of both buffers
+// are padded by 2 for the in-place real FFT.
+__kernel void partitionSegments(__global float* input, __global float* output,
+                                int inputLength, int L)
+{
+  int n = get_global_id(0);
+  int segment = get_global_id(1);
+  int channel = get_global_id(2);
+  int segmentCount = get_global_size(1);
+
+  int i = (segment - 1)*L + n;
+  float value = 0;
+
+  if (0 <= i && i < inputLength)
+    value = input[channel*(inputLength + 2) + i];
+
+  output[(channel*segmentCount + segment)*(2*L + 2) + n] = value;
+}
+
+// Sums the products of the segment spectra with the filter partition spectra.
+// The partition p is applied to the segment that is p segments older. This is
+// the frequency-domain delay line of uniformly partitioned convolution.
+__kernel void partitionAccumulate(__global float2* segments,
+                                  __global float2* partitions,
+                                  __global float2* output, int partitionCount)
+{
+  int bin = get_global_id(0);
+  int segment = get_global_id(1);
+  int channel = get_global_id(2);
+  int binCount = get_global_size(0);
+  int first = channel*get_global_size(1);
+
+  float2 sum = (float2)(0, 0);
+
+  for (int p = 0; p < partitionCount && p <= segment; ++p)
+  {
+    float2 x = segments[(first + segment - p)*binCount + bin];
+    sum += complexMultiply(x, partitions[p*binCount + bin]);
+  }
+
+  output[(first + segment)*binCount + bin] = sum;
+}
+
+// Moves the last L samples of every inverse transformed segment to their
+// place in the output rows. The first L samples are the wrapped-around part
+// of the circular convolution, so they are thrown away.
+__kernel void partitionGather(__global float* segments, __global float* output,
+                              int outputLength, int L)
+{
+  int n = get_global_id(0);
+  int segment = get_global_id(1);
+  int channel = get_global_id(2);
+  int segmentCount = get_global_size(1);
+
+  int i = segment*L + n;
+
+  if (i < outputLength)
+  {
+    int j = (channel*segmentCount + segment)*(2*L + 2) + L + n;
+    output[channel*(outputLength + 2) + i] = segments[j];
+  }
+}
+
+#define IIR_MAX_SECTIONS 8
+
+// Sets the state of a transposed direct form II biquad to the steady state for
+// a constant input x. Returns the output in that state.
+inline float iirSteadyState(__global float* c, float x, float* z1, float* z2)
+{
+  float y = x*(c[0] + c[1] + c[2])/(1 + c[3] + c[4]);
+  *z1 = y - c[0]*x;
+  *z2 = c[2]*x - c[4]*y;
+  return y;
+}
+
+// Runs one sample through the cascade of biquads.
+inline float iirStep(__global float* sections, int sectionCount, float x,
+                     float* z1, float* z2)
+{
+  for (int s = 0; s < sectionCount; ++s)
+  {
+    __global float* c = sections + 5*s;
+    float y = c[0]*x + z1[s];
+    z1[s] = c[1]*x - c[3]*y + z2[s];
+    z2[s] = c[2]*x - c[4]*y;
+    x = y;
+  }
+  return x;
+}
+
+// Zero-phase IIR filtering. Every work-item filters one row forward and then
+// backward by the sections (b0, b1, b2, a1, a2). Both passes start in the
+// steady state for the sample at the edge, so the row is effectively padded
+// by its edge values. The backward pass writes sample i to i + delay, which
+// has already been read, so that the result has the same delay as an FIR
+// filter of 2*delay + 1 samples.
+__kernel void iirFiltfilt(__global float* input, __global float* output,
+                          __global float* sections, int sectionCount,
+                          int length, int delay)
+{
+  int row = get_global_id(0);
+  __global float* x = input + row*(length + 2);
+  __global float* y = output + row*(length + 2);
+
+  float z1[IIR_MAX_SECTIONS], z2[IIR_MAX_SECTIONS];
+
+  float level = x[0];
+  for (int s = 0; s < sectionCount; ++s)
+    level = iirSteadyState(sections + 5*s, level, z1 + s, z2 + s);
+
+  for (int i = 0; i < length; ++i)
+    y[i] = iirStep(sections, sectionCount, x[i], z1, z2);
+
+  level = y[length - 1];
+  for (int s = 0; s < sectionCount; ++s)
+    level = iirSteadyState(sections + 5*s, level, z1 + s, z2 + s);
+
+  for (int i = length - 1; 0 <= i; --i)
+  {
+    float value = iirStep(sections, sectionCount, y[i], z1, z2);
+    if (i + delay < length)
+      y[i + delay] = value;
+  }
+}
+
 // Assigns zero to all elements.
 __kernel void zero(__global float* a)
 {
   int id0 = get_global_id(0);
   a[id0] = 0;
 }
+
+// Sums the input channels [from, to] into the row of output with index row.
+// The channels are added in the same order as by sum() in the montage header.
+__kernel void sharedSum(__global float* input, __global float* output,
+                        int inputRowLength, int inputRowOffset, int from,
+                        int to, int row)
+{
+  int id0 = get_global_id(0);
+
+  float sum = 0;
+  for (int i = from; i <= to; ++i)
+    sum += input[inputRowLength*i + inputRowOffset + id0];
+
+  output[get_global_size(0)*row + id0] = sum;
+}
 )";
@@ -5,16 +5,23 @@
 #include "../include/AlenkaSignal/montage.h"
 
 #include "../include/AlenkaSignal/openclcontext.h"
+#include "montagetokenizer.h"
 
 #include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <regex>
+#include <set>
 #include <sstream>
 
 #include <detailedexception.h>
 
 using namespace std;
+using AlenkaSignal::MontageLayout;
+using AlenkaSignal::Token;
+using AlenkaSignal::positionString;
 
 namespace {
 
@@ -41,28 +48,67 @@ string indentLines(const string &text, int indentLevel) {
   return output;
 }
 
-template <class T>
-string buildSource(const string &source, const string &headerSource = "",
-                   const string &additionalParameters = "") {
+// The fixed sizes are defined before everything else. They are part of the
+// source, and so also of the KernelCache key.
+string buildDefines(const MontageLayout &layout) {
+  string src;
+
+  if (0 < layout.inputRowLength)
+    src += "#define FIXED_INPUT_ROW_LENGTH " +
+           to_string(layout.inputRowLength) + "\n";
+  if (0 < layout.inputRowCount)
+    src += "#define FIXED_IN_COUNT " + to_string(layout.inputRowCount) + "\n";
+  if (0 < layout.outputCopyCount)
+    src += "#define FIXED_OUTPUT_COPY_COUNT " +
+           to_string(layout.outputCopyCount) + "\n";
+
+  return src;
+}
+
+// The code shared by all tracks: the helper functions and macros for access to
+// the input, and the type definition for the double version.
+template <class T> string buildPrelude(const MontageLayout &layout) {
   // The NAN value makes the signal line disappear, which makes it apparent that
   // the user made a mistake. But it caused problems during compilation on some
   // platforms, so I replaced it with 0.
-  string src;
+  string src = buildDefines(layout);
 
   if (is_same<T, double>::value)
     src += "#define float double\n\n";
 
   src += R"(
+// The sizes are kernel arguments unless they are fixed at compile time. Then
+// the compiler can fold the addressing and the bounds checks.
+#ifdef FIXED_IN_COUNT
+#define IN_COUNT FIXED_IN_COUNT
+#else
+#define IN_COUNT _inCount_
+#endif
+
+#ifdef FIXED_INPUT_ROW_LENGTH
+#define _INPUT_ROW_LENGTH_ FIXED_INPUT_ROW_LENGTH
+#else
+#define _INPUT_ROW_LENGTH_ _inputRowLength_
+#endif
+
+#ifdef FIXED_OUTPUT_COPY_COUNT
+#define _OUTPUT_COPY_COUNT_ FIXED_OUTPUT_COPY_COUNT
+#else
+#define _OUTPUT_COPY_COUNT_ _outputCopyCount_
+#endif
+
 #define PARA                                                                   \
   __global float *_input_, int _inputRowLength_, int _inputRowOffset_,         \
-     int IN_COUNT, __global float *_xyz_, int drawIndex, int INDEX
-#define PASS _input_, _inputRowLength_, _inputRowOffset_, IN_COUNT, _xyz_,     \
-  drawIndex, INDEX
+     int _inCount_, __global float *_xyz_, __global float *_sharedSums_,       \
+     int drawIndex, int INDEX
+#define PASS _input_, _inputRowLength_, _inputRowOffset_, _inCount_, _xyz_,    \
+  _sharedSums_, drawIndex, INDEX
 
 // Input: value of a sample for channel i.
 float in(int i, PARA) {
   if (0 <= i && i < IN_COUNT)
-    return _input_[_inputRowLength_ * i + _inputRowOffset_ + get_global_id(0)];
+    return _input_[_INPUT_ROW_LENGTH_ * i + _inputRowOffset_ +
+                   get_global_id(0)];
   else
     return /*NAN*/ 0;
 }
@@ -91,15 +137,37 @@ float z(int i, PARA) {
     return /*NAN*/ 0;
 }
 #define z(a_) z(a_, PASS)
+
+// Distance between channels i and j. The table of all pairs follows the
+// coordinates in _xyz_ (see MontageProcessor::buildXyzBuffer()), so the square
+// root is computed only for channels out of range.
+float _dist_(int i, int j, PARA) {
+  if (0 <= i && i < IN_COUNT && 0 <= j && j < IN_COUNT)
+    return _xyz_[3 * IN_COUNT + IN_COUNT * i + j];
+  else
+    return sqrt(pown(x(i) - x(j), 2) + pown(y(i) - y(j), 2) +
+                pown(z(i) - z(j), 2));
+}
+#define _dist_(a_, b_) _dist_(a_, b_, PASS)
+
+// Sum k of those computed once per block for all tracks (see shareSums()).
+float _sharedSum_(int k, PARA) {
+  return _sharedSums_[get_global_size(0) * k + get_global_id(0)];
+}
+#define _sharedSum_(a_) _sharedSum_(a_, PASS)
 )";
-  src += headerSource;
-  src += R"(
+
+  return src;
+}
+
+string buildKernel(const string &source, const string &additionalParameters) {
+  string src = R"(
 
 __kernel void montage(__global float *_input_, __global float *_output_,
                       int _inputRowLength_, int _inputRowOffset_,
-                      int IN_COUNT, int _outputRowLength_, int drawIndex,
+                      int _inCount_, int _outputRowLength_, int drawIndex,
                       int INDEX, int _outputCopyCount_,
-                      __global float *_xyz_)";
+                      __global float *_xyz_, __global float *_sharedSums_)";
   src += additionalParameters + R"() {
   float out = 0;
 
@@ -108,9 +176,9 @@ __kernel void montage(__global float *_input_, __global float *_output_,
   src += indentLines(source, 2);
   src += R"(  }
 
-  int outputIndex = _outputCopyCount_ *
+  int outputIndex = _OUTPUT_COPY_COUNT_ *
                     (_outputRowLength_ * drawIndex + get_global_id(0));
-  for (int i = 0; i < _outputCopyCount_; ++i) {
+  for (int i = 0; i < _OUTPUT_COPY_COUNT_; ++i) {
     _output_[outputIndex + i] = out;
   }
 })";
@@ -118,6 +186,76 @@ __kernel void montage(__global float *_input_, __global float *_output_,
   return src;
 }
 
+template <class T>
+string buildSource(const string &source, const string &headerSource = "",
+                   const string &additionalParameters = "",
+                   const MontageLayout &layout = MontageLayout()) {
+  return buildPrelude<T>(layout) + headerSource +
+         buildKernel(source, additionalParameters);
+}
+
+/**
+ * @brief Replaces the bodies of top-level function definitions with ';'.
+ *
+ * What is left are the prototypes, macros and type definitions, i.e. what a
+ * track needs to be compiled separately from the header. Comments must be
+ * already removed.
+ */
+string makeDeclarations(const string &source) {
+  string output;
+  output.reserve(source.size());
+
+  int depth = 0;
+  bool skipping = false, lineStart = true;
+  char lastSignificant = 0;
+  const size_t n = source.size();
+
+  for (size_t i = 0; i < n; ++i) {
+    const char c = source[i];
+
+    if (lineStart && c == '#') {
+      // Copy the whole preprocessor directive including continuation lines.
+      size_t end = i;
+      while (end < n && !(source[end] == '\n' && source[end - 1] != '\\'))
+        ++end;
+
+      output.append(source, i, end - i);
+      i = end - 1;
+      continue;
+    }
+
+    if (c == '\n')
+      lineStart = true;
+    else if (!isspace(static_cast<unsigned char>(c)))
+      lineStart = false;
+
+    if (c == '{') {
+      if (depth == 0 && lastSignificant == ')')
+        skipping = true;
+
+      ++depth;
+    } else if (c == '}') {
+      --depth;
+
+      if (skipping && depth == 0) {
+        skipping = false;
+        output += ';';
+        lastSignificant = ';';
+        continue;
+      }
+    }
+
+    if (!skipping) {
+      output += c;
+
+      if (!isspace(static_cast<unsigned char>(c)))
+        lastSignificant = c;
+    }
+  }
+
+  return output;
+}
+
 /**
  * @brief Tries to match an identity-montage.
  *
@@ -284,13 +422,347 @@ string replaceLabels(const string &source, const vector<string> &labels,
   return "";
 }
 
+bool isOperator(const Token &t) {
+  return t.kind == Token::Punctuator && t.text != "++" && t.text != "--" &&
+         t.text != "(" && t.text != ")" && t.text != "[" && t.text != "]" &&
+         t.text != "{" && t.text != "}" && t.text != ";" && t.text != ".";
+}
+
+bool isClosing(const Token &t) {
+  return t.kind == Token::Punctuator &&
+         (t.text == ")" || t.text == "]" || t.text == "}" || t.text == ";" ||
+          t.text == ",");
+}
+
+bool parseTokens(const vector<Token> &tokens, string *error) {
+  vector<const Token *> brackets;
+
+  for (size_t i = 0; i < tokens.size(); ++i) {
+    const Token &t = tokens[i];
+    const Token *previous = i > 0 ? &tokens[i - 1] : nullptr;
+    const Token *next = i + 1 < tokens.size() ? &tokens[i + 1] : nullptr;
+    const string where = positionString(t.line, t.column);
+
+    if (t.kind == Token::String) {
+      // Strings are only allowed as labels, i.e. arguments of a function call.
+      const bool inCall = !brackets.empty() && brackets.back()->text == "(" &&
+                          brackets.back() != &tokens[0] &&
+                          (brackets.back() - 1)->kind == Token::Identifier;
+      const bool argument =
+          previous && (previous->text == "(" || previous->text == ",");
+
+      if (!inCall || !argument) {
+        *error = where + "a string can only be used as a label, e.g. " +
+                 "in(\"Fp1\")";
+        return false;
+      }
+      continue;
+    }
+
+    if (t.kind != Token::Punctuator)
+      continue;
+
+    if (t.text == "(" || t.text == "[" || t.text == "{") {
+      brackets.push_back(&t);
+
+      if (t.text == "(" && next && next->text == ")" &&
+          (!previous || previous->kind != Token::Identifier)) {
+        *error = where + "empty parentheses";
+        return false;
+      }
+    } else if (t.text == ")" || t.text == "]" || t.text == "}") {
+      const string open = t.text == ")" ? "(" : t.text == "]" ? "[" : "{";
+
+      if (brackets.empty() || brackets.back()->text != open) {
+        *error = where + "unmatched '" + t.text + "'";
+        return false;
+      }
+      brackets.pop_back();
+    } else if (isOperator(t) && (!next || isClosing(*next))) {
+      *error = where + "expected an expression after '" + t.text + "'";
+      return false;
+    }
+  }
+
+  if (!brackets.empty()) {
+    const Token *t = brackets.back();
+    *error = positionString(t->line, t->column) + "'" + t->text +
+             "' is never closed";
+    return false;
+  }
+
+  if (!tokens.empty() && tokens.back().text != ";" &&
+      tokens.back().text != "}") {
+    const Token &t = tokens.back();
+    *error = positionString(t.line, t.column) + "missing ';' at the end";
+    return false;
+  }
+
+  return true;
+}
+
+// Matches calls of the sum functions of the default montage header with
+// integer literals or labels for arguments. Group 1 is the name of the
+// functions without parameters, groups 2 and 3 are the arguments of sum().
+const char *const SUM_CALL_PATTERN =
+    R"(\b(?:(sumAll|average)\s*\(\s*\)|sum\s*\(\s*(\d+|"(?:[^\\"]|\\.)*")\s*)"
+    R"(,\s*(\d+|"(?:[^\\"]|\\.)*")\s*\)))";
+
+int sumArgument(const string &argument, const vector<string> &labels) {
+  if (argument[0] != '"')
+    return argument.size() < 10 ? stoi(argument) : numeric_limits<int>::max();
+
+  auto it = find(labels.begin(), labels.end(),
+                 argument.substr(1, argument.size() - 2));
+  return it == labels.end() ? -1
+                            : static_cast<int>(distance(labels.begin(), it));
+}
+
+// Returns false if the call sums no channels.
+bool sumRange(const smatch &m, const vector<string> &labels, int inputRowCount,
+              pair<int, int> *range) {
+  if (m[1].matched) {
+    *range = make_pair(0, inputRowCount - 1);
+  } else {
+    // Channels out of range read as zeros, so they can be left out.
+    range->first = max(0, sumArgument(m[2], labels));
+    range->second = min(inputRowCount - 1, sumArgument(m[3], labels));
+  }
+
+  return range->first <= range->second;
+}
+
+// Defines const char* DEFAULT_MONTAGE_HEADER; generated by CMake from
+// montageheader.cl.in.
+#include "montageheader.cl"
+
+// The functions CpuMontage and shareSums() implement natively, and the ones
+// they depend on. The names of the prelude are included too: the default
+// header doesn't redefine them.
+const char *const BUILTIN_NAMES[] = {
+    "label", "contains", "sumSkip", "sum", "sumAll", "sumArr", "average",
+    "dist", "distAverage", "distAverageLinear", "in", "x", "y", "z",
+    "_dist_", "_sharedSum_", "IN_COUNT", "INDEX"};
+
+bool isIdentifierChar(char c) {
+  return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+// Removes whitespace except where it separates two identifiers or numbers.
+string normalizeSpace(const string &code) {
+  string output;
+  bool space = false;
+
+  for (char c : code) {
+    if (isspace(static_cast<unsigned char>(c))) {
+      space = true;
+      continue;
+    }
+
+    if (space && !output.empty() && isIdentifierChar(output.back()) &&
+        isIdentifierChar(c))
+      output += ' ';
+
+    output += c;
+    space = false;
+  }
+
+  return output;
+}
+
+// Returns the index of the bracket that closes the one at position i, or npos.
+size_t matchingBracket(const string &code, size_t i) {
+  const char open = code[i], close = open == '(' ? ')' : '}';
+  int depth = 0;
+
+  for (; i < code.size(); ++i) {
+    if (code[i] == open) {
+      ++depth;
+    } else if (code[i] == close && --depth == 0) {
+      return i;
+    }
+  }
+
+  return string::npos;
+}
+
+/**
+ * @brief Collects all top-level definitions of name in the header.
+ *
+ * These are the function definitions, and the #define and #undef directives
+ * for name, in the order of appearance. Comments must be already removed.
+ */
+string definitionsOf(const string &header, const string &name) {
+  string output;
+  const size_t n = header.size();
+  size_t statementStart = 0;
+  bool lineStart = true;
+
+  for (size_t i = 0; i < n; ++i) {
+    const char c = header[i];
+
+    if (lineStart && c == '#') {
+      size_t end = i;
+      while (end < n && !(header[end] == '\n' && header[end - 1] != '\\'))
+        ++end;
+
+      // Read the command and the identifier, e.g. "define sum".
+      const string directive = header.substr(i, end - i);
+      stringstream ss(directive.substr(1));
+      string command, identifier;
+      ss >> command >> ws;
+      while (ss && isIdentifierChar(static_cast<char>(ss.peek())))
+        identifier += static_cast<char>(ss.get());
+
+      if ((command == "define" || command == "undef") && identifier == name)
+        output += directive + '\n';
+
+      i = end;
+      statementStart = end + 1;
+      continue;
+    }
+
+    if (c == '\n')
+      lineStart = true;
+    else if (!isspace(static_cast<unsigned char>(c)))
+      lineStart = false;
+
+    if (c == ';') {
+      statementStart = i + 1;
+    } else if (c == '{') {
+      // Skip the bodies of structures and functions other than name.
+      const size_t end = matchingBracket(header, i);
+      if (end == string::npos)
+        break;
+
+      i = end;
+      statementStart = end + 1;
+    } else if ((c == '_' || isalpha(static_cast<unsigned char>(c))) &&
+               (i == 0 || !isIdentifierChar(header[i - 1]))) {
+      size_t end = i;
+      while (end < n && isIdentifierChar(header[end]))
+        ++end;
+
+      if (header.compare(i, end - i, name) == 0) {
+        size_t open = end;
+        while (open < n && isspace(static_cast<unsigned char>(header[open])))
+          ++open;
+
+        const size_t close =
+            open < n && header[open] == '(' ? matchingBracket(header, open)
+                                            : string::npos;
+        size_t body = close == string::npos ? n : close + 1;
+        while (body < n && isspace(static_cast<unsigned char>(header[body])))
+          ++body;
+
+        if (body < n && header[body] == '{') {
+          const size_t bodyEnd = matchingBracket(header, body);
+          if (bodyEnd == string::npos)
+            return normalizeSpace(output + header.substr(statementStart));
+
+          output +=
+              header.substr(statementStart, bodyEnd + 1 - statementStart);
+          output += '\n';
+          i = bodyEnd;
+          statementStart = bodyEnd + 1;
+          continue;
+        }
+      }
+
+      i = end - 1;
+    }
+  }
+
+  return normalizeSpace(output);
+}
+
 } // namespace
 
 namespace AlenkaSignal {
 
+const string &defaultMontageHeader() {
+  static const string header = DEFAULT_MONTAGE_HEADER;
+  return header;
+}
+
+bool hasDefaultBuiltins(const string &headerSource) {
+  const string header = Montage<float>::stripComments(headerSource);
+  const string defaultHeader =
+      Montage<float>::stripComments(defaultMontageHeader());
+
+  for (const char *name : BUILTIN_NAMES) {
+    if (definitionsOf(header, name) != definitionsOf(defaultHeader, name))
+      return false;
+  }
+
+  return true;
+}
+
+vector<pair<int, int>> shareSums(vector<string> *code,
+                                 const vector<string> &labels,
+                                 int inputRowCount) {
+  vector<pair<int, int>> sums;
+
+  try {
+    const regex re(SUM_CALL_PATTERN);
+
+    // Count the tracks that use each range.
+    map<pair<int, int>, int> trackCount;
+    for (const string &e : *code) {
+      set<pair<int, int>> used;
+
+      for (sregex_iterator it(e.cbegin(), e.cend(), re), end; it != end;
+           ++it) {
+        pair<int, int> range;
+        if (sumRange(*it, labels, inputRowCount, &range))
+          used.insert(range);
+      }
+
+      for (const auto &range : used)
+        ++trackCount[range];
+    }
+
+    map<pair<int, int>, int> sumIndex;
+    for (const auto &e : trackCount) {
+      if (2 <= e.second) {
+        sumIndex[e.first] = static_cast<int>(sums.size());
+        sums.push_back(e.first);
+      }
+    }
+
+    if (sums.empty())
+      return sums;
+
+    vector<string> rewritten;
+    for (const string &e : *code) {
+      rewritten.push_back(regex_replace_transform(
+          e.cbegin(), e.cend(), re, [&](const smatch &m) -> string {
+            pair<int, int> range;
+            auto it = sumRange(m, labels, inputRowCount, &range)
+                          ? sumIndex.find(range)
+                          : sumIndex.end();
+            if (it == sumIndex.end())
+              return m.str(0);
+
+            const string sum = "_sharedSum_(" + to_string(it->second) + ")";
+            return m[1] == "average" ? "(" + sum + " / IN_COUNT)" : sum;
+          }));
+    }
+
+    *code = std::move(rewritten);
+  } catch (const regex_error &) {
+    // The tracks are left as they are, like when the labels can't be
+    // replaced.
+    sums.clear();
+  }
+
+  return sums;
+}
+
 template <class T>
 Montage<T>::Montage(const string &source, OpenCLContext *context,
-                    const string &headerSource, const vector<string> &labels)
+                    const string &headerSource, const vector<string> &labels,
+                    const MontageLayout &layout)
     : context(context) {
   string src = preprocessSource(source, labels);
 
@@ -298,8 +770,20 @@ Montage<T>::Montage(const string &source, OpenCLContext *context,
     montageType = IdentityMontage;
   else if (parseCopyMontage(src, &copyIndex))
     montageType = CopyMontage;
-  else
-    this->source = stripComments(buildSource<T>(src, headerSource));
+  else {
+    this->source =
+        stripComments(buildSource<T>(src, headerSource, "", layout));
+
+    // The helper functions like in() live in the library. They can only be
+    // specialized for the layout, if they are compiled with the track.
+    if (context->getSeparateCompilation() && !layout.fixed()) {
+      const string prelude =
+          stripComments(buildPrelude<T>(layout) + headerSource);
+      librarySource = prelude;
+      trackSource = makeDeclarations(prelude) +
+                    stripComments(buildKernel(src, ""));
+    }
+  }
 }
 
 template <class T> Montage<T>::~Montage() {
@@ -318,6 +802,20 @@ bool Montage<T>::test(const string &source, OpenCLContext *context,
   return testHeader(source, context, "", errorMessage);
 }
 
+template <class T>
+bool Montage<T>::checkSyntax(const string &source, string *errorMessage) {
+  vector<Token> tokens;
+  string error;
+
+  if (tokenize(source, &tokens, &error) && parseTokens(tokens, &error))
+    return true;
+
+  if (errorMessage)
+    *errorMessage = "Syntax error:\n" + error;
+
+  return false;
+}
+
 /**
  * @brief Remove C and C++ comments from code.
  *
@@ -382,7 +880,13 @@ template <class T> void Montage<T>::buildProgram() {
     buildCopyProgram();
     break;
   case NormalMontage:
-    program = make_unique<OpenCLProgram>(source, context);
+    if (!trackSource.empty())
+      program = buildLinkedProgram();
+
+    // Without separate compilation, or if it fails for whatever reason, build
+    // the whole source. This also gives a complete error message.
+    if (!program)
+      program = make_unique<OpenCLProgram>(source, context);
 
     if (CL_SUCCESS != program->compileStatus()) {
       const string msg = "Kernel " + typeStr<T>();
@@ -395,6 +899,20 @@ template <class T> void Montage<T>::buildProgram() {
   }
 }
 
+template <class T>
+unique_ptr<OpenCLProgram> Montage<T>::buildLinkedProgram() {
+  auto library = context->library(librarySource);
+  if (CL_SUCCESS != library->compileStatus())
+    return nullptr;
+
+  unique_ptr<OpenCLProgram> p(
+      OpenCLProgram::compileAndLink(trackSource, *library, context));
+  if (CL_SUCCESS != p->compileStatus())
+    return nullptr;
+
+  return p;
+}
+
 template <class T> void Montage<T>::buildCopyProgram() {
   const bool isDouble = is_same<T, double>::value;
 
@@ -1,16 +1,84 @@
 #include "../include/AlenkaSignal/montageprocessor.h"
 
+#include "../include/AlenkaSignal/kernelprofiler.h"
 #include "../include/AlenkaSignal/openclcontext.h"
+#include "../include/AlenkaSignal/openclprogram.h"
 
 #include <detailedexception.h>
 
+#include <cmath>
+
 using namespace std;
 
+namespace {
+
+// Defines const char* KERNELS_SOURCE.
+#include "kernels.cl"
+
+template <class T> void setKernelArg(cl_kernel kernel, cl_uint index, T value) {
+  cl_int err = clSetKernelArg(kernel, index, sizeof(T), &value);
+  checkClErrorCode(err, "clSetKernelArg()");
+}
+
+} // namespace
+
 namespace AlenkaSignal {
 
+template <class T> MontageProcessor<T>::~MontageProcessor() {
+  if (sharedSumKernel) {
+    cl_int err = clReleaseKernel(sharedSumKernel);
+    checkClErrorCode(err, "clReleaseKernel()");
+  }
+}
+
+template <class T>
+void MontageProcessor<T>::setSharedSums(const vector<pair<int, int>> &ranges,
+                                        OpenCLContext *context) {
+  sharedSums = ranges;
+
+  if (sharedSums.empty() || sharedSumKernel)
+    return;
+
+  string kernelsSource;
+  if (is_same<double, T>::value)
+    kernelsSource = "#define float double\n#define float2 double2\n\n";
+
+  kernelsSource += KERNELS_SOURCE;
+  OpenCLProgram program(kernelsSource, context);
+
+  if (CL_SUCCESS != program.compileStatus()) {
+    const string msg = "Montage processor kernels";
+    throwDetailed(runtime_error(program.makeErrorMessage(msg)));
+  }
+
+  sharedSumKernel = program.createKernel("sharedSum");
+}
+
+template <class T>
+vector<T> MontageProcessor<T>::buildXyzBuffer(vector<T> xyz,
+                                              int inputRowCount) {
+  const int n = inputRowCount;
+  xyz.resize(3 * n, 0);
+  xyz.resize(xyzBufferSize(n), 0);
+
+  T *table = xyz.data() + 3 * n;
+  for (int i = 0; i < n; ++i) {
+    for (int j = 0; j < i; ++j) {
+      const T dx = xyz[3 * i] - xyz[3 * j];
+      const T dy = xyz[3 * i + 1] - xyz[3 * j + 1];
+      const T dz = xyz[3 * i + 2] - xyz[3 * j + 2];
+
+      table[n * i + j] = table[n * j + i] = sqrt(dx * dx + dy * dy + dz * dz);
+    }
+  }
+
+  return xyz;
+}
+
 template <class T>
 void MontageProcessor<T>::checkBufferSizes(cl_mem inBuffer, cl_mem outBuffer,
                                            cl_mem xyzBuffer,
+                                           cl_mem sharedSumBuffer,
                                            cl_int outputRowLength,
                                            size_t montageSize) {
   size_t inSize;
@@ -43,19 +111,63 @@ void MontageProcessor<T>::checkBufferSizes(cl_mem inBuffer, cl_mem outBuffer,
                            nullptr);
   checkClErrorCode(err, "clGetMemObjectInfo");
 
-  const size_t minXyzSize = inputRowCount * 3 * sizeof(T);
+  const size_t minXyzSize = xyzBufferSize(inputRowCount) * sizeof(T);
   if (xyzSize < minXyzSize) {
     const string msg = "The xyz buffer is too small: expected at least " +
                        to_string(minXyzSize) + ", got " + to_string(xyzSize);
     throwDetailed(runtime_error(msg));
   }
+
+  if (sharedSums.empty())
+    return;
+
+  size_t sharedSumSize = 0;
+  if (sharedSumBuffer) {
+    err = clGetMemObjectInfo(sharedSumBuffer, CL_MEM_SIZE, sizeof(size_t),
+                             &sharedSumSize, nullptr);
+    checkClErrorCode(err, "clGetMemObjectInfo");
+  }
+
+  const size_t minSharedSumSize =
+      outputRowLength * sharedSums.size() * sizeof(T);
+  if (sharedSumSize < minSharedSumSize) {
+    const string msg =
+        "The shared sum buffer is too small: expected at least " +
+        to_string(minSharedSumSize) + ", got " + to_string(sharedSumSize);
+    throwDetailed(runtime_error(msg));
+  }
+}
+
+template <class T>
+void MontageProcessor<T>::computeSharedSums(cl_mem inBuffer,
+                                            cl_mem sharedSumBuffer,
+                                            cl_command_queue queue,
+                                            cl_int outputRowLength,
+                                            cl_int inputRowOffset) {
+  setKernelArg(sharedSumKernel, 0, inBuffer);
+  setKernelArg(sharedSumKernel, 1, sharedSumBuffer);
+  setKernelArg(sharedSumKernel, 2, inputRowLength);
+  setKernelArg(sharedSumKernel, 3, inputRowOffset);
+
+  size_t globalWorkSize = outputRowLength;
+
+  for (unsigned int i = 0; i < sharedSums.size(); ++i) {
+    setKernelArg<cl_int>(sharedSumKernel, 4, sharedSums[i].first);
+    setKernelArg<cl_int>(sharedSumKernel, 5, sharedSums[i].second);
+    setKernelArg<cl_int>(sharedSumKernel, 6, i);
+
+    cl_int err = clEnqueueNDRangeKernel(
+        queue, sharedSumKernel, 1, nullptr, &globalWorkSize, nullptr, 0,
+        nullptr, profiler ? profiler->record("sharedSum") : nullptr);
+    checkClErrorCode(err, "clEnqueueNDRangeKernel()");
+  }
 }
 
 template <class T>
 void MontageProcessor<T>::processOneMontage(
-    cl_mem inBuffer, cl_mem outBuffer, cl_mem xyzBuffer, cl_command_queue queue,
-    cl_int outputRowLength, cl_int inputRowOffset, cl_int index,
-    cl_int montageIndex, cl_kernel kernel, int copyIndex) {
+    cl_mem inBuffer, cl_mem outBuffer, cl_mem xyzBuffer, cl_mem sharedSumBuffer,
+    cl_command_queue queue, cl_int outputRowLength, cl_int inputRowOffset,
+    cl_int index, cl_int montageIndex, cl_kernel kernel, int copyIndex) {
   cl_int err;
   int pi = 0;
 
@@ -89,6 +201,10 @@ void MontageProcessor<T>::processOneMontage(
   err = clSetKernelArg(kernel, pi++, sizeof(cl_mem), &xyzBuffer);
   checkClErrorCode(err, "clSetKernelArg(" << pi << ")");
 
+  // Null is a valid value for tracks that don't read the shared sums.
+  err = clSetKernelArg(kernel, pi++, sizeof(cl_mem), &sharedSumBuffer);
+  checkClErrorCode(err, "clSetKernelArg(" << pi << ")");
+
   if (0 <= copyIndex) {
     err = clSetKernelArg(kernel, pi++, sizeof(cl_int), &copyIndex);
     checkClErrorCode(err, "clSetKernelArg(" << pi << ")");
@@ -96,8 +212,9 @@ void MontageProcessor<T>::processOneMontage(
 
   size_t globalWorkSize = outputRowLength;
 
-  err = clEnqueueNDRangeKernel(queue, kernel, 1, nullptr, &globalWorkSize,
-                               nullptr, 0, nullptr, nullptr);
+  err = clEnqueueNDRangeKernel(
+      queue, kernel, 1, nullptr, &globalWorkSize, nullptr, 0, nullptr,
+      profiler ? profiler->record("montage", index) : nullptr);
   checkClErrorCode(err, "clEnqueueNDRangeKernel()");
 }
 
@@ -0,0 +1,125 @@
+#include "montagetokenizer.h"
+
+#include <algorithm>
+#include <cctype>
+
+using namespace std;
+
+namespace AlenkaSignal {
+
+string positionString(int line, int column) {
+  return "Line " + to_string(line) + ", column " + to_string(column) + ": ";
+}
+
+bool tokenize(const string &source, vector<Token> *tokens, string *error) {
+  const static vector<string> punctuators = {
+      "<<=", ">>=", "++", "--", "<<", ">>", "<=", ">=", "==", "!=", "&&",
+      "||",  "+=",  "-=", "*=", "/=", "%=", "&=", "|=", "^=", "->", "+",
+      "-",   "*",   "/",  "%",  "=",  "<",  ">",  "!",  "&",  "|",  "^",
+      "~",   "?",   ":",  ";",  ",",  ".",  "(",  ")",  "[",  "]",  "{",
+      "}"};
+
+  const size_t n = source.size();
+  size_t i = 0, lineStart = 0;
+  int line = 1;
+  bool firstOnLine = true;
+
+  auto skipTo = [&](size_t end) {
+    for (; i < end; ++i) {
+      if (source[i] == '\n') {
+        ++line;
+        lineStart = i + 1;
+      }
+    }
+  };
+
+  while (i < n) {
+    const char c = source[i];
+    const int column = static_cast<int>(i - lineStart) + 1;
+
+    if (c == '\n') {
+      skipTo(i + 1);
+      firstOnLine = true;
+      continue;
+    }
+    if (isspace(static_cast<unsigned char>(c))) {
+      ++i;
+      continue;
+    }
+
+    if (source.compare(i, 2, "//") == 0) {
+      skipTo(min(n, source.find('\n', i)));
+      continue;
+    }
+    if (source.compare(i, 2, "/*") == 0) {
+      const size_t end = source.find("*/", i + 2);
+      if (end == string::npos) {
+        *error = positionString(line, column) + "unterminated comment";
+        return false;
+      }
+      skipTo(end + 2);
+      continue;
+    }
+
+    if (c == '#' && firstOnLine) {
+      // Preprocessor directives are left to the compiler.
+      skipTo(min(n, source.find('\n', i)));
+      continue;
+    }
+    firstOnLine = false;
+
+    Token token{Token::Punctuator, "", line, column};
+    size_t end = i + 1;
+
+    if (isalpha(static_cast<unsigned char>(c)) || c == '_') {
+      token.kind = Token::Identifier;
+      while (end < n && (isalnum(static_cast<unsigned char>(source[end])) ||
+                         source[end] == '_'))
+        ++end;
+    } else if (isdigit(static_cast<unsigned char>(c)) ||
+               (c == '.' && i + 1 < n &&
+                isdigit(static_cast<unsigned char>(source[i + 1])))) {
+      token.kind = Token::Number;
+      while (end < n) {
+        const char d = source[end];
+        const char prev = static_cast<char>(tolower(source[end - 1]));
+
+        if (isalnum(static_cast<unsigned char>(d)) || d == '.' || d == '_' ||
+            ((d == '+' || d == '-') && (prev == 'e' || prev == 'p')))
+          ++end;
+        else
+          break;
+      }
+    } else if (c == '"' || c == '\'') {
+      token.kind = Token::String;
+      while (end < n && source[end] != c && source[end] != '\n')
+        end += source[end] == '\\' ? 2 : 1;
+
+      if (n <= end || source[end] != c) {
+        *error = positionString(line, column) + "unterminated string literal";
+        return false;
+      }
+      ++end;
+    } else {
+      auto it = find_if(punctuators.begin(), punctuators.end(),
+                        [&](const string &p) {
+                          return source.compare(i, p.size(), p) == 0;
+                        });
+
+      if (it == punctuators.end()) {
+        *error = positionString(line, column) + "unexpected character '" + c +
+                 "'";
+        return false;
+      }
+      end = i + it->size();
+    }
+
+    token.text = source.substr(i, end - i);
+    tokens->push_back(token);
+    i = end;
+  }
+
+  return true;
+}
+
+} // namespace AlenkaSignal
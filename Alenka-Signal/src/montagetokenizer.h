@@ -0,0 +1,35 @@
+#ifndef ALENKASIGNAL_MONTAGETOKENIZER_H
+#define ALENKASIGNAL_MONTAGETOKENIZER_H
+
+#include <string>
+#include <vector>
+
+namespace AlenkaSignal {
+
+/**
+ * @brief A token of the track code.
+ *
+ * This is shared by the syntax check of Montage and by the parser of
+ * CpuMontage.
+ */
+struct Token {
+  enum Kind { Identifier, Number, String, Punctuator } kind;
+  std::string text;
+  int line, column;
+};
+
+/**
+ * @brief Returns the prefix of an error message pointing to the code.
+ */
+std::string positionString(int line, int column);
+
+/**
+ * @brief Splits the track code into tokens, skipping comments and whitespace.
+ * @return False if there is a lexical error.
+ */
+bool tokenize(const std::string &source, std::vector<Token> *tokens,
+              std::string *error);
+
+} // namespace AlenkaSignal
+
+#endif // ALENKASIGNAL_MONTAGETOKENIZER_H
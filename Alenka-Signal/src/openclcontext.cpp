@@ -65,6 +65,8 @@ string deviceInfo(cl_device_id id, cl_device_info name) {
   return string(tmp.begin(), --tmp.end());
 }
 
+const size_t MAX_LIBRARIES = 8;
+
 vector<cl_platform_id> getPlatformIDs() {
   cl_int err;
   cl_uint platformCount;
@@ -141,6 +143,45 @@ OpenCLContext::~OpenCLContext() {
   // logToFile("OpenCLContext " << this << " destroyed.");
 }
 
+shared_ptr<OpenCLProgram> OpenCLContext::library(const string &source) {
+  lock_guard<mutex> lock(libraryMutex);
+
+  auto it = libraries.find(source);
+  if (it != libraries.end())
+    return it->second;
+
+  // Only a handful of headers are ever used during one session, so there is no
+  // need for anything smarter.
+  if (MAX_LIBRARIES <= libraries.size())
+    libraries.clear();
+
+  shared_ptr<OpenCLProgram> library(
+      OpenCLProgram::compileLibrary(source, this));
+  libraries.emplace(source, library);
+
+  return library;
+}
+
+string OpenCLContext::deviceFingerprint() const {
+  return platformInfo(platformId, CL_PLATFORM_NAME) + '|' +
+         platformInfo(platformId, CL_PLATFORM_VERSION) + '|' +
+         deviceInfo(deviceId, CL_DEVICE_NAME) + '|' +
+         deviceInfo(deviceId, CL_DEVICE_VERSION) + '|' +
+         deviceInfo(deviceId, CL_DRIVER_VERSION);
+}
+
+bool OpenCLContext::hasExtension(const string &name) const {
+  stringstream ss(deviceInfo(deviceId, CL_DEVICE_EXTENSIONS));
+  string extension;
+
+  while (ss >> extension) {
+    if (extension == name)
+      return true;
+  }
+
+  return false;
+}
+
 string OpenCLContext::getPlatformInfo(const unsigned int platformIndex) {
   const vector<cl_platform_id> platformIDs = getPlatformIDs();
 
@@ -221,6 +262,17 @@ string OpenCLContext::getDeviceInfo(const unsigned int platformIndex,
   return str;
 }
 
+unsigned int OpenCLContext::getDeviceCount(const unsigned int platformIndex) {
+  const vector<cl_platform_id> platformIDs = getPlatformIDs();
+
+  if (platformIndex >= platformIDs.size())
+    throwDetailed(runtime_error("Platform ID " + to_string(platformIndex) +
+                                " too high."));
+
+  return static_cast<unsigned int>(
+      getDeviceIDs(platformIDs[platformIndex]).size());
+}
+
 // TODO: Test this with a unit test.
 void OpenCLContext::CCEC(cl_int val, string message, const char *file,
                          int line) {
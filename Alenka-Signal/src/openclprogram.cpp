@@ -25,8 +25,10 @@ OpenCLProgram::OpenCLProgram(const string &source, OpenCLContext *context)
 }
 
 OpenCLProgram::~OpenCLProgram() {
-  cl_int err = clReleaseProgram(program);
-  checkClErrorCode(err, "clReleaseProgram()");
+  if (program) {
+    cl_int err = clReleaseProgram(program);
+    checkClErrorCode(err, "clReleaseProgram()");
+  }
 }
 
 cl_kernel OpenCLProgram::createKernel(const string &kernelName) const {
@@ -42,6 +44,9 @@ cl_kernel OpenCLProgram::createKernel(const string &kernelName) const {
 }
 
 string OpenCLProgram::getCompileLog() const {
+  if (!program)
+    return "";
+
   size_t logLength;
 
   cl_int err =
@@ -101,11 +106,75 @@ OpenCLProgram::OpenCLProgram(const vector<unsigned char> *binary,
 
   program = clCreateProgramWithBinary(context->getCLContext(), 1, &device,
                                       &size, &binaryPtr, &status, &err);
+
+  if (CL_INVALID_BINARY == err) {
+    // This happens when the binary comes from a different device or driver.
+    // Report it the same way as a failed build so that the caller can fall
+    // back to compiling from source.
+    program = nullptr;
+    buildError = err;
+    return;
+  }
   checkClErrorCode(err, "clCreateProgramWithBinary()");
 
   build();
 }
 
+OpenCLProgram *OpenCLProgram::compileLibrary(const string &source,
+                                             OpenCLContext *context) {
+  cl_int err;
+  const char *sourcePointer = source.c_str();
+  size_t size = source.size();
+  auto device = context->getCLDevice();
+
+  cl_program object = clCreateProgramWithSource(context->getCLContext(), 1,
+                                                &sourcePointer, &size, &err);
+  checkClErrorCode(err, "clCreateProgramWithSource()");
+
+  err = clCompileProgram(object, 1, &device, nullptr, 0, nullptr, nullptr,
+                         nullptr, nullptr);
+  if (CL_SUCCESS != err)
+    return new OpenCLProgram(object, err, context, source);
+
+  cl_program library =
+      clLinkProgram(context->getCLContext(), 1, &device, "-create-library", 1,
+                    &object, nullptr, nullptr, &err);
+
+  cl_int releaseErr = clReleaseProgram(object);
+  checkClErrorCode(releaseErr, "clReleaseProgram()");
+
+  return new OpenCLProgram(library, err, context, source);
+}
+
+OpenCLProgram *OpenCLProgram::compileAndLink(const string &source,
+                                             const OpenCLProgram &library,
+                                             OpenCLContext *context) {
+  assert(CL_SUCCESS == library.compileStatus());
+  cl_int err;
+  const char *sourcePointer = source.c_str();
+  size_t size = source.size();
+  auto device = context->getCLDevice();
+
+  cl_program object = clCreateProgramWithSource(context->getCLContext(), 1,
+                                                &sourcePointer, &size, &err);
+  checkClErrorCode(err, "clCreateProgramWithSource()");
+
+  err = clCompileProgram(object, 1, &device, nullptr, 0, nullptr, nullptr,
+                         nullptr, nullptr);
+  if (CL_SUCCESS != err)
+    return new OpenCLProgram(object, err, context, source);
+
+  cl_program programs[] = {object, library.program};
+  cl_program executable = clLinkProgram(context->getCLContext(), 1, &device,
+                                        nullptr, 2, programs, nullptr, nullptr,
+                                        &err);
+
+  cl_int releaseErr = clReleaseProgram(object);
+  checkClErrorCode(releaseErr, "clReleaseProgram()");
+
+  return new OpenCLProgram(executable, err, context, source);
+}
+
 void OpenCLProgram::build() {
   buildError = clBuildProgram(program, 0, nullptr, nullptr, nullptr, nullptr);
 
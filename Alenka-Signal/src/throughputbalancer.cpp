@@ -0,0 +1,80 @@
+#include "../include/AlenkaSignal/throughputbalancer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+using namespace std;
+
+namespace AlenkaSignal {
+
+ThroughputBalancer::ThroughputBalancer(unsigned int deviceCount,
+                                       double smoothing)
+    : devices(max(1u, deviceCount)), smoothing(smoothing) {
+  assert(0 < smoothing && smoothing <= 1);
+}
+
+unsigned int ThroughputBalancer::pick(double work) {
+  const double infinity = numeric_limits<double>::infinity();
+  unsigned int best = 0;
+  double bestTime = infinity;
+
+  for (unsigned int i = 0; i < size(); ++i) {
+    const Device &d = devices[i];
+    double time;
+
+    // Measure the idle devices first.
+    if (d.throughput == 0)
+      time = d.pending == 0 ? -infinity : infinity;
+    else
+      time = d.finishTime + work / d.throughput;
+
+    if (time < bestTime) {
+      best = i;
+      bestTime = time;
+    }
+  }
+
+  if (bestTime == infinity) {
+    // Nothing is measured yet, and all devices are busy.
+    for (unsigned int i = 1; i < size(); ++i) {
+      if (devices[i].pending < devices[best].pending)
+        best = i;
+    }
+  } else if (0 < devices[best].throughput) {
+    devices[best].finishTime = bestTime;
+  }
+
+  devices[best].pending += work;
+  return best;
+}
+
+void ThroughputBalancer::finished(unsigned int device, double work,
+                                  double seconds) {
+  assert(device < size());
+  Device &d = devices[device];
+
+  d.pending = max(0., d.pending - work);
+
+  if (seconds <= 0 || work <= 0)
+    return;
+
+  const double rate = work / seconds;
+
+  if (d.throughput == 0) {
+    // Start even with the other measured devices, so that this one doesn't
+    // get all the work until it catches up.
+    double start = numeric_limits<double>::infinity();
+    for (const Device &e : devices) {
+      if (0 < e.throughput)
+        start = min(start, e.finishTime);
+    }
+
+    d.finishTime = start == numeric_limits<double>::infinity() ? 0 : start;
+    d.throughput = rate;
+  } else {
+    d.throughput = (1 - smoothing) * d.throughput + smoothing * rate;
+  }
+}
+
+} // namespace AlenkaSignal
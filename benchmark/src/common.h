@@ -0,0 +1,51 @@
+#ifndef BENCHMARK_COMMON_H
+#define BENCHMARK_COMMON_H
+
+#include "../../Alenka-File/include/AlenkaFile/syntheticfile.h"
+
+#include <boost/filesystem.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Returns the settings of a SyntheticFile recording of the given size.
+ *
+ * The seed is fixed, so every run measures the same data.
+ */
+inline AlenkaFile::SyntheticSettings
+syntheticSettings(unsigned int channels, double seconds, double fs = 1000) {
+  AlenkaFile::SyntheticSettings settings;
+  settings.channels = channels;
+  settings.samplingFrequency = fs;
+  settings.duration = seconds;
+  return settings;
+}
+
+/**
+ * @brief Returns samples of a SyntheticFile recording with the channels stored
+ * one after another.
+ */
+inline std::vector<float> syntheticSignal(unsigned int channels,
+                                          uint64_t samples, double fs = 1000) {
+  AlenkaFile::SyntheticFile file(syntheticSettings(channels, samples / fs, fs));
+
+  // The samples past the end of the recording (due to rounding) are zero.
+  std::vector<float> signal(channels * samples);
+  file.readSignal(signal.data(), 0, samples - 1);
+  return signal;
+}
+
+/**
+ * @brief Returns a unique path in the temporary directory.
+ * @param suffix The extension including the dot.
+ */
+inline std::string temporaryFilePath(const std::string &suffix) {
+  using namespace boost::filesystem;
+  return unique_path(temp_directory_path().string() + "/%%%%_%%%%_%%%%_%%%%" +
+                     suffix)
+      .string();
+}
+
+#endif // BENCHMARK_COMMON_H
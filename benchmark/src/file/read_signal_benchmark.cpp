@@ -0,0 +1,111 @@
+#include <benchmark/benchmark.h>
+
+#include "../../Alenka-File/include/AlenkaFile/datamodel.h"
+#include "../../Alenka-File/include/AlenkaFile/edf.h"
+#include "../../Alenka-File/include/AlenkaFile/gdf2.h"
+#include "../../Alenka-File/include/AlenkaFile/mat.h"
+#include "../common.h"
+
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+
+using namespace std;
+using namespace AlenkaFile;
+
+namespace {
+
+const double SECONDS = 60;
+
+/**
+ * @brief Writes the synthetic files once per format and channel count, and
+ * deletes them at exit.
+ */
+class FileStore {
+  map<pair<string, int>, string> paths;
+
+public:
+  ~FileStore() {
+    for (const auto &e : paths)
+      remove(e.second.c_str());
+  }
+
+  template <class Format>
+  const string &path(const string &suffix, int channels) {
+    string &p = paths[make_pair(suffix, channels)];
+
+    if (p.empty()) {
+      SyntheticFile source(syntheticSettings(channels, SECONDS));
+      DataModel dataModel(make_unique<EventTypeTable>(),
+                          make_unique<MontageTable>());
+      source.setDataModel(&dataModel);
+
+      p = temporaryFilePath(suffix);
+      Format::saveAs(p, &source);
+    }
+
+    return p;
+  }
+};
+
+FileStore fileStore;
+
+void readWindows(benchmark::State &state, DataFile *file) {
+  const int64_t window = state.range(1);
+  const int64_t samples = file->getSamplesRecorded();
+  const int channels = file->getChannelCount();
+  vector<float> buffer(window * channels);
+  int64_t first = 0;
+
+  for (auto _ : state) {
+    file->readSignal(buffer.data(), first, first + window - 1);
+    benchmark::DoNotOptimize(buffer.data());
+
+    // Move on so that it's not always the same part of the file.
+    first = (first + window) % max<int64_t>(1, samples - window);
+  }
+
+  state.SetItemsProcessed(state.iterations() * window);
+  state.SetBytesProcessed(state.iterations() * window * channels *
+                          sizeof(float));
+}
+
+void BM_readSignal_GDF2(benchmark::State &state) {
+  const int channels = static_cast<int>(state.range(0));
+  GDF2 file(fileStore.path<GDF2>(".gdf", channels));
+  readWindows(state, &file);
+}
+
+void BM_readSignal_EDF(benchmark::State &state) {
+  const int channels = static_cast<int>(state.range(0));
+  EDF file(fileStore.path<EDF>(".edf", channels));
+  readWindows(state, &file);
+}
+
+void BM_readSignal_MAT(benchmark::State &state) {
+  const int channels = static_cast<int>(state.range(0));
+  MAT file(fileStore.path<MAT>(".mat", channels));
+  readWindows(state, &file);
+}
+
+void windowSizes(benchmark::internal::Benchmark *b, vector<int> channels) {
+  b->ArgNames({"channels", "window"});
+
+  for (int c : channels) {
+    for (int w : {1024, 16 * 1024, 64 * 1024})
+      b->Args({c, w});
+  }
+}
+
+} // namespace
+
+BENCHMARK(BM_readSignal_GDF2)->Apply([](auto *b) {
+  windowSizes(b, {8, 32, 128});
+});
+BENCHMARK(BM_readSignal_EDF)->Apply([](auto *b) {
+  windowSizes(b, {8, 32, 128});
+});
+BENCHMARK(BM_readSignal_MAT)->Apply([](auto *b) {
+  windowSizes(b, {8, 32, 128});
+});
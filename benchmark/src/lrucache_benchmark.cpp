@@ -0,0 +1,76 @@
+#include <benchmark/benchmark.h>
+
+#include "../../src/SignalProcessor/lrucache.h"
+
+#include <memory>
+#include <set>
+
+using namespace std;
+
+namespace {
+
+class FloatAllocator : public LRUCacheAllocator<float> {
+public:
+  bool constructElement(float **ptr) override {
+    *ptr = new float[1024];
+    return true;
+  }
+  void destroyElement(float *ptr) override { delete[] ptr; }
+};
+
+auto makeCache(int capacity) {
+  return make_unique<LRUCache<int, float>>(capacity,
+                                           make_unique<FloatAllocator>());
+}
+
+// Every lookup finds one of the keys, like when a page is redrawn.
+void BM_LRUCache_getAny(benchmark::State &state) {
+  const int capacity = static_cast<int>(state.range(0));
+  auto cache = makeCache(capacity);
+
+  for (int i = 0; i < capacity; ++i)
+    cache->setOldest(i);
+
+  set<int> keys;
+  for (int i = 0; i < 8; ++i)
+    keys.insert(capacity - 1 - i * capacity / 8);
+
+  int key;
+  for (auto _ : state)
+    benchmark::DoNotOptimize(cache->getAny(keys, &key));
+}
+
+void BM_LRUCache_getAny_miss(benchmark::State &state) {
+  const int capacity = static_cast<int>(state.range(0));
+  auto cache = makeCache(capacity);
+
+  for (int i = 0; i < capacity; ++i)
+    cache->setOldest(i);
+
+  set<int> keys;
+  for (int i = 0; i < 8; ++i)
+    keys.insert(capacity + i);
+
+  int key;
+  for (auto _ : state)
+    benchmark::DoNotOptimize(cache->getAny(keys, &key));
+}
+
+// Every insert evicts the oldest key, like when scrolling through a file.
+void BM_LRUCache_setOldest(benchmark::State &state) {
+  const int capacity = static_cast<int>(state.range(0));
+  auto cache = makeCache(capacity);
+
+  for (int i = 0; i < capacity; ++i)
+    cache->setOldest(i);
+
+  int key = capacity;
+  for (auto _ : state)
+    benchmark::DoNotOptimize(cache->setOldest(key++));
+}
+
+} // namespace
+
+BENCHMARK(BM_LRUCache_getAny)->RangeMultiplier(4)->Range(16, 4096);
+BENCHMARK(BM_LRUCache_getAny_miss)->RangeMultiplier(4)->Range(16, 4096);
+BENCHMARK(BM_LRUCache_setOldest)->RangeMultiplier(4)->Range(16, 4096);
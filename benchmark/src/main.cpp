@@ -0,0 +1,29 @@
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+// The results are printed as JSON by default, so that they can be compared
+// between versions, e.g. by compare.py from the Google Benchmark tools. Use
+// --benchmark_format=console for a table.
+int main(int argc, char **argv) {
+  vector<char *> args(argv, argv + argc);
+
+  bool formatSet = false;
+  for (int i = 1; i < argc; ++i)
+    formatSet |= strncmp(argv[i], "--benchmark_format", 18) == 0;
+
+  char jsonFormat[] = "--benchmark_format=json";
+  if (!formatSet)
+    args.insert(args.begin() + 1, jsonFormat);
+
+  int count = static_cast<int>(args.size());
+  benchmark::Initialize(&count, args.data());
+  if (benchmark::ReportUnrecognizedArguments(count, args.data()))
+    return 1;
+
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef BENCHMARK_SIGNAL_COMMON_H
+#define BENCHMARK_SIGNAL_COMMON_H
+
+#include "../../Alenka-Signal/include/AlenkaSignal/openclcontext.h"
+
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Returns the context shared by the benchmarks.
+ *
+ * The device is selected by BENCHMARK_OPENCL_PLATFORM and
+ * BENCHMARK_OPENCL_DEVICE. Use a CPU device (e.g. POCL) for results that can
+ * be compared between machines.
+ */
+inline AlenkaSignal::OpenCLContext *openCLContext() {
+  static std::unique_ptr<AlenkaSignal::OpenCLContext> context;
+
+  if (!context) {
+    AlenkaSignal::OpenCLContext::clfftInit();
+    context = std::make_unique<AlenkaSignal::OpenCLContext>(OPENCL_PLATFORM,
+                                                            OPENCL_DEVICE);
+  }
+
+  return context.get();
+}
+
+/**
+ * @brief Owns the queue and buffers used by a benchmark.
+ */
+class DeviceBuffers {
+  std::vector<cl_mem> buffers;
+
+public:
+  cl_command_queue queue;
+
+  DeviceBuffers() {
+    cl_int err;
+    queue = clCreateCommandQueue(openCLContext()->getCLContext(),
+                                 openCLContext()->getCLDevice(), 0, &err);
+    checkClErrorCode(err, "clCreateCommandQueue");
+  }
+  ~DeviceBuffers() {
+    for (cl_mem e : buffers)
+      clReleaseMemObject(e);
+    clReleaseCommandQueue(queue);
+  }
+
+  /**
+   * @brief Creates a buffer initialized with data.
+   */
+  cl_mem create(const std::vector<float> &data) {
+    cl_int err;
+    cl_mem buffer = clCreateBuffer(
+        openCLContext()->getCLContext(),
+        CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, data.size() * sizeof(float),
+        const_cast<float *>(data.data()), &err);
+    checkClErrorCode(err, "clCreateBuffer");
+
+    buffers.push_back(buffer);
+    return buffer;
+  }
+
+  void finish() {
+    cl_int err = clFinish(queue);
+    checkClErrorCode(err, "clFinish");
+  }
+};
+
+#endif // BENCHMARK_SIGNAL_COMMON_H
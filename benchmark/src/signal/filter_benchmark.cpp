@@ -0,0 +1,55 @@
+#include <benchmark/benchmark.h>
+
+#include "../../Alenka-Signal/include/AlenkaSignal/filter.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/filterprocessor.h"
+#include "../common.h"
+#include "common.h"
+
+using namespace std;
+using namespace AlenkaSignal;
+
+namespace {
+
+// The filter is as long as in Alenka: one second of signal.
+void BM_FilterProcessor_process(benchmark::State &state) {
+  const int channels = static_cast<int>(state.range(0));
+  const int blockSize = static_cast<int>(state.range(1));
+  const double fs = 1000;
+  const int M = static_cast<int>(fs) + 1;
+
+  Filter<float> filter(M, fs);
+  filter.setLowpassOn(true);
+  filter.setLowpass(40);
+  filter.setHighpassOn(true);
+  filter.setHighpass(1);
+
+  FilterProcessor<float> processor(blockSize, channels, openCLContext());
+  processor.changeSampleFilter(M, filter.computeSamples());
+
+  const vector<float> signal = syntheticSignal(channels, blockSize + 2, fs);
+  DeviceBuffers buffers;
+  cl_mem inBuffer = buffers.create(signal);
+  cl_mem outBuffer = buffers.create(signal);
+
+  // The first call computes the spectrum of the filter.
+  processor.process(inBuffer, outBuffer, buffers.queue);
+  buffers.finish();
+
+  for (auto _ : state) {
+    processor.process(inBuffer, outBuffer, buffers.queue);
+    buffers.finish();
+  }
+
+  state.SetItemsProcessed(state.iterations() * blockSize * channels);
+}
+
+} // namespace
+
+BENCHMARK(BM_FilterProcessor_process)
+    ->ArgNames({"channels", "blockSize"})
+    ->Args({32, 4 * 1024})
+    ->Args({32, 16 * 1024})
+    ->Args({128, 16 * 1024})
+    ->Args({32, 64 * 1024})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
@@ -0,0 +1,93 @@
+#include <benchmark/benchmark.h>
+
+#include "../../Alenka-Signal/include/AlenkaSignal/montage.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/montageprocessor.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/openclprogram.h"
+#include "../common.h"
+#include "common.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace AlenkaSignal;
+
+namespace {
+
+// A typical bipolar track.
+string bipolarTrack(int i, int channels) {
+  return "out = in(" + to_string(i % channels) + ") - in(" +
+         to_string((i + 1) % channels) + ");";
+}
+
+void BM_MontageProcessor_process(benchmark::State &state) {
+  const int channels = static_cast<int>(state.range(0));
+  const int blockSize = static_cast<int>(state.range(1));
+
+  vector<unique_ptr<Montage<float>>> montage;
+  for (int i = 0; i < channels; ++i) {
+    montage.push_back(make_unique<Montage<float>>(bipolarTrack(i, channels),
+                                                  openCLContext()));
+    montage.back()->getKernel();
+  }
+
+  MontageProcessor<float> processor(blockSize, channels);
+
+  const vector<float> signal = syntheticSignal(channels, blockSize);
+  DeviceBuffers buffers;
+  cl_mem inBuffer = buffers.create(signal);
+  cl_mem outBuffer = buffers.create(signal);
+  cl_mem xyzBuffer = buffers.create(MontageProcessor<float>::buildXyzBuffer(
+      vector<float>(), channels));
+
+  for (auto _ : state) {
+    processor.process(montage.begin(), montage.end(), inBuffer, outBuffer,
+                      xyzBuffer, buffers.queue, blockSize);
+    buffers.finish();
+  }
+
+  state.SetItemsProcessed(state.iterations() * blockSize * channels);
+}
+
+// Every iteration compiles a different source, so that the driver's own cache
+// doesn't help.
+void BM_Montage_compile(benchmark::State &state) {
+  int i = 0;
+
+  for (auto _ : state) {
+    const string code = bipolarTrack(0, 2) + " out += " + to_string(i++) + ";";
+    Montage<float> montage(code, openCLContext());
+    benchmark::DoNotOptimize(montage.getKernel());
+  }
+}
+
+// This is what KernelCache does for every program it loads from its file.
+void BM_KernelCache_load(benchmark::State &state) {
+  Montage<float> montage(bipolarTrack(0, 2), openCLContext());
+  unique_ptr<OpenCLProgram> program(montage.releaseProgram());
+  unique_ptr<vector<unsigned char>> binary(program->getBinary());
+
+  for (auto _ : state) {
+    unique_ptr<OpenCLProgram> loaded(
+        OpenCLProgram::fromBinary(binary.get(), openCLContext()));
+
+    if (CL_SUCCESS != loaded->compileStatus()) {
+      state.SkipWithError("The binary was rejected");
+      break;
+    }
+  }
+
+  state.SetBytesProcessed(state.iterations() * binary->size());
+}
+
+} // namespace
+
+BENCHMARK(BM_MontageProcessor_process)
+    ->ArgNames({"channels", "blockSize"})
+    ->Args({32, 16 * 1024})
+    ->Args({128, 16 * 1024})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_Montage_compile)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_KernelCache_load)->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,43 @@
+#include <benchmark/benchmark.h>
+
+#include "../../Alenka-Signal/include/AlenkaSignal/spikedet.h"
+#include "../common.h"
+
+#include <memory>
+#include <vector>
+
+using namespace std;
+using namespace AlenkaSignal;
+
+namespace {
+
+void BM_Spikedet(benchmark::State &state) {
+  const int channels = static_cast<int>(state.range(0));
+  const double fs = 200;
+  const int seconds = 5 * 60;
+
+  const vector<float> data =
+      syntheticSignal(channels, static_cast<uint64_t>(seconds * fs), fs);
+  VectorSpikedetLoader<SIGNALTYPE> loader(
+      vector<SIGNALTYPE>(data.begin(), data.end()), channels);
+
+  for (auto _ : state) {
+    CDetectorOutput out;
+    CDischarges discharges(channels);
+
+    Spikedet det(static_cast<int>(fs), false, Spikedet::defaultSettings());
+    det.runAnalysis(&loader, &out, &discharges);
+    benchmark::DoNotOptimize(out.m_pos.size());
+  }
+
+  state.SetItemsProcessed(state.iterations() * seconds);
+}
+
+} // namespace
+
+BENCHMARK(BM_Spikedet)
+    ->ArgName("channels")
+    ->Arg(8)
+    ->Arg(32)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
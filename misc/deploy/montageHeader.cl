@@ -47,21 +47,22 @@ float sumArr(int *indexArr, int n, PARA) {
 float average(PARA) { return sumAll() / IN_COUNT; }
 #define average() average(PASS)
 
-// Euclidean distance between channels i and j.
+// Euclidean distance between channels i and j. The distances are computed in
+// advance from the coordinates, so this is only a table lookup.
 float dist(int i, int j, PARA) {
-  return sqrt(pown(x(i) - x(j), 2) + pown(y(i) - y(j), 2) +
-              pown(z(i) - z(j), 2));
+  return _dist_(i, j);
 }
 #define dist(a_, b_) dist(a_, b_, PASS)
 
 // Weigted average by distance d where weights = 1/(d*coeff + 1).
 // For ceoff = 1 the weights for distances 0, 1, 2, ... are 1, 1/2, 1/3, ...
 float distAverage(int i, int coeff, PARA) {
+  float center = in(i);
   float tmp = 0;
   for (int j = 0; j < IN_COUNT; ++j) {
     if (i != j) {
       float d = dist(i, j) * coeff + 1;
-      tmp += (in(i) - in(j)) * 1 / d;
+      tmp += (center - in(j)) / d;
     }
   }
   return tmp;
@@ -72,12 +73,13 @@ float distAverage(int i, int coeff, PARA) {
 // It's a linear function with maximum at [0, 1] and minimum at [maxDist, 0].
 // For d > maxDist weights are 0.
 float distAverageLinear(int i, int maxDist, PARA) {
+  float center = in(i);
   float tmp = 0;
   for (int j = 0; j < IN_COUNT; ++j) {
     float d = dist(i, j);
     if (i != j && d < maxDist) {
       d = -(d / maxDist) + 1;
-      tmp += (in(i) - in(j)) * d;
+      tmp += (center - in(j)) * d;
     }
   }
   return tmp;
@@ -18,6 +18,7 @@ void InfoTable::setDefaultValues() {
   highpassOn = false;
   notchOn = false;
   filterWindow = AlenkaSignal::WindowFunction::None;
+  filterDesign = AlenkaSignal::FilterDesign::FIR;
   selectedMontage = 1;
   timeMode = InfoTable::TimeMode::offset;
   selectedType = 0;
@@ -44,6 +45,7 @@ void InfoTable::emitAllSignals() {
   emit highpassOnChanged(highpassOn);
   emit notchOnChanged(notchOn);
   emit filterWindowChanged(filterWindow);
+  emit filterDesignChanged(filterDesign);
   emit selectedMontageChanged(selectedMontage);
   emit timeModeChanged(timeMode);
   emit selectedTypeChanged(selectedType);
@@ -73,6 +75,8 @@ void InfoTable::writeXML(const string &filePath,
   xml_node filter = document.append_child("filter");
   filter.append_attribute("filterWindow")
       .set_value(static_cast<int>(filterWindow));
+  filter.append_attribute("filterDesign")
+      .set_value(static_cast<int>(filterDesign));
 
   xml_node lowpass = filter.append_child("lowpass");
   lowpass.append_attribute("on").set_value(lowpassOn);
@@ -150,6 +154,8 @@ void InfoTable::readXML(const string &filePath,
   xml_node filter = document.child("filter");
   filterWindow = static_cast<AlenkaSignal::WindowFunction>(
       browser.attribute("filterWindow").as_int(static_cast<int>(filterWindow)));
+  filterDesign = static_cast<AlenkaSignal::FilterDesign>(
+      filter.attribute("filterDesign").as_int(static_cast<int>(filterDesign)));
 
   xml_node lowpass = filter.child("lowpass");
   lowpassOn = lowpass.attribute("on").as_bool(lowpassOn);
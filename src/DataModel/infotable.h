@@ -3,6 +3,7 @@
 
 #include <QObject>
 
+#include "../../Alenka-Signal/include/AlenkaSignal/filter.h"
 #include "../../Alenka-Signal/include/AlenkaSignal/filterprocessor.h"
 
 #include <string>
@@ -36,6 +37,7 @@ private:
   bool highpassOn;
   bool notchOn; // TODO: Add notch frequency.
   AlenkaSignal::WindowFunction filterWindow;
+  AlenkaSignal::FilterDesign filterDesign;
   int selectedMontage;
   InfoTable::TimeMode timeMode;
   int selectedType;
@@ -84,6 +86,7 @@ public:
   bool getHighpassOn() const { return highpassOn; }
   bool getNotchOn() const { return notchOn; }
   AlenkaSignal::WindowFunction getFilterWindow() const { return filterWindow; }
+  AlenkaSignal::FilterDesign getFilterDesign() const { return filterDesign; }
   int getSelectedMontage() const { return selectedMontage; }
   InfoTable::TimeMode getTimeMode() const { return timeMode; }
   int getSelectedType() const { return selectedType; }
@@ -112,6 +115,7 @@ signals:
   void highpassOnChanged(bool);
   void notchOnChanged(bool);
   void filterWindowChanged(AlenkaSignal::WindowFunction);
+  void filterDesignChanged(AlenkaSignal::FilterDesign);
   void selectedMontageChanged(int);
   void timeModeChanged(InfoTable::TimeMode);
   void selectedTypeChanged(int);
@@ -185,6 +189,12 @@ public slots:
       emit filterWindowChanged(value);
     }
   }
+  void setFilterDesign(AlenkaSignal::FilterDesign value) {
+    if (value != filterDesign) {
+      filterDesign = value;
+      emit filterDesignChanged(value);
+    }
+  }
   void setSelectedMontage(int value) {
     if (value != selectedMontage) {
       selectedMontage = value;
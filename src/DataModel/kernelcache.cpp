@@ -1,15 +1,17 @@
 #include "kernelcache.h"
 
+#include "../../Alenka-Signal/include/AlenkaSignal/openclcontext.h"
 #include "../error.h"
 #include "../myapplication.h"
 #include "../options.h"
-
-#include <QFile>
+#include "../performancecounters.h"
 
 #include <fstream>
+#include <set>
 #include <sstream>
 
 using namespace std;
+using namespace AlenkaSignal;
 
 namespace {
 
@@ -19,7 +21,7 @@ string cacheFilePath() {
   programOption("clDevice", device);
 
   const QString fileName = QString::fromStdString(
-      "kernel-cache-" + to_string(platform) + '-' + to_string(device) + ".txt");
+      "kernel-cache-" + to_string(platform) + '-' + to_string(device) + ".bin");
 
   QString path;
   if (isProgramOptionSet("kernelCacheDir")) {
@@ -37,81 +39,98 @@ string cacheFilePath() {
 } // namespace
 
 // TODO: Perhaps use boost/compute/detail/lru_cache.hpp instead.
-// TODO: Reject caches from old Alenka versions and from changed devices.
 KernelCache::KernelCache() {
   cache.setMaxCost(programOption<int>("kernelCacheSize"));
 }
 
-void KernelCache::loadFromFile(AlenkaSignal::OpenCLContext *const context) {
-  const string filePath = cacheFilePath();
-  ifstream file(filePath, ios::binary);
+KernelCache::~KernelCache() { closeFile(); }
 
-  if (file.is_open()) {
-    // This cannot be done earlier, because we don't want is_open() to throw.
-    file.exceptions(ifstream::failbit | ifstream::badbit);
+void KernelCache::insert(const QString &code, OpenCLProgram *program) {
+  cache.insert(code, program);
+  PERFORMANCE_COUNTERS.kernelCacheSize = cache.size();
+}
 
-    int size;
-    file >> size;
-    logToFileAndConsole("Loading " + to_string(size) + " KernelCache entries");
+OpenCLProgram *KernelCache::find(const QString &code) {
+  OpenCLProgram *program = cache[code];
 
-    for (int i = 0; i < size; ++i) {
-      size_t codeSize;
-      file >> codeSize;
-      file.ignore(2, '\n');
+  if (!program && fileData)
+    program = findInFile(code);
 
-      auto code = make_unique<char[]>(codeSize + 1);
-      file.read(code.get(), codeSize);
+  if (program)
+    ++PERFORMANCE_COUNTERS.kernelCacheHits;
+  else
+    ++PERFORMANCE_COUNTERS.kernelCacheMisses;
+  PERFORMANCE_COUNTERS.kernelCacheSize = cache.size();
 
-      size_t binarySize;
-      file >> binarySize;
-      file.ignore(2, '\n');
+  return program;
+}
 
-      auto binary = make_unique<vector<unsigned char>>(binarySize);
-      file.read(reinterpret_cast<char *>(binary->data()), binarySize);
+void KernelCache::loadFromFile(OpenCLContext *const context) {
+  this->context = context;
+  closeFile();
 
-      auto program =
-          AlenkaSignal::OpenCLProgram::fromBinary(binary.get(), context);
-      cache.insert(QString(code.get()), program);
-    }
-  } else {
+  const string filePath = cacheFilePath();
+  file = make_unique<QFile>(QString::fromStdString(filePath));
+
+  if (!file->open(QIODevice::ReadOnly)) {
     logToFileAndConsole("Failed to open kernel cache at " << filePath << ".");
+    file.reset();
+    return;
+  }
+
+  const qint64 fileSize = file->size();
+  fileData = file->map(0, fileSize);
+
+  if (fileData && fileIndex.open(fileData, fileSize, fingerprint(context))) {
+    logToFileAndConsole("Loaded index of " << fileIndex.size()
+                                           << " KernelCache entries");
+  } else {
+    logToFileAndConsole("Rejected stale or damaged kernel cache at "
+                        << filePath << ".");
+    closeFile();
   }
 }
 
 void KernelCache::saveToFile() {
-  const int size = cache.size();
-  if (size <= 0)
-    return;
+  if (!context)
+    return; // loadFromFile() was never called.
 
-  const string filePath = cacheFilePath();
-  ofstream file(filePath, ios::binary);
+  KernelCacheFile::Entries entries;
+  set<string> saved;
 
-  if (file.is_open()) {
-    // This cannot be done earlier, because we don't want is_open() to throw.
-    file.exceptions(ifstream::failbit | ifstream::badbit);
+  for (const QString &qCode : cache.keys()) {
+    string code = qCode.toStdString();
+    unique_ptr<vector<unsigned char>> binary(cache[qCode]->getBinary());
 
-    logToFileAndConsole("Saving " + to_string(size) + " KernelCache entries");
-    file << size << endl;
-    const auto &keys = cache.keys();
+    if (!binary->empty() && saved.insert(code).second)
+      entries.emplace_back(move(code), move(*binary));
+  }
 
-    for (auto qCode : keys) {
-      size_t codeSize = qCode.size();
-      string code = qCode.toStdString();
+  // Keep also the entries that were not used during this session.
+  fileIndex.appendRemaining(&entries, &saved, cache.maxCost());
 
-      file << codeSize << endl;
-      file.write(code.data(), codeSize) << endl;
+  if (entries.empty())
+    return;
 
-      auto program = find(qCode);
-      auto binary = program->getBinary();
-      size_t binarySize = binary->size();
+  // The old file must be unmapped before it can be replaced.
+  closeFile();
 
-      file << binarySize << endl;
-      file.write(reinterpret_cast<const char *>(binary->data()), binarySize)
-          << endl;
-    }
-  } else {
+  const string filePath = cacheFilePath();
+  const string tmpPath = filePath + ".tmp";
+
+  try {
+    logToFileAndConsole("Saving " + to_string(entries.size()) +
+                        " KernelCache entries");
+    KernelCacheFile::write(tmpPath, fingerprint(context), entries);
+  } catch (const ios_base::failure &) {
     logToFileAndConsole("Failed to save kernel cache to " << filePath << ".");
+    QFile::remove(QString::fromStdString(tmpPath));
+    return;
   }
+
+  QFile::remove(QString::fromStdString(filePath));
+  QFile::rename(QString::fromStdString(tmpPath),
+                QString::fromStdString(filePath));
 }
 
 void KernelCache::deleteCacheFile() {
@@ -120,3 +139,42 @@ void KernelCache::deleteCacheFile() {
   assert(false);
   QFile::remove(QString::fromStdString(cacheFilePath()));
 }
+
+string KernelCache::fingerprint(OpenCLContext *context) {
+  return "Alenka " + MyApplication::versionString() + '|' +
+         context->deviceFingerprint();
+}
+
+OpenCLProgram *KernelCache::findInFile(const QString &code) {
+  // Either the entry moves to the memory cache or it is rejected, so it's not
+  // needed in the index anymore.
+  vector<unsigned char> binary;
+  if (!fileIndex.take(code.toStdString(), &binary))
+    return nullptr;
+
+  unique_ptr<OpenCLProgram> program(
+      OpenCLProgram::fromBinary(&binary, context));
+
+  if (CL_SUCCESS != program->compileStatus()) {
+    logToFile("Rejected a KernelCache binary: "
+              << OpenCLContext::clErrorCodeToString(program->compileStatus()));
+    return nullptr;
+  }
+
+  OpenCLProgram *programPointer = program.release();
+  // QCache deletes the object right away if it doesn't fit.
+  return cache.insert(code, programPointer) ? programPointer : nullptr;
+}
+
+void KernelCache::closeFile() {
+  fileIndex.close();
+
+  if (file) {
+    if (fileData)
+      file->unmap(fileData);
+    file->close();
+    file.reset();
+  }
+
+  fileData = nullptr;
+}
@@ -2,28 +2,62 @@
 #define KERNELCACHE_H
 
 #include <QCache>
+#include <QFile>
 
-#include <vector>
+#include <memory>
+#include <string>
 
 #include "../Alenka-Signal/include/AlenkaSignal/openclprogram.h"
-
+#include "kernelcachefile.h"
+
+/**
+ * @brief A cache of compiled montage programs with optional persistent
+ * storage.
+ *
+ * The cache file (see KernelCacheFile) consists of a header, an index keyed by
+ * a hash of the source code, and a blob with the sources and the program
+ * binaries. The file is memory-mapped, and the programs are created from the
+ * binaries only when their code is looked up for the first time. So loading
+ * takes the same time regardless of the number of entries.
+ *
+ * The header stores the Alenka version and the OpenCL platform, device and
+ * driver versions. When any of them differ from the current ones, the whole
+ * file is ignored. Individual binaries that the driver refuses are dropped.
+ */
 class KernelCache {
   QCache<QString, AlenkaSignal::OpenCLProgram> cache;
+  AlenkaSignal::OpenCLContext *context = nullptr;
+  std::unique_ptr<QFile> file;
+  uchar *fileData = nullptr;
+  KernelCacheFile fileIndex;
 
 public:
   KernelCache();
+  ~KernelCache();
+
+  void insert(const QString &code, AlenkaSignal::OpenCLProgram *program);
 
-  void insert(const QString &code, AlenkaSignal::OpenCLProgram *program) {
-    cache.insert(code, program);
-  }
-  AlenkaSignal::OpenCLProgram *find(const QString &code) const {
-    return cache[code];
-  }
+  /**
+   * @brief Returns the program for code, or nullptr if it isn't cached.
+   *
+   * If the program is only in the cache file, it gets created from the binary
+   * now.
+   */
+  AlenkaSignal::OpenCLProgram *find(const QString &code);
 
   void loadFromFile(AlenkaSignal::OpenCLContext *context);
   void saveToFile();
 
   static void deleteCacheFile();
+
+  /**
+   * @brief Returns a string that must match for a cache file to be used.
+   */
+  static std::string fingerprint(AlenkaSignal::OpenCLContext *context);
+
+private:
+  AlenkaSignal::OpenCLProgram *findInFile(const QString &code);
+  void closeFile();
 };
 
 #endif // KERNELCACHE_H
@@ -0,0 +1,253 @@
+#ifndef KERNELCACHEFILE_H
+#define KERNELCACHEFILE_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief The file format of KernelCache.
+ *
+ * The file consists of a header with a fingerprint, an index keyed by a hash
+ * of the source code, and a blob with the sources and the program binaries.
+ * This class parses the index of a file already in memory (KernelCache maps
+ * it), and copies the entries out of it on request.
+ *
+ * Every offset is checked against the size of the file when the index is
+ * read, so a truncated or otherwise damaged file is rejected as a whole.
+ */
+class KernelCacheFile {
+public:
+  /**
+   * @brief Pairs of source code and program binary.
+   */
+  using Entries =
+      std::vector<std::pair<std::string, std::vector<unsigned char>>>;
+
+private:
+  struct IndexEntry {
+    uint64_t sourceOffset, sourceSize, binaryOffset, binarySize;
+  };
+
+  static const char *magic() { return "ALENKAKC"; }
+  static const int MAGIC_SIZE = 8;
+  static const uint32_t FORMAT_VERSION = 1;
+
+  // hash, sourceOffset, sourceSize, binaryOffset, binarySize
+  static const uint64_t INDEX_ENTRY_SIZE = 5 * sizeof(uint64_t);
+
+  const unsigned char *data = nullptr;
+  std::unordered_multimap<uint64_t, IndexEntry> index;
+
+public:
+  /**
+   * @brief Reads the index of the file in data.
+   * @return False if the file is damaged or its fingerprint doesn't match.
+   * The index is left empty in that case.
+   *
+   * The data must stay valid until close() or the next call.
+   */
+  bool open(const unsigned char *data, int64_t size,
+            const std::string &fingerprint) {
+    close();
+
+    if (readIndex(data, size, fingerprint)) {
+      this->data = data;
+      return true;
+    }
+
+    index.clear();
+    return false;
+  }
+
+  void close() {
+    data = nullptr;
+    index.clear();
+  }
+
+  bool isOpen() const { return data != nullptr; }
+
+  /**
+   * @brief Returns the number of entries left in the index.
+   */
+  size_t size() const { return index.size(); }
+
+  /**
+   * @brief Copies the binary stored for source, and removes the entry from
+   * the index.
+   * @return False if the source isn't in the index.
+   */
+  bool take(const std::string &source, std::vector<unsigned char> *binary) {
+    auto range = index.equal_range(hashCode(source));
+
+    for (auto it = range.first; it != range.second; ++it) {
+      const IndexEntry e = it->second;
+
+      if (e.sourceSize != source.size() ||
+          memcmp(data + e.sourceOffset, source.data(), source.size()) != 0)
+        continue;
+
+      index.erase(it);
+
+      const auto binaryPtr = data + e.binaryOffset;
+      binary->assign(binaryPtr, binaryPtr + e.binarySize);
+      return true;
+    }
+
+    return false;
+  }
+
+  /**
+   * @brief Appends the entries of the index whose source is not in saved yet,
+   * until there are maxCount entries.
+   *
+   * The sources of the appended entries are added to saved.
+   */
+  void appendRemaining(Entries *entries, std::set<std::string> *saved,
+                       int maxCount) const {
+    for (const auto &e : index) {
+      if (maxCount <= static_cast<int>(entries->size()))
+        break;
+
+      const IndexEntry &entry = e.second;
+      const auto sourcePtr = data + entry.sourceOffset;
+      std::string code(sourcePtr, sourcePtr + entry.sourceSize);
+
+      if (saved->insert(code).second) {
+        const auto binaryPtr = data + entry.binaryOffset;
+        entries->emplace_back(std::move(code),
+                              std::vector<unsigned char>(
+                                  binaryPtr, binaryPtr + entry.binarySize));
+      }
+    }
+  }
+
+  /**
+   * @brief Writes the entries to filePath.
+   * @throws std::ios_base::failure if the file cannot be written.
+   */
+  static void write(const std::string &filePath,
+                    const std::string &fingerprint, const Entries &entries) {
+    std::ofstream file(filePath, std::ios::binary);
+
+    if (!file.is_open())
+      throw std::ios_base::failure("Cannot open " + filePath);
+
+    file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+
+    file.write(magic(), MAGIC_SIZE);
+    writeValue(file, FORMAT_VERSION);
+    writeValue(file, static_cast<uint32_t>(fingerprint.size()));
+    file.write(fingerprint.data(), fingerprint.size());
+    writeValue(file, static_cast<uint64_t>(entries.size()));
+
+    // The blob starts right after the index.
+    uint64_t offset = MAGIC_SIZE + 2 * sizeof(uint32_t) +
+                      fingerprint.size() + sizeof(uint64_t) +
+                      entries.size() * INDEX_ENTRY_SIZE;
+
+    for (const auto &e : entries) {
+      writeValue(file, hashCode(e.first));
+      writeValue(file, offset);
+      writeValue(file, static_cast<uint64_t>(e.first.size()));
+      offset += e.first.size();
+      writeValue(file, offset);
+      writeValue(file, static_cast<uint64_t>(e.second.size()));
+      offset += e.second.size();
+    }
+
+    for (const auto &e : entries) {
+      file.write(e.first.data(), e.first.size());
+      file.write(reinterpret_cast<const char *>(e.second.data()),
+                 e.second.size());
+    }
+  }
+
+  /**
+   * @brief The key used for the index (64-bit FNV-1a).
+   */
+  static uint64_t hashCode(const std::string &code) {
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (unsigned char c : code) {
+      hash ^= c;
+      hash *= 1099511628211ULL;
+    }
+
+    return hash;
+  }
+
+private:
+  bool readIndex(const unsigned char *data, int64_t size,
+                 const std::string &fingerprint) {
+    int64_t position = 0;
+
+    if (size < MAGIC_SIZE || memcmp(data, magic(), MAGIC_SIZE) != 0)
+      return false;
+    position += MAGIC_SIZE;
+
+    uint32_t version, fingerprintSize;
+    if (!readValue(data, size, &position, &version) ||
+        version != FORMAT_VERSION ||
+        !readValue(data, size, &position, &fingerprintSize) ||
+        fingerprintSize != fingerprint.size() ||
+        !inside(position, fingerprintSize, size) ||
+        memcmp(data + position, fingerprint.data(), fingerprintSize) != 0)
+      return false;
+    position += fingerprintSize;
+
+    uint64_t count;
+    if (!readValue(data, size, &position, &count) ||
+        static_cast<uint64_t>(size) / INDEX_ENTRY_SIZE < count ||
+        !inside(position, count * INDEX_ENTRY_SIZE, size))
+      return false;
+
+    index.reserve(count);
+
+    for (uint64_t i = 0; i < count; ++i) {
+      uint64_t hash;
+      IndexEntry e;
+
+      readValue(data, size, &position, &hash);
+      readValue(data, size, &position, &e.sourceOffset);
+      readValue(data, size, &position, &e.sourceSize);
+      readValue(data, size, &position, &e.binaryOffset);
+      readValue(data, size, &position, &e.binarySize);
+
+      if (!inside(e.sourceOffset, e.sourceSize, size) ||
+          !inside(e.binaryOffset, e.binarySize, size))
+        return false;
+
+      index.emplace(hash, e);
+    }
+
+    return true;
+  }
+
+  template <class T>
+  static bool readValue(const unsigned char *data, int64_t size,
+                        int64_t *position, T *value) {
+    if (size - *position < static_cast<int64_t>(sizeof(T)))
+      return false;
+
+    memcpy(value, data + *position, sizeof(T));
+    *position += sizeof(T);
+    return true;
+  }
+
+  template <class T> static void writeValue(std::ofstream &file, T value) {
+    file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+  }
+
+  static bool inside(uint64_t offset, uint64_t size, int64_t fileSize) {
+    const auto total = static_cast<uint64_t>(fileSize);
+    return offset <= total && size <= total - offset;
+  }
+};
+
+#endif // KERNELCACHEFILE_H
@@ -2,3 +2,14 @@
 
 InfoTable OpenDataFile::infoTable;
 std::unique_ptr<KernelCache> OpenDataFile::kernelCache;
+std::vector<std::unique_ptr<KernelCache>> OpenDataFile::extraKernelCaches;
+
+KernelCache *OpenDataFile::deviceKernelCache(unsigned int device) {
+  if (device == 0)
+    return kernelCache.get();
+
+  while (extraKernelCaches.size() < device)
+    extraKernelCaches.push_back(std::make_unique<KernelCache>());
+
+  return extraKernelCaches[device - 1].get();
+}
@@ -4,6 +4,7 @@
 #include <QObject>
 
 #include "../../Alenka-File/include/AlenkaFile/datafile.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/montage.h"
 #include "infotable.h"
 #include "kernelcache.h"
 
@@ -18,8 +19,26 @@ public:
   const AlenkaFile::DataModel *dataModel = nullptr;
   UndoCommandFactory *undoFactory = nullptr;
 
+  /**
+   * @brief The sizes the montage kernels for this file are compiled for.
+   *
+   * Set by SignalProcessor; see SignalProcessor::montageLayout().
+   */
+  AlenkaSignal::MontageLayout montageLayout;
+
   static InfoTable infoTable;
   static std::unique_ptr<KernelCache> kernelCache;
+
+  /**
+   * @brief Returns the montage kernel cache for a device of globalDevices.
+   *
+   * Programs can only be used with the context they were built for, so every
+   * device has its own cache. The one of the primary device is kernelCache.
+   */
+  static KernelCache *deviceKernelCache(unsigned int device);
+
+private:
+  static std::vector<std::unique_ptr<KernelCache>> extraKernelCaches;
 };
 
 #endif // OPENDATAFILE_H
@@ -1,38 +1,218 @@
 #include "trackcodevalidator.h"
 
+#include "../../Alenka-Signal/include/AlenkaSignal/cpumontage.h"
 #include "../../Alenka-Signal/include/AlenkaSignal/montage.h"
 #include "../../Alenka-Signal/include/AlenkaSignal/openclcontext.h"
 #include "../SignalProcessor/signalprocessor.h"
 #include "../myapplication.h"
+#include "../options.h"
+#include "kernelcache.h"
 #include "opendatafile.h"
 
 #include <QFile>
+#include <QTimer>
+
+#include <chrono>
 
 using namespace std;
 using namespace AlenkaSignal;
 
-TrackCodeValidator::TrackCodeValidator() { context = globalContext.get(); }
+namespace {
+
+const int DEBOUNCE_INTERVAL = 500;
+const int POLL_INTERVAL = 50;
+
+} // namespace
+
+TrackCodeValidator::TrackCodeValidator(QObject *parent) : QObject(parent) {
+  context = globalContext.get();
+
+  debounceTimer = new QTimer(this);
+  debounceTimer->setSingleShot(true);
+  debounceTimer->setInterval(DEBOUNCE_INTERVAL);
+  connect(debounceTimer, SIGNAL(timeout()), this, SLOT(startCompilation()));
+
+  pollTimer = new QTimer(this);
+  pollTimer->setInterval(POLL_INTERVAL);
+  connect(pollTimer, SIGNAL(timeout()), this, SLOT(checkCompilation()));
+}
+
+TrackCodeValidator::~TrackCodeValidator() {
+  // The compilation cannot be interrupted. So wait for it to finish before the
+  // context can go away.
+  if (compilation.valid())
+    compilation.wait();
+}
 
 bool TrackCodeValidator::validate(const QString &input, const QString &header,
                                   QString *errorMessage) {
-  string code = SignalProcessor::simplifyMontage<float>(input.toStdString());
-  string stdHeader = header.toStdString();
+  QString message, key;
+  const Precheck check = precheck(input, header, &message, &key);
+
+  bool result;
+  if (check == Precheck::NeedsCompiler)
+    result = finish(key, make_unique<OpenCLProgram>(key.toStdString(), context),
+                    &message);
+  else
+    result = check == Precheck::Valid;
 
-  if (errorMessage) {
-    string message;
+  if (errorMessage)
+    *errorMessage = message;
 
-    // I don't pass the labels here, because a montage formula with a bad label
-    // doesn't violate the syntax. Instead a fall back to zero is used. This is
-    // consistent with how an invalid index is handled.
-    bool result =
-        Montage<float>::testHeader(code, context, stdHeader, &message);
+  return result;
+}
 
-    *errorMessage = QString::fromStdString(message);
+void TrackCodeValidator::validateLater(const QString &input,
+                                       const QString &header) {
+  QString message;
+  const Precheck check = precheck(input, header, &message, &latestKey);
 
-    return result;
+  if (check == Precheck::NeedsCompiler) {
+    debounceTimer->start();
   } else {
-    return Montage<float>::testHeader(code, context, stdHeader, nullptr);
+    debounceTimer->stop();
+    latestKey.clear();
+    emit validated(check == Precheck::Valid, message);
+  }
+}
+
+void TrackCodeValidator::startCompilation() {
+  if (latestKey.isEmpty())
+    return;
+
+  // Only one compilation at a time. Try again when it's done.
+  if (compilation.valid()) {
+    debounceTimer->start();
+    return;
+  }
+
+  compilationKey = latestKey;
+  const string source = compilationKey.toStdString();
+  OpenCLContext *const c = context;
+
+  compilation = async(launch::async, [source, c]() {
+    return make_unique<OpenCLProgram>(source, c);
+  });
+  pollTimer->start();
+}
+
+void TrackCodeValidator::checkCompilation() {
+  if (compilation.wait_for(chrono::seconds(0)) != future_status::ready)
+    return;
+
+  pollTimer->stop();
+
+  QString message;
+  const bool result = finish(compilationKey, compilation.get(), &message);
+
+  // Results for code that was edited in the meantime are only cached.
+  if (compilationKey == latestKey) {
+    latestKey.clear();
+    emit validated(result, message);
+  }
+}
+
+TrackCodeValidator::Precheck
+TrackCodeValidator::precheck(const QString &input, const QString &header,
+                             QString *message, QString *key) {
+  string syntaxError;
+  if (!Montage<float>::checkSyntax(input.toStdString(), &syntaxError)) {
+    *message = QString::fromStdString(syntaxError);
+    return Precheck::Invalid;
+  }
+
+  // Without OpenCL SignalProcessor computes only what CpuMontage supports.
+  if (!context) {
+    string error;
+    if (hasDefaultBuiltins(header.toStdString()) &&
+        CpuMontage<float>::parse(
+            SignalProcessor::simplifyMontage<float>(input.toStdString()),
+            labels, -1, &error))
+      return Precheck::Valid;
+
+    *message = QString::fromStdString(
+        "OpenCL is not available, and the code cannot be computed on the "
+        "CPU. " +
+        error);
+    return Precheck::Invalid;
+  }
+
+  // A montage formula with a bad label doesn't violate the syntax. Instead a
+  // fall back to zero is used. This is consistent with how an invalid index is
+  // handled. The labels are needed only to get the same key as in
+  // SignalProcessor.
+  const Montage<float> montage(
+      shareSumsOf(SignalProcessor::simplifyMontage<float>(input.toStdString()),
+                  header.toStdString()),
+      context, header.toStdString(), labels, layout);
+
+  if (NormalMontage != montage.getMontageType())
+    return Precheck::Valid;
+
+  // SignalProcessor runs such code without OpenCL, so there is nothing to
+  // compile.
+  if (runsOnCpu(input.toStdString(), header.toStdString()))
+    return Precheck::Valid;
+
+  *key = QString::fromStdString(montage.getSource());
+
+  if (OpenDataFile::kernelCache->find(*key))
+    return Precheck::Valid;
+
+  if (*key == lastFailedKey) {
+    *message = lastFailure;
+    return Precheck::Invalid;
+  }
+
+  return Precheck::NeedsCompiler;
+}
+
+string TrackCodeValidator::shareSumsOf(const string &code,
+                                       const string &header) const {
+  // SignalProcessor rewrites the sums shared with the other tracks.
+  if (!otherTracksSet || !hasDefaultBuiltins(header))
+    return code;
+
+  vector<string> montageCode;
+  for (const string &e : otherTracks)
+    montageCode.push_back(SignalProcessor::simplifyMontage<float>(e));
+  montageCode.push_back(code);
+
+  shareSums(&montageCode, labels, fileChannels);
+  return montageCode.back();
+}
+
+bool TrackCodeValidator::runsOnCpu(const string &input,
+                                   const string &header) const {
+  // The same conditions as in SignalProcessor::updateCpuMontage().
+  if (!programOption<bool>("cpuBackend") || !otherTracksSet ||
+      !hasDefaultBuiltins(header))
+    return false;
+
+  if (!CpuMontage<float>::parse(SignalProcessor::simplifyMontage<float>(input),
+                                labels))
+    return false;
+
+  for (const string &e : otherTracks) {
+    if (!CpuMontage<float>::parse(SignalProcessor::simplifyMontage<float>(e),
+                                  labels))
+      return false;
   }
 
   return true;
 }
+
+bool TrackCodeValidator::finish(const QString &key,
+                                unique_ptr<OpenCLProgram> program,
+                                QString *message) {
+  if (CL_SUCCESS == program->compileStatus()) {
+    OpenDataFile::kernelCache->insert(key, program.release());
+    return true;
+  }
+
+  lastFailedKey = key;
+  lastFailure = QString::fromStdString("Compilation failed:\n" +
+                                       program->getCompileLog());
+  *message = lastFailure;
+  return false;
+}
@@ -1,32 +1,135 @@
 #ifndef TRACKCODEVALIDATOR_H
 #define TRACKCODEVALIDATOR_H
 
+#include "../../Alenka-Signal/include/AlenkaSignal/montage.h"
+
+#include <QObject>
 #include <QString>
 
+#include <future>
+#include <memory>
 #include <string>
+#include <vector>
+
+class QTimer;
 
 namespace AlenkaSignal {
 class OpenCLContext;
-}
+class OpenCLProgram;
+} // namespace AlenkaSignal
 
 /**
  * @brief A convenience class for testing montage track code.
+ *
+ * The code is first checked by Montage::checkSyntax(), which is instant. With
+ * the cpuBackend option, code that CpuMontage can compile is accepted right
+ * away, if SignalProcessor would compute the whole montage on the CPU. Only
+ * then the OpenCL compiler is used. Without an OpenCL context only the code
+ * CpuMontage supports is valid. Successfully compiled programs
+ * are put in KernelCache under the same key SignalProcessor uses, so the
+ * compilation is not repeated when the montage gets applied. For this the sums
+ * shared with the other tracks are replaced like in SignalProcessor, so the
+ * other tracks must be set. The last failure is remembered too.
+ *
+ * validateLater() is meant for checking the code while it is being typed: the
+ * compilation is postponed until the input stops changing, and runs on a
+ * background thread. The result is reported by the validated() signal.
  */
-class TrackCodeValidator {
+class TrackCodeValidator : public QObject {
+  Q_OBJECT
+
   AlenkaSignal::OpenCLContext *context;
+  std::vector<std::string> labels;
+  std::vector<std::string> otherTracks;
+  bool otherTracksSet = false;
+  int fileChannels = 0;
+  AlenkaSignal::MontageLayout layout;
+
+  QTimer *debounceTimer;
+  QTimer *pollTimer;
+  QString latestKey;
+  QString compilationKey;
+  std::future<std::unique_ptr<AlenkaSignal::OpenCLProgram>> compilation;
+
+  QString lastFailedKey;
+  QString lastFailure;
 
 public:
-  TrackCodeValidator();
+  explicit TrackCodeValidator(QObject *parent = nullptr);
+  ~TrackCodeValidator();
+
+  /**
+   * @brief Labels used to resolve names like in("Fp1") in the code.
+   *
+   * They don't affect the validity, but they are part of the KernelCache key.
+   */
+  void setLabels(const std::vector<std::string> &labels) {
+    this->labels = labels;
+  }
+
+  /**
+   * @brief The code of the other visible tracks of the montage.
+   *
+   * SignalProcessor uses CpuMontage only if all tracks are supported, and
+   * the sums shared by the tracks are replaced in the code. Unless this is
+   * set, the code is always compiled by OpenCL, and the programs may not
+   * match the ones SignalProcessor looks for in KernelCache.
+   *
+   * @param fileChannels The channel count of the recording, which bounds the
+   * shared sums the same way as in SignalProcessor.
+   */
+  void setOtherTracks(const std::vector<std::string> &code, int fileChannels) {
+    otherTracks = code;
+    otherTracksSet = true;
+    this->fileChannels = fileChannels;
+  }
+
+  /**
+   * @brief The sizes compiled into the kernels.
+   *
+   * Like the labels, they are part of the KernelCache key. Use
+   * OpenDataFile::montageLayout.
+   */
+  void setMontageLayout(const AlenkaSignal::MontageLayout &layout) {
+    this->layout = layout;
+  }
 
   /**
    * @brief Test the code in input.
    * @param input Input code.
+   * @param header Input OpenCL header.
    * @param errorMessage [out]
-   * @param input Input OpenCL header.
    * @return True if the test succeeds.
    */
   bool validate(const QString &input, const QString &header,
                 QString *errorMessage = nullptr);
+
+  /**
+   * @brief Test the code in input asynchronously.
+   *
+   * Syntax errors are reported immediately. The compilation starts after
+   * the input hasn't changed for a while.
+   */
+  void validateLater(const QString &input, const QString &header);
+
+signals:
+  void validated(bool valid, const QString &message);
+
+private slots:
+  void startCompilation();
+  void checkCompilation();
+
+private:
+  enum class Precheck { Valid, Invalid, NeedsCompiler };
+
+  Precheck precheck(const QString &input, const QString &header,
+                    QString *message, QString *key);
+  std::string shareSumsOf(const std::string &code,
+                          const std::string &header) const;
+  bool runsOnCpu(const std::string &input, const std::string &header) const;
+  bool finish(const QString &key,
+              std::unique_ptr<AlenkaSignal::OpenCLProgram> program,
+              QString *message);
 };
 
 #endif // TRACKCODEVALIDATOR_H
@@ -54,6 +54,11 @@ Code common for all montage formulas:)";
   editor = new QTextEdit(this);
   box->addWidget(editor);
 
+  status = new QLabel(this);
+  status->setWordWrap(true);
+  status->setTextInteractionFlags(Qt::TextSelectableByMouse);
+  box->addWidget(status);
+
   auto buttonBox = new QDialogButtonBox(
       QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
   auto button = new QPushButton("Validate", this);
@@ -64,6 +69,11 @@ Code common for all montage formulas:)";
   connect(buttonBox, SIGNAL(rejected()), this, SLOT(reject()));
   connect(button, SIGNAL(clicked(bool)), this, SLOT(validate()));
 
+  connect(editor, SIGNAL(textChanged()), this, SLOT(validateLater()));
+  connect(header, SIGNAL(textChanged()), this, SLOT(validateLater()));
+  connect(validator.get(), SIGNAL(validated(bool, QString)), this,
+          SLOT(showValidation(bool, QString)));
+
   widget = new QWidget;
   widget->setLayout(box);
   splitter->addWidget(widget);
@@ -77,6 +87,20 @@ CodeEditDialog::~CodeEditDialog() {}
 
 QString CodeEditDialog::getText() const { return editor->toPlainText(); }
 
+void CodeEditDialog::setLabels(const vector<string> &labels) {
+  validator->setLabels(labels);
+}
+
+void CodeEditDialog::setOtherTracks(const vector<string> &code,
+                                    int fileChannels) {
+  validator->setOtherTracks(code, fileChannels);
+}
+
+void CodeEditDialog::setMontageLayout(
+    const AlenkaSignal::MontageLayout &layout) {
+  validator->setMontageLayout(layout);
+}
+
 void CodeEditDialog::errorMessageDialog(const QString &message,
                                         QWidget *parent) {
   // TODO: Make a better error dialog.
@@ -119,3 +143,25 @@ void CodeEditDialog::validate() {
     errorMessageDialog(message, this);
   }
 }
+
+void CodeEditDialog::validateLater() {
+  status->setStyleSheet("");
+  status->setText("Compiling...");
+  status->setToolTip("");
+
+  // Syntax errors are reported right away by this call.
+  validator->validateLater(getText(), header->toPlainText());
+}
+
+void CodeEditDialog::showValidation(bool valid, const QString &message) {
+  if (valid) {
+    status->setStyleSheet("color: green");
+    status->setText("Montage code compiled correctly");
+    status->setToolTip("");
+  } else {
+    // Compilation logs can be long, so only the beginning is shown here.
+    status->setStyleSheet("color: red");
+    status->setText(message.section('\n', 0, 2));
+    status->setToolTip(message);
+  }
+}
@@ -4,10 +4,17 @@
 #include <QDialog>
 
 #include <memory>
+#include <string>
+#include <vector>
 
+class QLabel;
 class QTextEdit;
 class TrackCodeValidator;
 
+namespace AlenkaSignal {
+struct MontageLayout;
+} // namespace AlenkaSignal
+
 /**
  * @brief Implements a dialog for entering more detailed montage track code.
  */
@@ -16,6 +23,7 @@ class CodeEditDialog : public QDialog {
 
   QTextEdit *header;
   QTextEdit *editor;
+  QLabel *status;
   std::unique_ptr<TrackCodeValidator> validator;
 
 public:
@@ -24,6 +32,22 @@ public:
 
   QString getText() const;
 
+  /**
+   * @brief Sets the labels used to resolve names in the code.
+   */
+  void setLabels(const std::vector<std::string> &labels);
+
+  /**
+   * @brief Sets the code of the other visible tracks of the montage, and the
+   * channel count of the recording.
+   */
+  void setOtherTracks(const std::vector<std::string> &code, int fileChannels);
+
+  /**
+   * @brief Sets the sizes the montage kernels are compiled for.
+   */
+  void setMontageLayout(const AlenkaSignal::MontageLayout &layout);
+
   /**
    * @brief Shows a message dialog with the error message.
    */
@@ -40,6 +64,8 @@ public slots:
 
 private slots:
   void validate();
+  void validateLater();
+  void showValidation(bool valid, const QString &message);
 };
 
 #endif // CODEEDITDIALOG_H
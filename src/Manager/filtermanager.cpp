@@ -123,6 +123,28 @@ FilterManager::FilterManager(QWidget *parent) : QWidget(parent) {
           });
   hbox->addWidget(windowCombo);
 
+  label = new QLabel("Design:");
+  label->setToolTip("FIR uses the frequency-sampled coefficients; IIR uses "
+                    "4th order Butterworth filters run forward and backward, "
+                    "which is cheaper at high sampling rates (the window is "
+                    "not used, and FIR is used while multipliers are on)");
+  hbox->addWidget(label);
+  auto designCombo = new QComboBox();
+  designCombo->addItem("FIR");
+  designCombo->addItem("IIR");
+  connect(
+      designCombo,
+      static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
+      [](int index) {
+        OpenDataFile::infoTable.setFilterDesign(
+            static_cast<AlenkaSignal::FilterDesign>(index));
+      });
+  connect(&OpenDataFile::infoTable, &InfoTable::filterDesignChanged,
+          [designCombo](AlenkaSignal::FilterDesign index) {
+            designCombo->setCurrentIndex(static_cast<int>(index));
+          });
+  hbox->addWidget(designCombo);
+
   hbox->addStretch();
 
   QPushButton *applyButton = new QPushButton("Apply");
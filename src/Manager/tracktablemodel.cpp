@@ -4,6 +4,7 @@
 #include "../DataModel/trackcodevalidator.h"
 #include "../DataModel/undocommandfactory.h"
 #include "../DataModel/vitnessdatamodel.h"
+#include "../SignalProcessor/signalprocessor.h"
 #include "codeeditdialog.h"
 
 #include <QAction>
@@ -24,6 +25,25 @@ const AbstractTrackTable *currentTrackTable(OpenDataFile *file) {
       OpenDataFile::infoTable.getSelectedMontage());
 }
 
+vector<string> defaultLabels(OpenDataFile *file) {
+  return SignalProcessor::collectLabels(
+      file->dataModel->montageTable()->trackTable(0));
+}
+
+// The code of the visible tracks of the current montage except track row.
+vector<string> otherTrackCode(OpenDataFile *file, int row) {
+  const AbstractTrackTable *trackTable = currentTrackTable(file);
+  vector<string> code;
+
+  for (int i = 0; i < trackTable->rowCount(); ++i) {
+    const Track t = trackTable->row(i);
+    if (i != row && !t.hidden)
+      code.push_back(t.code);
+  }
+
+  return code;
+}
+
 class Label : public TableColumn {
 public:
   Label(OpenDataFile *file) : TableColumn("Label", file) {}
@@ -71,6 +91,11 @@ public:
       const QString qc = value.toString();
       const string c = qc.toStdString();
 
+      validator->setLabels(defaultLabels(file));
+      validator->setOtherTracks(otherTrackCode(file, row),
+                                file->file->getChannelCount());
+      validator->setMontageLayout(file->montageLayout);
+
       if (t.code != c &&
           validator->validate(
               qc, OpenDataFile::infoTable.getGlobalMontageHeader())) {
@@ -94,14 +119,24 @@ public:
 
   bool createEditor(const QStyledItemDelegate *delegate, QWidget *parent,
                     const QStyleOptionViewItem & /*option*/,
-                    const QModelIndex & /*index*/,
+                    const QModelIndex &index,
                     QWidget **widget) const override {
     auto lineEdit = new QLineEdit(parent);
     QAction *action = lineEdit->addAction(QIcon(":/icons/edit.png"),
                                           QLineEdit::TrailingPosition);
 
-    lineEdit->connect(action, &QAction::triggered, [lineEdit, delegate]() {
+    const vector<string> labels = defaultLabels(file);
+    const vector<string> otherTracks = otherTrackCode(file, index.row());
+    const int fileChannels = file->file->getChannelCount();
+    const AlenkaSignal::MontageLayout layout = file->montageLayout;
+
+    lineEdit->connect(action, &QAction::triggered,
+                      [lineEdit, delegate, labels, otherTracks, fileChannels,
+                       layout]() {
       CodeEditDialog dialog(lineEdit);
+      dialog.setLabels(labels);
+      dialog.setOtherTracks(otherTracks, fileChannels);
+      dialog.setMontageLayout(layout);
       dialog.setText(lineEdit->text());
       int result = dialog.exec();
 
@@ -119,9 +154,13 @@ public:
 
   bool setModelData(const QStyledItemDelegate * /*delegate*/, QWidget *editor,
                     QAbstractItemModel * /*model*/,
-                    const QModelIndex & /*index*/) const override {
+                    const QModelIndex &index) const override {
     QLineEdit *lineEdit = reinterpret_cast<QLineEdit *>(editor);
     QString message;
+    validator->setLabels(defaultLabels(file));
+    validator->setOtherTracks(otherTrackCode(file, index.row()),
+                              file->file->getChannelCount());
+    validator->setMontageLayout(file->montageLayout);
 
     if (!validator->validate(lineEdit->text(),
                              OpenDataFile::infoTable.getGlobalMontageHeader(),
@@ -0,0 +1,352 @@
+#include "autotuner.h"
+
+#include "../../Alenka-File/include/AlenkaFile/syntheticfile.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/openclcontext.h"
+#include "../DataModel/kernelcache.h"
+#include "../DataModel/opendatafile.h"
+#include "../DataModel/undocommandfactory.h"
+#include "../error.h"
+#include "../myapplication.h"
+#include "../options.h"
+#include "../signalfilebrowserwindow.h"
+#include "signalprocessor.h"
+
+#include <detailedexception.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <thread>
+
+using namespace std;
+using namespace AlenkaFile;
+
+namespace {
+
+const int SLEEP_FOR_MS = 10;
+
+// How long every candidate is measured.
+const double MEASURE_SECONDS = 0.5;
+
+// The length of the generated signal that LoopedFile repeats.
+const uint64_t PERIOD = 1 << 16;
+
+// The smallest blocks with at least this fraction of the best throughput are
+// chosen. The canvas waits for whole blocks and keeps them in the GPU memory,
+// so smaller blocks are worth a little throughput.
+const double GOOD_ENOUGH = 0.9;
+
+const int MIN_BLOCK_SIZE = 1 << 12;
+const int MAX_BLOCK_SIZE = 1 << 16;
+const int PARALLEL_QUEUES[] = {1, 2, 4};
+
+int nextPowerOfTwo(double x) {
+  int p = 1;
+  while (p < x)
+    p *= 2;
+  return p;
+}
+
+/**
+ * @brief A long recording that repeats a stretch of SyntheticFile.
+ *
+ * The samples are copied from memory, so the measurement isn't affected by
+ * how fast the signal is generated.
+ */
+class LoopedFile : public DataFile {
+  double samplingFrequency;
+  unsigned int channels;
+  vector<float> signal; // The channels are stored one after another.
+
+public:
+  LoopedFile(double samplingFrequency, int channels)
+      : DataFile(""), samplingFrequency(samplingFrequency),
+        channels(channels) {
+    SyntheticSettings settings;
+    settings.channels = channels;
+    settings.samplingFrequency = samplingFrequency;
+    settings.duration = PERIOD / samplingFrequency;
+
+    SyntheticFile source(settings);
+    assert(source.getSamplesRecorded() == PERIOD);
+
+    signal.resize(PERIOD * channels);
+    source.readSignal(signal.data(), 0, PERIOD - 1);
+  }
+
+  double getSamplingFrequency() const override { return samplingFrequency; }
+  unsigned int getChannelCount() const override { return channels; }
+  uint64_t getSamplesRecorded() const override { return PERIOD << 16; }
+  string getLabel(unsigned int channel) override {
+    return "Ch" + to_string(channel + 1);
+  }
+
+  bool load() override {
+    getDataModel()->montageTable()->insertRows(0);
+    fillDefaultMontage(0);
+    return false;
+  }
+
+  void readChannels(vector<float *> dataChannels, uint64_t firstSample,
+                    uint64_t lastSample) override {
+    readChannelsFloatDouble(dataChannels, firstSample, lastSample);
+  }
+  void readChannels(vector<double *> dataChannels, uint64_t firstSample,
+                    uint64_t lastSample) override {
+    readChannelsFloatDouble(dataChannels, firstSample, lastSample);
+  }
+
+private:
+  template <typename T>
+  void readChannelsFloatDouble(vector<T *> dataChannels, uint64_t firstSample,
+                               uint64_t lastSample) {
+    for (unsigned int j = 0; j < channels; ++j) {
+      const float *channel = signal.data() + j * PERIOD;
+      T *out = dataChannels[j];
+
+      for (uint64_t i = firstSample; i <= lastSample;) {
+        const uint64_t offset = i % PERIOD;
+        const uint64_t n = min(PERIOD - offset, lastSample - i + 1);
+
+        copy(channel + offset, channel + offset + n, out);
+        out += n;
+        i += n;
+      }
+    }
+  }
+};
+
+class OutputBuffers {
+public:
+  vector<cl_mem> buffers;
+
+  OutputBuffers(int count, size_t size, AlenkaSignal::OpenCLContext *context) {
+    for (int i = 0; i < count; ++i) {
+      cl_int err;
+      buffers.push_back(clCreateBuffer(context->getCLContext(),
+                                       CL_MEM_READ_WRITE, size, nullptr, &err));
+      checkClErrorCode(err, "clCreateBuffer()");
+    }
+  }
+  ~OutputBuffers() {
+    for (cl_mem e : buffers) {
+      cl_int err = clReleaseMemObject(e);
+      checkClErrorCode(err, "clReleaseMemObject()");
+    }
+  }
+};
+
+vector<Autotuner::Settings> candidates(double samplingFrequency) {
+  // Blocks shorter than twice the filter would be extended by SignalProcessor.
+  const int minBlockSize =
+      max(MIN_BLOCK_SIZE, nextPowerOfTwo(2 * samplingFrequency));
+  const int maxBlockSize =
+      max(MAX_BLOCK_SIZE, nextPowerOfTwo(4 * samplingFrequency));
+
+  vector<Autotuner::Settings> result;
+  for (int blockSize = minBlockSize; blockSize <= maxBlockSize;
+       blockSize *= 2) {
+    for (int parallelQueues : PARALLEL_QUEUES)
+      result.push_back(Autotuner::Settings{blockSize, parallelQueues});
+  }
+
+  return result;
+}
+
+/**
+ * @brief Returns the number of output samples per second.
+ */
+double measure(const Autotuner::Settings &candidate, OpenDataFile *file,
+               AlenkaSignal::OpenCLContext *context) {
+  SignalProcessor processor(candidate.blockSize, candidate.parallelQueues, 1,
+                            nullptr, file, context);
+
+  while (!processor.allTracksReady()) {
+    processor.updateCompiledTracks();
+    this_thread::sleep_for(chrono::milliseconds(SLEEP_FOR_MS));
+  }
+
+  const int rowLength = processor.montageLength();
+  OutputBuffers out(candidate.parallelQueues,
+                    rowLength * processor.getTrackCount() * sizeof(float),
+                    context);
+
+  vector<int> indexVector(candidate.parallelQueues);
+  int nextBlock = 0;
+  auto processNext = [&]() {
+    for (int &e : indexVector)
+      e = nextBlock++;
+    processor.process(indexVector, out.buffers);
+  };
+
+  // The first blocks include one-time costs like the FFT plans.
+  processNext();
+
+  using namespace chrono;
+  const auto start = high_resolution_clock::now();
+  int blocks = 0;
+  double seconds = 0;
+
+  while (seconds < MEASURE_SECONDS) {
+    processNext();
+    blocks += candidate.parallelQueues;
+
+    const nanoseconds time = high_resolution_clock::now() - start;
+    seconds = static_cast<double>(time.count()) / 1000 / 1000 / 1000;
+  }
+
+  // Adjacent blocks share one sample.
+  return static_cast<double>(blocks) * (rowLength - 1) / seconds;
+}
+
+} // namespace
+
+int Autotuner::autotuneCommandLine() {
+  vector<string> fileNames;
+  if (isProgramOptionSet("filename"))
+    programOption("filename", fileNames);
+
+  if (fileNames.empty()) {
+    cerr << "Error: no recording specified" << endl;
+    return EXIT_FAILURE;
+  }
+
+  try {
+    OpenDataFile::kernelCache = make_unique<KernelCache>();
+    if (programOption<bool>("kernelCachePersist"))
+      OpenDataFile::kernelCache->loadFromFile(globalContext.get());
+
+    // Recordings of the same profile are tuned only once.
+    map<QString, pair<double, int>> profiles;
+
+    for (const auto &e : fileNames) {
+      auto file = SignalFileBrowserWindow::dataFileBySuffix(
+          QString::fromStdString(e), vector<string>());
+      if (!file)
+        throwDetailed(runtime_error("Unsupported file type: " + e));
+
+      const double fs = file->getSamplingFrequency();
+      const int channels = file->getChannelCount();
+      profiles.emplace(profileKey(fs, channels, globalContext.get()),
+                       make_pair(fs, channels));
+    }
+
+    for (const auto &e : profiles) {
+      const Settings best =
+          tune(e.second.first, e.second.second, globalContext.get());
+
+      cout << e.first.toStdString() << ": blockSize = " << best.blockSize
+           << ", parProc = " << best.parallelQueues << endl;
+    }
+  } catch (const exception &e) {
+    cerr << "Error: " << catchDetailed(e) << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+Autotuner::Settings Autotuner::tune(double samplingFrequency, int channelCount,
+                                    AlenkaSignal::OpenCLContext *context) {
+  auto dataModel = UndoCommandFactory::emptyDataModel();
+  LoopedFile file(samplingFrequency, channelCount);
+  file.setDataModel(dataModel.get());
+  file.load();
+
+  OpenDataFile openFile;
+  openFile.file = &file;
+  openFile.dataModel = dataModel.get();
+
+  // A typical filter, so that it isn't skipped as an all-pass.
+  InfoTable &infoTable = OpenDataFile::infoTable;
+  infoTable.setSelectedMontage(0);
+  infoTable.setHighpassFrequency(0.5);
+  infoTable.setHighpassOn(true);
+  infoTable.setLowpassFrequency(samplingFrequency / 4);
+  infoTable.setLowpassOn(true);
+
+  Settings best{0, 0};
+  double bestThroughput = 0;
+  vector<pair<Settings, double>> results;
+
+  for (const Settings &candidate : candidates(samplingFrequency)) {
+    try {
+      const double throughput = measure(candidate, &openFile, context);
+      results.emplace_back(candidate, throughput);
+      bestThroughput = max(bestThroughput, throughput);
+
+      char str[200];
+      snprintf(str, sizeof(str),
+               "Autotune %g Hz, %d channels: blockSize = %d, parProc = %d: "
+               "%.4g samples/s",
+               samplingFrequency, channelCount, candidate.blockSize,
+               candidate.parallelQueues, throughput);
+      logToFileAndConsole(str);
+    } catch (const exception &e) {
+      // Most likely there is not enough memory for the large blocks.
+      logToFileAndConsole("Autotune skipped blockSize = "
+                          << candidate.blockSize << ", parProc = "
+                          << candidate.parallelQueues << ": "
+                          << catchDetailed(e));
+    }
+  }
+
+  if (results.empty())
+    throwDetailed(runtime_error("All autotune candidates failed"));
+
+  // The candidates go from the smallest blocks.
+  for (const auto &e : results) {
+    if (GOOD_ENOUGH * bestThroughput <= e.second) {
+      best = e.first;
+      break;
+    }
+  }
+
+  const QString key = profileKey(samplingFrequency, channelCount, context);
+  PROGRAM_OPTIONS->settings(key + "/blockSize", best.blockSize);
+  PROGRAM_OPTIONS->settings(key + "/parProc", best.parallelQueues);
+
+  return best;
+}
+
+Autotuner::Settings
+Autotuner::settingsFor(const DataFile *file,
+                       const AlenkaSignal::OpenCLContext *context) {
+  Settings settings{programOption<int>("blockSize"),
+                    programOption<int>("parProc")};
+
+  // The settings are tuned for a device, so they don't apply without one.
+  if (!programOption<bool>("autotuned") || !context)
+    return settings;
+
+  const QString key = profileKey(file->getSamplingFrequency(),
+                                 file->getChannelCount(), context);
+  const int blockSize = PROGRAM_OPTIONS->settings(key + "/blockSize").toInt();
+  const int parallelQueues =
+      PROGRAM_OPTIONS->settings(key + "/parProc").toInt();
+
+  if (0 < blockSize && 0 < parallelQueues) {
+    settings = Settings{blockSize, parallelQueues};
+    logToFile("Using autotuned blockSize = " << blockSize << ", parProc = "
+                                             << parallelQueues << " for "
+                                             << key.toStdString() << ".");
+  }
+
+  return settings;
+}
+
+QString Autotuner::profileKey(double samplingFrequency, int channelCount,
+                              const AlenkaSignal::OpenCLContext *context) {
+  // A slash would start a new group of keys.
+  QString device = QString::fromStdString(context->deviceFingerprint());
+  device.replace('/', '_').replace('\\', '_');
+
+  return QString("autotune/%1/fs%2/ch%3")
+      .arg(device)
+      .arg(nextPowerOfTwo(samplingFrequency))
+      .arg(nextPowerOfTwo(channelCount));
+}
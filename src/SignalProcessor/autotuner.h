@@ -0,0 +1,65 @@
+#ifndef AUTOTUNER_H
+#define AUTOTUNER_H
+
+#include <QString>
+
+namespace AlenkaFile {
+class DataFile;
+}
+
+namespace AlenkaSignal {
+class OpenCLContext;
+}
+
+/**
+ * @brief Finds the blockSize and parProc that work best on a device.
+ *
+ * The best values depend on the sampling rate (the filter has fs + 1 samples),
+ * the number of channels and the device. So SignalProcessor is measured with
+ * a synthetic recording of the same shape over a few candidate settings, and
+ * the result is stored in the settings database under a profile key. The
+ * profiles cover ranges of the sampling rate and the channel count bounded by
+ * powers of two, so that similar recordings share them.
+ *
+ * When a file is opened, the stored values of its profile are used instead of
+ * the blockSize and parProc options, unless the autotuned option is off.
+ */
+class Autotuner {
+public:
+  struct Settings {
+    int blockSize;
+    int parallelQueues;
+  };
+
+  /**
+   * @brief Implements the --autotune command-line mode.
+   * @return The exit status.
+   *
+   * The profiles are given by the recordings specified on the command line.
+   */
+  static int autotuneCommandLine();
+
+  /**
+   * @brief Measures the candidate settings, and stores the best ones.
+   */
+  static Settings tune(double samplingFrequency, int channelCount,
+                       AlenkaSignal::OpenCLContext *context);
+
+  /**
+   * @brief Returns the settings to be used for file.
+   *
+   * These are the tuned ones if they are stored for the profile of the file,
+   * or the blockSize and parProc options otherwise, e.g. when context is
+   * nullptr.
+   */
+  static Settings settingsFor(const AlenkaFile::DataFile *file,
+                              const AlenkaSignal::OpenCLContext *context);
+
+  /**
+   * @brief Returns the settings database key of the profile.
+   */
+  static QString profileKey(double samplingFrequency, int channelCount,
+                            const AlenkaSignal::OpenCLContext *context);
+};
+
+#endif // AUTOTUNER_H
@@ -0,0 +1,590 @@
+#include "batchprocessor.h"
+
+#include "../../Alenka-File/include/AlenkaFile/edf.h"
+#include "../../Alenka-File/include/AlenkaFile/gdf2.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/openclcontext.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/spikedet.h"
+#include "../DataModel/opendatafile.h"
+#include "../DataModel/undocommandfactory.h"
+#include "../error.h"
+#include "../myapplication.h"
+#include "../options.h"
+#include "../signalfilebrowserwindow.h"
+#include "../tracer.h"
+#include "autotuner.h"
+#include "kernelprecompiler.h"
+#include "signalprocessor.h"
+
+#include <detailedexception.h>
+#include <localeoverride.h>
+
+#include <QFileInfo>
+#include <QString>
+
+#ifndef __APPLE__
+#include <samplerate.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+using namespace AlenkaFile;
+
+namespace {
+
+const int SLEEP_FOR_MS = 10;
+
+/**
+ * @brief Presents the tracks produced by SignalProcessor as a DataFile.
+ *
+ * Only the non-hidden tracks of the selected montage are included. The signal
+ * is produced block by block as it is read, so the readers are expected to go
+ * through it sequentially from the start like GDF2::saveAs() does. Reading
+ * from before the last position starts over; EDF::saveAs() needs two passes,
+ * the first one determines the physical range.
+ *
+ * The events are passed through only when the signal isn't resampled.
+ */
+class ProcessedFile : public DataFile {
+  OpenDataFile *source;
+  SignalProcessor *processor;
+  unique_ptr<DataModel> emptyDataModel;
+  vector<string> labels;
+  double samplingFrequency, ratio;
+  uint64_t sourceSamples, samplesRecorded;
+
+  cl_command_queue queue;
+  vector<cl_mem> outBuffers;
+  vector<float> blockBuffer;
+  int nextBlock = 0;
+  uint64_t sourcePosition = 0;
+  bool flushed = false;
+
+  vector<vector<float>> fifo;
+  uint64_t fifoStart = 0;
+
+#ifndef __APPLE__
+  SRC_STATE *resampler = nullptr;
+#endif
+  vector<float> interleaved, resampled;
+
+  uint64_t processed = 0;
+  int lastPercentage = -1;
+
+public:
+  /**
+   * @param outputFrequency The sampling frequency of the result; 0 means no
+   * resampling.
+   */
+  ProcessedFile(OpenDataFile *source, SignalProcessor *processor,
+                AlenkaSignal::OpenCLContext *context,
+                unsigned int parallelQueues, double outputFrequency);
+  ~ProcessedFile() override;
+
+  double getSamplingFrequency() const override { return samplingFrequency; }
+  unsigned int getChannelCount() const override {
+    return static_cast<unsigned int>(labels.size());
+  }
+  uint64_t getSamplesRecorded() const override { return samplesRecorded; }
+  double getStartDate() const override { return source->file->getStartDate(); }
+  time_t getStandardStartDate() const override {
+    return source->file->getStandardStartDate();
+  }
+  void readChannels(vector<float *> dataChannels, uint64_t firstSample,
+                    uint64_t lastSample) override {
+    readChannelsFloatDouble(dataChannels, firstSample, lastSample);
+  }
+  void readChannels(vector<double *> dataChannels, uint64_t firstSample,
+                    uint64_t lastSample) override {
+    readChannelsFloatDouble(dataChannels, firstSample, lastSample);
+  }
+  string getLabel(unsigned int channel) override {
+    if (channel < getChannelCount())
+      return labels[channel];
+    return "";
+  }
+
+  /**
+   * @brief Returns the number of input samples per channel processed so far,
+   * including any repeated passes.
+   */
+  uint64_t processedSamples() const { return processed; }
+
+private:
+  uint64_t fifoLength() const { return fifo.empty() ? 0 : fifo[0].size(); }
+  bool produce();
+  void append(const float *data, int rowLength, int count);
+  void resample(long frames, bool endOfInput);
+  void rewind();
+  void printProgress();
+
+  template <class T>
+  void readChannelsFloatDouble(vector<T *> dataChannels, uint64_t firstSample,
+                               uint64_t lastSample);
+};
+
+ProcessedFile::ProcessedFile(OpenDataFile *source, SignalProcessor *processor,
+                             AlenkaSignal::OpenCLContext *context,
+                             unsigned int parallelQueues,
+                             double outputFrequency)
+    : DataFile(source->file->getFilePath()), source(source),
+      processor(processor) {
+  const double sourceFrequency = source->file->getSamplingFrequency();
+  samplingFrequency = 0 < outputFrequency ? outputFrequency : sourceFrequency;
+  ratio = samplingFrequency / sourceFrequency;
+
+  sourceSamples = source->file->getSamplesRecorded();
+  samplesRecorded =
+      ratio == 1 ? sourceSamples
+                 : static_cast<uint64_t>(floor(sourceSamples * ratio));
+
+  const int index = OpenDataFile::infoTable.getSelectedMontage();
+  const AbstractTrackTable *trackTable =
+      source->dataModel->montageTable()->trackTable(index);
+
+  for (int i = 0; i < trackTable->rowCount(); ++i) {
+    const Track t = trackTable->row(i);
+    if (!t.hidden)
+      labels.push_back(t.label);
+  }
+
+  assert(static_cast<int>(labels.size()) == processor->getTrackCount());
+  const int channels = getChannelCount();
+  fifo.resize(channels);
+
+  if (ratio == 1) {
+    setDataModel(source->file->getDataModel());
+  } else {
+    emptyDataModel = UndoCommandFactory::emptyDataModel();
+    setDataModel(emptyDataModel.get());
+
+#ifdef __APPLE__
+    throwDetailed(runtime_error("Resampling is not supported on Mac"));
+#else
+    int err;
+    resampler = src_new(SRC_SINC_MEDIUM_QUALITY, channels, &err);
+    if (!resampler)
+      throwDetailed(runtime_error(string("src_new failed: ") +
+                                  src_strerror(err)));
+
+    const int rowLength = processor->montageLength();
+    interleaved.resize(rowLength * channels);
+    resampled.resize((static_cast<int>(ceil(rowLength * ratio)) + 1024) *
+                     channels);
+#endif
+  }
+
+  cl_int err;
+  queue = clCreateCommandQueue(context->getCLContext(),
+                               context->getCLDevice(), 0, &err);
+  checkClErrorCode(err, "clCreateCommandQueue()");
+
+  blockBuffer.resize(processor->montageLength() * channels);
+  const size_t size = blockBuffer.size() * sizeof(float);
+
+  for (unsigned int i = 0; i < parallelQueues; ++i) {
+    outBuffers.push_back(clCreateBuffer(
+        context->getCLContext(), CL_MEM_READ_WRITE, size, nullptr, &err));
+    checkClErrorCode(err, "clCreateBuffer()");
+  }
+}
+
+ProcessedFile::~ProcessedFile() {
+  cl_int err;
+
+  for (cl_mem e : outBuffers) {
+    err = clReleaseMemObject(e);
+    checkClErrorCode(err, "clReleaseMemObject()");
+  }
+
+  err = clReleaseCommandQueue(queue);
+  checkClErrorCode(err, "clReleaseCommandQueue()");
+
+#ifndef __APPLE__
+  if (resampler)
+    src_delete(resampler);
+#endif
+}
+
+bool ProcessedFile::produce() {
+  traceSpan("batchBlock");
+  if (sourceSamples <= sourcePosition) {
+    if (ratio == 1 || flushed)
+      return false;
+
+    // Get the rest of the samples out of the resampler.
+    flushed = true;
+    resample(0, true);
+    return true;
+  }
+
+  // Adjacent blocks share one sample; only the first one is used.
+  const int rowLength = processor->montageLength();
+  const int step = rowLength - 1;
+
+  vector<int> indexVector;
+  vector<cl_mem> bufferVector;
+
+  for (unsigned int i = 0; i < outBuffers.size(); ++i) {
+    const int index = nextBlock + i;
+    if (sourceSamples <= static_cast<uint64_t>(index) * step)
+      break;
+
+    indexVector.push_back(index);
+    bufferVector.push_back(outBuffers[i]);
+  }
+
+  processor->process(indexVector, bufferVector);
+
+  for (cl_mem buffer : bufferVector) {
+    cl_int err = clEnqueueReadBuffer(queue, buffer, CL_TRUE, 0,
+                                     blockBuffer.size() * sizeof(float),
+                                     blockBuffer.data(), 0, nullptr, nullptr);
+    checkClErrorCode(err, "clEnqueueReadBuffer()");
+
+    const int count =
+        static_cast<int>(min<uint64_t>(step, sourceSamples - sourcePosition));
+    append(blockBuffer.data(), rowLength, count);
+
+    sourcePosition += count;
+    processed += count;
+  }
+
+  nextBlock += static_cast<int>(indexVector.size());
+  printProgress();
+  return true;
+}
+
+void ProcessedFile::append(const float *data, int rowLength, int count) {
+  const int channels = getChannelCount();
+
+  if (ratio == 1) {
+    for (int i = 0; i < channels; ++i) {
+      const float *row = data + i * rowLength;
+      fifo[i].insert(fifo[i].end(), row, row + count);
+    }
+    return;
+  }
+
+  // libsamplerate expects the channels interleaved.
+  for (int i = 0; i < count; ++i)
+    for (int j = 0; j < channels; ++j)
+      interleaved[i * channels + j] = data[j * rowLength + i];
+
+  resample(count, false);
+}
+
+void ProcessedFile::resample(long frames, bool endOfInput) {
+#ifdef __APPLE__
+  (void)frames;
+  (void)endOfInput;
+#else
+  const int channels = getChannelCount();
+
+  SRC_DATA data;
+  data.data_in = interleaved.data();
+  data.input_frames = frames;
+  data.end_of_input = endOfInput ? 1 : 0;
+  data.src_ratio = ratio;
+
+  do {
+    data.data_out = resampled.data();
+    data.output_frames = static_cast<long>(resampled.size() / channels);
+
+    int err = src_process(resampler, &data);
+    if (err != 0)
+      throwDetailed(runtime_error(string("src_process failed: ") +
+                                  src_strerror(err)));
+
+    for (long i = 0; i < data.output_frames_gen; ++i)
+      for (int j = 0; j < channels; ++j)
+        fifo[j].push_back(resampled[i * channels + j]);
+
+    data.data_in += data.input_frames_used * channels;
+    data.input_frames -= data.input_frames_used;
+  } while (0 < data.input_frames ||
+           data.output_frames_gen == data.output_frames ||
+           (endOfInput && 0 < data.output_frames_gen));
+#endif
+}
+
+void ProcessedFile::rewind() {
+  nextBlock = 0;
+  sourcePosition = 0;
+  flushed = false;
+  lastPercentage = -1;
+
+  for (auto &e : fifo)
+    e.clear();
+  fifoStart = 0;
+
+#ifndef __APPLE__
+  if (resampler)
+    src_reset(resampler);
+#endif
+}
+
+void ProcessedFile::printProgress() {
+  const int percentage = static_cast<int>(100 * sourcePosition / sourceSamples);
+
+  if (percentage < 100 && lastPercentage < percentage) {
+    fprintf(stderr, "progress: %3d%%\n", percentage);
+    lastPercentage = percentage;
+  }
+}
+
+template <class T>
+void ProcessedFile::readChannelsFloatDouble(vector<T *> dataChannels,
+                                            uint64_t firstSample,
+                                            uint64_t lastSample) {
+  assert(firstSample <= lastSample && "Bad parameter order.");
+
+  if (firstSample < fifoStart)
+    rewind();
+
+  while (fifoStart + fifoLength() <= lastSample && produce())
+    continue;
+
+  // The samples before firstSample won't be needed anymore.
+  const uint64_t drop = min(firstSample - fifoStart, fifoLength());
+  for (auto &e : fifo)
+    e.erase(e.begin(), e.begin() + drop);
+  fifoStart += drop;
+
+  // The resampler can produce a few samples less than expected; these are
+  // filled with zeros.
+  const uint64_t offset = firstSample - fifoStart;
+  const uint64_t n = lastSample - firstSample + 1;
+  const uint64_t available =
+      offset < fifoLength() ? min(n, fifoLength() - offset) : 0;
+
+  for (unsigned int i = 0; i < getChannelCount(); ++i) {
+    auto it = fifo[i].begin() + offset;
+    copy(it, it + available, dataChannels[i]);
+    fill(dataChannels[i] + available, dataChannels[i] + n, T(0));
+  }
+}
+
+/**
+ * @brief Writes the signal as 32-bit floats with the channels interleaved.
+ */
+void saveRaw(const string &filePath, DataFile *sourceFile) {
+  ofstream file(filePath, ios::binary | ios::trunc);
+  if (!file)
+    throwDetailed(runtime_error("File '" + filePath +
+                                "' could not be opened for writing"));
+
+  const unsigned int channels = sourceFile->getChannelCount();
+  const uint64_t samplesRecorded = sourceFile->getSamplesRecorded();
+  const int chunk =
+      max(1, static_cast<int>(round(sourceFile->getSamplingFrequency())));
+
+  vector<float> buffer(chunk * channels), frames(chunk * channels);
+
+  for (uint64_t i = 0; i < samplesRecorded; i += chunk) {
+    const int n = static_cast<int>(min<uint64_t>(chunk, samplesRecorded - i));
+    sourceFile->readSignal(buffer.data(), i, i + n - 1);
+
+    for (int j = 0; j < n; ++j)
+      for (unsigned int k = 0; k < channels; ++k)
+        frames[j * channels + k] = buffer[k * n + j];
+
+    file.write(reinterpret_cast<const char *>(frames.data()),
+               n * channels * sizeof(float));
+  }
+
+  if (!file)
+    throwDetailed(runtime_error("Writing to '" + filePath + "' failed"));
+}
+
+string outputFormat(const string &outputPath) {
+  string format;
+  if (isProgramOptionSet("batchFormat"))
+    programOption("batchFormat", format);
+  else
+    format = QFileInfo(QString::fromStdString(outputPath))
+                 .suffix()
+                 .toLower()
+                 .toStdString();
+
+  if (format != "gdf" && format != "edf" && format != "raw")
+    throwDetailed(runtime_error("Unknown output format '" + format +
+                                "'; use gdf, edf or raw"));
+
+  return format;
+}
+
+/**
+ * @brief Opens the input file, and loads its montages and the .info file.
+ */
+unique_ptr<DataFile> openInputFile(DataModel *dataModel) {
+  vector<string> fileNames;
+  if (isProgramOptionSet("filename"))
+    programOption("filename", fileNames);
+
+  if (fileNames.empty())
+    throwDetailed(runtime_error("No input file specified"));
+
+  const QString fileName = QString::fromStdString(fileNames[0]);
+  const vector<string> rest(fileNames.begin() + 1, fileNames.end());
+  unique_ptr<DataFile> file =
+      SignalFileBrowserWindow::dataFileBySuffix(fileName, rest);
+
+  if (!file)
+    throwDetailed(runtime_error("Unsupported file type"));
+
+  logToFile("Opening file '" << fileNames[0] << "' for batch processing.");
+  file->setDataModel(dataModel);
+
+  string montFilePath;
+  if (isProgramOptionSet("montageFile"))
+    programOption("montageFile", montFilePath);
+
+  bool montageLoaded = true;
+  LocaleOverride::executeWithCLocale([&]() {
+    if (montFilePath.empty())
+      file->load();
+    else
+      montageLoaded = file->loadSecondaryFile(montFilePath);
+
+    DETECTOR_SETTINGS settings = AlenkaSignal::Spikedet::defaultSettings();
+    double spikeDuration;
+    OpenDataFile::infoTable.readXML(file->getFilePath() + ".info", &settings,
+                                    &spikeDuration);
+  });
+
+  if (!montageLoaded)
+    throwDetailed(runtime_error("Cannot read montage file " + montFilePath));
+
+  return file;
+}
+
+void selectMontage(const DataModel *dataModel) {
+  const int count = dataModel->montageTable()->rowCount();
+  if (count == 0)
+    throwDetailed(runtime_error("The file has no montage"));
+
+  if (isProgramOptionSet("montageIndex")) {
+    const int index = programOption<int>("montageIndex");
+    if (index < 0 || count <= index)
+      throwDetailed(runtime_error("Montage index " + to_string(index) +
+                                  " is out of range; the file has " +
+                                  to_string(count) + " montages"));
+
+    OpenDataFile::infoTable.setSelectedMontage(index);
+  } else {
+    const int index = OpenDataFile::infoTable.getSelectedMontage();
+    if (index < 0 || count <= index)
+      OpenDataFile::infoTable.setSelectedMontage(0);
+  }
+}
+
+void loadMontageHeader() {
+  try {
+    OpenDataFile::infoTable.setGlobalMontageHeader(
+        QString::fromStdString(KernelPrecompiler::readHeader()));
+  } catch (const runtime_error &e) {
+    // Without the option, the header saved by the GUI is optional.
+    if (isProgramOptionSet("montageHeader"))
+      throw;
+    logToFile("Using an empty montage header: " << catchDetailed(e));
+  }
+}
+
+void compileMontage(SignalProcessor *processor) {
+  while (!processor->allTracksReady()) {
+    processor->updateCompiledTracks();
+    this_thread::sleep_for(chrono::milliseconds(SLEEP_FOR_MS));
+  }
+
+  for (int i = 0; i < processor->getTrackCount(); ++i) {
+    if (!processor->isTrackReady(i))
+      throwDetailed(
+          runtime_error("Track " + to_string(i) + " failed to compile"));
+  }
+}
+
+void printThroughput(const ProcessedFile &processed, OpenDataFile *source,
+                     double seconds) {
+  const double samples = static_cast<double>(processed.processedSamples());
+  const double signalSeconds = samples / source->file->getSamplingFrequency();
+  const double bytes =
+      samples * source->file->getChannelCount() * sizeof(float);
+
+  char str[200];
+  snprintf(str, sizeof(str),
+           "Processed %.1f s of signal in %.2f s (%.1fx real time): %.4g "
+           "samples/s, %.1f MB/s",
+           signalSeconds, seconds, signalSeconds / seconds, samples / seconds,
+           bytes / seconds / 1000 / 1000);
+
+  logToFileAndConsole(str);
+}
+
+} // namespace
+
+int BatchProcessor::batchCommandLine() {
+  try {
+    string outputPath;
+    programOption("batch", outputPath);
+    const string format = outputFormat(outputPath);
+
+    const double outputFrequency = programOption<double>("resample");
+    if (outputFrequency < 0)
+      throwDetailed(runtime_error("The resample frequency must be positive"));
+
+    auto dataModel = UndoCommandFactory::emptyDataModel();
+    unique_ptr<DataFile> file = openInputFile(dataModel.get());
+    selectMontage(dataModel.get());
+    loadMontageHeader();
+
+    OpenDataFile::kernelCache = make_unique<KernelCache>();
+    if (programOption<bool>("kernelCachePersist"))
+      OpenDataFile::kernelCache->loadFromFile(globalContext.get());
+
+    OpenDataFile openFile;
+    openFile.file = file.get();
+    openFile.dataModel = dataModel.get();
+
+    // No GL sharing; the output buffers are read back to the host.
+    const Autotuner::Settings settings =
+        Autotuner::settingsFor(file.get(), globalContext.get());
+    const unsigned int parallelQueues = settings.parallelQueues;
+    auto processor = make_unique<SignalProcessor>(
+        settings.blockSize, parallelQueues, 1, nullptr, &openFile,
+        globalContext.get());
+
+    if (!processor->ready())
+      throwDetailed(runtime_error("The montage has no visible tracks"));
+
+    compileMontage(processor.get());
+
+    ProcessedFile processed(&openFile, processor.get(), globalContext.get(),
+                            parallelQueues, outputFrequency);
+
+    using namespace chrono;
+    const auto start = high_resolution_clock::now();
+
+    if (format == "gdf")
+      GDF2::saveAs(outputPath, &processed);
+    else if (format == "edf")
+      EDF::saveAs(outputPath, &processed);
+    else
+      saveRaw(outputPath, &processed);
+
+    const nanoseconds time = high_resolution_clock::now() - start;
+    printThroughput(processed, &openFile,
+                    static_cast<double>(time.count()) / 1000 / 1000 / 1000);
+  } catch (const exception &e) {
+    cerr << "Error: " << catchDetailed(e) << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,26 @@
+#ifndef BATCHPROCESSOR_H
+#define BATCHPROCESSOR_H
+
+/**
+ * @brief Writes the processed tracks of a recording without the GUI.
+ *
+ * The recording is processed the same way as it is displayed: the montage
+ * from the .mont file and the filter from the .info file are applied by
+ * SignalProcessor. The result can be resampled by libsamplerate, and it is
+ * streamed block by block to a GDF, EDF or raw float32 file, so the memory use
+ * doesn't depend on the length of the recording.
+ *
+ * No OpenGL context or window is needed, so this can run on headless machines
+ * with a CPU OpenCL device (select it by clPlatform and clDevice). The
+ * throughput is printed at the end.
+ */
+class BatchProcessor {
+public:
+  /**
+   * @brief Implements the --batch command-line mode.
+   * @return The exit status.
+   */
+  static int batchCommandLine();
+};
+
+#endif // BATCHPROCESSOR_H
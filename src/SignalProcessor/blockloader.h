@@ -0,0 +1,129 @@
+#ifndef BLOCKLOADER_H
+#define BLOCKLOADER_H
+
+#include "../../Alenka-File/include/AlenkaFile/datafile.h"
+#include "lrucache.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <set>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Loads signal blocks from a file into the file cache of
+ * SignalProcessor.
+ *
+ * A block holds all channels one after another, with the same number of
+ * samples each. Adjacent blocks usually overlap by the samples the filter
+ * discards, so the shared part is copied from a cached neighbour instead of
+ * being read from the file again.
+ */
+class BlockLoader {
+public:
+  using Range = std::pair<std::int64_t, std::int64_t>;
+
+  /**
+   * @brief Returns the buffer with block index, loading it if needed.
+   * @param inUse Buffers that must not be overwritten yet. If one of them is
+   * to be reused, wait is called first.
+   * @param load Called as load(buffer, neighbour, neighbourIndex) to fill
+   * the buffer; neighbour is nullptr when no adjacent block is cached or
+   * reuseOverlap is off.
+   */
+  template <class Load>
+  static float *cachedBlock(LRUCache<int, float> *cache, int index,
+                            bool reuseOverlap,
+                            const std::set<const float *> &inUse,
+                            const std::function<void()> &wait, Load load) {
+    int cacheIndex;
+    float *buffer = cache->getAny(std::set<int>{index}, &cacheIndex);
+    assert(!buffer || cacheIndex == index);
+
+    if (!buffer) {
+      // When scrolling, exporting etc., the previous block usually overlaps
+      // with this one. Only peeking keeps the hit rate and the age of the
+      // neighbour as they are.
+      int neighbourIndex = -1;
+      const float *neighbour =
+          reuseOverlap
+              ? cache->peek(std::set<int>{index - 1, index + 1},
+                            &neighbourIndex)
+              : nullptr;
+
+      buffer = cache->setOldest(index);
+
+      if (inUse.count(buffer))
+        wait();
+
+      load(buffer, neighbour, neighbourIndex);
+    }
+
+    assert(buffer);
+    return buffer;
+  }
+
+  /**
+   * @brief Fills buffer with the samples in range of all channels of file.
+   * @param neighbour A block with the samples in neighbourRange, or nullptr.
+   * It can be the same memory as buffer.
+   * @param readBuffer Temporary storage reused between calls.
+   * @return The number of samples per channel copied from the neighbour.
+   *
+   * The part shared with the neighbour is copied, and only the rest is read
+   * from the file.
+   */
+  static std::int64_t loadBlock(AlenkaFile::DataFile *file, float *buffer,
+                                Range range, const float *neighbour,
+                                Range neighbourRange,
+                                std::vector<float> *readBuffer) {
+    const std::int64_t length = range.second - range.first + 1;
+    const unsigned int channels = file->getChannelCount();
+    std::int64_t overlap = 0;
+
+    if (neighbour) {
+      assert(neighbourRange.second - neighbourRange.first + 1 == length);
+      overlap = std::min(range.second, neighbourRange.second) -
+                std::max(range.first, neighbourRange.first) + 1;
+    }
+
+    if (overlap <= 0 || length <= overlap) {
+      file->readSignal(buffer, range.first, range.second);
+      return 0;
+    }
+
+    const std::int64_t rest = length - overlap;
+    std::int64_t copyFrom, copyTo, readTo, readFirst;
+
+    if (neighbourRange.first < range.first) {
+      copyFrom = length - overlap;
+      copyTo = 0;
+      readTo = overlap;
+      readFirst = range.first + overlap;
+    } else {
+      copyFrom = 0;
+      copyTo = rest;
+      readTo = 0;
+      readFirst = range.first;
+    }
+
+    // memmove() because the buffers may be the same if the cache is small.
+    for (unsigned int i = 0; i < channels; ++i)
+      memmove(buffer + i * length + copyTo, neighbour + i * length + copyFrom,
+              overlap * sizeof(float));
+
+    readBuffer->resize(rest * channels);
+    file->readSignal(readBuffer->data(), readFirst, readFirst + rest - 1);
+
+    for (unsigned int i = 0; i < channels; ++i)
+      std::copy_n(readBuffer->data() + i * rest, rest,
+                  buffer + i * length + readTo);
+
+    return overlap;
+  }
+};
+
+#endif // BLOCKLOADER_H
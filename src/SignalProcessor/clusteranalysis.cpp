@@ -8,6 +8,7 @@
 #include "../myapplication.h"
 #include "../signalfilebrowserwindow.h"
 #include "../spikedetsettingsdialog.h"
+#include "../tracer.h"
 #include "signalprocessor.h"
 
 #include <QFile>
@@ -46,6 +47,7 @@ double resolvePosition(int channels, int index, vector<double> *positions) {
 } // namespace
 
 void ClusterAnalysis::runAnalysis(OpenDataFile *file, QWidget * /*parent*/) {
+  traceSpan("cluster");
   if (!cluster)
     cluster = make_unique<Cluster>();
 
@@ -0,0 +1,214 @@
+#include "kernelprecompiler.h"
+
+#include "../../Alenka-File/include/AlenkaFile/datafile.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/montage.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/openclcontext.h"
+#include "../DataModel/kernelcache.h"
+#include "../error.h"
+#include "../myapplication.h"
+#include "../options.h"
+#include "../signalfilebrowserwindow.h"
+#include "autotuner.h"
+#include "montagecompiler.h"
+#include "signalprocessor.h"
+
+#include <detailedexception.h>
+
+#include <QFile>
+#include <QFileInfo>
+#include <QString>
+
+#include <pugixml.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <set>
+#include <thread>
+
+using namespace std;
+using namespace AlenkaSignal;
+
+namespace {
+
+const int SLEEP_FOR_MS = 50;
+
+vector<string> readTemplateCode(const string &filePath) {
+  pugi::xml_document xmlFile;
+  pugi::xml_parse_result res = xmlFile.load_file(filePath.c_str());
+
+  if (!res)
+    throwDetailed(runtime_error("Error while opening file '" + filePath +
+                                "': " + res.description()));
+
+  vector<string> code;
+  pugi::xml_node row = xmlFile.child("document").child("row");
+
+  while (row) {
+    code.push_back(row.child("code").text().as_string());
+    row = row.next_sibling("row");
+  }
+
+  return code;
+}
+
+bool isTemplate(const string &fileName) {
+  return QFileInfo(QString::fromStdString(fileName))
+             .suffix()
+             .compare("xml", Qt::CaseInsensitive) == 0;
+}
+
+} // namespace
+
+int KernelPrecompiler::precompileCommandLine() {
+  string outputPath;
+  programOption("precompile", outputPath);
+
+  vector<string> fileNames, templateFiles, recordingFiles;
+  if (isProgramOptionSet("filename"))
+    programOption("filename", fileNames);
+
+  for (const auto &e : fileNames)
+    (isTemplate(e) ? templateFiles : recordingFiles).push_back(e);
+
+  if (templateFiles.empty()) {
+    cerr << "Error: no montage template specified" << endl;
+    return EXIT_FAILURE;
+  }
+
+  vector<string> labels;
+  MontageLayout layout;
+
+  try {
+    if (!recordingFiles.empty()) {
+      const QString fileName = QString::fromStdString(recordingFiles[0]);
+      const vector<string> rest(recordingFiles.begin() + 1,
+                                recordingFiles.end());
+      auto file = SignalFileBrowserWindow::dataFileBySuffix(fileName, rest);
+      labels = file->getLabels();
+
+      // The same layout as in Canvas, which duplicates the samples unless
+      // OpenGL 4.3 is used.
+      const Autotuner::Settings settings =
+          Autotuner::settingsFor(file.get(), globalContext.get());
+      layout = SignalProcessor::montageLayout(
+          settings.blockSize, file->getSamplingFrequency(),
+          file->getChannelCount(), programOption<bool>("gl43") ? 1 : 2);
+    } else {
+      cerr << "Warning: no recording specified, so formulas that use labels "
+              "will not match the ones compiled for real files"
+           << endl;
+    }
+
+    const int failed =
+        precompile(outputPath, templateFiles, readHeader(), labels, layout);
+
+    if (0 < failed) {
+      cerr << "Error: " << failed << " tracks failed to compile" << endl;
+      return EXIT_FAILURE;
+    }
+  } catch (const exception &e) {
+    cerr << "Error: " << catchDetailed(e) << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+int KernelPrecompiler::precompile(const string &outputPath,
+                                  const vector<string> &templateFiles,
+                                  const string &header,
+                                  const vector<string> &labels,
+                                  const MontageLayout &layout) {
+  OpenCLContext *context = globalContext.get();
+
+  // Identical tracks (e.g. across templates) are compiled only once.
+  vector<unique_ptr<Montage<float>>> jobs;
+  set<string> sources;
+
+  for (const auto &fileName : templateFiles) {
+    vector<string> templateCode;
+    for (const auto &code : readTemplateCode(fileName))
+      templateCode.push_back(SignalProcessor::simplifyMontage<float>(code));
+
+    // The same rewriting as in SignalProcessor. The channel count is known
+    // only from the recording.
+    if (!labels.empty() && hasDefaultBuiltins(header))
+      shareSums(&templateCode, labels, static_cast<int>(labels.size()));
+
+    for (const auto &code : templateCode) {
+      auto montage =
+          make_unique<Montage<float>>(code, context, header, labels, layout);
+
+      if (NormalMontage == montage->getMontageType() &&
+          sources.insert(montage->getSource()).second)
+        jobs.push_back(move(montage));
+    }
+  }
+
+  vector<string> jobSource;
+  for (const auto &e : jobs)
+    jobSource.push_back(e->getSource());
+
+  const int jobCount = static_cast<int>(jobs.size());
+  cerr << "Compiling " << jobCount << " montage kernels" << endl;
+
+  MontageCompiler compiler(move(jobs), programOption<int>("compileThreads"));
+  vector<pair<string, vector<unsigned char>>> entries;
+  int failed = 0, lastPercentage = -1;
+
+  while (!compiler.finished()) {
+    this_thread::sleep_for(chrono::milliseconds(SLEEP_FOR_MS));
+
+    for (auto &result : compiler.takeFinished()) {
+      if (result.error) {
+        ++failed;
+
+        try {
+          rethrow_exception(result.error);
+        } catch (const exception &e) {
+          logToFileAndConsole("Track '" << jobSource[result.job]
+                                        << "' failed: " << catchDetailed(e));
+        }
+      } else {
+        unique_ptr<vector<unsigned char>> binary(result.program->getBinary());
+        entries.emplace_back(jobSource[result.job], move(*binary));
+      }
+    }
+
+    const int percentage = 100 *
+                           (failed + static_cast<int>(entries.size())) /
+                           max(1, jobCount);
+
+    if (lastPercentage < percentage) {
+      fprintf(stderr, "progress: %3d%%\n", percentage);
+      lastPercentage = percentage;
+    }
+  }
+
+  KernelCacheFile::write(outputPath, KernelCache::fingerprint(context),
+                         entries);
+  logToFileAndConsole("Saved " << entries.size() << " KernelCache entries to "
+                               << outputPath);
+
+  return failed;
+}
+
+string KernelPrecompiler::readHeader() {
+  QString path;
+  if (isProgramOptionSet("montageHeader")) {
+    string tmp;
+    programOption("montageHeader", tmp);
+    path = QString::fromStdString(tmp);
+  } else {
+    path = MyApplication::makeAppSubdir({"montageHeader.cl"}).absolutePath();
+  }
+
+  QFile headerFile(path);
+  if (!headerFile.open(QIODevice::ReadOnly))
+    throwDetailed(
+        runtime_error("Cannot open montage header " + path.toStdString()));
+
+  return QString(headerFile.readAll()).toStdString();
+}
@@ -0,0 +1,52 @@
+#ifndef KERNELPRECOMPILER_H
+#define KERNELPRECOMPILER_H
+
+#include "../../Alenka-Signal/include/AlenkaSignal/montage.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Builds kernel cache packs from montage templates without the GUI.
+ *
+ * All tracks of the given template XML files are compiled for the selected
+ * OpenCL device, and the binaries are written in the KernelCache file format.
+ * When such a pack is copied to a reading station with the same device and
+ * driver as 'kernel-cache-P-D.bin' in the kernel cache directory, the standard
+ * montages are displayed without any compilation delay.
+ *
+ * The cache key is the final kernel source, which depends on the montage
+ * header and on how the labels in formulas like in("Fp1") are resolved. So
+ * the same header must be used, and the channel order is taken from a
+ * recording that is representative of the files read at the station. With the
+ * specializeKernels option the kernels are compiled for the layout of this
+ * recording too.
+ */
+class KernelPrecompiler {
+public:
+  /**
+   * @brief Implements the --precompile command-line mode.
+   * @return The exit status.
+   */
+  static int precompileCommandLine();
+
+  /**
+   * @brief Compiles the templates and writes the pack to outputPath.
+   * @param layout The same as SignalProcessor::montageLayout() gives.
+   * @return The number of track programs that failed to compile.
+   */
+  static int
+  precompile(const std::string &outputPath,
+             const std::vector<std::string> &templateFiles,
+             const std::string &header, const std::vector<std::string> &labels,
+             const AlenkaSignal::MontageLayout &layout =
+                 AlenkaSignal::MontageLayout());
+
+  /**
+   * @brief Reads the montage header given by --montageHeader, or the one
+   * saved by the GUI.
+   */
+  static std::string readHeader();
+};
+
+#endif // KERNELPRECOMPILER_H
@@ -2,6 +2,7 @@
 #define LRUCACHE_H
 
 #include <cassert>
+#include <cstdint>
 #include <map>
 #include <memory>
 #include <set>
@@ -15,6 +16,20 @@ public:
   virtual void destroyElement(T *ptr) = 0;
 };
 
+/**
+ * @brief Counters of how an LRUCache is used.
+ *
+ * They can outlive the cache, so that the counts are kept when the cache is
+ * recreated with a different capacity.
+ */
+struct LRUCacheStats {
+  std::uint64_t hits = 0, misses = 0, evictions = 0;
+  unsigned int resident = 0, capacity = 0; // In elements.
+  std::int64_t elementBytes = 0;
+
+  std::int64_t residentBytes() const { return resident * elementBytes; }
+};
+
 template <class K, class T> class LRUCache {
   unsigned int capacity;
   std::unique_ptr<LRUCacheAllocator<T>> allocator;
@@ -22,6 +37,7 @@ template <class K, class T> class LRUCache {
   std::vector<unsigned int> lastUsed;
   std::map<K, unsigned int> keyMap;
   std::map<unsigned int, K> reverseKeyMap;
+  LRUCacheStats *stats = nullptr;
 
 public:
   LRUCache(unsigned int capacity,
@@ -36,6 +52,22 @@ public:
   ~LRUCache() {
     for (auto e : elements)
       allocator->destroyElement(e);
+
+    if (stats)
+      stats->resident -= constructedCount();
+  }
+
+  /**
+   * @brief Counts the hits, misses and evictions of this cache in stats.
+   *
+   * A hit is an element returned by getAny(), and a miss is a call of
+   * setOldest(). An eviction is a miss that reuses an element of another key.
+   */
+  void setStats(LRUCacheStats *stats, std::int64_t elementBytes) {
+    this->stats = stats;
+    stats->resident += constructedCount();
+    stats->capacity = capacity;
+    stats->elementBytes = elementBytes;
   }
 
   T *getAny(const std::set<K> &keys, K *key) {
@@ -50,21 +82,47 @@ public:
       updateLastUsed(cacheIndex);
 
       *key = keyFound;
+      if (stats)
+        ++stats->hits;
     }
 
     return ret;
   }
 
+  /**
+   * @brief Like getAny(), but the element is neither counted as a hit nor
+   * marked as used.
+   */
+  T *peek(const std::set<K> &keys, K *key) const {
+    int keyFound;
+    unsigned int cacheIndex;
+
+    if (!findFirstKey(keys, &keyFound, &cacheIndex))
+      return nullptr;
+
+    *key = keyFound;
+    return elements[cacheIndex];
+  }
+
   T *setOldest(K key) {
     unsigned int maxElement = emptyOrOldest();
 
     if (!elements[maxElement]) {
       T *ptr;
 
-      if (allocator->constructElement(&ptr))
+      if (allocator->constructElement(&ptr)) {
         elements[maxElement] = ptr;
-      else
+        if (stats)
+          ++stats->resident;
+      } else {
         maxElement = oldestAlreadyCreated();
+      }
+    }
+
+    if (stats) {
+      ++stats->misses;
+      if (reverseKeyMap.count(maxElement))
+        ++stats->evictions;
     }
 
     insertKey(key, maxElement);
@@ -76,12 +134,26 @@ public:
 
   unsigned int getCapacity() const { return capacity; }
 
+  /**
+   * @brief Returns the number of keys stored.
+   */
+  unsigned int size() const {
+    return static_cast<unsigned int>(keyMap.size());
+  }
+
   void clear() {
     keyMap.clear();
     reverseKeyMap.clear();
   }
 
 private:
+  unsigned int constructedCount() const {
+    unsigned int count = 0;
+    for (auto e : elements)
+      count += e ? 1 : 0;
+    return count;
+  }
+
   /**
    * @brief Find a element with key from keys.
    * @param index [out]
@@ -89,7 +161,7 @@ private:
    * @return True if a common element was found.
    */
   bool findFirstKey(const std::set<K> &keySet, int *key,
-                    unsigned int *cacheIndex) {
+                    unsigned int *cacheIndex) const {
     auto cacheKeys = keyMap.begin();
     auto keys = keySet.begin();
 
@@ -0,0 +1,102 @@
+#include "montagecompiler.h"
+
+#include "../tracer.h"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+using namespace AlenkaSignal;
+
+MontageCompiler::MontageCompiler(unsigned int threadCount) {
+  if (threadCount == 0)
+    threadCount = max(1u, thread::hardware_concurrency());
+
+  for (unsigned int i = 0; i < threadCount; ++i)
+    threads.emplace_back(&MontageCompiler::work, this);
+}
+
+MontageCompiler::~MontageCompiler() {
+  {
+    lock_guard<mutex> lock(jobMutex);
+    stopping = true;
+    queue.clear();
+  }
+  wake.notify_all();
+
+  for (auto &e : threads)
+    e.join();
+}
+
+void MontageCompiler::submit(vector<unique_ptr<Montage<float>>> jobs) {
+  // The old jobs are destroyed outside of the lock.
+  decltype(queue) oldQueue;
+
+  {
+    lock_guard<mutex> lock(jobMutex);
+    ++generation;
+    swap(oldQueue, queue);
+    results.clear();
+
+    jobCount = static_cast<int>(jobs.size());
+    collected = 0;
+
+    for (int i = 0; i < jobCount; ++i)
+      queue.emplace_back(i, std::move(jobs[i]));
+  }
+
+  wake.notify_all();
+}
+
+vector<MontageCompiler::Result> MontageCompiler::takeFinished() {
+  vector<Result> finishedResults;
+
+  {
+    lock_guard<mutex> lock(jobMutex);
+    swap(finishedResults, results);
+  }
+
+  collected += static_cast<int>(finishedResults.size());
+  return finishedResults;
+}
+
+void MontageCompiler::work() {
+  unique_lock<mutex> lock(jobMutex);
+
+  while (true) {
+    wake.wait(lock, [this]() { return stopping || !queue.empty(); });
+    if (stopping)
+      break;
+
+    auto job = std::move(queue.front());
+    queue.pop_front();
+    const int jobGeneration = generation;
+    lock.unlock();
+
+    Result result;
+    result.job = job.first;
+
+    {
+      traceSpan("compileMontage");
+      const auto start = chrono::steady_clock::now();
+
+      try {
+        // releaseProgram() triggers the build and throws if it fails.
+        result.program.reset(job.second->releaseProgram());
+      } catch (...) {
+        result.error = current_exception();
+      }
+
+      const chrono::duration<double> time =
+          chrono::steady_clock::now() - start;
+      result.seconds = time.count();
+      job.second.reset();
+    }
+
+    lock.lock();
+
+    // The owner has moved on to other jobs since this one was started.
+    if (jobGeneration == generation)
+      results.push_back(std::move(result));
+  }
+}
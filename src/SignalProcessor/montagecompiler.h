@@ -0,0 +1,93 @@
+#ifndef MONTAGECOMPILER_H
+#define MONTAGECOMPILER_H
+
+#include "../../Alenka-Signal/include/AlenkaSignal/montage.h"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Compiles montage track programs on a pool of worker threads.
+ *
+ * Building one track program can take hundreds of milliseconds, which used to
+ * freeze the GUI for seconds when a big montage was opened. Here the jobs are
+ * pulled from a shared queue by a fixed number of threads, and the owner
+ * periodically collects the finished programs with takeFinished().
+ *
+ * The pool lives as long as its owner, and every submit() starts a new
+ * generation of jobs. The queued jobs of the previous generation are dropped,
+ * and the ones in progress are left to finish in the background, but their
+ * results are discarded. So changing the montage never waits for the OpenCL
+ * compiler. Only the destructor waits for the jobs in progress.
+ *
+ * All OpenCL calls used for the compilation are thread-safe since OpenCL 1.1.
+ * KernelCache is not, so the results must be inserted there by the owner.
+ */
+class MontageCompiler {
+public:
+  struct Result {
+    int job;
+    std::unique_ptr<AlenkaSignal::OpenCLProgram> program;
+    std::exception_ptr error;
+    double seconds; // How long the compilation took.
+  };
+
+  /**
+   * @brief Starts the worker threads.
+   * @param threadCount The number of worker threads; 0 means use the number
+   * of hardware threads.
+   */
+  explicit MontageCompiler(unsigned int threadCount = 0);
+  ~MontageCompiler();
+
+  MontageCompiler(const MontageCompiler &) = delete;
+  MontageCompiler &operator=(const MontageCompiler &) = delete;
+
+  /**
+   * @brief Replaces the jobs of the previous generation with these.
+   * @param jobs Montage objects of type NormalMontage. The indexes in this
+   * vector are used as Result::job.
+   */
+  void submit(std::vector<std::unique_ptr<AlenkaSignal::Montage<float>>> jobs);
+
+  /**
+   * @brief Drops the jobs of the current generation, as if an empty vector
+   * was submitted.
+   */
+  void cancel() { submit({}); }
+
+  /**
+   * @brief Returns the results of the current generation finished since the
+   * last call.
+   *
+   * If the compilation failed, the error member is set instead of program.
+   */
+  std::vector<Result> takeFinished();
+
+  /**
+   * @brief Returns true when all results of the current generation have been
+   * taken.
+   */
+  bool finished() const { return collected == jobCount; }
+
+private:
+  std::mutex jobMutex;
+  std::condition_variable wake;
+  std::deque<std::pair<int, std::unique_ptr<AlenkaSignal::Montage<float>>>>
+      queue;
+  int generation = 0;
+  bool stopping = false;
+  std::vector<Result> results;
+  int jobCount = 0, collected = 0;
+  std::vector<std::thread> threads;
+
+  void work();
+};
+
+#endif // MONTAGECOMPILER_H
@@ -1,18 +1,32 @@
 #include "signalprocessor.h"
 
 #include "../../Alenka-File/include/AlenkaFile/datafile.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/cpufilterprocessor.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/cpuiirfilterprocessor.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/cpumontageprocessor.h"
 #include "../../Alenka-Signal/include/AlenkaSignal/filter.h"
 #include "../../Alenka-Signal/include/AlenkaSignal/filterprocessor.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/iirfilterprocessor.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/kernelprofiler.h"
 #include "../../Alenka-Signal/include/AlenkaSignal/montageprocessor.h"
 #include "../../Alenka-Signal/include/AlenkaSignal/openclcontext.h"
 #include "../DataModel/vitnessdatamodel.h"
 #include "../myapplication.h"
 #include "../options.h"
+#include "../performancecounters.h"
+#include "../tracer.h"
+#include "blockloader.h"
 
+#include <QCache>
 #include <QFile>
 
 #include <algorithm>
 #include <cassert>
+#include <exception>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
 
@@ -46,6 +60,75 @@ void multiplySamples(vector<float> *samples) {
             samples->begin(), [](int a, int b) { return a * b; });
 }
 
+// The FIR coefficients of the recently used filter settings. The design takes
+// an inverse FFT of M samples, so toggling between common settings would
+// repeat it needlessly.
+const int FILTER_DESIGN_CACHE_SIZE = 16;
+QCache<QString, vector<float>> filterDesignCache(FILTER_DESIGN_CACHE_SIZE);
+
+QString filterDesignKey(double fs, int M) {
+  const InfoTable &info = OpenDataFile::infoTable;
+  stringstream ss;
+  ss.precision(numeric_limits<double>::max_digits10);
+
+  ss << fs << ' ' << M;
+  if (info.getLowpassOn())
+    ss << " lp " << info.getLowpassFrequency();
+  if (info.getHighpassOn())
+    ss << " hp " << info.getHighpassFrequency();
+  if (info.getNotchOn())
+    ss << " notch " << programOption<double>("notchFrequency");
+  ss << " window " << static_cast<int>(info.getFilterWindow());
+
+  if (info.getFrequencyMultipliersOn()) {
+    ss << " multi";
+    for (const auto &e : info.getFrequencyMultipliers())
+      ss << ' ' << e.first << ' ' << e.second;
+  }
+
+  return QString::fromStdString(ss.str());
+}
+
+// Markers and barriers were introduced in OpenCL 1.2 with different names.
+cl_event enqueueMarker(cl_command_queue queue) {
+  cl_event event;
+  cl_int err;
+
+  if (programOption<bool>("cl11"))
+    err = clEnqueueMarker(queue, &event);
+  else
+    err = clEnqueueMarkerWithWaitList(queue, 0, nullptr, &event);
+  checkClErrorCode(err, "clEnqueueMarker()");
+
+  return event;
+}
+
+void enqueueWait(cl_command_queue queue, cl_event event) {
+  cl_int err;
+
+  if (programOption<bool>("cl11"))
+    err = clEnqueueWaitForEvents(queue, 1, &event);
+  else
+    err = clEnqueueBarrierWithWaitList(queue, 1, &event, nullptr);
+  checkClErrorCode(err, "clEnqueueBarrier()");
+}
+
+void waitAndRelease(vector<cl_event> *events) {
+  if (events->empty())
+    return;
+
+  cl_int err = clWaitForEvents(static_cast<cl_uint>(events->size()),
+                               events->data());
+  checkClErrorCode(err, "clWaitForEvents()");
+
+  for (cl_event e : *events) {
+    err = clReleaseEvent(e);
+    checkClErrorCode(err, "clReleaseEvent()");
+  }
+
+  events->clear();
+}
+
 // TODO: Fix this this *allocator* hack. Change the cache so that it default
 // constructs the elements as needed; then return pointers to these elements.
 // Then there would be no need for an allocator -- the specialized allocation
@@ -77,35 +160,89 @@ SignalProcessor::SignalProcessor(unsigned int nBlock,
       file(file), context(context), extraSamplesFront(extraSamplesFront),
       extraSamplesBack(extraSamplesBack) {
   maxMontageTracks = programOption<int>("kernelCacheSize");
+  reuseOverlap = programOption<bool>("reuseBlockOverlap");
+  cpuBackend = programOption<bool>("cpuBackend");
+
+  if (!context && !cpuBackend)
+    throwDetailed(runtime_error("OpenCL context is required without the "
+                                "cpuBackend option"));
+
+  // With cl_khr_gl_event, acquiring and releasing the shared buffers
+  // synchronizes with the GL commands that use them. So there is no need to
+  // wait for the montage to finish.
+  implicitGLSync = this->glSharing && context &&
+                   context->hasExtension("cl_khr_gl_event");
 
   fileChannels = file->file->getChannelCount();
-  cl_int err;
-  size_t size = (nBlock + 2) * fileChannels * sizeof(float);
 
-  for (unsigned int i = 0; i < parallelQueues; ++i) {
-    commandQueues.push_back(clCreateCommandQueue(
-        context->getCLContext(), context->getCLDevice(), 0, &err));
-    checkClErrorCode(err, "clCreateCommandQueue()");
+  this->nBlock = blockLength(nBlock, file->file->getSamplingFrequency());
+  if (this->nBlock != static_cast<int>(nBlock))
+    logToFile("Extending blocks to " << this->nBlock
+                                     << " samples for a filter of "
+                                     << filterLength() << " samples.");
+
+  // The layout is published, so that TrackCodeValidator can make the same
+  // KernelCache keys.
+  file->montageLayout =
+      montageLayout(nBlock, file->file->getSamplingFrequency(), fileChannels,
+                    montageCopyCount);
+
+  // The device time of every stage is measured, and written to a file when
+  // this object is destroyed.
+  cl_command_queue_properties queueProperties = 0;
+  if (isProgramOptionSet("profileKernels")) {
+    profiler = make_unique<AlenkaSignal::KernelProfiler>();
+    queueProperties = CL_QUEUE_PROFILING_ENABLE;
+  }
+
+  // The blocks processed together are stored one after another in the
+  // buffers, and they are all filtered in a single batch. So the FFT of one
+  // large batch is used instead of several small ones.
+  const unsigned int batchChannels = parallelQueues * fileChannels;
+  size_t size = (this->nBlock + 2) * batchChannels * sizeof(float);
+
+  if (context) {
+    cl_int err;
+
+    for (unsigned int i = 0; i < parallelQueues; ++i) {
+      commandQueues.push_back(
+          clCreateCommandQueue(context->getCLContext(), context->getCLDevice(),
+                               queueProperties, &err));
+      checkClErrorCode(err, "clCreateCommandQueue()");
+    }
 
     cl_mem_flags flags = CL_MEM_READ_WRITE;
-    rawBuffers.push_back(
-        clCreateBuffer(context->getCLContext(), flags, size, nullptr, &err));
+    rawBuffer =
+        clCreateBuffer(context->getCLContext(), flags, size, nullptr, &err);
     checkClErrorCode(err, "clCreateBuffer()");
 
 #ifdef NDEBUG
     if (!programOption<bool>("cl11"))
       flags |= CL_MEM_HOST_NO_ACCESS;
 #endif
-    filterBuffers.push_back(
-        clCreateBuffer(context->getCLContext(), flags, size, nullptr, &err));
+    filterBuffer =
+        clCreateBuffer(context->getCLContext(), flags, size, nullptr, &err);
     checkClErrorCode(err, "clCreateBuffer()");
 
-    filterProcessors.push_back(
-        make_unique<AlenkaSignal::FilterProcessor<float>>(nBlock, fileChannels,
-                                                          context));
+    filterProcessor = make_unique<AlenkaSignal::FilterProcessor<float>>(
+        this->nBlock, batchChannels, context);
+    iirFilterProcessor = make_unique<AlenkaSignal::IirFilterProcessor<float>>(
+        this->nBlock, batchChannels, context);
+    filterProcessor->setProfiler(profiler.get());
+    iirFilterProcessor->setProfiler(profiler.get());
   }
 
-  int blockFloats = nBlock * fileChannels;
+  if (cpuBackend) {
+    cpuFilterProcessor = make_unique<AlenkaSignal::CpuFilterProcessor<float>>(
+        this->nBlock, batchChannels);
+    cpuIirFilterProcessor =
+        make_unique<AlenkaSignal::CpuIirFilterProcessor<float>>(this->nBlock,
+                                                                batchChannels);
+    cpuRawBuffer.resize(size / sizeof(float));
+    cpuFilterBuffer.resize(size / sizeof(float));
+  }
+
+  int blockFloats = this->nBlock * fileChannels;
   int64_t fileCacheMemory = programOption<int>("fileCacheSize");
   fileCacheMemory *= 1000 * 1000 / sizeof(float); // Convert from MB.
   int capacity = max(1, static_cast<int>(fileCacheMemory / blockFloats));
@@ -115,30 +252,63 @@ SignalProcessor::SignalProcessor(unsigned int nBlock,
                                         << blockFloats * sizeof(float) << ".");
   cache = make_unique<LRUCache<int, float>>(
       capacity, make_unique<FloatAllocator>(blockFloats));
+  cache->setStats(&PERFORMANCE_COUNTERS.fileCache,
+                  blockFloats * sizeof(float));
 
   updateFilter();
   setUpdateMontageFlag();
 
-  createXyzBuffer();
+  if (context)
+    createXyzBuffer();
 }
 
 SignalProcessor::~SignalProcessor() {
-  cl_int err;
+  if (profiler) {
+    // Every processor of this run (reopened files, the autotuner, batch
+    // workers) appends its table to the same file. The first one truncates
+    // it, and the processor column tells them apart.
+    static mutex csvMutex;
+    static int processorCount = 0;
+    lock_guard<mutex> lock(csvMutex);
+
+    const string path = programOption<string>("profileKernels");
+    ofstream csv(path, processorCount == 0 ? ios::trunc : ios::app);
+
+    const string processor = to_string(processorCount) + " (" +
+                             to_string(nBlock) + " x " +
+                             to_string(parallelQueues) + ")";
+    profiler->printCsv(csv, processor, processorCount == 0);
+    ++processorCount;
+
+    logToFile("Kernel profile of processor " << processor << " written to "
+                                             << path << ".");
+  }
 
-  for (unsigned int i = 0; i < parallelQueues; ++i) {
-    err = clReleaseCommandQueue(commandQueues[i]);
-    checkClErrorCode(err, "clReleaseCommandQueue()");
+  if (context) {
+    cl_int err;
 
-    err = clReleaseMemObject(rawBuffers[i]);
-    checkClErrorCode(err, "clReleaseMemObject()");
+    for (cl_event e : montageFinished) {
+      err = clReleaseEvent(e);
+      checkClErrorCode(err, "clReleaseEvent()");
+    }
 
-    err = clReleaseMemObject(filterBuffers[i]);
+    for (unsigned int i = 0; i < parallelQueues; ++i) {
+      err = clReleaseCommandQueue(commandQueues[i]);
+      checkClErrorCode(err, "clReleaseCommandQueue()");
+    }
+
+    err = clReleaseMemObject(rawBuffer);
     checkClErrorCode(err, "clReleaseMemObject()");
-  }
 
-  if (xyzBuffer) {
-    err = clReleaseMemObject(xyzBuffer);
+    err = clReleaseMemObject(filterBuffer);
     checkClErrorCode(err, "clReleaseMemObject()");
+
+    if (xyzBuffer) {
+      err = clReleaseMemObject(xyzBuffer);
+      checkClErrorCode(err, "clReleaseMemObject()");
+    }
+
+    createSharedSumBuffers(0);
   }
 
   QObject::disconnect(xyzBufferConnection);
@@ -150,7 +320,7 @@ void SignalProcessor::updateFilter() {
   if (!file)
     return;
 
-  M = file->file->getSamplingFrequency() + 1;
+  M = filterLength();
 
   filter = make_unique<AlenkaSignal::Filter<float>>(
       M, file->file->getSamplingFrequency());
@@ -164,22 +334,87 @@ void SignalProcessor::updateFilter() {
   filter->setNotchOn(OpenDataFile::infoTable.getNotchOn());
   filter->setNotch(programOption<double>("notchFrequency"));
 
-  auto samples = filter->computeSamples();
-  if (OpenDataFile::infoTable.getFrequencyMultipliersOn())
-    multiplySamples(&samples);
+  const bool multipliersOn =
+      OpenDataFile::infoTable.getFrequencyMultipliersOn() &&
+      !OpenDataFile::infoTable.getFrequencyMultipliers().empty();
+  useIir = OpenDataFile::infoTable.getFilterDesign() ==
+               AlenkaSignal::FilterDesign::IIR &&
+           !multipliersOn;
+
+  const int oldDiscard = nDiscard;
+  vector<float> coefficients;
+
+  if (useIir) {
+    // Low cut-off frequencies need a longer warm-up than the FIR filter
+    // discards, otherwise seams appear at the block borders. At least half of
+    // the block is kept, though.
+    const auto sections = filter->computeBiquads();
+    const int warmUp =
+        AlenkaSignal::IirFilterProcessor<float>::warmUpSamples(sections);
+    const int discard = max(M - 1, 2 * min(warmUp, nBlock / 4));
+
+    if (nBlock / 4 < warmUp) {
+      logToFile("IIR filter warm-up of " << warmUp
+                                         << " samples is shortened to "
+                                         << discard / 2
+                                         << "; increase blockSize.");
+    }
+
+    if (iirFilterProcessor)
+      iirFilterProcessor->changeFilter(sections, discard);
+    if (cpuIirFilterProcessor)
+      cpuIirFilterProcessor->changeFilter(sections, discard);
+
+    nDiscard = discard;
+    nDelay = discard / 2;
+    coefficients = AlenkaSignal::IirFilterProcessor<float>::impulseResponse(
+        sections, nDelay);
+  } else {
+    using AlenkaSignal::FilterProcessor;
+    const QString key =
+        filterDesignKey(file->file->getSamplingFrequency(), M);
+
+    if (vector<float> *cached = filterDesignCache[key]) {
+      coefficients = *cached;
+    } else {
+      auto samples = filter->computeSamples();
+      if (OpenDataFile::infoTable.getFrequencyMultipliersOn())
+        multiplySamples(&samples);
+
+      coefficients =
+          FilterProcessor<float>::sampleFilterCoefficients(M, samples);
+      FilterProcessor<float>::applyWindow(
+          &coefficients, OpenDataFile::infoTable.getFilterWindow());
+
+      filterDesignCache.insert(key, new vector<float>(coefficients));
+    }
 
-  for (unsigned int i = 0; i < parallelQueues; ++i) {
-    filterProcessors[i]->changeSampleFilter(M, samples);
-    filterProcessors[i]->applyWindow(OpenDataFile::infoTable.getFilterWindow());
+    if (filterProcessor)
+      filterProcessor->changeFilter(coefficients);
+    if (cpuFilterProcessor)
+      cpuFilterProcessor->changeFilter(coefficients);
+
+    nDiscard = M - 1;
+    nDelay = (M - 1) / 2;
   }
 
-  nDiscard = filterProcessors[0]->discardSamples();
-  nDelay = filterProcessors[0]->delaySamples();
   nMontage = nBlock - nDiscard;
   nSamples = nMontage - (extraSamplesFront + extraSamplesBack);
 
-  OpenDataFile::infoTable.setFilterCoefficients(
-      filterProcessors[0]->getCoefficients());
+  // The blocks start at different samples now, and the shared sum buffers
+  // are sized by nMontage.
+  if (nDiscard != oldDiscard) {
+    cache->clear();
+    setUpdateMontageFlag();
+  }
+
+  // The first nDiscard samples of every FFT block are invalid, so only this
+  // fraction of the work is useful. Increase blockSize if it's too low.
+  logToFile("Filter FFT efficiency " << 100 * nMontage / nBlock << "%: "
+                                     << nDiscard << " of " << nBlock
+                                     << " samples are discarded.");
+
+  OpenDataFile::infoTable.setFilterCoefficients(coefficients);
 }
 
 void SignalProcessor::setUpdateMontageFlag() {
@@ -200,98 +435,148 @@ void SignalProcessor::setUpdateMontageFlag() {
 }
 
 void SignalProcessor::process(const vector<int> &indexVector,
-                              const vector<cl_mem> &outBuffers) {
+                              const vector<cl_mem> &outBuffers,
+                              const HostOutput &hostOutput) {
 #ifndef NDEBUG
   assert(ready());
   assert(0 < indexVector.size());
   assert(static_cast<unsigned int>(indexVector.size()) <= parallelQueues);
   assert(indexVector.size() == outBuffers.size());
+  assert(context || hostOutput);
 
   for (unsigned int i = 0; i < outBuffers.size(); ++i)
     for (unsigned int j = 0; j < outBuffers.size(); ++j)
-      assert(i == j || (outBuffers[i] != outBuffers[j] &&
+      assert(i == j || ((!context || outBuffers[i] != outBuffers[j]) &&
                         indexVector[i] != indexVector[j]));
 #endif
 
+  // The montage kernels of the previous call may still be reading rawBuffer,
+  // filterBuffer or xyzBuffer on the other queues. Everything overwriting
+  // them is enqueued in queue 0, so it must wait for those kernels first.
+  for (cl_event e : montageFinished) {
+    enqueueWait(commandQueues[0], e);
+
+    cl_int err = clReleaseEvent(e);
+    checkClErrorCode(err, "clReleaseEvent()");
+  }
+  montageFinished.clear();
+
   if (updateMontageFlag) {
     updateMontageFlag = false;
     updateMontage();
   }
 
+  if (!cpuMontage.empty()) {
+    processOnCpu(indexVector, outBuffers, hostOutput);
+    return;
+  }
+
   cl_int err;
   const unsigned int iters =
       min(parallelQueues, static_cast<unsigned int>(indexVector.size()));
+  const int blockStride = (nBlock + 2) * fileChannels;
 
-  for (unsigned int i = 0; i < iters; ++i) {
-    // Load the signal data into the file cache.
-    int index = indexVector[i], cacheIndex;
-
-    float *fileBuffer = cache->getAny(set<int>{index}, &cacheIndex);
-    assert(!fileBuffer || cacheIndex == index);
-
-    if (!fileBuffer) {
-      fileBuffer = cache->setOldest(index);
-      logToFile("Loading block " << index << " to File cache.");
+  // The uploads are asynchronous, so that the next block can be read from the
+  // file meanwhile. The host buffers must stay untouched until they finish.
+  vector<cl_event> uploads;
+  set<const float *> uploading;
 
-      auto fromTo = blockIndexToSampleRange(index, nSamples);
-      fromTo.first += -nDiscard + nDelay - extraSamplesFront;
-      fromTo.second += nDelay + extraSamplesBack;
-      assert(fromTo.second - fromTo.first + 1 == nBlock);
-
-      file->file->readSignal(fileBuffer, fromTo.first, fromTo.second);
-    }
-
-    assert(fileBuffer);
+  for (unsigned int i = 0; i < iters; ++i) {
+    // Load the signal data into the file cache. A small cache can hand out a
+    // buffer that is still being uploaded.
+    float *fileBuffer = cachedBlock(indexVector[i], uploading, [&]() {
+      waitAndRelease(&uploads);
+      uploading.clear();
+    });
     printBuffer("after_readSignal.txt", fileBuffer, nBlock * fileChannels);
 
-    size_t origin[] = {0, 0, 0};
+    // Block i goes to the rows from i*fileChannels on.
+    size_t bufferOrigin[] = {0, i * fileChannels, 0};
+    size_t hostOrigin[] = {0, 0, 0};
     size_t rowLen = nBlock * sizeof(float);
     size_t region[] = {rowLen, fileChannels, 1};
 
-    err = clEnqueueWriteBufferRect(
-        commandQueues[i], rawBuffers[i], CL_TRUE, origin, origin, region,
-        rowLen + 2 * sizeof(float), 0, 0, 0, fileBuffer, 0, nullptr, nullptr);
+    // The commands don't block, so these spans measure only the enqueueing.
+    // The device time is recorded by the profileKernels option.
+    traceSpan("enqueueUpload");
+    cl_event event;
+    err = clEnqueueWriteBufferRect(commandQueues[0], rawBuffer, CL_FALSE,
+                                   bufferOrigin, hostOrigin, region,
+                                   rowLen + 2 * sizeof(float), 0, 0, 0,
+                                   fileBuffer, 0, nullptr, &event);
     checkClErrorCode(err, "clEnqueueWriteBufferRect()");
 
-    if (!allpass()) {
-      // Enqueu the filter operation, and store the result in the second buffer.
-      printBuffer("before_filter.txt", rawBuffers[i], commandQueues[i]);
-      filterProcessors[i]->process(rawBuffers[i], filterBuffers[i],
-                                   commandQueues[i]);
-      printBuffer("after_filter.txt", filterBuffers[i], commandQueues[i]);
-    }
+    if (profiler)
+      profiler->record("upload", event);
+    uploads.push_back(event);
+    uploading.insert(fileBuffer);
+  }
+
+  err = clFlush(commandQueues[0]);
+  checkClErrorCode(err, "clFlush()");
+
+  if (!allpass()) {
+    traceSpan("enqueueFilter");
+
+    // Enqueue the filter operation for all the blocks at once, and store the
+    // result in the second buffer. The queue is in-order, so this waits for
+    // the uploads.
+    printBuffer("before_filter.txt", rawBuffer, commandQueues[0]);
+    if (useIir)
+      iirFilterProcessor->process(rawBuffer, filterBuffer, commandQueues[0],
+                                  iters * fileChannels);
+    else
+      filterProcessor->process(rawBuffer, filterBuffer, commandQueues[0],
+                               iters * fileChannels);
+    printBuffer("after_filter.txt", filterBuffer, commandQueues[0]);
   }
 
+  // The montage of each block is computed in its own queue. Those queues wait
+  // for the filter on the device, not here.
+  cl_event filtered = enqueueMarker(commandQueues[0]);
+
+  for (unsigned int i = 1; i < iters; ++i)
+    enqueueWait(commandQueues[i], filtered);
+
+  err = clReleaseEvent(filtered);
+  checkClErrorCode(err, "clReleaseEvent()");
+
   // TODO: Right here would be a great place to load a few extra neighbouring
   // blocks.
 
   // Synchronize with GL so that we can use the shared buffers.
   if (glSharing)
-    glSharing(); // Could be replaced by a fence.
+    glSharing();
 
   // Enque the montage computation, and store the the result in the output
   // buffer.
   for (unsigned int i = 0; i < iters; ++i) {
+    traceSpan("enqueueMontage");
+
     if (glSharing) {
       err = clEnqueueAcquireGLObjects(commandQueues[i], 1, &outBuffers[i], 0,
                                       nullptr, nullptr);
       checkClErrorCode(err, "clEnqueueAcquireGLObjects()");
     }
 
-    cl_mem buffer = filterBuffers[i];
-    int offset = nDiscard;
+    cl_mem buffer = filterBuffer;
+    int offset = i * blockStride + nDiscard;
     if (allpass()) {
-      buffer = rawBuffers[i];
+      buffer = rawBuffer;
       offset -= nDelay;
     }
 
+    cl_mem sharedSumBuffer =
+        sharedSumBuffers.empty() ? nullptr : sharedSumBuffers[i];
     montageProcessor->process(montage.begin(), montage.end(), buffer,
                               outBuffers[i], xyzBuffer, commandQueues[i],
-                              nMontage, offset);
+                              nMontage, offset, sharedSumBuffer);
     printBuffer("after_montage.txt", outBuffers[i], commandQueues[i]);
   }
 
-  // Release the locked buffers and wait for all operations to finish.
+  // Release the locked buffers. Unless GL synchronizes with them implicitly,
+  // wait for all operations to finish.
+  traceSpan("deviceWait");
   for (unsigned int i = 0; i < iters; ++i) {
     if (glSharing) {
       err = clEnqueueReleaseGLObjects(commandQueues[i], 1, &outBuffers[i], 0,
@@ -299,13 +584,74 @@ void SignalProcessor::process(const vector<int> &indexVector,
       checkClErrorCode(err, "clEnqueueReleaseGLObjects()");
     }
 
-    err = clFinish(commandQueues[i]);
-    checkClErrorCode(err, "clFinish()");
+    if (implicitGLSync) {
+      if (0 < i)
+        montageFinished.push_back(enqueueMarker(commandQueues[i]));
+
+      err = clFlush(commandQueues[i]);
+      checkClErrorCode(err, "clFlush()");
+    } else {
+      err = clFinish(commandQueues[i]);
+      checkClErrorCode(err, "clFinish()");
+    }
   }
+
+  // The file cache may reuse the host buffers in the next call.
+  waitAndRelease(&uploads);
+
+  if (profiler)
+    profiler->collect(profiledTracks);
 }
 
 void SignalProcessor::updateXyzBuffer(cl_command_queue queue, cl_mem xyzBuffer,
-                                      const AbstractTrackTable *trackTable) {
+                                      const AbstractTrackTable *trackTable,
+                                      int channels) {
+  using AlenkaSignal::MontageProcessor;
+  const vector<float> xyz =
+      MontageProcessor<float>::buildXyzBuffer(collectXyz(trackTable), channels);
+
+  cl_int err;
+  size_t size = xyz.size() * sizeof(float);
+  err = clEnqueueWriteBuffer(queue, xyzBuffer, CL_FALSE, 0, size, xyz.data(), 0,
+                             nullptr, nullptr);
+  checkClErrorCode(err, "clEnqueueWriteBuffer()");
+
+  err = clFinish(queue);
+  checkClErrorCode(err, "clFinish()");
+}
+
+unsigned int SignalProcessor::blockLength(unsigned int blockSize,
+                                          double samplingFrequency) {
+  // The block is extended to still give the requested number of samples
+  // after the M - 1 samples are discarded. The extended length is usually not
+  // a size clFFT supports, so FilterProcessor always uses partitioned
+  // convolution for such blocks.
+  const unsigned int filterDiscard =
+      static_cast<unsigned int>(samplingFrequency + 1) - 1;
+
+  if (blockSize < 2 * filterDiscard)
+    blockSize += filterDiscard + filterDiscard % 2;
+
+  return blockSize;
+}
+
+AlenkaSignal::MontageLayout
+SignalProcessor::montageLayout(unsigned int blockSize,
+                               double samplingFrequency, int channels,
+                               int montageCopyCount) {
+  AlenkaSignal::MontageLayout layout;
+
+  if (programOption<bool>("specializeKernels")) {
+    layout.inputRowLength = blockLength(blockSize, samplingFrequency) + 2;
+    layout.inputRowCount = channels;
+    layout.outputCopyCount = montageCopyCount;
+  }
+
+  return layout;
+}
+
+vector<float>
+SignalProcessor::collectXyz(const AbstractTrackTable *trackTable) {
   const int tracks = trackTable->rowCount();
   vector<float> xyz(3 * tracks);
 
@@ -317,14 +663,140 @@ void SignalProcessor::updateXyzBuffer(cl_command_queue queue, cl_mem xyzBuffer,
     xyz[3 * i + 2] = t.z;
   }
 
-  cl_int err;
-  size_t size = 3 * tracks * sizeof(float);
-  err = clEnqueueWriteBuffer(queue, xyzBuffer, CL_FALSE, 0, size, xyz.data(), 0,
-                             nullptr, nullptr);
-  checkClErrorCode(err, "clEnqueueWriteBuffer()");
+  return xyz;
+}
 
-  err = clFinish(queue);
-  checkClErrorCode(err, "clFinish()");
+void SignalProcessor::processOnCpu(const vector<int> &indexVector,
+                                   const vector<cl_mem> &outBuffers,
+                                   const HostOutput &hostOutput) {
+  const unsigned int iters =
+      min(parallelQueues, static_cast<unsigned int>(indexVector.size()));
+  const int rowLength = nBlock + 2;
+  const int blockStride = rowLength * fileChannels;
+  const unsigned int rows = iters * fileChannels;
+
+  // Lay out the blocks the same way as in rawBuffer.
+  for (unsigned int i = 0; i < iters; ++i) {
+    const float *fileBuffer = cachedBlock(indexVector[i], {}, nullptr);
+
+    for (unsigned int j = 0; j < fileChannels; ++j)
+      copy_n(fileBuffer + j * nBlock, nBlock,
+             cpuRawBuffer.data() + i * blockStride + j * rowLength);
+  }
+
+  const float *input = cpuRawBuffer.data();
+  int offset = nDiscard;
+
+  if (allpass()) {
+    offset -= nDelay;
+  } else {
+    traceSpan("filter");
+    if (useIir)
+      cpuIirFilterProcessor->process(cpuRawBuffer.data(),
+                                     cpuFilterBuffer.data(), rows);
+    else
+      cpuFilterProcessor->process(cpuRawBuffer.data(), cpuFilterBuffer.data(),
+                                  rows);
+    input = cpuFilterBuffer.data();
+  }
+
+  const size_t outputSize = cpuMontage.size() * nMontage * montageCopyCount;
+  cpuOutput.resize(iters * outputSize);
+
+  for (unsigned int i = 0; i < iters; ++i) {
+    traceSpan("montage");
+    cpuMontageProcessor->process(cpuMontage.begin(), cpuMontage.end(), input,
+                                 cpuOutput.data() + i * outputSize,
+                                 cpuXyz.data(), nMontage,
+                                 i * blockStride + offset);
+  }
+
+  if (hostOutput) {
+    // The caller copies the result where it is needed, e.g. straight to the
+    // vertex buffers. So no device is involved at all.
+    traceSpan("hostOutput");
+    for (unsigned int i = 0; i < iters; ++i)
+      hostOutput(i, cpuOutput.data() + i * outputSize, outputSize);
+  } else {
+    // Upload the result to the output buffers.
+    cl_int err;
+
+    if (glSharing)
+      glSharing();
+
+    for (unsigned int i = 0; i < iters; ++i) {
+      if (glSharing) {
+        err = clEnqueueAcquireGLObjects(commandQueues[i], 1, &outBuffers[i],
+                                        0, nullptr, nullptr);
+        checkClErrorCode(err, "clEnqueueAcquireGLObjects()");
+      }
+
+      err = clEnqueueWriteBuffer(commandQueues[i], outBuffers[i], CL_FALSE, 0,
+                                 outputSize * sizeof(float),
+                                 cpuOutput.data() + i * outputSize, 0,
+                                 nullptr, nullptr);
+      checkClErrorCode(err, "clEnqueueWriteBuffer()");
+
+      if (glSharing) {
+        err = clEnqueueReleaseGLObjects(commandQueues[i], 1, &outBuffers[i],
+                                        0, nullptr, nullptr);
+        checkClErrorCode(err, "clEnqueueReleaseGLObjects()");
+      }
+    }
+
+    // cpuOutput is reused in the next call.
+    for (unsigned int i = 0; i < iters; ++i) {
+      err = clFinish(commandQueues[i]);
+      checkClErrorCode(err, "clFinish()");
+    }
+  }
+
+  if (profiler)
+    profiler->collect();
+}
+
+pair<int64_t, int64_t> SignalProcessor::fileSampleRange(int index) const {
+  auto fromTo = blockIndexToSampleRange(index, nSamples);
+  fromTo.first += -nDiscard + nDelay - extraSamplesFront;
+  fromTo.second += nDelay + extraSamplesBack;
+  assert(fromTo.second - fromTo.first + 1 == nBlock);
+
+  return fromTo;
+}
+
+float *SignalProcessor::cachedBlock(int index, const set<const float *> &inUse,
+                                    const function<void()> &wait) {
+  traceSpan("fileCache");
+
+  return BlockLoader::cachedBlock(
+      cache.get(), index, reuseOverlap, inUse, wait,
+      [this, index](float *buffer, const float *neighbour,
+                    int neighbourIndex) {
+        loadBlock(buffer, index, neighbour, neighbourIndex);
+      });
+}
+
+void SignalProcessor::loadBlock(float *buffer, int index,
+                                const float *neighbour, int neighbourIndex) {
+  traceSpan("readFile");
+  ++PERFORMANCE_COUNTERS.blocksLoaded;
+
+  const BlockLoader::Range neighbourRange =
+      neighbour ? fileSampleRange(neighbourIndex) : BlockLoader::Range();
+  const int64_t overlap =
+      BlockLoader::loadBlock(file->file, buffer, fileSampleRange(index),
+                             neighbour, neighbourRange, &readBuffer);
+
+  PERFORMANCE_COUNTERS.bytesRead +=
+      (nBlock - overlap) * fileChannels * sizeof(float);
+
+  if (overlap == 0) {
+    logToFile("Loading block " << index << " to File cache.");
+  } else {
+    logToFile("Loading block " << index << " to File cache, reusing "
+                               << overlap << " samples of block "
+                               << neighbourIndex << ".");
+  }
 }
 
 vector<string> SignalProcessor::collectLabels(AbstractTrackTable *trackTable) {
@@ -340,9 +812,14 @@ vector<string> SignalProcessor::collectLabels(AbstractTrackTable *trackTable) {
 
 void SignalProcessor::updateMontage() {
   assert(ready());
+  traceSpan("updateMontage");
 
   montageProcessor = make_unique<AlenkaSignal::MontageProcessor<float>>(
       nBlock + 2, fileChannels, montageCopyCount);
+  cpuMontageProcessor =
+      make_unique<AlenkaSignal::CpuMontageProcessor<float>>(
+          nBlock + 2, fileChannels, montageCopyCount);
+  montageProcessor->setProfiler(profiler.get());
 
   clearMontage();
 
@@ -353,6 +830,10 @@ void SignalProcessor::updateMontage() {
       montageCode.emplace_back(t.code, i);
   }
 
+  profiledTracks.clear();
+  for (const auto &e : montageCode)
+    profiledTracks.push_back(getTrackTable(file)->row(e.second).label);
+
   if (maxMontageTracks < static_cast<int>(montageCode.size()))
     throwDetailed(runtime_error("Maximum montage size of " +
                                 to_string(maxMontageTracks) + " exceeded"));
@@ -361,12 +842,205 @@ void SignalProcessor::updateMontage() {
   assert(0 < montageTable->rowCount());
   auto defaultTrackTable = montageTable->trackTable(0);
 
-  updateXyzBuffer(commandQueues[0], xyzBuffer, defaultTrackTable);
+  if (context)
+    updateXyzBuffer(commandQueues[0], xyzBuffer, defaultTrackTable,
+                    fileChannels);
 
   const string header =
       OpenDataFile::infoTable.getGlobalMontageHeader().toStdString();
-  montage = makeMontage<float>(montageCode, context, header,
-                               collectLabels(defaultTrackTable));
+  const vector<string> labels = collectLabels(defaultTrackTable);
+
+  if (cpuBackend) {
+    // The same values as in xyzBuffer; channels beyond the table read as 0.
+    cpuXyz = collectXyz(defaultTrackTable);
+    cpuXyz.resize(max<size_t>(cpuXyz.size(), 3 * fileChannels), 0);
+
+    if (updateCpuMontage(montageCode, header, labels))
+      return;
+  }
+
+  assert(context);
+
+  // Sums like average() used by many tracks are computed only once. This
+  // assumes the default definitions of the sum functions.
+  vector<string> simplifiedCode;
+  for (const auto &e : montageCode)
+    simplifiedCode.push_back(simplifyMontage<float>(e.first));
+
+  vector<pair<int, int>> sharedSums;
+  if (AlenkaSignal::hasDefaultBuiltins(header))
+    sharedSums =
+        AlenkaSignal::shareSums(&simplifiedCode, labels, fileChannels);
+  montageProcessor->setSharedSums(sharedSums, context);
+  createSharedSumBuffers(static_cast<int>(sharedSums.size()));
+
+  if (!sharedSums.empty())
+    logToFile("Sharing " << sharedSums.size() << " channel sums among "
+                         << montageCode.size() << " tracks.");
+
+  // The kernels can be compiled for this file and block size only.
+  const AlenkaSignal::MontageLayout layout = file->montageLayout;
+
+  // The cached kernels are used right away. The rest is handed over to
+  // MontageCompiler, and the tracks stay empty until updateCompiledTracks()
+  // picks up the results.
+  vector<unique_ptr<AlenkaSignal::Montage<float>>> jobs;
+  map<QString, int> jobIndex;
+
+  for (unsigned int i = 0; i < montageCode.size(); ++i) {
+    const auto &e = montageCode[i];
+    auto sourceMontage = make_unique<AlenkaSignal::Montage<float>>(
+        simplifiedCode[i], context, header, labels, layout);
+    sourceMontage->setMontageIndex(e.second);
+    const int track = static_cast<int>(montage.size());
+
+    if (AlenkaSignal::NormalMontage != sourceMontage->getMontageType()) {
+      montage.push_back(std::move(sourceMontage));
+      continue;
+    }
+
+    const QString code = QString::fromStdString(sourceMontage->getSource());
+    auto programPointer = OpenDataFile::kernelCache->find(code);
+
+    if (programPointer) {
+      montage.emplace_back(
+          AlenkaSignal::Montage<float>::fromProgram(programPointer));
+      montage.back()->setMontageIndex(e.second);
+    } else {
+      // Tracks with identical code share one job.
+      auto it = jobIndex.find(code);
+      if (it == jobIndex.end()) {
+        it = jobIndex.emplace(code, static_cast<int>(jobs.size())).first;
+        jobs.push_back(std::move(sourceMontage));
+        compilerJobTracks.emplace_back();
+        compilerJobCode.push_back(code);
+      }
+
+      compilerJobTracks[it->second].emplace_back(track, e.second);
+      montage.emplace_back(nullptr);
+      ++pendingTracks;
+    }
+  }
+
+  if (!jobs.empty()) {
+    logToFile("Compiling " << jobs.size() << " montage kernels for "
+                           << pendingTracks << " tracks in the background.");
+    compileStart = chrono::high_resolution_clock::now();
+
+    if (!montageCompiler)
+      montageCompiler =
+          make_unique<MontageCompiler>(programOption<int>("compileThreads"));
+    montageCompiler->submit(std::move(jobs));
+  }
+}
+
+bool SignalProcessor::updateCompiledTracks() {
+  if (updateMontageFlag) {
+    updateMontageFlag = false;
+    updateMontage();
+  }
+
+  if (compilerJobCode.empty())
+    return false;
+
+  bool changed = false;
+
+  for (auto &result : montageCompiler->takeFinished()) {
+    const auto &tracks = compilerJobTracks[result.job];
+    pendingTracks -= static_cast<int>(tracks.size());
+
+    if (result.error) {
+      // The failed tracks are left empty. This is called from the paint path,
+      // so the error is only logged; the tracks from this batch that did
+      // compile must still be reported by the return value.
+      for (const auto &e : tracks)
+        failedTracks.insert(e.first);
+
+      try {
+        rethrow_exception(result.error);
+      } catch (const exception &e) {
+        logToFileAndConsole("Montage kernel for " << tracks.size()
+                                                  << " track(s) failed: "
+                                                  << catchDetailed(e));
+      }
+      continue;
+    }
+
+    ++PERFORMANCE_COUNTERS.kernelsCompiled;
+    PERFORMANCE_COUNTERS.compileSeconds += result.seconds;
+
+    for (const auto &e : tracks) {
+      montage[e.first].reset(
+          AlenkaSignal::Montage<float>::fromProgram(result.program.get()));
+      montage[e.first]->setMontageIndex(e.second);
+    }
+    changed = true;
+
+    OpenDataFile::kernelCache->insert(compilerJobCode[result.job],
+                                      result.program.release());
+  }
+
+  if (montageCompiler->finished()) {
+    using namespace chrono;
+    const nanoseconds time = high_resolution_clock::now() - compileStart;
+    logToFile("Compiled " << compilerJobCode.size() << " montage kernels in "
+                          << static_cast<double>(time.count()) / 1000 / 1000
+                          << " ms.");
+
+    compilerJobTracks.clear();
+    compilerJobCode.clear();
+  }
+
+  return changed;
+}
+
+bool SignalProcessor::updateCpuMontage(
+    const vector<pair<string, cl_int>> &montageCode, const string &header,
+    const vector<string> &labels) {
+  // CpuMontage implements the header functions itself. Without OpenCL
+  // there is no fallback, so the tracks it can't compute stay empty.
+  const bool defaultBuiltins = AlenkaSignal::hasDefaultBuiltins(header);
+
+  if (!defaultBuiltins) {
+    if (context) {
+      logToFile("The montage header redefines built-in functions, "
+                << "using OpenCL for the montage.");
+      return false;
+    }
+
+    logToFileAndConsole("The montage header redefines built-in functions, "
+                        << "which is not supported without OpenCL.");
+  }
+
+  vector<unique_ptr<AlenkaSignal::CpuMontage<float>>> tracks;
+  string error;
+
+  for (const auto &e : montageCode) {
+    unique_ptr<AlenkaSignal::CpuMontage<float>> track;
+    if (defaultBuiltins)
+      track = AlenkaSignal::CpuMontage<float>::parse(
+          simplifyMontage<float>(e.first), labels, e.second, &error);
+
+    if (!track) {
+      if (context) {
+        logToFile("Track " << e.second << " cannot be computed on the CPU, "
+                           << "using OpenCL for the montage. " << error);
+        return false;
+      }
+
+      if (defaultBuiltins)
+        logToFileAndConsole("Track " << e.second << " cannot be computed "
+                                     << "without OpenCL. " << error);
+      failedTracks.insert(static_cast<int>(tracks.size()));
+    }
+
+    tracks.push_back(std::move(track));
+  }
+
+  logToFile("Computing " << tracks.size() - failedTracks.size()
+                         << " tracks on the CPU.");
+  cpuMontage = std::move(tracks);
+  return true;
 }
 
 bool SignalProcessor::allpass() {
@@ -383,9 +1057,37 @@ void SignalProcessor::createXyzBuffer() {
   }
 
   cl_mem_flags flags = CL_MEM_READ_WRITE;
-  size_t size = 3 * fileChannels * sizeof(float);
+  size_t size =
+      AlenkaSignal::MontageProcessor<float>::xyzBufferSize(fileChannels) *
+      sizeof(float);
 
   xyzBuffer =
       clCreateBuffer(context->getCLContext(), flags, size, nullptr, &err);
   checkClErrorCode(err, "clCreateBuffer");
 }
+
+void SignalProcessor::createSharedSumBuffers(int count) {
+  cl_int err;
+
+  for (cl_mem e : sharedSumBuffers) {
+    err = clReleaseMemObject(e);
+    checkClErrorCode(err, "clReleaseMemObject()");
+  }
+  sharedSumBuffers.clear();
+
+  if (count == 0)
+    return;
+
+  // Every queue needs its own, as they compute different blocks concurrently.
+  cl_mem_flags flags = CL_MEM_READ_WRITE;
+  if (!programOption<bool>("cl11"))
+    flags |= CL_MEM_HOST_NO_ACCESS;
+
+  size_t size = count * nMontage * sizeof(float);
+
+  for (unsigned int i = 0; i < parallelQueues; ++i) {
+    sharedSumBuffers.push_back(
+        clCreateBuffer(context->getCLContext(), flags, size, nullptr, &err));
+    checkClErrorCode(err, "clCreateBuffer");
+  }
+}
@@ -6,6 +6,7 @@
 #include "../DataModel/opendatafile.h"
 #include "../error.h"
 #include "lrucache.h"
+#include "montagecompiler.h"
 
 #ifdef __APPLE__
 #include <OpenCL/cl_gl.h>
@@ -28,8 +29,14 @@ class AbstractTrackTable;
 }
 
 namespace AlenkaSignal {
+class KernelProfiler;
 class OpenCLContext;
+template <class T> class CpuFilterProcessor;
+template <class T> class CpuIirFilterProcessor;
+template <class T> class CpuMontage;
+template <class T> class CpuMontageProcessor;
 template <class T> class FilterProcessor;
+template <class T> class IirFilterProcessor;
 template <class T> class MontageProcessor;
 template <class T> class Filter;
 } // namespace AlenkaSignal
@@ -48,31 +55,69 @@ doneCurrent();
  *
  */
 class SignalProcessor {
+public:
+  /**
+   * @brief Receives the output of block i computed on the host.
+   *
+   * The data is only valid during the call.
+   */
+  using HostOutput =
+      std::function<void(unsigned int i, const float *data, size_t size)>;
+
+private:
   int trackCount = 0;
   bool updateMontageFlag = false;
   int maxMontageTracks = 0;
 
-  int nBlock, nMontage, nSamples, M, nDelay, nDiscard;
+  int nBlock, nMontage, nSamples, M, nDelay, nDiscard = 0;
   unsigned int parallelQueues, montageCopyCount, fileChannels;
 
   std::vector<cl_command_queue> commandQueues;
-  std::vector<cl_mem> rawBuffers;
-  std::vector<cl_mem> filterBuffers;
+  cl_mem rawBuffer, filterBuffer;
   cl_mem xyzBuffer = nullptr;
   QMetaObject::Connection xyzBufferConnection;
+  std::vector<cl_mem> sharedSumBuffers;
   std::unique_ptr<LRUCache<int, float>> cache;
+  bool reuseOverlap;
+  std::vector<float> readBuffer;
 
   std::function<void()> glSharing;
+  bool implicitGLSync;
+  std::vector<cl_event> montageFinished;
   OpenDataFile *file;
   AlenkaSignal::OpenCLContext *context;
-  std::vector<std::unique_ptr<AlenkaSignal::FilterProcessor<float>>>
-      filterProcessors;
+  std::unique_ptr<AlenkaSignal::FilterProcessor<float>> filterProcessor;
+  std::unique_ptr<AlenkaSignal::IirFilterProcessor<float>> iirFilterProcessor;
+  bool useIir = false;
   std::unique_ptr<AlenkaSignal::MontageProcessor<float>> montageProcessor;
   std::vector<std::unique_ptr<AlenkaSignal::Montage<float>>> montage;
+  std::unique_ptr<MontageCompiler> montageCompiler;
+  std::vector<std::vector<std::pair<int, cl_int>>> compilerJobTracks;
+  std::vector<QString> compilerJobCode;
+  int pendingTracks = 0;
+  std::set<int> failedTracks;
+  std::chrono::high_resolution_clock::time_point compileStart;
   int extraSamplesFront, extraSamplesBack;
   std::unique_ptr<AlenkaSignal::Filter<float>> filter;
 
+  bool cpuBackend;
+  std::unique_ptr<AlenkaSignal::CpuFilterProcessor<float>> cpuFilterProcessor;
+  std::unique_ptr<AlenkaSignal::CpuIirFilterProcessor<float>>
+      cpuIirFilterProcessor;
+  std::unique_ptr<AlenkaSignal::CpuMontageProcessor<float>>
+      cpuMontageProcessor;
+  std::vector<std::unique_ptr<AlenkaSignal::CpuMontage<float>>> cpuMontage;
+  std::vector<float> cpuRawBuffer, cpuFilterBuffer, cpuOutput, cpuXyz;
+
+  std::unique_ptr<AlenkaSignal::KernelProfiler> profiler;
+  std::vector<std::string> profiledTracks;
+
 public:
+  /**
+   * @param context Can be nullptr only with the cpuBackend option. Then
+   * everything is computed on the host, and the tracks CpuMontage doesn't
+   * support stay empty.
+   */
   SignalProcessor(unsigned int nBlock, unsigned int parallelQueues,
                   int montageCopyCount, std::function<void()> glSharing,
                   OpenDataFile *file, AlenkaSignal::OpenCLContext *context,
@@ -91,6 +136,15 @@ public:
    * InfoTable.
    *
    * The filter is updated immediately.
+   *
+   * The IIR design is used with the same delay as the FIR filter, so that the
+   * block geometry doesn't depend on the selected design. The frequency
+   * multipliers can only be applied to the FIR filter; so it is used whenever
+   * they are in effect.
+   *
+   * The FIR coefficients are cached by the filter settings, and
+   * FilterProcessor keeps the spectra of the recent ones. So switching back to
+   * recently used settings is cheap.
    */
   void updateFilter();
 
@@ -103,21 +157,73 @@ public:
    */
   void setUpdateMontageFlag();
 
+  /**
+   * @brief Collects the track kernels that finished compiling in the
+   * background.
+   * @return True if some tracks became ready since the last call. Blocks
+   * processed before that are missing those tracks and should be discarded.
+   *
+   * Montage is updated if needed. Tracks that are not ready yet are skipped by
+   * process() and their part of the output buffer is left undefined. So call
+   * this regularly (e.g. before every frame) until allTracksReady() is true.
+   *
+   * Compilation errors are logged, not thrown; see hasTrackFailed().
+   */
+  bool updateCompiledTracks();
+
+  /**
+   * @brief Returns true if the kernel for the track failed to compile.
+   *
+   * Such a track is never going to be ready, and stays empty until the
+   * montage changes.
+   */
+  bool hasTrackFailed(int track) const {
+    return failedTracks.count(track) > 0;
+  }
+
+  /**
+   * @brief Returns true if the kernel for the (non-hidden) track is compiled.
+   */
+  bool isTrackReady(int track) const {
+    return (track < static_cast<int>(montage.size()) && montage[track]) ||
+           (track < static_cast<int>(cpuMontage.size()) && cpuMontage[track]);
+  }
+
+  bool allTracksReady() const {
+    return !updateMontageFlag && pendingTracks == 0;
+  }
+
   /**
    * @brief Returns any block from indexSet ready to be used for rendering.
    * @param indexSet Requested block indexes.
    * @return An object wrapping the block index (and other info) and the vertex
    * arrays for accessing the data.
    *
-   * In this method the synchronization between OpenGL and OpenCL is performed
-   * through glFinish() and clFinish().
+   * The uploads, the filter and the montage are chained on the device by
+   * events. The glSharing function is called before the output buffers are
+   * acquired; it must make sure GL is done with them (glFinish(), or only
+   * glFlush() when the device supports cl_khr_gl_event). In the latter case
+   * this method doesn't wait for the montage to finish, as releasing the
+   * buffers synchronizes with the subsequent GL commands; the next call
+   * makes the device wait for it before overwriting the input buffers.
+   * Otherwise all queues are finished before returning.
    *
    * Montage is updated if needed.
    *
+   * With the cpuBackend option the montage is computed on the host if all
+   * tracks are supported by AlenkaSignal::CpuMontage, and so is the filter.
+   * The result is then passed to hostOutput if it is set, and the output
+   * buffers are not used. Otherwise it is uploaded to them. Without an
+   * OpenCL context hostOutput must be set.
+   *
+   * With the profileKernels option this waits for all commands, and their
+   * device times are added to the profile.
+   *
    * When called ready() should be true.
    */
   void process(const std::vector<int> &indexVector,
-               const std::vector<cl_mem> &outBuffers);
+               const std::vector<cl_mem> &outBuffers,
+               const HostOutput &hostOutput = nullptr);
 
   /**
    * @brief Returns true if this object is ready for full operation.
@@ -130,62 +236,6 @@ public:
     return qstr.simplified().toStdString();
   }
 
-  // TODO: Make sure you don't cache copy-montages.
-  template <class T>
-  static auto
-  makeMontage(const std::vector<std::pair<std::string, cl_int>> &montageCode,
-              AlenkaSignal::OpenCLContext *context, const std::string &header,
-              const std::vector<std::string> &labels) {
-    using namespace std;
-#ifndef NDEBUG
-    // TODO: Remove this after the compilation time issue is solved, or perhaps
-    // log this info to a file.
-    using namespace chrono;
-    auto start = high_resolution_clock::now();
-    int needToCompile = 0;
-#endif
-    std::vector<std::unique_ptr<AlenkaSignal::Montage<T>>> montage;
-
-    for (const auto &e : montageCode) {
-      auto sourceMontage = make_unique<AlenkaSignal::Montage<T>>(
-          simplifyMontage<T>(e.first), context, header, labels);
-      sourceMontage->setMontageIndex(e.second);
-
-      if (AlenkaSignal::NormalMontage != sourceMontage->getMontageType()) {
-        montage.push_back(std::move(sourceMontage));
-      } else {
-        const QString code = QString::fromStdString(sourceMontage->getSource());
-        auto programPointer = OpenDataFile::kernelCache->find(code);
-
-        if (!programPointer) {
-          programPointer = sourceMontage->releaseProgram();
-          assert(programPointer);
-          OpenDataFile::kernelCache->insert(code, programPointer);
-#ifndef NDEBUG
-          ++needToCompile;
-#endif
-        }
-
-        auto m = AlenkaSignal::Montage<T>::fromProgram(programPointer);
-        montage.emplace_back(m);
-      }
-    }
-
-#ifndef NDEBUG
-    auto end = high_resolution_clock::now();
-    nanoseconds time = end - start;
-    string str = "Need to compile " + to_string(needToCompile) + " montages: " +
-                 to_string(static_cast<double>(time.count()) / 1000 / 1000) +
-                 " ms";
-    if (needToCompile > 0) {
-      logToFileAndConsole(str);
-    } else {
-      logToFile(str);
-    }
-#endif
-    return montage;
-  }
-
   static std::pair<std::int64_t, std::int64_t>
   blockIndexToSampleRange(int index, unsigned int blockSize) {
     using namespace std;
@@ -196,21 +246,99 @@ public:
     return make_pair(from, to);
   }
 
+  /**
+   * @brief Uploads the coordinates of the tracks and the table of distances
+   * between them for a montage with the given number of input channels.
+   */
   static void updateXyzBuffer(cl_command_queue queue, cl_mem xyzBuffer,
-                              const AlenkaFile::AbstractTrackTable *trackTable);
+                              const AlenkaFile::AbstractTrackTable *trackTable,
+                              int channels);
+
+  /**
+   * @brief Returns the coordinates of the tracks as x, y, z triplets.
+   */
+  static std::vector<float>
+  collectXyz(const AlenkaFile::AbstractTrackTable *trackTable);
 
   static std::vector<std::string>
   collectLabels(AlenkaFile::AbstractTrackTable *trackTable);
 
+  /**
+   * @brief Returns the length of the blocks processed for the requested
+   * blockSize.
+   *
+   * At high sampling rates the filter would leave little or nothing of the
+   * block after discarding its samples, so the block is extended.
+   */
+  static unsigned int blockLength(unsigned int blockSize,
+                                  double samplingFrequency);
+
+  /**
+   * @brief Returns the sizes compiled into the montage kernels.
+   *
+   * They are fixed only with the specializeKernels option. They are part of
+   * the KernelCache key, so the same layout must be used by everyone who
+   * looks up the kernels.
+   */
+  static AlenkaSignal::MontageLayout montageLayout(unsigned int blockSize,
+                                                   double samplingFrequency,
+                                                   int channels,
+                                                   int montageCopyCount);
+
 private:
   /**
    * @brief This method actually (unlike setUpdateMontageFlag()) updates the
    * MontageProcessor object.
    */
   void updateMontage();
-  void clearMontage() { montage.clear(); }
+  void clearMontage() {
+    // The compiler is kept, so that this doesn't wait for the jobs in
+    // progress.
+    if (montageCompiler)
+      montageCompiler->cancel();
+    montage.clear();
+    cpuMontage.clear();
+    compilerJobTracks.clear();
+    compilerJobCode.clear();
+    pendingTracks = 0;
+    failedTracks.clear();
+  }
   bool allpass();
   void createXyzBuffer();
+  void createSharedSumBuffers(int count);
+  bool updateCpuMontage(
+      const std::vector<std::pair<std::string, cl_int>> &montageCode,
+      const std::string &header, const std::vector<std::string> &labels);
+  void processOnCpu(const std::vector<int> &indexVector,
+                    const std::vector<cl_mem> &outBuffers,
+                    const HostOutput &hostOutput);
+  int filterLength() const {
+    return static_cast<int>(file->file->getSamplingFrequency() + 1);
+  }
+
+  /**
+   * @brief Returns the range of samples read from the file for a block.
+   */
+  std::pair<std::int64_t, std::int64_t> fileSampleRange(int index) const;
+
+  /**
+   * @brief Returns the file cache buffer with block index, loading it if
+   * needed.
+   * @param inUse Buffers that must not be overwritten yet. If one of them is
+   * to be reused, wait is called first.
+   */
+  float *cachedBlock(int index, const std::set<const float *> &inUse,
+                     const std::function<void()> &wait);
+
+  /**
+   * @brief Fills buffer with the samples of block index.
+   * @param neighbour An adjacent block (already in the file cache) or nullptr.
+   *
+   * The part shared with the neighbour is copied, and only the rest is read
+   * from the file. The neighbour and buffer can be the same memory.
+   */
+  void loadBlock(float *buffer, int index, const float *neighbour,
+                 int neighbourIndex);
 };
 
 #endif // SIGNALPROCESSOR_H
@@ -1,17 +1,21 @@
 #include "spikedetanalysis.h"
 
+#include "../../Alenka-Signal/include/AlenkaSignal/deviceset.h"
 #include "../../Alenka-Signal/include/AlenkaSignal/montage.h"
 #include "../../Alenka-Signal/include/AlenkaSignal/montageprocessor.h"
 #include "../../Alenka-Signal/include/AlenkaSignal/openclcontext.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/throughputbalancer.h"
 #include "../DataModel/opendatafile.h"
 #include "../DataModel/undocommandfactory.h"
 #include "../myapplication.h"
 #include "../signalfilebrowserwindow.h"
 #include "../spikedetsettingsdialog.h"
+#include "../tracer.h"
 #include "signalprocessor.h"
 
 #include <QFile>
 #include <QFileInfo>
+#include <QMessageBox>
 #include <QProgressDialog>
 
 #include <chrono>
@@ -22,137 +26,264 @@ using namespace AlenkaSignal;
 
 namespace {
 
-template <class T> class Loader : public AbstractSpikedetLoader<T> {
-  const int BLOCK_LENGTH = 8 * 1024;
-
-  AlenkaFile::DataFile *file;
-  const vector<unique_ptr<Montage<T>>> &montage;
-  vector<T> tmpData;
-  int inChannels, outChannels;
-  unique_ptr<MontageProcessor<T>> processor;
-  cl_command_queue queue = nullptr;
-  cl_mem inBuffer = nullptr, outBuffer = nullptr, xyzBuffer = nullptr;
+// Creates the montage objects of the selected montage. Unlike in
+// SignalProcessor, all tracks are needed before the analysis can start, so the
+// missing programs are compiled here, on the analysis thread.
+template <class T>
+auto makeMontage(OpenDataFile *file, OpenCLContext *context,
+                 KernelCache *kernelCache) {
+  const AlenkaFile::AbstractTrackTable *trackTable =
+      file->dataModel->montageTable()->trackTable(
+          OpenDataFile::infoTable.getSelectedMontage());
 
-public:
-  Loader(AlenkaFile::DataFile *file,
-         const vector<unique_ptr<Montage<T>>> &montage, OpenCLContext *context)
-      : file(file), montage(montage), inChannels(file->getChannelCount()),
-        outChannels(static_cast<int>(montage.size())),
-        processor(new MontageProcessor<T>(BLOCK_LENGTH, inChannels)) {
-    cl_int err;
-    cl_mem_flags flags = CL_MEM_READ_WRITE;
+  auto labels = SignalProcessor::collectLabels(
+      file->file->getDataModel()->montageTable()->trackTable(0));
+  string header =
+      OpenDataFile::infoTable.getGlobalMontageHeader().toStdString();
 
-    queue = clCreateCommandQueue(context->getCLContext(),
-                                 context->getCLDevice(), 0, &err);
-    checkClErrorCode(err, "clCreateCommandQueue");
+  const auto start = chrono::steady_clock::now();
+  int compiled = 0;
+  vector<unique_ptr<Montage<T>>> montage;
 
-    inBuffer =
-        clCreateBuffer(context->getCLContext(), flags,
-                       BLOCK_LENGTH * inChannels * sizeof(T), nullptr, &err);
-    checkClErrorCode(err, "clCreateBuffer");
+  for (int i = 0; i < trackTable->rowCount(); ++i) {
+    auto sourceMontage = make_unique<Montage<T>>(
+        SignalProcessor::simplifyMontage<T>(trackTable->row(i).code), context,
+        header, labels);
+    sourceMontage->setMontageIndex(i);
 
-    outBuffer =
-        clCreateBuffer(context->getCLContext(), flags,
-                       BLOCK_LENGTH * outChannels * sizeof(T), nullptr, &err);
-    checkClErrorCode(err, "clCreateBuffer");
+    if (NormalMontage != sourceMontage->getMontageType()) {
+      montage.push_back(std::move(sourceMontage));
+      continue;
+    }
 
-    xyzBuffer = clCreateBuffer(context->getCLContext(), flags,
-                               inChannels * 3 * sizeof(T), nullptr, &err);
-    checkClErrorCode(err, "clCreateBuffer");
+    const QString code = QString::fromStdString(sourceMontage->getSource());
+    auto programPointer = kernelCache->find(code);
 
-    auto montageTable = file->getDataModel()->montageTable();
-    assert(0 < montageTable->rowCount());
-    auto defaultTrackTable = montageTable->trackTable(0);
+    if (!programPointer) {
+      programPointer = sourceMontage->releaseProgram();
+      assert(programPointer);
+      kernelCache->insert(code, programPointer);
+      ++compiled;
+    }
 
-    SignalProcessor::updateXyzBuffer(queue, xyzBuffer, defaultTrackTable);
+    montage.emplace_back(Montage<T>::fromProgram(programPointer));
+    montage.back()->setMontageIndex(i);
+  }
 
-    tmpData.resize(BLOCK_LENGTH * inChannels);
+  if (0 < compiled) {
+    const chrono::duration<double, milli> time =
+        chrono::steady_clock::now() - start;
+    logToFile("Compiled " << compiled << " montage kernels for spikedet in "
+                          << time.count() << " ms.");
   }
 
-  ~Loader() override {
-    cl_int err;
+  return montage;
+}
 
-    if (queue) {
-      err = clReleaseCommandQueue(queue);
-      checkClErrorCode(err, "clReleaseCommandQueue()");
-    }
+template <class T> class Loader : public AbstractSpikedetLoader<T> {
+  const int BLOCK_LENGTH = 8 * 1024;
 
-    if (inBuffer) {
-      err = clReleaseMemObject(inBuffer);
-      checkClErrorCode(err, "clReleaseMemObject()");
+  // Everything needed to process blocks on one device.
+  struct Worker {
+    vector<unique_ptr<Montage<T>>> montage;
+    unique_ptr<MontageProcessor<T>> processor;
+    cl_command_queue queue = nullptr;
+    cl_mem inBuffer = nullptr, outBuffer = nullptr, xyzBuffer = nullptr;
+    vector<T> tmpData;
+
+    // The block in flight.
+    cl_event start = nullptr, done = nullptr;
+    int length = 0;
+
+    ~Worker() {
+      cl_int err;
+
+      if (queue) {
+        err = clReleaseCommandQueue(queue);
+        checkClErrorCode(err, "clReleaseCommandQueue()");
+      }
+
+      if (inBuffer) {
+        err = clReleaseMemObject(inBuffer);
+        checkClErrorCode(err, "clReleaseMemObject()");
+      }
+
+      if (outBuffer) {
+        err = clReleaseMemObject(outBuffer);
+        checkClErrorCode(err, "clReleaseMemObject()");
+      }
+
+      if (xyzBuffer) {
+        err = clReleaseMemObject(xyzBuffer);
+        checkClErrorCode(err, "clReleaseMemObject()");
+      }
     }
+  };
 
-    if (outBuffer) {
-      err = clReleaseMemObject(outBuffer);
-      checkClErrorCode(err, "clReleaseMemObject()");
-    }
+  AlenkaFile::DataFile *file;
+  int inChannels, outChannels;
+  vector<unique_ptr<Worker>> workers;
+  ThroughputBalancer balancer;
 
-    if (xyzBuffer) {
-      err = clReleaseMemObject(xyzBuffer);
-      checkClErrorCode(err, "clReleaseMemObject()");
+public:
+  Loader(OpenDataFile *file, DeviceSet *devices)
+      : file(file->file), inChannels(file->file->getChannelCount()),
+        balancer(devices->size()) {
+    auto montageTable = file->dataModel->montageTable();
+    assert(0 < montageTable->rowCount());
+    auto defaultTrackTable = montageTable->trackTable(0);
+
+    for (unsigned int i = 0; i < devices->size(); ++i) {
+      OpenCLContext *context = devices->context(i);
+      auto w = make_unique<Worker>();
+
+      w->montage = makeMontage<T>(file, context,
+                                  OpenDataFile::deviceKernelCache(i));
+      outChannels = static_cast<int>(w->montage.size());
+      w->processor = make_unique<MontageProcessor<T>>(BLOCK_LENGTH, inChannels);
+
+      cl_int err;
+      cl_mem_flags flags = CL_MEM_READ_WRITE;
+
+      // Profiling is used to measure the throughput of the device.
+      w->queue = clCreateCommandQueue(context->getCLContext(),
+                                      context->getCLDevice(),
+                                      CL_QUEUE_PROFILING_ENABLE, &err);
+      checkClErrorCode(err, "clCreateCommandQueue");
+
+      w->inBuffer =
+          clCreateBuffer(context->getCLContext(), flags,
+                         BLOCK_LENGTH * inChannels * sizeof(T), nullptr, &err);
+      checkClErrorCode(err, "clCreateBuffer");
+
+      w->outBuffer =
+          clCreateBuffer(context->getCLContext(), flags,
+                         BLOCK_LENGTH * outChannels * sizeof(T), nullptr, &err);
+      checkClErrorCode(err, "clCreateBuffer");
+
+      w->xyzBuffer = clCreateBuffer(
+          context->getCLContext(), flags,
+          MontageProcessor<T>::xyzBufferSize(inChannels) * sizeof(T), nullptr,
+          &err);
+      checkClErrorCode(err, "clCreateBuffer");
+
+      SignalProcessor::updateXyzBuffer(w->queue, w->xyzBuffer,
+                                       defaultTrackTable, inChannels);
+
+      w->tmpData.resize(BLOCK_LENGTH * inChannels);
+      workers.push_back(move(w));
     }
   }
 
+  ~Loader() override {
+    for (unsigned int i = 0; i < workers.size(); ++i)
+      finish(i);
+  }
+
+  // The blocks are spread over the devices. Every device works on one block
+  // at a time, while the next one is read from the file for another device.
   void readSignal(T *data, int64_t firstSample, int64_t lastSample) override {
     cl_int err;
 
     for (int64_t sample = firstSample; sample <= lastSample;
          sample += BLOCK_LENGTH) {
-      // OpenCLContext::printBuffer("spikedet_loader.txt", data, (lastSample -
-      // firstSample + 1)*outChannels);
       int len = min<int>(BLOCK_LENGTH, lastSample - sample + 1);
       assert(len >= 1);
 
-      file->readSignal(tmpData.data(), sample, sample + len - 1);
+      // The device may still be busy with its previous block.
+      poll();
+      const unsigned int device = balancer.pick(len);
+      finish(device);
+      Worker *w = workers[device].get();
+
+      {
+        traceSpan("readFile");
+        file->readSignal(w->tmpData.data(), sample, sample + len - 1);
+      }
 
       size_t origin[] = {0, 0, 0};
       size_t rowLen = len * sizeof(T);
       size_t inRegion[] = {rowLen, static_cast<size_t>(inChannels), 1};
 
-      err = clEnqueueWriteBufferRect(queue, inBuffer, CL_TRUE, origin, origin,
-                                     inRegion, BLOCK_LENGTH * sizeof(T), 0, 0,
-                                     0, tmpData.data(), 0, nullptr, nullptr);
+      err = clEnqueueWriteBufferRect(
+          w->queue, w->inBuffer, CL_FALSE, origin, origin, inRegion,
+          BLOCK_LENGTH * sizeof(T), 0, 0, 0, w->tmpData.data(), 0, nullptr,
+          &w->start);
       checkClErrorCode(err, "clEnqueueWriteBufferRect()");
 
-      processor->process(montage.begin(), montage.end(), inBuffer, outBuffer,
-                         xyzBuffer, queue, BLOCK_LENGTH);
-      // OpenCLContext::printBuffer("after_process.txt", outBuffer, queue);
+      w->processor->process(w->montage.begin(), w->montage.end(), w->inBuffer,
+                            w->outBuffer, w->xyzBuffer, w->queue,
+                            BLOCK_LENGTH);
 
       size_t outRegion[] = {rowLen, static_cast<size_t>(outChannels), 1};
       size_t dataOrigin[] = {
           static_cast<size_t>((sample - firstSample) * sizeof(T)), 0, 0};
 
-      err =
-          clEnqueueReadBufferRect(queue, outBuffer, CL_TRUE, origin, dataOrigin,
-                                  outRegion, BLOCK_LENGTH * sizeof(T), 0,
-                                  (lastSample - firstSample + 1) * sizeof(T), 0,
-                                  data, 0, nullptr, nullptr);
+      err = clEnqueueReadBufferRect(
+          w->queue, w->outBuffer, CL_FALSE, origin, dataOrigin, outRegion,
+          BLOCK_LENGTH * sizeof(T), 0,
+          (lastSample - firstSample + 1) * sizeof(T), 0, data, 0, nullptr,
+          &w->done);
       checkClErrorCode(err, "clEnqueueReadBufferRect()");
+
+      err = clFlush(w->queue);
+      checkClErrorCode(err, "clFlush()");
+
+      w->length = len;
     }
-    // OpenCLContext::printBuffer("spikedet_loader_done.txt", data, (lastSample
-    // - firstSample + 1)*outChannels);
+
+    for (unsigned int i = 0; i < workers.size(); ++i)
+      finish(i);
   }
 
   int64_t sampleCount() override { return file->getSamplesRecorded(); }
   int channelCount() override { return outChannels; }
-};
 
-template <class T>
-auto makeMontage(OpenDataFile *file, OpenCLContext *context) {
-  const AlenkaFile::AbstractTrackTable *trackTable =
-      file->dataModel->montageTable()->trackTable(
-          OpenDataFile::infoTable.getSelectedMontage());
-
-  vector<pair<string, cl_int>> montageCode;
-  for (int i = 0; i < trackTable->rowCount(); ++i)
-    montageCode.emplace_back(trackTable->row(i).code, i);
+private:
+  // Collects the blocks that are already done without waiting.
+  void poll() {
+    for (unsigned int i = 0; i < workers.size(); ++i) {
+      if (!workers[i]->done)
+        continue;
+
+      cl_int status;
+      cl_int err = clGetEventInfo(workers[i]->done,
+                                  CL_EVENT_COMMAND_EXECUTION_STATUS,
+                                  sizeof(cl_int), &status, nullptr);
+      checkClErrorCode(err, "clGetEventInfo()");
+
+      if (status == CL_COMPLETE)
+        finish(i);
+    }
+  }
 
-  auto labels = SignalProcessor::collectLabels(
-      file->file->getDataModel()->montageTable()->trackTable(0));
-  string header =
-      OpenDataFile::infoTable.getGlobalMontageHeader().toStdString();
-  return SignalProcessor::makeMontage<T>(montageCode, context, header, labels);
-}
+  // Waits for the block in flight on the device, and reports how long it took
+  // to the balancer.
+  void finish(unsigned int device) {
+    Worker *w = workers[device].get();
+    if (!w->done)
+      return;
+
+    cl_int err = clWaitForEvents(1, &w->done);
+    checkClErrorCode(err, "clWaitForEvents()");
+
+    cl_ulong start, end;
+    err = clGetEventProfilingInfo(w->start, CL_PROFILING_COMMAND_START,
+                                  sizeof(cl_ulong), &start, nullptr);
+    checkClErrorCode(err, "clGetEventProfilingInfo()");
+    err = clGetEventProfilingInfo(w->done, CL_PROFILING_COMMAND_END,
+                                  sizeof(cl_ulong), &end, nullptr);
+    checkClErrorCode(err, "clGetEventProfilingInfo()");
+
+    balancer.finished(device, w->length, (end - start) / 1e9);
+
+    err = clReleaseEvent(w->start);
+    checkClErrorCode(err, "clReleaseEvent()");
+    err = clReleaseEvent(w->done);
+    checkClErrorCode(err, "clReleaseEvent()");
+    w->start = w->done = nullptr;
+  }
+};
 
 void processOutput(OpenDataFile *file, SpikedetAnalysis *spikedetAnalysis,
                    double spikeDuration) {
@@ -222,6 +353,14 @@ const int SLEEP_FOR_MS = 1;
 void SpikedetAnalysis::runAnalysis(OpenDataFile *file, QWidget *parent) {
   assert(file);
 
+  // The montage is computed by OpenCL, unlike in the CPU backend.
+  if (!globalDevices) {
+    QMessageBox::critical(parent, "Spikedet",
+                          "Spikedet analysis requires OpenCL, which is not "
+                          "available.");
+    return;
+  }
+
   QProgressDialog progress("Running Spikedet analysis", "Abort", 0, 100,
                            parent);
   progress.setWindowModality(Qt::WindowModal);
@@ -229,20 +368,17 @@ void SpikedetAnalysis::runAnalysis(OpenDataFile *file, QWidget *parent) {
   progress.setMinimumDuration(0); // This is to show the dialog immediately.
   progress.setValue(1);
 
-  OpenCLContext *const context = globalContext.get();
-
-  vector<unique_ptr<Montage<SIGNALTYPE>>> montage =
-      makeMontage<SIGNALTYPE>(file, context);
-
   int Fs = static_cast<int>(round(file->file->getSamplingFrequency()));
   Spikedet spikedet(Fs, originalSpikedet(), settings);
-  Loader<SIGNALTYPE> loader(file->file, montage, context);
+  Loader<SIGNALTYPE> loader(file, globalDevices.get());
 
   output = make_unique<CDetectorOutput>();
   discharges = make_unique<CDischarges>(loader.channelCount());
 
-  thread t(
-      [&]() { spikedet.runAnalysis(&loader, output.get(), discharges.get()); });
+  thread t([&]() {
+    traceSpan("spikedet");
+    spikedet.runAnalysis(&loader, output.get(), discharges.get());
+  });
 
   while (1) {
     int percentage = spikedet.progressPercentage();
@@ -262,6 +398,7 @@ void SpikedetAnalysis::runAnalysis(OpenDataFile *file, QWidget *parent) {
   t.join();
   progress.setValue(100);
 
+  traceSpan("spikedetOutput");
   processOutput(file, this, spikeDuration);
 }
 
@@ -296,8 +433,10 @@ void SpikedetAnalysis::analyseCommandLineFile() {
   auto output = make_unique<CDetectorOutput>();
   auto discharges = make_unique<CDischarges>(loader.channelCount());
 
-  thread t(
-      [&]() { spikedet.runAnalysis(&loader, output.get(), discharges.get()); });
+  thread t([&]() {
+    traceSpan("spikedet");
+    spikedet.runAnalysis(&loader, output.get(), discharges.get());
+  });
 
   int lastPercentage = -1;
 
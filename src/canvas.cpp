@@ -1,20 +1,25 @@
 #include "canvas.h"
 
 #include "../Alenka-File/include/AlenkaFile/datafile.h"
+#include "../Alenka-Signal/include/AlenkaSignal/deviceset.h"
 #include "DataModel/opendatafile.h"
 #include "DataModel/undocommandfactory.h"
 #include "DataModel/vitnessdatamodel.h"
+#include "SignalProcessor/autotuner.h"
 #include "SignalProcessor/signalprocessor.h"
 #include "error.h"
 #include "myapplication.h"
 #include "openglprogram.h"
 #include "options.h"
+#include "performancecounters.h"
 #include "signalviewer.h"
+#include "tracer.h"
 
 #include <QCursor>
 #include <QKeyEvent>
 #include <QMatrix4x4>
 #include <QOpenGLDebugLogger>
+#include <QTimer>
 #include <QUndoCommand>
 #include <QWheelEvent>
 
@@ -44,6 +49,7 @@ namespace {
 const double HORIZONTAL_ZOOM = 1.3;
 const double VERTICAL_ZOOM = 1.3;
 const double TRACK_ZOOM = VERTICAL_ZOOM;
+const int COMPILE_POLL_INTERVAL = 50; // In ms.
 
 void getEventTypeColorOpacity(OpenDataFile *file, int type, QColor *color,
                               double *opacity) {
@@ -139,6 +145,7 @@ void getEventsForRendering(
     OpenDataFile *file, int firstSample, int lastSample,
     vector<tuple<int, int, int>> *allChannelEvents,
     vector<tuple<int, int, int, int>> *singleChannelEvents) {
+  traceSpan("gatherEvents");
   const AbstractEventTable *eventTable = getEventTable(file);
 
   for (int i = 0; i < eventTable->rowCount(); ++i) {
@@ -302,10 +309,13 @@ Canvas::Canvas(QWidget *parent) : QOpenGLWidget(parent) {
   setMouseTracking(true);
 
   // TODO: Fix the OpenGL 4.3 optimization.
-  programOption("parProc", parallelQueues);
-  programOption("blockSize", nBlock);
   duplicateSignal = !programOption<bool>("gl43");
   programOption("glSharing", glSharing);
+
+  // Without OpenCL the CPU backend writes straight to the vertex buffers.
+  if (!globalContext)
+    glSharing = false;
+
   printTiming = isProgramOptionSet("printTiming");
 
   extraSamplesFront = extraSamplesBack = 0; // TODO: Test this with other values
@@ -372,6 +382,10 @@ void Canvas::changeFile(OpenDataFile *file) {
                 SIGNAL(filterWindowChanged(AlenkaSignal::WindowFunction)), this,
                 SLOT(updateFilter()));
     openFileConnections.push_back(c);
+    c = connect(&OpenDataFile::infoTable,
+                SIGNAL(filterDesignChanged(AlenkaSignal::FilterDesign)), this,
+                SLOT(updateFilter()));
+    openFileConnections.push_back(c);
     c = connect(&OpenDataFile::infoTable, SIGNAL(frequencyMultipliersChanged()),
                 this, SLOT(updateFilter()));
     openFileConnections.push_back(c);
@@ -389,8 +403,19 @@ void Canvas::changeFile(OpenDataFile *file) {
     openFileConnections.push_back(c);
 
     function<void()> sharingFunction = nullptr;
-    if (glSharing)
-      sharingFunction = [this]() { gl()->glFinish(); };
+    if (glSharing) {
+      // With cl_khr_gl_event acquiring the buffers waits for the GL commands
+      // that use them, so they only need to be flushed.
+      if (globalContext->hasExtension("cl_khr_gl_event"))
+        sharingFunction = [this]() { gl()->glFlush(); };
+      else
+        sharingFunction = [this]() { gl()->glFinish(); };
+    }
+
+    const Autotuner::Settings settings =
+        Autotuner::settingsFor(file->file, globalContext.get());
+    nBlock = settings.blockSize;
+    parallelQueues = settings.parallelQueues;
 
     signalProcessor = make_unique<SignalProcessor>(
         nBlock, parallelQueues, duplicateSignal ? 2 : 1, sharingFunction, file,
@@ -533,7 +558,7 @@ void Canvas::initializeGL() {
 
   createContext();
 
-  if (!glSharing) {
+  if (!glSharing && globalContext) {
     cl_int err;
     commandQueue = clCreateCommandQueue(globalContext->getCLContext(),
                                         globalContext->getCLDevice(), 0, &err);
@@ -549,10 +574,13 @@ void Canvas::resizeGL(int /*w*/, int /*h*/) {
 
 void Canvas::paintGL() {
   using namespace chrono;
+  traceSpan("paintGL");
 
   if (paintingDisabled)
     return;
 
+  const auto frameStart = high_resolution_clock::now();
+
 #ifndef NDEBUG
   logToFile("Painting started.");
 #endif
@@ -565,6 +593,11 @@ void Canvas::paintGL() {
       start = high_resolution_clock::now();
     }
 
+    // Blocks processed before the last batch of track kernels was compiled
+    // are missing those tracks, so they must be recomputed.
+    if (signalProcessor->updateCompiledTracks())
+      cache->clear();
+
     // Calculate the transformMatrix.
     const double ratio = virtualRatio();
     const float position = leftEdgePosition();
@@ -645,14 +678,37 @@ void Canvas::paintGL() {
         logToFile("Loading block " << index << " to GPU cache.");
 
         indexVector.push_back(index);
-        bufferVector.push_back(glSharing ? cacheItem->sharedBuffer
-                                         : processorOutputBuffers[j]);
+        if (glSharing)
+          bufferVector.push_back(cacheItem->sharedBuffer);
+        else if (globalContext)
+          bufferVector.push_back(processorOutputBuffers[j]);
+        else
+          bufferVector.push_back(nullptr);
         items.push_back(cacheItem);
       }
 
-      signalProcessor->process(indexVector, bufferVector);
+      // The CPU backend hands over the result on the host, so it is copied
+      // to the vertex buffers directly.
+      bool onHost = false;
+      const auto hostOutput = [&](unsigned int j, const float *data,
+                                  size_t size) {
+        gl()->glBindBuffer(GL_ARRAY_BUFFER, items[j]->signalBuffer);
+        if (glSharing)
+          gl()->glBufferSubData(GL_ARRAY_BUFFER, 0, size * sizeof(float),
+                                data);
+        else
+          gl()->glBufferData(GL_ARRAY_BUFFER, size * sizeof(float), data,
+                             GL_STATIC_DRAW);
+        onHost = true;
+      };
+
+      signalProcessor->process(indexVector, bufferVector, hostOutput);
 
-      if (!glSharing) {
+      if (onHost) {
+        for (unsigned int j = 0; j < indexVector.size(); ++j)
+          drawBlock(indexVector[j], items[j], singleChannelEvents);
+      } else if (!glSharing) {
+        traceSpan("download");
         // Pull the data from CL buffer and copy it to the GL buffer.
         cl_int err;
         size_t size = signalProcessor->montageLength() *
@@ -680,6 +736,12 @@ void Canvas::paintGL() {
       gl()->glFlush();
     }
 
+    drawTrackPlaceholders(firstSample, lastSample);
+
+    // Keep repainting until all the kernels are compiled.
+    if (!signalProcessor->allTracksReady())
+      QTimer::singleShot(COMPILE_POLL_INTERVAL, this, SLOT(update()));
+
     drawPositionIndicator();
     drawCross();
 
@@ -697,6 +759,12 @@ void Canvas::paintGL() {
 
   checkGLMessages();
 
+  if (ready()) {
+    const nanoseconds time = high_resolution_clock::now() - frameStart;
+    emit frameFinished(static_cast<double>(time.count()) / 1000 / 1000 / 1000,
+                       signalProcessor->allTracksReady());
+  }
+
 #ifndef NDEBUG
   logToFile("Painting finished.");
 #endif
@@ -867,7 +935,11 @@ void Canvas::updateProcessor() {
   int64_t gpuMemorySize = programOption<int>("gpuMemorySize");
   gpuMemorySize *= 1000 * 1000; // Convert from MB.
 
-  if (gpuMemorySize <= 0) {
+  if (gpuMemorySize <= 0 && !globalContext) {
+    // There is no device to ask, so use as much as the file cache.
+    gpuMemorySize = programOption<int>("fileCacheSize");
+    gpuMemorySize *= 1000 * 1000;
+  } else if (gpuMemorySize <= 0) {
     cl_ulong gpuSize;
     cl_int err =
         clGetDeviceInfo(globalContext->getCLDevice(), CL_DEVICE_GLOBAL_MEM_SIZE,
@@ -899,8 +971,9 @@ void Canvas::updateProcessor() {
       cacheCapacity,
       make_unique<GPUCacheAllocator>(size, duplicateSignal, glSharing,
                                      globalContext.get()));
+  cache->setStats(&PERFORMANCE_COUNTERS.gpuCache, size);
 
-  if (!glSharing) {
+  if (!glSharing && globalContext) {
     processorSyncBuffer.resize(size / sizeof(float));
 
     for (int i = 0; i < parallelQueues; ++i) {
@@ -918,6 +991,7 @@ void Canvas::updateProcessor() {
 void Canvas::drawBlock(
     int index, GPUCacheItem *cacheItem,
     const vector<tuple<int, int, int, int>> &singleChannelEvents) {
+  traceSpan("drawBlock");
   assert(cacheItem);
 
   signalArray = cacheItem->signalArray;
@@ -1148,6 +1222,9 @@ void Canvas::drawSignal(int index) {
             duplicateSignal ? 2 * sizeof(float) : 0);
 
   for (int track = 0; track < signalProcessor->getTrackCount(); ++track) {
+    if (!signalProcessor->isTrackReady(track))
+      continue; // The placeholder is drawn instead.
+
     int hidden = countHiddenTracks(track);
 
     setUniformTrack(signalProgram->getGLProgram(), track + hidden, hidden,
@@ -1165,6 +1242,38 @@ void Canvas::drawSignal(int index) {
   }
 }
 
+void Canvas::drawTrackPlaceholders(int from, int to) {
+  const int trackCount = signalProcessor->getTrackCount();
+  bool bound = false;
+
+  for (int track = 0; track < trackCount; ++track) {
+    if (signalProcessor->isTrackReady(track) ||
+        signalProcessor->hasTrackFailed(track))
+      continue;
+
+    if (!bound) {
+      bound = true;
+      gl()->glUseProgram(rectangleLineProgram->getGLProgram());
+      bindArray(rectangleLineArray, rectangleLineBuffer, 2, 0);
+      gl()->glBindBuffer(GL_ARRAY_BUFFER, rectangleLineBuffer);
+      setUniformColor(rectangleLineProgram->getGLProgram(), QColor(Qt::gray),
+                      0.5);
+    }
+
+    const float trackHeight = static_cast<float>(height()) / trackCount;
+    const float y0 = (track + 0.5f) * trackHeight;
+    const float halfWidth = max(1.f, 0.05f * trackHeight);
+
+    float data[8] = {static_cast<float>(from), y0 - halfWidth,
+                     static_cast<float>(to),   y0 - halfWidth,
+                     static_cast<float>(from), y0 + halfWidth,
+                     static_cast<float>(to),   y0 + halfWidth};
+
+    gl()->glBufferData(GL_ARRAY_BUFFER, sizeof(data), data, GL_STATIC_DRAW);
+    gl()->glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  }
+}
+
 void Canvas::setUniformTrack(GLuint program, int track, int hidden, int index) {
   GLuint location = gl()->glGetUniformLocation(program, "y0");
   checkNotErrorCode(location, static_cast<GLuint>(-1),
@@ -1259,6 +1368,9 @@ int Canvas::countHiddenTracks(int track) {
 
 void Canvas::createContext() {
   // TODO: Make sure this function is executed only once.
+  if (!globalContext)
+    return;
+
   vector<cl_context_properties> properties;
 
   if (glSharing) {
@@ -1286,6 +1398,8 @@ void Canvas::createContext() {
   globalContext = make_unique<AlenkaSignal::OpenCLContext>(
       programOption<int>("clPlatform"), programOption<int>("clDevice"),
       properties);
+  globalContext->setSeparateCompilation(!programOption<bool>("cl11"));
+  globalDevices->setPrimary(globalContext.get());
 
   if (programOption<bool>("kernelCachePersist"))
     OpenDataFile::kernelCache->loadFromFile(globalContext.get());
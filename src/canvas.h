@@ -120,6 +120,13 @@ signals:
   void shiftZoomUp();
   void shiftZoomDown();
 
+  /**
+   * @brief Emitted at the end of every frame painted with a file open.
+   * @param seconds The time spent in paintGL() including glFinish().
+   * @param complete False if some tracks were still compiling.
+   */
+  void frameFinished(double seconds, bool complete);
+
 public slots:
   void updateCursor();
 
@@ -157,6 +164,10 @@ private:
       int index, const std::vector<std::tuple<int, int, int, int>> &events);
   void drawSingleChannelEvent(int index, int track, int from, int to);
   void drawSignal(int index);
+  /**
+   * @brief Draws a gray band in place of tracks that are still compiling.
+   */
+  void drawTrackPlaceholders(int from, int to);
   void setUniformTrack(GLuint program, int track, int hidden, int index);
   void setUniformColor(GLuint program, const QColor &color, double opacity);
   void checkGLMessages();
@@ -6,6 +6,9 @@
  * @file
  */
 
+#include "SignalProcessor/autotuner.h"
+#include "SignalProcessor/batchprocessor.h"
+#include "SignalProcessor/kernelprecompiler.h"
 #include "SignalProcessor/spikedetanalysis.h"
 #include "error.h"
 #include "myapplication.h"
@@ -13,6 +16,7 @@
 #include "signalfilebrowserwindow.h"
 #include <detailedexception.h>
 
+#include <cstring>
 #include <stdexcept>
 #include <string>
 
@@ -31,10 +35,32 @@ using namespace std;
 #error You must define one of WIN_BUILD or UNIX_BUILD.
 #endif
 
+namespace {
+
+/**
+ * @brief Lets the batch mode run without a display.
+ *
+ * The platform plugin is chosen when QApplication is constructed, i.e. before
+ * the options are parsed.
+ */
+void useOffscreenPlatformForBatch(int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--batch", 7) == 0 &&
+        (argv[i][7] == 0 || argv[i][7] == '=')) {
+      if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+      return;
+    }
+  }
+}
+
+} // namespace
+
 int main(int argc, char **argv) {
   int ret = EXIT_FAILURE;
 
   try {
+    useOffscreenPlatformForBatch(argc, argv);
     MyApplication app(argc, argv);
 
     if (isProgramOptionSet("spikedet")) {
@@ -47,6 +73,19 @@ int main(int argc, char **argv) {
       }
     }
 
+    if (isProgramOptionSet("batch")) {
+      return MyApplication::logExitStatus(BatchProcessor::batchCommandLine());
+    }
+
+    if (isProgramOptionSet("precompile")) {
+      return MyApplication::logExitStatus(
+          KernelPrecompiler::precompileCommandLine());
+    }
+
+    if (isProgramOptionSet("autotune")) {
+      return MyApplication::logExitStatus(Autotuner::autotuneCommandLine());
+    }
+
     SignalFileBrowserWindow window;
 
     string mode;
@@ -1,8 +1,10 @@
 #include "myapplication.h"
 
+#include "../Alenka-Signal/include/AlenkaSignal/deviceset.h"
 #include "../Alenka-Signal/include/AlenkaSignal/openclcontext.h"
 #include "error.h"
 #include "options.h"
+#include "tracer.h"
 
 #include <QDir>
 #include <QLoggingCategory>
@@ -77,19 +79,43 @@ MyApplication::MyApplication(int &argc, char **argv)
 
   PROGRAM_OPTIONS->logConfigFile();
 
+  if (isProgramOptionSet("trace"))
+    Tracer::start(programOption<string>("trace"));
+
   // Process some of the command-line-only options.
   const unsigned int platformIndex = programOption<int>("clPlatform");
   const unsigned int deviceIndex = programOption<int>("clDevice");
-  const string clInfoString =
-      AlenkaSignal::OpenCLContext::getPlatformInfo(platformIndex) + "\n\n" +
-      AlenkaSignal::OpenCLContext::getDeviceInfo(platformIndex, deviceIndex) +
-      "\n";
-  logToFile(clInfoString);
+  string clInfoString;
+  bool openCLAvailable = true;
+
+  try {
+    clInfoString =
+        AlenkaSignal::OpenCLContext::getPlatformInfo(platformIndex) + "\n\n" +
+        AlenkaSignal::OpenCLContext::getDeviceInfo(platformIndex, deviceIndex) +
+        "\n";
+    logToFile(clInfoString);
+  } catch (const exception &e) {
+    // The GUI can do without OpenCL with the cpuBackend option. The
+    // command-line modes need it.
+    const bool needsOpenCL =
+        !programOption<bool>("cpuBackend") || isProgramOptionSet("clInfo") ||
+        isProgramOptionSet("spikedet") || isProgramOptionSet("batch") ||
+        isProgramOptionSet("precompile") || isProgramOptionSet("autotune");
+    if (needsOpenCL)
+      throw;
+
+    openCLAvailable = false;
+
+    logToFileAndConsole("OpenCL is not available, everything is computed on "
+                        << "the CPU: " << catchDetailed(e));
+  }
 
   if (isProgramOptionSet("help")) { // Help should be always the first.
     cout << R"(Usage:
   Alenka [OPTION]... [FILE]...
   Alenka --spikedet OUTPUT_FILE [SPIKEDET_SETTINGS]... FILE [FILE]...
+  Alenka --precompile OUTPUT_FILE [--montageHeader FILE] [FILE] TEMPLATE...
+  Alenka --batch OUTPUT_FILE [--montageFile FILE] [--resample F] FILE...
   Alenka --help|--clInfo|--glInfo|--version
 )";
     cout << PROGRAM_OPTIONS->getDescription();
@@ -105,12 +131,30 @@ MyApplication::MyApplication(int &argc, char **argv)
     mainExit();
   }
 
-  // Initialize the global OpenCL context.
-  globalContext =
-      make_unique<AlenkaSignal::OpenCLContext>(platformIndex, deviceIndex);
+  // Initialize the global OpenCL context. The platform was found, so
+  // failures from here on are errors even with the cpuBackend option.
+  if (openCLAvailable) {
+    globalContext =
+        make_unique<AlenkaSignal::OpenCLContext>(platformIndex, deviceIndex);
+    globalContext->setSeparateCompilation(!programOption<bool>("cl11"));
+
+    try {
+      const auto extraDevices = AlenkaSignal::DeviceSet::parseDeviceList(
+          programOption<string>("clExtraDevices"));
+      globalDevices = make_unique<AlenkaSignal::DeviceSet>(globalContext.get(),
+                                                           extraDevices);
+    } catch (const runtime_error &e) {
+      logToFileAndConsole("Extra OpenCL devices are not used: "
+                          << catchDetailed(e));
+      globalDevices =
+          make_unique<AlenkaSignal::DeviceSet>(globalContext.get());
+    }
+    logToFile("Using " << globalDevices->size()
+                       << " OpenCL devices for batch processing.");
 
-  // Set up the clFFT library.
-  AlenkaSignal::OpenCLContext::clfftInit();
+    // Set up the clFFT library.
+    AlenkaSignal::OpenCLContext::clfftInit();
+  }
 
   // Set some OpenGL context details.
   QSurfaceFormat format = QSurfaceFormat::defaultFormat();
@@ -129,7 +173,10 @@ MyApplication::MyApplication(int &argc, char **argv)
   QLocale::setDefault(locale);
 }
 
-MyApplication::~MyApplication() { AlenkaSignal::OpenCLContext::clfftDeinit(); }
+MyApplication::~MyApplication() {
+  if (globalContext)
+    AlenkaSignal::OpenCLContext::clfftDeinit();
+}
 
 bool MyApplication::notify(QObject *receiver, QEvent *event) {
   try {
@@ -150,6 +197,7 @@ void MyApplication::mainExit(int status) {
 }
 
 int MyApplication::logExitStatus(int status) {
+  Tracer::finish();
   logToFile("Exiting with status " << status << ".");
   return status;
 }
@@ -166,3 +214,4 @@ QDir MyApplication::makeSubdir(const QString &path,
 }
 
 unique_ptr<AlenkaSignal::OpenCLContext> globalContext(nullptr);
+unique_ptr<AlenkaSignal::DeviceSet> globalDevices(nullptr);
@@ -9,8 +9,9 @@
 
 class Options;
 namespace AlenkaSignal {
+class DeviceSet;
 class OpenCLContext;
-}
+} // namespace AlenkaSignal
 
 /**
  * @brief This class initializes objects and libraries needed to run the
@@ -63,6 +64,18 @@ public:
   }
 };
 
+/**
+ * @brief The OpenCL context used by the GUI.
+ *
+ * It is nullptr if OpenCL is not available and the cpuBackend option is set.
+ */
 extern std::unique_ptr<AlenkaSignal::OpenCLContext> globalContext;
 
+/**
+ * @brief The devices used for batch processing.
+ *
+ * The first one is always globalContext. It is nullptr when globalContext is.
+ */
+extern std::unique_ptr<AlenkaSignal::DeviceSet> globalDevices;
+
 #endif // MYAPPLICATION_H
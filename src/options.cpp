@@ -40,10 +40,22 @@ Options::Options(int argc, char **argv)
   ("help", "help message")
   ("config", value<string>()->value_name("path"), "override default config file path")
   ("spikedet", value<string>()->value_name("OUTPUT_FILE"), "Spikedet only mode")
+  ("precompile", value<string>()->value_name("OUTPUT_FILE"), "write a kernel cache pack for montage templates")
+  ("montageHeader", value<string>()->value_name("path"), "montage header used by --precompile and --batch")
+  ("autotune", "find the best blockSize and parProc for the recordings on the selected device")
+  ("batch", value<string>()->value_name("OUTPUT_FILE"), "write the processed tracks without the GUI")
+  ("batchFormat", value<string>()->value_name("type"), "gdf|edf|raw; the default is by OUTPUT_FILE suffix")
+  ("montageFile", value<string>()->value_name("path"), "montage used by --batch; the default is FILE.mont")
+  ("montageIndex", value<int>()->value_name("i"), "montage used by --batch; the default is the selected one")
+  ("resample", value<double>()->default_value(0)->value_name("f"), "output sampling rate for --batch; 0 to disable")
   ("clInfo", "print OpenCL platform and device info")
   ("glInfo", "print OpenGL info")
   ("version", "print version number")
   ("printTiming", "print the time it took to redraw Canvas")
+  ("trace", value<string>()->value_name("OUTPUT_FILE"), "record a timeline of the processing stages in Chrome trace format")
+  ("profileKernels", value<string>()->value_name("OUTPUT_FILE"), "write the device time of the processing stages and tracks of every signal processor as CSV")
+  ("replay", value<string>()->value_name("SCRIPT"), "replay the view changes in SCRIPT, print the frame times, and quit")
+  ("recordReplay", value<string>()->value_name("OUTPUT_FILE"), "record the view changes as a script for --replay")
 #ifndef NDEBUG
   ("printBuffers", "dump OpenCL buffers for debugging")
 #endif
@@ -58,16 +70,23 @@ Options::Options(int argc, char **argv)
   ("kernelCacheSize", value<int>()->default_value(10000)->value_name("c"), "how many montage kernels are stored in memory")
   ("kernelCachePersist", value<bool>()->default_value(false)->value_name("bool"), "whether to store kernels persistently")
   ("kernelCacheDir", value<string>()->value_name("path"), "default is install dir")
+  ("compileThreads", value<int>()->default_value(0)->value_name("val"), "montage compilation threads; 0 means auto")
+  ("performanceLogInterval", value<int>()->default_value(0)->value_name("seconds"), "interval between logging the performance counters; 0 to disable")
+  ("specializeKernels", value<bool>()->default_value(false)->value_name("bool"), "compile montage kernels for the file layout and block size")
   ("gl20", value<bool>()->default_value(false)->value_name("bool"), "use OpenGL 2.0 instead of 3.0")
   ("gl43", value<bool>()->default_value(false)->value_name("bool"), "use OpenGL 4.3 instead of 3.0; disabled")
   ("cl11", value<bool>()->default_value(false)->value_name("bool"), "use OpenCL 1.1 instead of 1.2")
   ("glSharing", value<bool>()->default_value(true)->value_name("bool"), "use cl_khr_gl_sharing extension")
   ("clPlatform", value<int>()->default_value(0)->value_name("ID"), "select OpenCL platform")
   ("clDevice", value<int>()->default_value(0)->value_name("ID"), "OpenCL device")
+  ("clExtraDevices", value<string>()->default_value("")->value_name("list"), "more devices for batch processing, e.g. '0:1 1:0'")
   ("blockSize", value<int>()->default_value(16*1024)->value_name("val"), "samples per channel per block")
   ("gpuMemorySize", value<int>()->default_value(0)->value_name("MB"), "allowed GPU memory; 0 means no limit")
   ("parProc", value<int>()->default_value(2)->value_name("val"), "parallel signal processor queue count")
+  ("autotuned", value<bool>()->default_value(true)->value_name("bool"), "use the blockSize and parProc found by --autotune")
   ("fileCacheSize", value<int>()->default_value(0)->value_name("MB"), "allowed RAM for caching signal files")
+  ("reuseBlockOverlap", value<bool>()->default_value(true)->value_name("bool"), "copy the overlap of adjacent blocks instead of rereading it")
+  ("cpuBackend", value<bool>()->default_value(false)->value_name("bool"), "filter and compute montages on the CPU instead of OpenCL")
   ("notchFrequency", value<double>()->default_value(50)->value_name("f"), "power interference filter")
   ("resOptions", value<string>()->default_value("1 2 5 7.5 10 20 50 75 100 200 500 750", "1 2 ...")->value_name("list"), "resolution combo options")
   ("screenPath", value<string>()->value_name("path"), "screenshot output dir path")
@@ -145,6 +164,12 @@ void Options::validateValues() {
     throwDetailed(validation_error(validation_error::invalid_option_value,
                                    "parProc", to_string(parallelProcessors)));
 
+  const int compileThreads = get("compileThreads").as<int>();
+  if (compileThreads < 0)
+    throwDetailed(validation_error(validation_error::invalid_option_value,
+                                   "compileThreads",
+                                   to_string(compileThreads)));
+
   const int blockSize = get("blockSize").as<int>();
   if (blockSize <= 0)
     throwDetailed(validation_error(validation_error::invalid_option_value,
@@ -0,0 +1,77 @@
+#include "performancecounters.h"
+
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+
+PerformanceCounters PERFORMANCE_COUNTERS;
+
+namespace {
+
+string percent(uint64_t part, uint64_t total) {
+  if (total == 0)
+    return "-";
+
+  stringstream ss;
+  ss << fixed << setprecision(1) << 100. * part / total << " %";
+  return ss.str();
+}
+
+string megabytes(int64_t bytes) {
+  stringstream ss;
+  ss << fixed << setprecision(1) << bytes / 1000. / 1000 << " MB";
+  return ss.str();
+}
+
+string rate(uint64_t now, uint64_t before, double seconds) {
+  stringstream ss;
+  ss << fixed << setprecision(1)
+     << (0 < seconds ? (now - before) / seconds : 0);
+  return ss.str();
+}
+
+void describeCache(const string &name, const LRUCacheStats &s,
+                   vector<pair<string, string>> *rows) {
+  rows->emplace_back(name + " hits", to_string(s.hits));
+  rows->emplace_back(name + " misses", to_string(s.misses));
+  rows->emplace_back(name + " hit rate", percent(s.hits, s.hits + s.misses));
+  rows->emplace_back(name + " evictions", to_string(s.evictions));
+  rows->emplace_back(name + " resident",
+                     to_string(s.resident) + " of " + to_string(s.capacity) +
+                         " blocks, " + megabytes(s.residentBytes()));
+}
+
+} // namespace
+
+vector<pair<string, string>>
+PerformanceCounters::describe(const PerformanceCounters &previous,
+                              double seconds) const {
+  vector<pair<string, string>> rows;
+
+  describeCache("File cache", fileCache, &rows);
+  rows.emplace_back("Blocks loaded", to_string(blocksLoaded));
+  rows.emplace_back("Blocks loaded per second",
+                    rate(blocksLoaded, previous.blocksLoaded, seconds));
+  rows.emplace_back("Read from file", megabytes(bytesRead));
+
+  describeCache("GPU cache", gpuCache, &rows);
+  rows.emplace_back("GPU cache blocks per second",
+                    rate(gpuCache.misses, previous.gpuCache.misses, seconds));
+
+  rows.emplace_back("Kernel cache hits", to_string(kernelCacheHits));
+  rows.emplace_back("Kernel cache misses", to_string(kernelCacheMisses));
+  rows.emplace_back(
+      "Kernel cache hit rate",
+      percent(kernelCacheHits, kernelCacheHits + kernelCacheMisses));
+  rows.emplace_back("Kernel cache size", to_string(kernelCacheSize));
+  rows.emplace_back("Kernels compiled", to_string(kernelsCompiled));
+
+  stringstream ss;
+  ss << fixed << setprecision(1) << 1000 * compileSeconds << " ms";
+  if (0 < kernelsCompiled)
+    ss << ", " << 1000 * compileSeconds / kernelsCompiled << " ms each";
+  rows.emplace_back("Compile time", ss.str());
+
+  return rows;
+}
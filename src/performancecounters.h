@@ -0,0 +1,47 @@
+/**
+ * @brief This file defines the counters shown in the Performance dialog.
+ *
+ * @file
+ */
+
+#ifndef PERFORMANCECOUNTERS_H
+#define PERFORMANCECOUNTERS_H
+
+#include "SignalProcessor/lrucache.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Counts how the caches and the signal processing behave in practice.
+ *
+ * The counters accumulate over the whole session, also across files. They are
+ * only updated from the GUI thread.
+ */
+struct PerformanceCounters {
+  LRUCacheStats fileCache, gpuCache;
+  std::uint64_t blocksLoaded = 0, bytesRead = 0;
+
+  std::uint64_t kernelCacheHits = 0, kernelCacheMisses = 0;
+  unsigned int kernelCacheSize = 0;
+  std::uint64_t kernelsCompiled = 0;
+  double compileSeconds = 0; // Summed over the compiler threads.
+
+  /**
+   * @brief Returns the counters as pairs of a name and a formatted value.
+   *
+   * The rates are computed from the change since previous, which was taken
+   * seconds ago.
+   */
+  std::vector<std::pair<std::string, std::string>>
+  describe(const PerformanceCounters &previous, double seconds) const;
+};
+
+/**
+ * @brief The counters of this process.
+ */
+extern PerformanceCounters PERFORMANCE_COUNTERS;
+
+#endif // PERFORMANCECOUNTERS_H
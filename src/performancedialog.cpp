@@ -0,0 +1,72 @@
+#include "performancedialog.h"
+
+#include <QDialogButtonBox>
+#include <QHeaderView>
+#include <QTableWidget>
+#include <QTimer>
+#include <QVBoxLayout>
+
+using namespace std;
+
+PerformanceDialog::PerformanceDialog(QWidget *parent) : QDialog(parent) {
+  setWindowTitle("Performance");
+
+  table = new QTableWidget(0, 2, this);
+  table->setHorizontalHeaderLabels({"Counter", "Value"});
+  table->horizontalHeader()->setStretchLastSection(true);
+  table->verticalHeader()->hide();
+  table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+  table->setSelectionMode(QAbstractItemView::NoSelection);
+
+  auto buttonBox = new QDialogButtonBox(QDialogButtonBox::Close);
+  connect(buttonBox, SIGNAL(rejected()), this, SLOT(reject()));
+
+  auto box = new QVBoxLayout();
+  box->addWidget(table);
+  box->addWidget(buttonBox);
+  setLayout(box);
+
+  timer = new QTimer(this);
+  timer->setInterval(1000);
+  connect(timer, SIGNAL(timeout()), this, SLOT(refresh()));
+
+  resize(450, 550);
+}
+
+void PerformanceDialog::showEvent(QShowEvent *event) {
+  previous = PERFORMANCE_COUNTERS;
+  elapsed.start();
+  refresh();
+  timer->start();
+
+  QDialog::showEvent(event);
+}
+
+void PerformanceDialog::hideEvent(QHideEvent *event) {
+  timer->stop();
+  QDialog::hideEvent(event);
+}
+
+void PerformanceDialog::refresh() {
+  const double seconds = elapsed.restart() / 1000.;
+  const auto rows = PERFORMANCE_COUNTERS.describe(previous, seconds);
+  previous = PERFORMANCE_COUNTERS;
+
+  table->setRowCount(static_cast<int>(rows.size()));
+
+  for (int i = 0; i < static_cast<int>(rows.size()); ++i) {
+    for (int j = 0; j < 2; ++j) {
+      const string &text = j == 0 ? rows[i].first : rows[i].second;
+      QTableWidgetItem *item = table->item(i, j);
+
+      if (item) {
+        item->setText(QString::fromStdString(text));
+      } else {
+        table->setItem(i, j,
+                       new QTableWidgetItem(QString::fromStdString(text)));
+      }
+    }
+  }
+
+  table->resizeColumnToContents(0);
+}
@@ -0,0 +1,38 @@
+#ifndef PERFORMANCEDIALOG_H
+#define PERFORMANCEDIALOG_H
+
+#include "performancecounters.h"
+
+#include <QDialog>
+#include <QElapsedTimer>
+
+class QTableWidget;
+class QTimer;
+
+/**
+ * @brief This class implements the dialog window that shows the performance
+ * counters.
+ *
+ * The values are refreshed every second while the dialog is visible. The rates
+ * are computed over the time since the previous refresh.
+ */
+class PerformanceDialog : public QDialog {
+  Q_OBJECT
+
+  QTableWidget *table;
+  QTimer *timer;
+  QElapsedTimer elapsed;
+  PerformanceCounters previous;
+
+public:
+  explicit PerformanceDialog(QWidget *parent = nullptr);
+
+protected:
+  void showEvent(QShowEvent *event) override;
+  void hideEvent(QHideEvent *event) override;
+
+private slots:
+  void refresh();
+};
+
+#endif // PERFORMANCEDIALOG_H
@@ -0,0 +1,242 @@
+#include "replaybenchmark.h"
+
+#include "../Alenka-File/include/AlenkaFile/datafile.h"
+#include "DataModel/opendatafile.h"
+#include "canvas.h"
+#include "error.h"
+
+#include <detailedexception.h>
+
+#include <QTimer>
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+using namespace std;
+using namespace AlenkaFile;
+
+namespace {
+
+/**
+ * @brief Returns the nearest-rank percentile of sorted values.
+ */
+double percentile(const vector<double> &sorted, double p) {
+  const int rank = static_cast<int>(ceil(p / 100 * sorted.size()));
+  return sorted[max(0, rank - 1)];
+}
+
+string hitRate(const LRUCacheStats &now, const LRUCacheStats &before) {
+  const uint64_t hits = now.hits - before.hits;
+  const uint64_t total = hits + now.misses - before.misses;
+
+  if (total == 0)
+    return "-";
+
+  stringstream ss;
+  ss << fixed << setprecision(1) << 100. * hits / total << " %";
+  return ss.str();
+}
+
+} // namespace
+
+ReplayBenchmark::ReplayBenchmark(const string &filePath, Canvas *canvas,
+                                 OpenDataFile *file, QObject *parent)
+    : QObject(parent), canvas(canvas), file(file) {
+  ifstream script(filePath);
+  if (!script.is_open())
+    throwDetailed(runtime_error("File '" + filePath + "' could not be opened"));
+
+  const map<string, pair<Step::Command, int>> commands = {
+      {"position", {Step::Position, 1}}, {"scroll", {Step::Scroll, 1}},
+      {"zoom", {Step::Zoom, 1}},         {"width", {Step::Width, 1}},
+      {"montage", {Step::Montage, 1}},   {"window", {Step::Window, 2}}};
+
+  string line;
+  int lineNumber = 0;
+
+  while (getline(script, line)) {
+    ++lineNumber;
+    line = line.substr(0, line.find('#'));
+
+    stringstream ss(line);
+    string name;
+    if (!(ss >> name))
+      continue;
+
+    auto it = commands.find(name);
+    Step step{Step::Position, 0, 0};
+    int repeat = 1;
+    bool ok = it != commands.end();
+
+    if (ok) {
+      step.command = it->second.first;
+      ok = static_cast<bool>(ss >> step.a);
+      if (ok && it->second.second == 2)
+        ok = static_cast<bool>(ss >> step.b);
+
+      string rest;
+      if (ok && ss >> rest) {
+        stringstream count(rest);
+        ok = count >> repeat && count.eof() && 0 < repeat && !(ss >> rest);
+      }
+    }
+
+    if (!ok)
+      throwDetailed(runtime_error("Bad command on line " +
+                                  to_string(lineNumber) + " of '" + filePath +
+                                  "': " + line));
+
+    steps.insert(steps.end(), repeat, step);
+  }
+
+  if (steps.empty())
+    throwDetailed(runtime_error("The script '" + filePath + "' is empty"));
+}
+
+void ReplayBenchmark::start() {
+  connect(canvas, SIGNAL(frameFinished(double, bool)), this,
+          SLOT(frameFinished(double, bool)));
+  canvas->update();
+}
+
+void ReplayBenchmark::frameFinished(double seconds, bool complete) {
+  if (started) {
+    frameTimes.push_back(seconds);
+  } else {
+    // Wait for the initial compilation.
+    if (!complete)
+      return;
+
+    started = true;
+    before = PERFORMANCE_COUNTERS;
+    elapsed.start();
+  }
+
+  if (!complete)
+    return;
+
+  if (nextStep == steps.size()) {
+    disconnect(canvas, SIGNAL(frameFinished(double, bool)), this,
+               SLOT(frameFinished(double, bool)));
+    printReport();
+    emit finished();
+    return;
+  }
+
+  // Apply the step outside of paintGL().
+  const Step step = steps[nextStep++];
+  QTimer::singleShot(0, this, [this, step]() {
+    applyStep(step);
+    canvas->update();
+  });
+}
+
+void ReplayBenchmark::applyStep(const Step &step) {
+  InfoTable &infoTable = OpenDataFile::infoTable;
+  const double fs = file->file->getSamplingFrequency();
+  const double samples = static_cast<double>(file->file->getSamplesRecorded());
+
+  auto setPosition = [&](double position) {
+    position = min(max(0., position), samples - 1);
+    infoTable.setPosition(static_cast<int>(round(position)));
+  };
+
+  switch (step.command) {
+  case Step::Position:
+    setPosition(step.a * fs);
+    break;
+  case Step::Scroll: {
+    const double page = canvas->width() * samples / infoTable.getVirtualWidth();
+    setPosition(infoTable.getPosition() + step.a * page);
+    break;
+  }
+  case Step::Zoom:
+    infoTable.setVirtualWidth(
+        static_cast<int>(round(infoTable.getVirtualWidth() * step.a)));
+    break;
+  case Step::Width:
+    infoTable.setVirtualWidth(static_cast<int>(round(step.a)));
+    break;
+  case Step::Montage: {
+    const int index = static_cast<int>(step.a);
+    if (0 <= index && index < file->dataModel->montageTable()->rowCount())
+      infoTable.setSelectedMontage(index);
+    else
+      logToFileAndConsole("Replay: there is no montage " << index);
+    break;
+  }
+  case Step::Window:
+    canvas->window()->resize(static_cast<int>(step.a),
+                             static_cast<int>(step.b));
+    break;
+  }
+}
+
+void ReplayBenchmark::printReport() {
+  const double seconds = elapsed.elapsed() / 1000.;
+  const PerformanceCounters &now = PERFORMANCE_COUNTERS;
+
+  vector<double> sorted = frameTimes;
+  sort(sorted.begin(), sorted.end());
+  const double frames = static_cast<double>(max<size_t>(1, sorted.size()));
+
+  stringstream ss;
+  ss << fixed << setprecision(2);
+  ss << "Replayed " << steps.size() << " steps in " << sorted.size()
+     << " frames and " << seconds << " s\n";
+
+  if (!sorted.empty()) {
+    ss << "Frame time p50: " << 1000 * percentile(sorted, 50) << " ms\n";
+    ss << "Frame time p95: " << 1000 * percentile(sorted, 95) << " ms\n";
+    ss << "Frame time p99: " << 1000 * percentile(sorted, 99) << " ms\n";
+    ss << "Frame time max: " << 1000 * sorted.back() << " ms\n";
+  }
+
+  ss << "GPU cache hit rate: " << hitRate(now.gpuCache, before.gpuCache)
+     << '\n';
+  ss << "File cache hit rate: " << hitRate(now.fileCache, before.fileCache)
+     << '\n';
+  ss << "Blocks loaded per frame: "
+     << (now.blocksLoaded - before.blocksLoaded) / frames << '\n';
+  ss << "Read per frame: "
+     << (now.bytesRead - before.bytesRead) / frames / 1000 / 1000 << " MB";
+
+  logToFileAndConsole(ss.str());
+}
+
+ReplayRecorder::ReplayRecorder(const string &filePath, Canvas *canvas,
+                               OpenDataFile *file, QObject *parent)
+    : QObject(parent), file(file), script(filePath) {
+  if (!script.is_open())
+    throwDetailed(runtime_error("File '" + filePath +
+                                "' could not be opened for writing"));
+
+  const QWidget *window = canvas->window();
+  script << "window " << window->width() << ' ' << window->height() << '\n';
+  selectedMontageChanged(OpenDataFile::infoTable.getSelectedMontage());
+  virtualWidthChanged(OpenDataFile::infoTable.getVirtualWidth());
+  positionChanged(OpenDataFile::infoTable.getPosition());
+
+  connect(&OpenDataFile::infoTable, SIGNAL(positionChanged(int, double)), this,
+          SLOT(positionChanged(int)));
+  connect(&OpenDataFile::infoTable, SIGNAL(virtualWidthChanged(int)), this,
+          SLOT(virtualWidthChanged(int)));
+  connect(&OpenDataFile::infoTable, SIGNAL(selectedMontageChanged(int)), this,
+          SLOT(selectedMontageChanged(int)));
+}
+
+void ReplayRecorder::positionChanged(int position) {
+  script << "position " << setprecision(10)
+         << position / file->file->getSamplingFrequency() << endl;
+}
+
+void ReplayRecorder::virtualWidthChanged(int width) {
+  script << "width " << width << endl;
+}
+
+void ReplayRecorder::selectedMontageChanged(int index) {
+  script << "montage " << index << endl;
+}
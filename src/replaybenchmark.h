@@ -0,0 +1,103 @@
+#ifndef REPLAYBENCHMARK_H
+#define REPLAYBENCHMARK_H
+
+#include "performancecounters.h"
+
+#include <QElapsedTimer>
+#include <QObject>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+class Canvas;
+class OpenDataFile;
+
+/**
+ * @brief Replays a script of view changes, and measures the frames of Canvas.
+ *
+ * The script has one command per line; '#' starts a comment:
+ * - position S -- move to S seconds,
+ * - scroll P -- move by P pages (negative to the left),
+ * - zoom F -- multiply the virtual width by F (more than 1 zooms in),
+ * - width W -- set the virtual width to W pixels,
+ * - montage I -- select the montage with index I,
+ * - window W H -- resize the window to W times H pixels.
+ *
+ * A number after the arguments repeats the command, e.g. 'scroll 0.5 100'.
+ *
+ * Every command is applied after the previous one is fully drawn, i.e. after
+ * the first frame with all tracks compiled. The replay starts after the first
+ * complete frame, so the initial compilation isn't included. Then the
+ * percentiles of the frame times, the hit rates of the caches and the amount of
+ * data read per frame are printed, and the application quits.
+ *
+ * A window is still needed for the OpenGL context, but it can be on the
+ * offscreen platform (QT_QPA_PLATFORM=offscreen) if the driver supports it.
+ */
+class ReplayBenchmark : public QObject {
+  Q_OBJECT
+
+  struct Step {
+    enum Command { Position, Scroll, Zoom, Width, Montage, Window };
+
+    Command command;
+    double a, b;
+  };
+
+  Canvas *canvas;
+  OpenDataFile *file;
+  std::vector<Step> steps;
+  unsigned int nextStep = 0;
+  bool started = false;
+  std::vector<double> frameTimes;
+  PerformanceCounters before;
+  QElapsedTimer elapsed;
+
+public:
+  /**
+   * @brief ReplayBenchmark constructor.
+   * @param filePath The path to the script.
+   */
+  ReplayBenchmark(const std::string &filePath, Canvas *canvas,
+                  OpenDataFile *file, QObject *parent = nullptr);
+
+  /**
+   * @brief Starts when the canvas finishes the next frame.
+   */
+  void start();
+
+signals:
+  void finished();
+
+private slots:
+  void frameFinished(double seconds, bool complete);
+
+private:
+  void applyStep(const Step &step);
+  void printReport();
+};
+
+/**
+ * @brief Records the view changes as a script for ReplayBenchmark.
+ *
+ * The script starts with the current window size and view, and then a line is
+ * written for every change of the position, virtual width and montage.
+ */
+class ReplayRecorder : public QObject {
+  Q_OBJECT
+
+  OpenDataFile *file;
+  std::ofstream script;
+
+public:
+  ReplayRecorder(const std::string &filePath, Canvas *canvas,
+                 OpenDataFile *file, QObject *parent = nullptr);
+
+private slots:
+  void positionChanged(int position);
+  void virtualWidthChanged(int width);
+  void selectedMontageChanged(int index);
+};
+
+#endif // REPLAYBENCHMARK_H
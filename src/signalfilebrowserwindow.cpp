@@ -30,6 +30,9 @@
 #include "montagetemplatedialog.h"
 #include "myapplication.h"
 #include "options.h"
+#include "performancecounters.h"
+#include "performancedialog.h"
+#include "replaybenchmark.h"
 #include "signalviewer.h"
 #include "spikedetsettingsdialog.h"
 #include <localeoverride.h>
@@ -84,6 +87,33 @@ SignalFileBrowserWindow::SignalFileBrowserWindow(QWidget *parent)
 
   autoSaveTimer = new QTimer(this);
 
+  // Set up logging of the performance counters.
+  performanceLogTimer = new QTimer(this);
+  const int performanceLogMs =
+      1000 * programOption<int>("performanceLogInterval");
+
+  if (performanceLogMs > 0) {
+    connect(performanceLogTimer, &QTimer::timeout,
+            [previous = PERFORMANCE_COUNTERS,
+             elapsed = QElapsedTimer()]() mutable {
+              if (!elapsed.isValid())
+                elapsed.start();
+
+              const double seconds = elapsed.restart() / 1000.;
+              string text = "Performance counters:";
+
+              for (const auto &e :
+                   PERFORMANCE_COUNTERS.describe(previous, seconds))
+                text += "\n  " + e.first + ": " + e.second;
+
+              logToFile(text);
+              previous = PERFORMANCE_COUNTERS;
+            });
+
+    performanceLogTimer->setInterval(performanceLogMs);
+    performanceLogTimer->start();
+  }
+
   undoStack = new QUndoStack(this);
   connect(undoStack, SIGNAL(cleanChanged(bool)), this,
           SLOT(cleanChanged(bool)));
@@ -637,6 +667,13 @@ SignalFileBrowserWindow::SignalFileBrowserWindow(QWidget *parent)
   toolsMenu->addAction(synchronize);
   toolsMenu->addSeparator();
 
+  performanceDialog = new PerformanceDialog(this);
+  QAction *showPerformanceDialog = new QAction("Performance...", this);
+  connect(showPerformanceDialog, SIGNAL(triggered(bool)), performanceDialog,
+          SLOT(show()));
+  toolsMenu->addAction(showPerformanceDialog);
+  toolsMenu->addSeparator();
+
   QMenu *addMontageMenu = toolsMenu->addMenu("Add Montage");
   addMontageButton->setMenu(addMontageMenu);
   QAction *montageTemplatesAction = new QAction("Montage Templates...", this);
@@ -811,6 +848,29 @@ void SignalFileBrowserWindow::openCommandLineFile() {
 
     openFile(QString::fromStdString(fn[0]), rest);
   }
+
+  const bool fileOpen = openDataFile->file != nullptr;
+  Canvas *canvas = signalViewer->getCanvas();
+
+  if (isProgramOptionSet("recordReplay") && fileOpen) {
+    new ReplayRecorder(programOption<string>("recordReplay"), canvas,
+                       openDataFile.get(), this);
+  }
+
+  if (isProgramOptionSet("replay")) {
+    // The event loop isn't running yet, so exit() must be queued.
+    if (!fileOpen) {
+      logToFileAndConsole("Replay: no file is open");
+      QTimer::singleShot(0, qApp, []() { QApplication::exit(EXIT_FAILURE); });
+      return;
+    }
+
+    auto replay = new ReplayBenchmark(programOption<string>("replay"), canvas,
+                                      openDataFile.get(), this);
+    connect(replay, &ReplayBenchmark::finished, qApp,
+            []() { QApplication::exit(EXIT_SUCCESS); });
+    replay->start();
+  }
 }
 
 void SignalFileBrowserWindow::closeEvent(QCloseEvent *const event) {
@@ -1360,6 +1420,10 @@ void SignalFileBrowserWindow::openFile(const QString &fileName,
               SIGNAL(filterWindowChanged(AlenkaSignal::WindowFunction)),
               signalViewer, SLOT(updateSignalViewer()));
   openFileConnections.push_back(c);
+  c = connect(&OpenDataFile::infoTable,
+              SIGNAL(filterDesignChanged(AlenkaSignal::FilterDesign)),
+              signalViewer, SLOT(updateSignalViewer()));
+  openFileConnections.push_back(c);
   c = connect(&OpenDataFile::infoTable, SIGNAL(selectedMontageChanged(int)),
               signalViewer, SLOT(updateSignalViewer()));
   openFileConnections.push_back(c);
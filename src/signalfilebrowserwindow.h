@@ -34,6 +34,7 @@ class QActionGroup;
 class QLabel;
 class QAction;
 class SyncDialog;
+class PerformanceDialog;
 class TableModel;
 class DataModelVitness;
 class QTimer;
@@ -85,6 +86,8 @@ class SignalFileBrowserWindow : public QMainWindow {
   std::vector<QMetaObject::Connection> openFileConnections;
   std::vector<QMetaObject::Connection> managersConnections;
   QTimer *autoSaveTimer;
+  QTimer *performanceLogTimer;
+  PerformanceDialog *performanceDialog;
   std::string autoSaveName;
   QUndoStack *undoStack;
   QAction *saveFileAction;
@@ -116,6 +119,10 @@ public:
   explicit SignalFileBrowserWindow(QWidget *parent = nullptr);
   ~SignalFileBrowserWindow() override;
 
+  /**
+   * @brief Opens the file given on the command line, and starts --replay or
+   * --recordReplay for it.
+   */
   void openCommandLineFile();
 
   static QDateTime sampleToDate(AlenkaFile::DataFile *file, int sample);
@@ -0,0 +1,140 @@
+#include "tracer.h"
+
+#include "error.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+struct Span {
+  const char *name;
+  int64_t start, end;
+};
+
+const int CHUNK_SIZE = 4096;
+
+// Only the owner thread appends to a chunk. The size is published after the
+// span is stored, so that finish() can read the chunks of running threads.
+struct Chunk {
+  Span spans[CHUNK_SIZE];
+  atomic<int> size{0};
+  atomic<Chunk *> next{nullptr};
+};
+
+struct ThreadBuffer {
+  Chunk *first, *last;
+  int id;
+  ThreadBuffer *next;
+};
+
+// The buffers are kept until exit, so that the spans of finished threads
+// (like the montage compiler workers) are written too.
+atomic<ThreadBuffer *> buffers{nullptr};
+atomic<int> threadCount{0};
+thread_local ThreadBuffer *threadBuffer = nullptr;
+
+string traceFilePath;
+steady_clock::time_point epoch;
+
+ThreadBuffer *getThreadBuffer() {
+  if (!threadBuffer) {
+    auto buffer = new ThreadBuffer;
+    buffer->first = buffer->last = new Chunk;
+    buffer->id = threadCount++;
+    buffer->next = buffers.load();
+
+    while (!buffers.compare_exchange_weak(buffer->next, buffer))
+      ;
+
+    threadBuffer = buffer;
+  }
+
+  return threadBuffer;
+}
+
+string escapeJson(const char *str) {
+  string escaped;
+  for (; *str; ++str) {
+    if (*str == '"' || *str == '\\')
+      escaped += '\\';
+    escaped += *str;
+  }
+  return escaped;
+}
+
+} // namespace
+
+atomic<bool> Tracer::enabled{false};
+
+void Tracer::start(const string &filePath) {
+  traceFilePath = filePath;
+  epoch = steady_clock::now();
+  enabled = true;
+
+  logToFile("Recording a trace to " << filePath << ".");
+}
+
+void Tracer::finish() {
+  if (!enabled.exchange(false))
+    return;
+
+  // The times are in microseconds with nanosecond resolution. The default
+  // precision of 6 significant digits would round them to 1 ms after about 17
+  // minutes.
+  ofstream file(traceFilePath);
+  file << fixed << setprecision(3);
+  file << "{\"traceEvents\":[";
+
+  bool first = true;
+  for (ThreadBuffer *b = buffers.load(); b; b = b->next) {
+    for (Chunk *c = b->first; c; c = c->next.load(memory_order_acquire)) {
+      const int size = c->size.load(memory_order_acquire);
+
+      for (int i = 0; i < size; ++i) {
+        const Span &s = c->spans[i];
+
+        if (!first)
+          file << ',';
+        first = false;
+
+        file << "\n{\"name\":\"" << escapeJson(s.name)
+             << "\",\"cat\":\"Alenka\",\"ph\":\"X\",\"ts\":" << s.start / 1000.
+             << ",\"dur\":" << (s.end - s.start) / 1000.
+             << ",\"pid\":1,\"tid\":" << b->id << '}';
+      }
+    }
+  }
+
+  file << "\n]}\n";
+
+  if (file.good())
+    logToFile("Trace written to " << traceFilePath << ".");
+  else
+    logToFileAndConsole("Could not write the trace to " << traceFilePath
+                                                        << ".");
+}
+
+int64_t Tracer::now() {
+  return duration_cast<nanoseconds>(steady_clock::now() - epoch).count();
+}
+
+void Tracer::record(const char *name, int64_t start, int64_t end) {
+  ThreadBuffer *buffer = getThreadBuffer();
+  Chunk *chunk = buffer->last;
+  int size = chunk->size.load(memory_order_relaxed);
+
+  if (size == CHUNK_SIZE) {
+    auto next = new Chunk;
+    chunk->next.store(next, memory_order_release);
+    buffer->last = chunk = next;
+    size = 0;
+  }
+
+  chunk->spans[size] = Span{name, start, end};
+  chunk->size.store(size + 1, memory_order_release);
+}
@@ -0,0 +1,90 @@
+/**
+ * @brief This file defines a timeline tracer of the processing stages.
+ *
+ * The spans are recorded only when the trace option is set, and they are
+ * written in the Chrome trace format at exit. The file can be viewed in
+ * chrome://tracing or ui.perfetto.dev.
+ *
+ * The spans measure host time. For OpenCL commands that is only the time to
+ * enqueue them (the spans are named enqueue*), and the device work shows up in
+ * the span that waits for it.
+ *
+ * @file
+ */
+
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Collects the spans recorded by traceSpan().
+ *
+ * Every thread appends to its own buffer, so recording takes no locks. When
+ * the tracer is not started, a span costs only a check of a flag.
+ */
+class Tracer {
+  static std::atomic<bool> enabled;
+
+public:
+  /**
+   * @brief Starts recording; the trace is written to filePath by finish().
+   */
+  static void start(const std::string &filePath);
+
+  /**
+   * @brief Stops recording, and writes the trace if it was started.
+   */
+  static void finish();
+
+  static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Returns the current time in nanoseconds.
+   */
+  static std::int64_t now();
+
+  /**
+   * @brief Adds a span to the buffer of the calling thread.
+   * @param name Must stay valid until finish(), e.g. a string literal.
+   */
+  static void record(const char *name, std::int64_t start, std::int64_t end);
+};
+
+/**
+ * @brief Records a span from its construction until it goes out of scope.
+ */
+class TraceSpan {
+  const char *name;
+  std::int64_t start;
+  bool active;
+
+public:
+  explicit TraceSpan(const char *name)
+      : name(name), start(0), active(Tracer::isEnabled()) {
+    if (active)
+      start = Tracer::now();
+  }
+  ~TraceSpan() {
+    if (active)
+      Tracer::record(name, start, Tracer::now());
+  }
+
+  TraceSpan(const TraceSpan &) = delete;
+  TraceSpan &operator=(const TraceSpan &) = delete;
+};
+
+#define TRACE_CONCATENATE_(a_, b_) a_##b_
+#define TRACE_CONCATENATE(a_, b_) TRACE_CONCATENATE_(a_, b_)
+
+/**
+ * @brief Records the rest of the enclosing scope as a span called name_.
+ *
+ * name_ must be a string literal.
+ */
+#define traceSpan(name_)                                                       \
+  TraceSpan TRACE_CONCATENATE(traceSpan_, __LINE__)(name_)
+
+#endif // TRACER_H
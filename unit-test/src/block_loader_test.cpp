@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+
+#include "../../Alenka-File/include/AlenkaFile/syntheticfile.h"
+#include "../../src/SignalProcessor/blockloader.h"
+
+#include <memory>
+
+using namespace std;
+using namespace AlenkaFile;
+
+namespace {
+
+// Blocks like in SignalProcessor: they overlap by the discarded samples, the
+// first one starts before the recording, and the last ones end after it.
+const int LENGTH = 1000, STRIDE = 600, BLOCKS = 8;
+
+class FloatAllocator : public LRUCacheAllocator<float> {
+  const int size;
+
+public:
+  explicit FloatAllocator(int size) : size(size) {}
+
+  bool constructElement(float **ptr) override {
+    *ptr = new float[size];
+    return true;
+  }
+  void destroyElement(float *ptr) override { delete[] ptr; }
+};
+
+BlockLoader::Range range(int index) {
+  const int64_t from = static_cast<int64_t>(index) * STRIDE - 200;
+  return make_pair(from, from + LENGTH - 1);
+}
+
+SyntheticSettings testSettings() {
+  SyntheticSettings settings;
+  settings.channels = 3;
+  settings.samplingFrequency = 200;
+  settings.duration = (BLOCKS - 1) * STRIDE / settings.samplingFrequency;
+  return settings;
+}
+
+class BlockLoaderTest {
+  SyntheticFile file;
+  LRUCache<int, float> cache;
+  vector<float> readBuffer;
+
+public:
+  int reused = 0;
+
+  explicit BlockLoaderTest(unsigned int capacity)
+      : file(testSettings()),
+        cache(capacity, make_unique<FloatAllocator>(
+                            LENGTH * testSettings().channels)) {}
+
+  // Loads the block and compares it with reading the whole range directly.
+  void load(int index) {
+    const float *block = BlockLoader::cachedBlock(
+        &cache, index, true, set<const float *>(), []() {},
+        [this, index](float *buffer, const float *neighbour,
+                      int neighbourIndex) {
+          const auto neighbourRange = neighbour ? range(neighbourIndex)
+                                                : BlockLoader::Range();
+          const int64_t overlap =
+              BlockLoader::loadBlock(&file, buffer, range(index), neighbour,
+                                     neighbourRange, &readBuffer);
+          if (0 < overlap) {
+            EXPECT_EQ(overlap, LENGTH - STRIDE);
+            ++reused;
+          }
+        });
+
+    vector<float> expected(LENGTH * file.getChannelCount());
+    file.readSignal(expected.data(), range(index).first, range(index).second);
+
+    for (unsigned int i = 0; i < expected.size(); ++i)
+      ASSERT_EQ(block[i], expected[i]) << "block " << index << ", sample " << i;
+  }
+};
+
+} // namespace
+
+TEST(block_loader_test, forwards) {
+  BlockLoaderTest test(4);
+  for (int i = 0; i < BLOCKS; ++i)
+    test.load(i);
+
+  EXPECT_EQ(test.reused, BLOCKS - 1);
+}
+
+TEST(block_loader_test, backwards) {
+  BlockLoaderTest test(4);
+  for (int i = BLOCKS - 1; 0 <= i; --i)
+    test.load(i);
+
+  EXPECT_EQ(test.reused, BLOCKS - 1);
+}
+
+TEST(block_loader_test, capacity_one) {
+  // The neighbour is the buffer being overwritten.
+  BlockLoaderTest test(1);
+  for (int i = 0; i < BLOCKS; ++i)
+    test.load(i);
+  for (int i = BLOCKS - 2; 0 <= i; --i)
+    test.load(i);
+
+  EXPECT_EQ(test.reused, 2 * BLOCKS - 2);
+}
+
+TEST(block_loader_test, no_neighbour) {
+  BlockLoaderTest test(4);
+  for (int i : {0, 2, 4, 2, 6, 5})
+    test.load(i);
+
+  // Only block 5 is loaded next to a cached block (4 or 6); block 2 is the
+  // second time a cache hit.
+  EXPECT_EQ(test.reused, 1);
+}
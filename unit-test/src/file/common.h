@@ -4,6 +4,7 @@
 #include "../../Alenka-File/include/AlenkaFile/edf.h"
 #include "../../Alenka-File/include/AlenkaFile/gdf2.h"
 #include "../../Alenka-File/include/AlenkaFile/mat.h"
+#include "../../Alenka-File/include/AlenkaFile/syntheticfile.h"
 
 #include <algorithm>
 #include <fstream>
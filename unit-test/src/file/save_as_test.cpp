@@ -48,3 +48,40 @@ TEST(save_as_test, save_GDF_as_EDF) {
   edfFile.reset();
   remove(tmpPath);
 }
+
+TEST(save_as_test, save_GDF_as_GDF) {
+  TestFile gdf00(TEST_DATA_PATH + "gdf/gdf00.gdf", 200, 19, 364000);
+  unique_ptr<DataFile> gdf_file(gdf00.makeGDF2());
+
+  DataModel dataModel(make_unique<EventTypeTable>(),
+                      make_unique<MontageTable>());
+
+  gdf_file->setDataModel(&dataModel);
+  gdf_file->load();
+
+  path tmpPath =
+      unique_path(temp_directory_path().string() + "/%%%%_%%%%_%%%%_%%%%.gdf");
+  GDF2::saveAs(tmpPath.string(), gdf_file.get());
+  unique_ptr<DataFile> gdfFile(new GDF2(tmpPath.string()));
+
+  EXPECT_DOUBLE_EQ(gdfFile->getSamplingFrequency(), gdf00.sampleRate);
+  EXPECT_EQ(gdfFile->getChannelCount(), gdf00.channelCount);
+  EXPECT_EQ(gdfFile->getSamplesRecorded(), gdf00.samplesRecorded);
+  EXPECT_EQ(gdfFile->getLabels(), gdf_file->getLabels());
+
+  int channelCount = gdfFile->getChannelCount();
+  int samplesRecorded = static_cast<int>(gdfFile->getSamplesRecorded());
+
+  vector<float> dataF(channelCount * samplesRecorded);
+  gdfFile->readSignal(dataF.data(), 0, samplesRecorded - 1);
+
+  // The samples are stored as floats, so there is no loss beyond that.
+  double relErr, absErr;
+  compareMatrix(dataF.data(), gdf00.getValues().data(), channelCount,
+                samplesRecorded, &relErr, &absErr);
+  EXPECT_LT(relErr, MAX_REL_ERR_FLOAT);
+  EXPECT_LT(absErr, MAX_ABS_ERR_FLOAT);
+
+  gdfFile.reset();
+  remove(tmpPath);
+}
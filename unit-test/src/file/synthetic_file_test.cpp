@@ -0,0 +1,118 @@
+#include "common.h"
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+using namespace boost::filesystem;
+
+namespace {
+
+SyntheticSettings testSettings() {
+  SyntheticSettings settings;
+  settings.channels = 8;
+  settings.samplingFrequency = 200;
+  settings.duration = 600;
+  settings.seed = 7;
+  settings.artifactsPerHour = 120;
+  return settings;
+}
+
+} // namespace
+
+TEST(synthetic_file_test, deterministic) {
+  SyntheticFile a(testSettings()), b(testSettings());
+  const int n = 1000;
+  const int channels = a.getChannelCount();
+
+  vector<float> dataA(n * channels), dataB(n * channels);
+  a.readSignal(dataA.data(), 5000, 5000 + n - 1);
+  b.readSignal(dataB.data(), 5000, 5000 + n - 1);
+  EXPECT_EQ(dataA, dataB);
+
+  SyntheticSettings other = testSettings();
+  ++other.seed;
+  SyntheticFile c(other);
+  c.readSignal(dataB.data(), 5000, 5000 + n - 1);
+  EXPECT_NE(dataA, dataB);
+}
+
+TEST(synthetic_file_test, any_range) {
+  SyntheticFile file(testSettings());
+  const int channels = file.getChannelCount();
+  const int n = 70000, from = 1234, m = 40000;
+
+  vector<double> whole(n * channels), part(m * channels);
+  file.readSignal(whole.data(), 0, n - 1);
+  file.readSignal(part.data(), from, from + m - 1);
+
+  double relErr, absErr;
+  compareMatrix(whole.data() + from, part.data(), channels, m, n, m, &relErr,
+                &absErr);
+  EXPECT_DOUBLE_EQ(absErr, 0);
+
+  for (double e : whole) {
+    EXPECT_LE(e, file.getPhysicalMaximum(0));
+    EXPECT_GE(e, file.getPhysicalMinimum(0));
+  }
+}
+
+TEST(synthetic_file_test, ground_truth) {
+  SyntheticFile file(testSettings());
+  const auto &events = file.getGroundTruth();
+
+  // The expected number of spikes is 60.
+  int spikes = 0;
+  for (const SyntheticEvent &e : events)
+    spikes += e.type == SyntheticEvent::Spike;
+  EXPECT_GT(spikes, 30);
+  EXPECT_LT(spikes, 90);
+
+  for (size_t i = 0; i < events.size(); ++i) {
+    if (0 < i)
+      EXPECT_LE(events[i - 1].position, events[i].position);
+
+    EXPECT_GE(events[i].position, 0);
+    EXPECT_LE(events[i].position + events[i].duration,
+              static_cast<int64_t>(file.getSamplesRecorded()));
+    EXPECT_GE(events[i].channel, -1);
+    EXPECT_LT(events[i].channel, static_cast<int>(file.getChannelCount()));
+  }
+}
+
+TEST(synthetic_file_test, save_as_GDF) {
+  SyntheticFile file(testSettings());
+
+  DataModel dataModel(make_unique<EventTypeTable>(),
+                      make_unique<MontageTable>());
+  file.setDataModel(&dataModel);
+  file.load();
+
+  path tmpPath =
+      unique_path(temp_directory_path().string() + "/%%%%_%%%%_%%%%_%%%%.gdf");
+  GDF2::saveAs(tmpPath.string(), &file);
+  unique_ptr<DataFile> gdfFile(new GDF2(tmpPath.string()));
+
+  EXPECT_DOUBLE_EQ(gdfFile->getSamplingFrequency(),
+                   file.getSamplingFrequency());
+  EXPECT_EQ(gdfFile->getChannelCount(), file.getChannelCount());
+  EXPECT_EQ(gdfFile->getSamplesRecorded(), file.getSamplesRecorded());
+
+  const int channels = file.getChannelCount();
+  const int n = static_cast<int>(file.getSamplesRecorded());
+
+  vector<float> expected(n * channels), data(n * channels);
+  file.readSignal(expected.data(), 0, n - 1);
+  gdfFile->readSignal(data.data(), 0, n - 1);
+  EXPECT_EQ(expected, data);
+
+  DataModel gdfModel(make_unique<EventTypeTable>(),
+                     make_unique<MontageTable>());
+  gdfFile->setDataModel(&gdfModel);
+  gdfFile->load();
+
+  EXPECT_EQ(gdfModel.montageTable()->eventTable(0)->rowCount(),
+            static_cast<int>(file.getGroundTruth().size()));
+
+  gdfFile.reset();
+  remove(tmpPath);
+}
@@ -0,0 +1,166 @@
+#include <gtest/gtest.h>
+
+#include "../../src/DataModel/kernelcachefile.h"
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+using namespace std;
+using namespace boost::filesystem;
+
+namespace {
+
+const string FINGERPRINT = "Alenka 1.0|platform|device|driver 1.2.3";
+
+KernelCacheFile::Entries makeEntries(int count) {
+  KernelCacheFile::Entries entries;
+
+  for (int i = 0; i < count; ++i) {
+    string source = "out = in(" + to_string(i) + ");";
+    vector<unsigned char> binary(10 + i);
+
+    for (unsigned int j = 0; j < binary.size(); ++j)
+      binary[j] = static_cast<unsigned char>(i * 31 + j);
+
+    entries.emplace_back(source, binary);
+  }
+
+  return entries;
+}
+
+vector<unsigned char> writeAndRead(const KernelCacheFile::Entries &entries) {
+  const path p =
+      unique_path(temp_directory_path().string() + "/%%%%_%%%%_%%%%_%%%%.bin");
+
+  KernelCacheFile::write(p.string(), FINGERPRINT, entries);
+
+  ifstream file(p.string(), ios::binary);
+  vector<unsigned char> data((istreambuf_iterator<char>(file)),
+                             istreambuf_iterator<char>());
+  file.close();
+
+  remove(p);
+  return data;
+}
+
+} // namespace
+
+TEST(kernel_cache_file_test, round_trip) {
+  const auto entries = makeEntries(5);
+  const auto data = writeAndRead(entries);
+
+  KernelCacheFile file;
+  ASSERT_TRUE(file.open(data.data(), data.size(), FINGERPRINT));
+  EXPECT_EQ(file.size(), entries.size());
+
+  vector<unsigned char> binary;
+  EXPECT_FALSE(file.take("out = in(5);", &binary));
+
+  for (const auto &e : entries) {
+    ASSERT_TRUE(file.take(e.first, &binary));
+    EXPECT_EQ(binary, e.second);
+
+    // A taken entry is removed from the index.
+    EXPECT_FALSE(file.take(e.first, &binary));
+  }
+
+  EXPECT_EQ(file.size(), 0u);
+}
+
+TEST(kernel_cache_file_test, empty) {
+  const auto data = writeAndRead(KernelCacheFile::Entries());
+
+  KernelCacheFile file;
+  EXPECT_TRUE(file.open(data.data(), data.size(), FINGERPRINT));
+  EXPECT_EQ(file.size(), 0u);
+}
+
+TEST(kernel_cache_file_test, truncated) {
+  const auto data = writeAndRead(makeEntries(3));
+
+  // The last binary ends at the end of the file, so any shorter file must be
+  // rejected.
+  for (unsigned int size = 0; size < data.size(); ++size) {
+    KernelCacheFile file;
+    EXPECT_FALSE(file.open(data.data(), size, FINGERPRINT)) << size;
+    EXPECT_EQ(file.size(), 0u);
+    EXPECT_FALSE(file.isOpen());
+  }
+}
+
+TEST(kernel_cache_file_test, corrupt) {
+  const auto data = writeAndRead(makeEntries(3));
+  const unsigned int indexStart = 8 + 2 * 4 + FINGERPRINT.size() + 8;
+
+  auto corrupt = [&](unsigned int position, unsigned char value) {
+    auto copy = data;
+    copy[position] = value;
+
+    KernelCacheFile file;
+    EXPECT_FALSE(file.open(copy.data(), copy.size(), FINGERPRINT)) << position;
+    EXPECT_EQ(file.size(), 0u);
+  };
+
+  corrupt(0, 'X');                         // magic
+  corrupt(8, 2);                           // format version
+  corrupt(12, 0xFF);                       // fingerprint size
+  corrupt(indexStart - 1, 0xFF);           // entry count
+  corrupt(indexStart + 8 + 7, 0xFF);       // source offset of the 1st entry
+  corrupt(indexStart + 40 + 32 + 7, 0xFF); // binary size of the 2nd entry
+}
+
+TEST(kernel_cache_file_test, fingerprint_mismatch) {
+  const auto data = writeAndRead(makeEntries(3));
+
+  string sameSize = FINGERPRINT;
+  sameSize.back() = '4';
+
+  for (const string &fingerprint :
+       {sameSize, FINGERPRINT + ".1", string("Alenka 1.0"), string()}) {
+    KernelCacheFile file;
+    EXPECT_FALSE(file.open(data.data(), data.size(), fingerprint))
+        << fingerprint;
+    EXPECT_EQ(file.size(), 0u);
+  }
+}
+
+TEST(kernel_cache_file_test, max_cost) {
+  const auto fileEntries = makeEntries(10);
+  const auto data = writeAndRead(fileEntries);
+
+  KernelCacheFile file;
+  ASSERT_TRUE(file.open(data.data(), data.size(), FINGERPRINT));
+
+  // Two entries are in memory, and one of them is in the file as well.
+  KernelCacheFile::Entries entries = {fileEntries[3],
+                                      {"out = 0;", vector<unsigned char>(3)}};
+  set<string> saved = {entries[0].first, entries[1].first};
+
+  file.appendRemaining(&entries, &saved, 6);
+
+  ASSERT_EQ(entries.size(), 6u);
+  EXPECT_EQ(saved.size(), 6u);
+
+  for (unsigned int i = 2; i < entries.size(); ++i) {
+    EXPECT_NE(entries[i].first, fileEntries[3].first);
+
+    auto it = find(fileEntries.begin(), fileEntries.end(), entries[i]);
+    EXPECT_NE(it, fileEntries.end());
+  }
+
+  // The entries used in this session are never dropped.
+  file.appendRemaining(&entries, &saved, 1);
+  EXPECT_EQ(entries.size(), 6u);
+
+  file.appendRemaining(&entries, &saved, 100);
+  EXPECT_EQ(entries.size(), 11u);
+
+  // Saving and loading again keeps everything.
+  const auto data2 = writeAndRead(entries);
+  KernelCacheFile file2;
+  ASSERT_TRUE(file2.open(data2.data(), data2.size(), FINGERPRINT));
+  EXPECT_EQ(file2.size(), 11u);
+}
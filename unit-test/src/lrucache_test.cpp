@@ -123,3 +123,50 @@ TEST(lrucache_test, random_clear) {
   for (int i = 1; i < 5; ++i)
     randomTest(13 * i * i, 1000 * i * i * i, 111 * i * i, 1000 * i * i);
 }
+
+TEST(lrucache_test, stats) {
+  LRUCacheStats stats;
+  {
+    LRUCache<int, float> cache(2, make_unique<FloatAllocator>(nullptr));
+    cache.setStats(&stats, 1024 * sizeof(float));
+    EXPECT_EQ(stats.capacity, 2u);
+
+    int key;
+    cache.setOldest(0);
+    cache.setOldest(1);
+    EXPECT_TRUE(cache.getAny(set<int>{0}, &key));
+    cache.setOldest(2); // Evicts key 1.
+    EXPECT_FALSE(cache.getAny(set<int>{1}, &key));
+    EXPECT_TRUE(cache.getAny(set<int>{0, 2}, &key));
+
+    EXPECT_EQ(stats.hits, 2u);
+    EXPECT_EQ(stats.misses, 3u);
+    EXPECT_EQ(stats.evictions, 1u);
+    EXPECT_EQ(stats.resident, 2u);
+    EXPECT_EQ(stats.residentBytes(), 2 * 1024 * 4);
+    EXPECT_EQ(cache.size(), 2u);
+  }
+
+  // The counts are kept, but the memory is freed.
+  EXPECT_EQ(stats.misses, 3u);
+  EXPECT_EQ(stats.resident, 0u);
+}
+
+TEST(lrucache_test, peek) {
+  LRUCacheStats stats;
+  LRUCache<int, float> cache(2, make_unique<FloatAllocator>(nullptr));
+  cache.setStats(&stats, 1024 * sizeof(float));
+
+  int key;
+  float *ptr0 = cache.setOldest(0);
+  cache.setOldest(1);
+
+  EXPECT_EQ(cache.peek(set<int>{0, 5}, &key), ptr0);
+  EXPECT_EQ(key, 0);
+  EXPECT_FALSE(cache.peek(set<int>{2}, &key));
+  EXPECT_EQ(stats.hits, 0u);
+
+  // Peeking doesn't make key 0 more recently used.
+  EXPECT_EQ(cache.setOldest(2), ptr0);
+  EXPECT_FALSE(cache.peek(set<int>{0}, &key));
+}
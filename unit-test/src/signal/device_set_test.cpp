@@ -0,0 +1,164 @@
+#include <gtest/gtest.h>
+
+#include "../../Alenka-Signal/include/AlenkaSignal/deviceset.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/filterprocessor.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/openclcontext.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/throughputbalancer.h"
+
+#include <algorithm>
+#include <random>
+
+using namespace std;
+using namespace AlenkaSignal;
+
+namespace {
+
+vector<float> filterOnDevice(OpenCLContext *context, int n,
+                             const vector<float> &coefficients,
+                             const vector<float> &input) {
+  cl_int err;
+  vector<float> output(input.size());
+
+  FilterProcessor<float> processor(n, 1, context);
+  processor.changeFilter(coefficients);
+
+  cl_command_queue queue = clCreateCommandQueue(
+      context->getCLContext(), context->getCLDevice(), 0, &err);
+  checkClErrorCode(err, "clCreateCommandQueue");
+
+  cl_mem_flags flags = CL_MEM_READ_WRITE;
+
+  cl_mem inBuffer = clCreateBuffer(
+      context->getCLContext(), flags | CL_MEM_COPY_HOST_PTR,
+      input.size() * sizeof(float), const_cast<float *>(input.data()), &err);
+  checkClErrorCode(err, "clCreateBuffer");
+
+  cl_mem outBuffer =
+      clCreateBuffer(context->getCLContext(), flags,
+                     input.size() * sizeof(float), nullptr, &err);
+  checkClErrorCode(err, "clCreateBuffer");
+
+  processor.process(inBuffer, outBuffer, queue);
+
+  err = clEnqueueReadBuffer(queue, outBuffer, CL_TRUE, 0,
+                            output.size() * sizeof(float), output.data(), 0,
+                            nullptr, nullptr);
+  checkClErrorCode(err, "clEnqueueReadBuffer");
+
+  err = clReleaseCommandQueue(queue);
+  checkClErrorCode(err, "clReleaseCommandQueue");
+
+  err = clReleaseMemObject(inBuffer);
+  checkClErrorCode(err, "clReleaseMemObject");
+
+  err = clReleaseMemObject(outBuffer);
+  checkClErrorCode(err, "clReleaseMemObject");
+
+  return output;
+}
+
+} // namespace
+
+TEST(device_set_test, parse_device_list) {
+  auto devices = DeviceSet::parseDeviceList(" 0:1  2:0 ");
+  ASSERT_EQ(devices.size(), 2u);
+  EXPECT_EQ(devices[0], make_pair(0u, 1u));
+  EXPECT_EQ(devices[1], make_pair(2u, 0u));
+
+  EXPECT_TRUE(DeviceSet::parseDeviceList("").empty());
+  EXPECT_ANY_THROW(DeviceSet::parseDeviceList("0-1"));
+  EXPECT_ANY_THROW(DeviceSet::parseDeviceList("0:1x"));
+}
+
+TEST(device_set_test, balancer_measures_every_device) {
+  ThroughputBalancer balancer(3);
+
+  EXPECT_EQ(balancer.pick(1), 0u);
+  EXPECT_EQ(balancer.pick(1), 1u);
+  EXPECT_EQ(balancer.pick(1), 2u);
+}
+
+// Simulates two devices, one three times faster than the other, used the
+// same way as by the Spikedet loader: every device has at most one block in
+// flight, and the finished ones are collected before picking the next device.
+TEST(device_set_test, balancer_prefers_faster_device) {
+  const double speed[] = {3000, 1000};
+  const double blockLength = 100;
+  const int blockCount = 400;
+
+  ThroughputBalancer balancer(2);
+  int blocks[2] = {0, 0};
+  bool busy[2] = {false, false};
+  double finishAt[2] = {0, 0}, now = 0;
+
+  auto finish = [&](unsigned int device) {
+    now = max(now, finishAt[device]);
+    balancer.finished(device, blockLength, blockLength / speed[device]);
+    busy[device] = false;
+  };
+
+  for (int i = 0; i < blockCount; ++i) {
+    for (unsigned int j = 0; j < 2; ++j) {
+      if (busy[j] && finishAt[j] <= now)
+        finish(j);
+    }
+
+    const unsigned int device = balancer.pick(blockLength);
+    if (busy[device])
+      finish(device);
+
+    finishAt[device] = now + blockLength / speed[device];
+    busy[device] = true;
+    ++blocks[device];
+  }
+
+  EXPECT_NEAR(balancer.throughput(0), speed[0], 1e-6);
+  EXPECT_NEAR(balancer.throughput(1), speed[1], 1e-6);
+  EXPECT_NEAR(static_cast<double>(blocks[0]) / blockCount, 0.75, 0.02);
+
+  // Faster than the fast device alone.
+  EXPECT_LT(max(finishAt[0], finishAt[1]),
+            0.8 * blockCount * blockLength / speed[0]);
+}
+
+// With PoCL, more CPU devices can be set up like this:
+// POCL_DEVICES="pthread pthread"
+TEST(device_set_test, same_result_on_all_devices) {
+  const int n = 1000, M = 101;
+
+  mt19937 generator(1);
+  uniform_real_distribution<float> distribution(-1, 1);
+
+  vector<float> coefficients(M), input(n + 2);
+  for (auto &e : coefficients)
+    e = distribution(generator);
+  for (auto &e : input)
+    e = distribution(generator);
+
+  OpenCLContext::clfftInit();
+
+  {
+    OpenCLContext primary(OPENCL_PLATFORM, OPENCL_DEVICE);
+
+    vector<pair<unsigned int, unsigned int>> all;
+    for (unsigned int i = 0; i < OpenCLContext::getDeviceCount(OPENCL_PLATFORM);
+         ++i)
+      all.emplace_back(OPENCL_PLATFORM, i);
+
+    DeviceSet devices(&primary, all);
+    EXPECT_EQ(devices.size(), all.size());
+
+    const vector<float> expected =
+        filterOnDevice(devices.context(0), n, coefficients, input);
+
+    for (unsigned int i = 1; i < devices.size(); ++i) {
+      const vector<float> output =
+          filterOnDevice(devices.context(i), n, coefficients, input);
+
+      for (int j = M - 1; j < n; ++j)
+        EXPECT_FLOAT_EQ(output[j], expected[j]);
+    }
+  }
+
+  OpenCLContext::clfftDeinit();
+}
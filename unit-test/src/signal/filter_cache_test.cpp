@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+
+#include "../../Alenka-Signal/include/AlenkaSignal/filterprocessor.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/openclcontext.h"
+
+#include <random>
+
+using namespace std;
+using namespace AlenkaSignal;
+
+namespace {
+
+vector<float> randomVector(int n, mt19937 *generator) {
+  uniform_real_distribution<float> distribution(-1, 1);
+  vector<float> v(n);
+
+  for (auto &e : v)
+    e = distribution(*generator);
+
+  return v;
+}
+
+// Switches between more filters than the cache can hold, and checks that
+// every result is the same as the first one with that filter.
+void test(int n, int M) {
+  const int filterCount = FilterProcessor<float>::SPECTRUM_CACHE_SIZE + 2;
+
+  mt19937 generator(1);
+  vector<vector<float>> filters;
+  for (int i = 0; i < filterCount; ++i)
+    filters.push_back(randomVector(M, &generator));
+
+  vector<float> input = randomVector(n + 2, &generator);
+
+  OpenCLContext::clfftInit();
+
+  {
+    cl_int err;
+
+    OpenCLContext context(OPENCL_PLATFORM, OPENCL_DEVICE);
+    FilterProcessor<float> processor(n, 1, &context);
+
+    cl_command_queue queue = clCreateCommandQueue(
+        context.getCLContext(), context.getCLDevice(), 0, &err);
+    checkClErrorCode(err, "clCreateCommandQueue");
+
+    cl_mem_flags flags = CL_MEM_READ_WRITE;
+
+    cl_mem inBuffer =
+        clCreateBuffer(context.getCLContext(), flags | CL_MEM_COPY_HOST_PTR,
+                       input.size() * sizeof(float), input.data(), &err);
+    checkClErrorCode(err, "clCreateBuffer");
+
+    cl_mem outBuffer =
+        clCreateBuffer(context.getCLContext(), flags,
+                       input.size() * sizeof(float), nullptr, &err);
+    checkClErrorCode(err, "clCreateBuffer");
+
+    vector<vector<float>> expected(filterCount);
+    const int order[] = {0, 1, 0, 2, 1, 0, 3, 4, 5, 6, 7, 8, 9, 0, 9, 2};
+
+    for (int i : order) {
+      processor.changeFilter(filters[i]);
+      processor.process(inBuffer, outBuffer, queue);
+
+      vector<float> output(input.size());
+      err = clEnqueueReadBuffer(queue, outBuffer, CL_TRUE, 0,
+                                output.size() * sizeof(float), output.data(),
+                                0, nullptr, nullptr);
+      checkClErrorCode(err, "clEnqueueReadBuffer");
+
+      if (expected[i].empty()) {
+        expected[i] = output;
+      } else {
+        for (int j = processor.discardSamples(); j < n; ++j)
+          EXPECT_FLOAT_EQ(output[j], expected[i][j]);
+      }
+    }
+
+    err = clReleaseCommandQueue(queue);
+    checkClErrorCode(err, "clReleaseCommandQueue");
+
+    err = clReleaseMemObject(inBuffer);
+    checkClErrorCode(err, "clReleaseMemObject");
+
+    err = clReleaseMemObject(outBuffer);
+    checkClErrorCode(err, "clReleaseMemObject");
+  }
+
+  OpenCLContext::clfftDeinit();
+}
+
+} // namespace
+
+TEST(filter_cache_test, whole_block) { test(1024, 101); }
+
+TEST(filter_cache_test, partitioned) { test(1000, 701); }
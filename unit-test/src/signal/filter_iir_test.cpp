@@ -0,0 +1,255 @@
+#include <gtest/gtest.h>
+
+#include "../../Alenka-Signal/include/AlenkaSignal/cpuiirfilterprocessor.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/filter.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/iirfilterprocessor.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/openclcontext.h"
+
+#include <cmath>
+#include <random>
+
+using namespace std;
+using namespace AlenkaSignal;
+
+namespace {
+
+const double FS = 1000;
+const int N = 4000, DISCARD = 1000;
+
+// Filters a sine wave of frequency f by a 40 Hz low-pass filter, and returns
+// the largest difference between the valid part of the output and the input
+// multiplied by gain.
+double maxError(double f, double gain) {
+  vector<float> input(N + 2, 0);
+  for (int i = 0; i < N; ++i)
+    input[i] = static_cast<float>(sin(2 * M_PI * f * i / FS));
+
+  Filter<float> filter(DISCARD + 1, FS);
+  filter.setLowpassOn(true);
+  filter.setLowpass(40);
+
+  double result = 0;
+
+  {
+    cl_int err;
+
+    OpenCLContext context(OPENCL_PLATFORM, OPENCL_DEVICE);
+    IirFilterProcessor<float> processor(N, 1, &context);
+    processor.changeFilter(filter.computeBiquads(), DISCARD);
+
+    cl_command_queue queue = clCreateCommandQueue(
+        context.getCLContext(), context.getCLDevice(), 0, &err);
+    checkClErrorCode(err, "clCreateCommandQueue");
+
+    cl_mem_flags flags = CL_MEM_READ_WRITE;
+
+    cl_mem inBuffer =
+        clCreateBuffer(context.getCLContext(), flags | CL_MEM_COPY_HOST_PTR,
+                       input.size() * sizeof(float), input.data(), &err);
+    checkClErrorCode(err, "clCreateBuffer");
+
+    cl_mem outBuffer =
+        clCreateBuffer(context.getCLContext(), flags,
+                       input.size() * sizeof(float), nullptr, &err);
+    checkClErrorCode(err, "clCreateBuffer");
+
+    processor.process(inBuffer, outBuffer, queue);
+
+    vector<float> output(input.size());
+    err = clEnqueueReadBuffer(queue, outBuffer, CL_TRUE, 0,
+                              output.size() * sizeof(float), output.data(), 0,
+                              nullptr, nullptr);
+    checkClErrorCode(err, "clEnqueueReadBuffer");
+
+    const int delay = processor.delaySamples();
+    for (int i = processor.discardSamples(); i < N; ++i)
+      result = max(result, fabs(output[i] - gain * input[i - delay]));
+
+    err = clReleaseCommandQueue(queue);
+    checkClErrorCode(err, "clReleaseCommandQueue");
+
+    err = clReleaseMemObject(inBuffer);
+    checkClErrorCode(err, "clReleaseMemObject");
+
+    err = clReleaseMemObject(outBuffer);
+    checkClErrorCode(err, "clReleaseMemObject");
+  }
+
+  return result;
+}
+
+// Filters length samples of input starting at from, and returns the output.
+vector<double> filterBlock(OpenCLContext *context,
+                           const vector<Biquad> &sections, int discard,
+                           const vector<double> &input, int from,
+                           int length) {
+  vector<double> block(input.begin() + from, input.begin() + from + length);
+  block.resize(length + 2, 0);
+
+  IirFilterProcessor<double> processor(length, 1, context);
+  processor.changeFilter(sections, discard);
+
+  cl_int err;
+  cl_command_queue queue = clCreateCommandQueue(
+      context->getCLContext(), context->getCLDevice(), 0, &err);
+  checkClErrorCode(err, "clCreateCommandQueue");
+
+  cl_mem_flags flags = CL_MEM_READ_WRITE;
+
+  cl_mem inBuffer =
+      clCreateBuffer(context->getCLContext(), flags | CL_MEM_COPY_HOST_PTR,
+                     block.size() * sizeof(double), block.data(), &err);
+  checkClErrorCode(err, "clCreateBuffer");
+
+  cl_mem outBuffer =
+      clCreateBuffer(context->getCLContext(), flags,
+                     block.size() * sizeof(double), nullptr, &err);
+  checkClErrorCode(err, "clCreateBuffer");
+
+  processor.process(inBuffer, outBuffer, queue);
+
+  vector<double> output(block.size());
+  err = clEnqueueReadBuffer(queue, outBuffer, CL_TRUE, 0,
+                            output.size() * sizeof(double), output.data(), 0,
+                            nullptr, nullptr);
+  checkClErrorCode(err, "clEnqueueReadBuffer");
+
+  err = clReleaseCommandQueue(queue);
+  checkClErrorCode(err, "clReleaseCommandQueue");
+
+  err = clReleaseMemObject(inBuffer);
+  checkClErrorCode(err, "clReleaseMemObject");
+
+  err = clReleaseMemObject(outBuffer);
+  checkClErrorCode(err, "clReleaseMemObject");
+
+  return output;
+}
+
+} // namespace
+
+TEST(filter_iir_test, passband_is_kept_without_phase_shift) {
+  EXPECT_LT(maxError(5, 1), 1e-3);
+}
+
+TEST(filter_iir_test, stopband_is_removed) {
+  EXPECT_LT(maxError(150, 0), 1e-3);
+}
+
+TEST(filter_iir_test, impulse_response_is_symmetric) {
+  OpenCLContext context(OPENCL_PLATFORM, OPENCL_DEVICE);
+  IirFilterProcessor<double> processor(N, 1, &context);
+
+  Filter<double> filter(DISCARD + 1, FS);
+  filter.setHighpassOn(true);
+  filter.setHighpass(10);
+  filter.setNotchOn(true);
+  filter.setNotch(50);
+  processor.changeFilter(filter.computeBiquads(), DISCARD);
+
+  const vector<double> response = processor.impulseResponse();
+  ASSERT_EQ(static_cast<int>(response.size()), DISCARD + 1);
+
+  double sum = 0;
+  for (unsigned int i = 0; i < response.size(); ++i) {
+    EXPECT_NEAR(response[i], response[response.size() - 1 - i], 1e-7);
+    sum += response[i];
+  }
+
+  // A high-pass filter has no DC gain.
+  EXPECT_NEAR(sum, 0, 1e-3);
+}
+
+TEST(filter_iir_test, warm_up_follows_slowest_pole) {
+  Filter<double> filter(DISCARD + 1, FS);
+  filter.setLowpassOn(true);
+  filter.setLowpass(40);
+  const int lowpass = IirFilterProcessor<double>::warmUpSamples(
+      filter.computeBiquads());
+
+  filter.setHighpassOn(true);
+  filter.setHighpass(0.5);
+  const int highpass = IirFilterProcessor<double>::warmUpSamples(
+      filter.computeBiquads());
+
+  EXPECT_EQ(IirFilterProcessor<double>::warmUpSamples({}), 0);
+  EXPECT_LT(lowpass, DISCARD / 2);
+  EXPECT_LT(DISCARD / 2, highpass);
+}
+
+// Adjacent blocks must join without seams, i.e. their valid parts must be the
+// same as the corresponding part of a single long block. A 0.5 Hz high-pass
+// takes several seconds to settle, much longer than the FIR filter discards.
+TEST(filter_iir_test, adjacent_blocks_match_long_run) {
+  Filter<double> filter(DISCARD + 1, FS);
+  filter.setHighpassOn(true);
+  filter.setHighpass(0.5);
+  const vector<Biquad> sections = filter.computeBiquads();
+
+  const int discard =
+      2 * IirFilterProcessor<double>::warmUpSamples(sections);
+  const int blockLength = discard + N, stride = blockLength - discard;
+  const int longLength = stride + blockLength;
+
+  mt19937 generator(1);
+  normal_distribution<double> distribution(0, 1);
+
+  // Noise on top of a slow wave that the high-pass removes.
+  vector<double> input(longLength);
+  for (int i = 0; i < longLength; ++i)
+    input[i] = distribution(generator) + 3 * sin(2 * M_PI * 0.3 * i / FS);
+
+  OpenCLContext context(OPENCL_PLATFORM, OPENCL_DEVICE);
+
+  const vector<double> longRun =
+      filterBlock(&context, sections, discard, input, 0, longLength);
+
+  for (int k = 0; k < 2; ++k) {
+    const vector<double> block = filterBlock(&context, sections, discard,
+                                             input, k * stride, blockLength);
+
+    for (int i = discard; i < blockLength; ++i)
+      EXPECT_NEAR(block[i], longRun[k * stride + i], 1e-2);
+  }
+}
+
+// The host implementation must give the same result as the kernel, also when
+// filtering in place.
+TEST(filter_iir_test, cpu_matches_device) {
+  Filter<double> filter(DISCARD + 1, FS);
+  filter.setLowpassOn(true);
+  filter.setLowpass(40);
+  filter.setHighpassOn(true);
+  filter.setHighpass(1);
+  const vector<Biquad> sections = filter.computeBiquads();
+
+  mt19937 generator(2);
+  normal_distribution<double> distribution(0, 1);
+
+  vector<double> input(N);
+  for (int i = 0; i < N; ++i)
+    input[i] = distribution(generator) + 5;
+
+  OpenCLContext context(OPENCL_PLATFORM, OPENCL_DEVICE);
+  const vector<double> device =
+      filterBlock(&context, sections, DISCARD, input, 0, N);
+
+  CpuIirFilterProcessor<double> processor(N, 1);
+  processor.changeFilter(sections, DISCARD);
+
+  vector<double> block = input, output(N + 2, 0);
+  block.resize(N + 2, 0);
+  processor.process(block.data(), output.data());
+
+  for (int i = 0; i < N; ++i)
+    EXPECT_NEAR(output[i], device[i], 1e-6);
+
+  processor.process(block.data(), block.data());
+
+  for (int i = 0; i < N; ++i)
+    EXPECT_EQ(block[i], output[i]);
+
+  EXPECT_EQ(processor.impulseResponse(),
+            IirFilterProcessor<double>::impulseResponse(
+                sections, processor.delaySamples()));
+}
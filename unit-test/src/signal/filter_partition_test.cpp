@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+
+#include "../../Alenka-Signal/include/AlenkaSignal/filterprocessor.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/openclcontext.h"
+
+#include <cmath>
+#include <random>
+
+using namespace std;
+using namespace AlenkaSignal;
+
+namespace {
+
+// Compares the output of FilterProcessor with direct convolution. If rows is
+// not zero, only that many of the channels are filtered.
+template <class T>
+void test(int n, int M, double maxError, unsigned int rows = 0) {
+  const int channelCount = 3, rowLength = n + 2;
+  const int testedCount = rows == 0 ? channelCount : rows;
+
+  mt19937 generator(1);
+  uniform_real_distribution<double> distribution(-1, 1);
+
+  vector<T> coefficients(M);
+  for (auto &e : coefficients)
+    e = static_cast<T>(distribution(generator) / M);
+
+  vector<T> input(rowLength * channelCount, 0);
+  for (int j = 0; j < channelCount; ++j)
+    for (int i = 0; i < n; ++i)
+      input[j * rowLength + i] = static_cast<T>(distribution(generator));
+
+  OpenCLContext::clfftInit();
+
+  {
+    cl_int err;
+
+    OpenCLContext context(OPENCL_PLATFORM, OPENCL_DEVICE);
+    FilterProcessor<T> processor(n, channelCount, &context);
+    processor.changeFilter(coefficients);
+    EXPECT_EQ(processor.partitioned(),
+              n < 2 * M || !FilterProcessor<T>::fftSizeSupported(n));
+
+    cl_command_queue queue = clCreateCommandQueue(
+        context.getCLContext(), context.getCLDevice(), 0, &err);
+    checkClErrorCode(err, "clCreateCommandQueue");
+
+    cl_mem_flags flags = CL_MEM_READ_WRITE;
+
+    cl_mem inBuffer =
+        clCreateBuffer(context.getCLContext(), flags | CL_MEM_COPY_HOST_PTR,
+                       input.size() * sizeof(T), input.data(), &err);
+    checkClErrorCode(err, "clCreateBuffer");
+
+    cl_mem outBuffer = clCreateBuffer(context.getCLContext(), flags,
+                                      input.size() * sizeof(T), nullptr, &err);
+    checkClErrorCode(err, "clCreateBuffer");
+
+    // Run it twice to make sure the state is kept correctly between calls.
+    vector<T> output(input.size());
+    for (int k = 0; k < 2; ++k) {
+      processor.process(inBuffer, outBuffer, queue, rows);
+
+      err = clEnqueueReadBuffer(queue, outBuffer, CL_TRUE, 0,
+                                output.size() * sizeof(T), output.data(), 0,
+                                nullptr, nullptr);
+      checkClErrorCode(err, "clEnqueueReadBuffer");
+
+      for (int j = 0; j < testedCount; ++j) {
+        for (int i = processor.discardSamples(); i < n; ++i) {
+          double sum = 0;
+          for (int l = 0; l < M; ++l)
+            sum += coefficients[l] * input[j * rowLength + i - l];
+
+          EXPECT_NEAR(output[j * rowLength + i], sum, maxError);
+        }
+      }
+    }
+
+    err = clReleaseCommandQueue(queue);
+    checkClErrorCode(err, "clReleaseCommandQueue");
+
+    err = clReleaseMemObject(inBuffer);
+    checkClErrorCode(err, "clReleaseMemObject");
+
+    err = clReleaseMemObject(outBuffer);
+    checkClErrorCode(err, "clReleaseMemObject");
+  }
+
+  OpenCLContext::clfftDeinit();
+}
+
+} // namespace
+
+TEST(filter_partition_test, whole_block_float) { test<float>(1024, 101, 1e-4); }
+
+TEST(filter_partition_test, partitioned_float) { test<float>(1000, 701, 1e-4); }
+
+TEST(filter_partition_test, partitioned_double) {
+  test<double>(1000, 701, 1e-10);
+}
+
+TEST(filter_partition_test, filter_longer_than_partition_float) {
+  test<float>(4000, 3001, 1e-4);
+}
+
+TEST(filter_partition_test, fewer_rows_float) {
+  test<float>(1024, 101, 1e-4, 1);
+  test<float>(1024, 101, 1e-4, 2);
+}
+
+TEST(filter_partition_test, fewer_rows_partitioned_float) {
+  test<float>(1000, 701, 1e-4, 2);
+}
+
+TEST(filter_partition_test, fft_size_supported) {
+  EXPECT_TRUE(FilterProcessor<float>::fftSizeSupported(16384));
+  EXPECT_TRUE(FilterProcessor<float>::fftSizeSupported(2 * 3 * 5 * 7 * 8));
+  EXPECT_FALSE(FilterProcessor<float>::fftSizeSupported(26384));
+  EXPECT_FALSE(FilterProcessor<float>::fftSizeSupported(32384));
+  EXPECT_FALSE(FilterProcessor<float>::fftSizeSupported(0));
+}
+
+// The block SignalProcessor uses at 10 kHz with the default blockSize of 16384:
+// it is extended by the M - 1 = 10000 discarded samples to 26384 = 2^4*17*97.
+TEST(filter_partition_test, extended_block_10khz_float) {
+  test<float>(16384 + 10000, 10001, 1e-4, 1);
+}
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 
+#include "../../Alenka-Signal/include/AlenkaSignal/cpufilterprocessor.h"
 #include "../../Alenka-Signal/include/AlenkaSignal/filter.h"
 #include "../../Alenka-Signal/include/AlenkaSignal/filterprocessor.h"
 #include "../../Alenka-Signal/include/AlenkaSignal/openclcontext.h"
@@ -7,6 +8,7 @@
 #include <algorithm>
 #include <cmath>
 #include <functional>
+#include <random>
 
 using namespace std;
 using namespace AlenkaSignal;
@@ -101,6 +103,83 @@ vector<T> addSignal(int length, int channelCount, vector<T> *data1,
   return tmp;
 }
 
+// Compares the valid samples of CpuFilterProcessor with FilterProcessor.
+template <class T> void compareWithCpu(int n, int M, double maxError) {
+  const int channelCount = 3, rowLength = n + 2;
+
+  mt19937 generator(1);
+  uniform_real_distribution<double> distribution(-1, 1);
+
+  vector<T> coefficients(M);
+  for (auto &e : coefficients)
+    e = static_cast<T>(distribution(generator) / M);
+
+  vector<T> input(rowLength * channelCount, 0);
+  for (int j = 0; j < channelCount; ++j)
+    for (int i = 0; i < n; ++i)
+      input[j * rowLength + i] = static_cast<T>(distribution(generator));
+
+  vector<T> expected(input.size()), output(input.size());
+
+  OpenCLContext::clfftInit();
+
+  {
+    cl_int err;
+
+    OpenCLContext context(OPENCL_PLATFORM, OPENCL_DEVICE);
+    FilterProcessor<T> processor(n, channelCount, &context);
+    processor.changeFilter(coefficients);
+
+    cl_command_queue queue = clCreateCommandQueue(
+        context.getCLContext(), context.getCLDevice(), 0, &err);
+    checkClErrorCode(err, "clCreateCommandQueue");
+
+    cl_mem_flags flags = CL_MEM_READ_WRITE;
+
+    cl_mem inBuffer =
+        clCreateBuffer(context.getCLContext(), flags | CL_MEM_COPY_HOST_PTR,
+                       input.size() * sizeof(T), input.data(), &err);
+    checkClErrorCode(err, "clCreateBuffer");
+
+    cl_mem outBuffer = clCreateBuffer(context.getCLContext(), flags,
+                                      input.size() * sizeof(T), nullptr, &err);
+    checkClErrorCode(err, "clCreateBuffer");
+
+    processor.process(inBuffer, outBuffer, queue);
+
+    err = clEnqueueReadBuffer(queue, outBuffer, CL_TRUE, 0,
+                              expected.size() * sizeof(T), expected.data(), 0,
+                              nullptr, nullptr);
+    checkClErrorCode(err, "clEnqueueReadBuffer");
+
+    err = clReleaseCommandQueue(queue);
+    checkClErrorCode(err, "clReleaseCommandQueue");
+
+    err = clReleaseMemObject(inBuffer);
+    checkClErrorCode(err, "clReleaseMemObject");
+
+    err = clReleaseMemObject(outBuffer);
+    checkClErrorCode(err, "clReleaseMemObject");
+  }
+
+  OpenCLContext::clfftDeinit();
+
+  CpuFilterProcessor<T> cpuProcessor(n, channelCount);
+  cpuProcessor.changeFilter(coefficients);
+  EXPECT_EQ(cpuProcessor.discardSamples(), M - 1);
+  EXPECT_EQ(cpuProcessor.delaySamples(), (M - 1) / 2);
+
+  // Run it twice to make sure the spectrum is reused correctly.
+  for (int k = 0; k < 2; ++k) {
+    cpuProcessor.process(input.data(), output.data());
+
+    for (int j = 0; j < channelCount; ++j)
+      for (int i = M - 1; i < n; ++i)
+        EXPECT_NEAR(output[j * rowLength + i], expected[j * rowLength + i],
+                    maxError);
+  }
+}
+
 } // namespace
 
 TEST(filter_test, allpass_float) {
@@ -115,3 +194,10 @@ TEST(filter_test, allpass_float) {
 
   // testFilter(filter, 200, c, data, data); // TODO: Turn this on.
 }
+
+TEST(filter_test, cpu_float) { compareWithCpu<float>(1000, 101, 0.00001); }
+
+TEST(filter_test, cpu_double) { compareWithCpu<double>(1000, 101, 1e-10); }
+
+// FilterProcessor uses partitioned convolution for this filter.
+TEST(filter_test, cpu_long_float) { compareWithCpu<float>(1000, 701, 0.00001); }
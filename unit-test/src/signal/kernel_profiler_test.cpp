@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+
+#include "../../Alenka-Signal/include/AlenkaSignal/kernelprofiler.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/montage.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/montageprocessor.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/openclcontext.h"
+
+#include <sstream>
+
+using namespace std;
+using namespace AlenkaSignal;
+
+TEST(kernel_profiler_test, montage_tracks) {
+  const int n = 1000, inChannels = 2;
+  OpenCLContext context(OPENCL_PLATFORM, OPENCL_DEVICE);
+
+  Montage<float> m1("out = in(0);", &context);
+  Montage<float> m2("out = 0; for (int i = 0; i < 100; ++i) out += in(1);",
+                    &context);
+  vector<Montage<float> *> montage = {&m1, nullptr, &m2};
+
+  cl_int err;
+  cl_command_queue queue =
+      clCreateCommandQueue(context.getCLContext(), context.getCLDevice(),
+                           CL_QUEUE_PROFILING_ENABLE, &err);
+  checkClErrorCode(err, "clCreateCommandQueue");
+
+  cl_mem inBuffer =
+      clCreateBuffer(context.getCLContext(), CL_MEM_READ_WRITE,
+                     n * inChannels * sizeof(float), nullptr, &err);
+  checkClErrorCode(err, "clCreateBuffer");
+
+  cl_mem outBuffer =
+      clCreateBuffer(context.getCLContext(), CL_MEM_READ_WRITE,
+                     n * montage.size() * sizeof(float), nullptr, &err);
+  checkClErrorCode(err, "clCreateBuffer");
+
+  const vector<float> xyz = MontageProcessor<float>::buildXyzBuffer(
+      vector<float>(3 * inChannels), inChannels);
+  cl_mem xyzBuffer = clCreateBuffer(
+      context.getCLContext(), CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+      xyz.size() * sizeof(float), const_cast<float *>(xyz.data()), &err);
+  checkClErrorCode(err, "clCreateBuffer");
+
+  KernelProfiler profiler;
+  MontageProcessor<float> processor(n, inChannels);
+  processor.setProfiler(&profiler);
+
+  for (int i = 0; i < 3; ++i) {
+    processor.process(montage.begin(), montage.end(), inBuffer, outBuffer,
+                      xyzBuffer, queue, n);
+    profiler.collect({"A", "B"});
+  }
+
+  for (cl_mem e : {inBuffer, outBuffer, xyzBuffer}) {
+    err = clReleaseMemObject(e);
+    checkClErrorCode(err, "clReleaseMemObject");
+  }
+
+  err = clReleaseCommandQueue(queue);
+  checkClErrorCode(err, "clReleaseCommandQueue");
+
+  // The tracks are told apart by the names, and the index is used beyond
+  // them. The missing track isn't measured.
+  EXPECT_EQ(profiler.count("montage", "A"), 3);
+  EXPECT_EQ(profiler.count("montage", "B"), 0);
+  EXPECT_EQ(profiler.count("montage", "2"), 3);
+  EXPECT_GT(profiler.total("montage", "2"), 0);
+
+  stringstream csv;
+  profiler.printCsv(csv);
+
+  string line;
+  getline(csv, line);
+  EXPECT_EQ(line, "stage,track,count,total_ms,mean_ms,max_ms");
+  getline(csv, line);
+  EXPECT_EQ(line.substr(0, 12), "montage,2,3,");
+
+  // Tables of several processors can be appended to one file.
+  stringstream appended;
+  profiler.printCsv(appended, "1 (4096 x 2)", false);
+
+  getline(appended, line);
+  EXPECT_EQ(line.substr(0, 25), "1 (4096 x 2),montage,2,3,");
+}
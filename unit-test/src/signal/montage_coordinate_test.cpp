@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 
 #include "../../Alenka-Signal/include/AlenkaSignal/montage.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/montageprocessor.h"
 #include "../../Alenka-Signal/include/AlenkaSignal/openclcontext.h"
 
 using namespace std;
@@ -10,4 +11,70 @@ using namespace AlenkaSignal;
 
 TEST(montage_coordinate_test, xyz) {}
 
-TEST(montage_coordinate_test, distance) {}
+TEST(montage_coordinate_test, distance) {
+  const int n = 4, inChannels = 3;
+  const vector<float> xyz = MontageProcessor<float>::buildXyzBuffer(
+      {0, 0, 0, 3, 4, 0, 3, 4, 12}, inChannels);
+
+  ASSERT_EQ(xyz.size(), MontageProcessor<float>::xyzBufferSize(inChannels));
+  const float *table = xyz.data() + 3 * inChannels;
+  EXPECT_FLOAT_EQ(table[0 * inChannels + 1], 5);
+  EXPECT_FLOAT_EQ(table[1 * inChannels + 0], 5);
+  EXPECT_FLOAT_EQ(table[0 * inChannels + 2], 13);
+  EXPECT_FLOAT_EQ(table[1 * inChannels + 2], 12);
+  EXPECT_FLOAT_EQ(table[2 * inChannels + 2], 0);
+
+  // The kernels read the table, and compute the distance only for channels out
+  // of range, which are at the origin.
+  OpenCLContext context(OPENCL_PLATFORM, OPENCL_DEVICE);
+  Montage<float> m1("out = _dist_(0, 2);", &context);
+  Montage<float> m2("out = _dist_(2, 1);", &context);
+  Montage<float> m3("out = _dist_(1, 5);", &context);
+  vector<Montage<float> *> montage = {&m1, &m2, &m3};
+
+  cl_int err;
+  cl_command_queue queue = clCreateCommandQueue(context.getCLContext(),
+                                                context.getCLDevice(), 0, &err);
+  checkClErrorCode(err, "clCreateCommandQueue");
+
+  vector<float> signal(n * inChannels), output(n * montage.size());
+  cl_mem_flags flags = CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR;
+
+  cl_mem inBuffer =
+      clCreateBuffer(context.getCLContext(), flags,
+                     signal.size() * sizeof(float), signal.data(), &err);
+  checkClErrorCode(err, "clCreateBuffer");
+
+  cl_mem outBuffer =
+      clCreateBuffer(context.getCLContext(), CL_MEM_READ_WRITE,
+                     output.size() * sizeof(float), nullptr, &err);
+  checkClErrorCode(err, "clCreateBuffer");
+
+  cl_mem xyzBuffer = clCreateBuffer(
+      context.getCLContext(), CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+      xyz.size() * sizeof(float), const_cast<float *>(xyz.data()), &err);
+  checkClErrorCode(err, "clCreateBuffer");
+
+  MontageProcessor<float> processor(n, inChannels);
+  processor.process(montage.begin(), montage.end(), inBuffer, outBuffer,
+                    xyzBuffer, queue, n);
+
+  err = clEnqueueReadBuffer(queue, outBuffer, CL_TRUE, 0,
+                            output.size() * sizeof(float), output.data(), 0,
+                            nullptr, nullptr);
+  checkClErrorCode(err, "clEnqueueReadBuffer");
+
+  for (cl_mem e : {inBuffer, outBuffer, xyzBuffer}) {
+    err = clReleaseMemObject(e);
+    checkClErrorCode(err, "clReleaseMemObject");
+  }
+
+  err = clReleaseCommandQueue(queue);
+  checkClErrorCode(err, "clReleaseCommandQueue");
+
+  for (int i = 0; i < n; ++i) {
+    EXPECT_FLOAT_EQ(output[i], 13);
+    EXPECT_FLOAT_EQ(output[n + i], 12);
+    EXPECT_FLOAT_EQ(output[2 * n + i], 5);
+  }
+}
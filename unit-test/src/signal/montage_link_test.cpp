@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+
+#include "../../Alenka-Signal/include/AlenkaSignal/montage.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/montageprocessor.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/openclcontext.h"
+
+#include <cmath>
+
+using namespace std;
+using namespace AlenkaSignal;
+
+namespace {
+
+const string HEADER = R"(
+float sumAll(PARA) {
+  float tmp = 0;
+  for (int i = 0; i < IN_COUNT; ++i)
+    tmp += in(i);
+  return tmp;
+}
+#define sumAll() sumAll(PASS)
+
+float scaled(int i, float k, PARA) { return k * in(i); }
+#define scaled(a_, b_) scaled(a_, b_, PASS)
+)";
+
+const vector<string> TRACKS = {"out = sumAll();", "out = scaled(1, 2.5f);",
+                               "out = in(2) - sumAll()/IN_COUNT;"};
+
+vector<float> runMontage(bool separateCompilation) {
+  const int n = 20, inChannels = 3;
+  cl_int err;
+
+  OpenCLContext context(OPENCL_PLATFORM, OPENCL_DEVICE);
+  context.setSeparateCompilation(separateCompilation);
+
+  cl_command_queue queue = clCreateCommandQueue(context.getCLContext(),
+                                                context.getCLDevice(), 0, &err);
+  checkClErrorCode(err, "clCreateCommandQueue");
+
+  vector<unique_ptr<Montage<float>>> montage;
+  for (const auto &e : TRACKS)
+    montage.push_back(make_unique<Montage<float>>(e, &context, HEADER));
+
+  vector<float> signal;
+  for (int j = 0; j < inChannels; ++j)
+    for (int i = 1; i <= n; ++i)
+      signal.push_back(static_cast<float>(10 * pow(10, j) + i));
+
+  vector<float> output(n * montage.size());
+  vector<float> xyz = MontageProcessor<float>::buildXyzBuffer({}, inChannels);
+  cl_mem_flags flags = CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR;
+
+  cl_mem inBuffer =
+      clCreateBuffer(context.getCLContext(), flags,
+                     signal.size() * sizeof(float), signal.data(), &err);
+  checkClErrorCode(err, "clCreateBuffer");
+
+  cl_mem outBuffer =
+      clCreateBuffer(context.getCLContext(), CL_MEM_READ_WRITE,
+                     output.size() * sizeof(float), nullptr, &err);
+  checkClErrorCode(err, "clCreateBuffer");
+
+  cl_mem xyzBuffer = clCreateBuffer(context.getCLContext(), flags,
+                                    xyz.size() * sizeof(float), xyz.data(),
+                                    &err);
+  checkClErrorCode(err, "clCreateBuffer");
+
+  MontageProcessor<float> processor(n, inChannels);
+  processor.process(montage.begin(), montage.end(), inBuffer, outBuffer,
+                    xyzBuffer, queue, n);
+
+  err = clEnqueueReadBuffer(queue, outBuffer, CL_TRUE, 0,
+                            output.size() * sizeof(float), output.data(), 0,
+                            nullptr, nullptr);
+  checkClErrorCode(err, "clEnqueueReadBuffer");
+
+  montage.clear();
+
+  err = clReleaseCommandQueue(queue);
+  checkClErrorCode(err, "clReleaseCommandQueue");
+
+  err = clReleaseMemObject(inBuffer);
+  checkClErrorCode(err, "clReleaseMemObject");
+
+  err = clReleaseMemObject(outBuffer);
+  checkClErrorCode(err, "clReleaseMemObject");
+
+  err = clReleaseMemObject(xyzBuffer);
+  checkClErrorCode(err, "clReleaseMemObject");
+
+  return output;
+}
+
+} // namespace
+
+TEST(montage_link_test, same_as_whole_program) {
+  const vector<float> whole = runMontage(false);
+  const vector<float> linked = runMontage(true);
+
+  ASSERT_EQ(whole.size(), linked.size());
+  for (unsigned int i = 0; i < whole.size(); ++i)
+    EXPECT_FLOAT_EQ(whole[i], linked[i]);
+}
+
+TEST(montage_link_test, library_is_reused) {
+  OpenCLContext context(OPENCL_PLATFORM, OPENCL_DEVICE);
+
+  const string source = "float twice(float a) { return 2 * a; }";
+
+  auto a = context.library(source);
+  auto b = context.library(source);
+  EXPECT_EQ(a.get(), b.get());
+}
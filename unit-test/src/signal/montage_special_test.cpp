@@ -1,8 +1,12 @@
 #include <gtest/gtest.h>
 
 #include "../../Alenka-Signal/include/AlenkaSignal/montage.h"
+#include "../../Alenka-Signal/include/AlenkaSignal/montageprocessor.h"
 #include "../../Alenka-Signal/include/AlenkaSignal/openclcontext.h"
 
+#include <fstream>
+#include <sstream>
+
 using namespace std;
 using namespace AlenkaSignal;
 
@@ -12,3 +16,122 @@ TEST(montage_special_test, identity_montage) {
   Montage<float> m("out = in(INDEX);", &context);
   EXPECT_EQ(m.getMontageType(), IdentityMontage);
 }
+
+TEST(montage_special_test, default_header) {
+  // The library embeds the deployed header verbatim.
+  ifstream file(TEST_DATA + string("/../../misc/deploy/montageHeader.cl"));
+  ASSERT_TRUE(file.good());
+  stringstream deployed;
+  deployed << file.rdbuf();
+  EXPECT_EQ(deployed.str(), defaultMontageHeader());
+
+  const string header = defaultMontageHeader();
+  EXPECT_TRUE(hasDefaultBuiltins(header));
+  EXPECT_TRUE(hasDefaultBuiltins("// A comment.\n" + header +
+                                 "\nfloat twice(int i, PARA) {\n"
+                                 "  return 2 * in(i);\n}\n"));
+  EXPECT_FALSE(hasDefaultBuiltins(""));
+
+  string edited = header;
+  const string body = "return sumAll() / IN_COUNT;";
+  edited.replace(edited.find(body), body.size(), "return sumAll();");
+  EXPECT_FALSE(hasDefaultBuiltins(edited));
+
+  EXPECT_FALSE(
+      hasDefaultBuiltins(header + "#undef sum\n#define sum(a_, b_) 0\n"));
+  EXPECT_FALSE(hasDefaultBuiltins(header + "#define IN_COUNT 3\n"));
+}
+
+TEST(montage_special_test, share_sums) {
+  vector<string> code = {"out = in(0) - average();", "out = in(1) - average();",
+                         "out = sum(0, 1) + sum(\"B\", \"C\");",
+                         "out = sum(1, 5) - sumAll();", "out = sum(2, 0);"};
+  const vector<string> original = code;
+
+  const auto sums = shareSums(&code, {"A", "B", "C"}, 3);
+  ASSERT_EQ(sums.size(), 2u);
+  EXPECT_EQ(sums[0], make_pair(0, 2));
+  EXPECT_EQ(sums[1], make_pair(1, 2));
+
+  EXPECT_EQ(code[0], "out = in(0) - (_sharedSum_(0) / IN_COUNT);");
+  EXPECT_EQ(code[2], "out = sum(0, 1) + _sharedSum_(1);");
+  EXPECT_EQ(code[3], "out = _sharedSum_(1) - _sharedSum_(0);");
+  EXPECT_EQ(code[4], original[4]);
+
+  // Nothing is shared by a single track.
+  code = {original[0]};
+  EXPECT_TRUE(shareSums(&code, {}, 3).empty());
+  EXPECT_EQ(code[0], original[0]);
+}
+
+TEST(montage_special_test, shared_sums) {
+  const int n = 8, inChannels = 3;
+  OpenCLContext context(OPENCL_PLATFORM, OPENCL_DEVICE);
+
+  vector<string> code = {"out = in(0) - average();",
+                         "out = in(2) - average();"};
+  MontageProcessor<float> processor(n, inChannels);
+  processor.setSharedSums(shareSums(&code, {}, inChannels), &context);
+  ASSERT_EQ(processor.sharedSumCount(), 1);
+
+  Montage<float> m1(code[0], &context);
+  Montage<float> m2(code[1], &context);
+  vector<Montage<float> *> montage = {&m1, &m2};
+
+  vector<float> signal;
+  for (int j = 0; j < inChannels; ++j)
+    for (int i = 0; i < n; ++i)
+      signal.push_back(static_cast<float>(i * (j + 1)));
+
+  cl_int err;
+  cl_command_queue queue = clCreateCommandQueue(context.getCLContext(),
+                                                context.getCLDevice(), 0, &err);
+  checkClErrorCode(err, "clCreateCommandQueue");
+
+  vector<float> xyz = MontageProcessor<float>::buildXyzBuffer({}, inChannels);
+  vector<float> output(n * montage.size());
+  cl_mem_flags flags = CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR;
+
+  cl_mem inBuffer =
+      clCreateBuffer(context.getCLContext(), flags,
+                     signal.size() * sizeof(float), signal.data(), &err);
+  checkClErrorCode(err, "clCreateBuffer");
+
+  cl_mem xyzBuffer =
+      clCreateBuffer(context.getCLContext(), flags, xyz.size() * sizeof(float),
+                     xyz.data(), &err);
+  checkClErrorCode(err, "clCreateBuffer");
+
+  cl_mem outBuffer =
+      clCreateBuffer(context.getCLContext(), CL_MEM_READ_WRITE,
+                     output.size() * sizeof(float), nullptr, &err);
+  checkClErrorCode(err, "clCreateBuffer");
+
+  cl_mem sharedSumBuffer =
+      clCreateBuffer(context.getCLContext(), CL_MEM_READ_WRITE,
+                     n * processor.sharedSumCount() * sizeof(float), nullptr,
+                     &err);
+  checkClErrorCode(err, "clCreateBuffer");
+
+  processor.process(montage.begin(), montage.end(), inBuffer, outBuffer,
+                    xyzBuffer, queue, n, 0, sharedSumBuffer);
+
+  err = clEnqueueReadBuffer(queue, outBuffer, CL_TRUE, 0,
+                            output.size() * sizeof(float), output.data(), 0,
+                            nullptr, nullptr);
+  checkClErrorCode(err, "clEnqueueReadBuffer");
+
+  for (cl_mem e : {inBuffer, xyzBuffer, outBuffer, sharedSumBuffer}) {
+    err = clReleaseMemObject(e);
+    checkClErrorCode(err, "clReleaseMemObject");
+  }
+
+  err = clReleaseCommandQueue(queue);
+  checkClErrorCode(err, "clReleaseCommandQueue");
+
+  for (int i = 0; i < n; ++i) {
+    const float average = (i + 2 * i + 3 * i) / 3.f;
+    EXPECT_FLOAT_EQ(output[i], i - average);
+    EXPECT_FLOAT_EQ(output[n + i], 3 * i - average);
+  }
+}
@@ -0,0 +1,39 @@
+#include <gtest/gtest.h>
+
+#include "../../Alenka-Signal/include/AlenkaSignal/montage.h"
+
+using namespace std;
+using namespace AlenkaSignal;
+
+TEST(montage_syntax_test, valid) {
+  EXPECT_TRUE(Montage<float>::checkSyntax(""));
+  EXPECT_TRUE(Montage<float>::checkSyntax("// comment only"));
+  EXPECT_TRUE(Montage<float>::checkSyntax("out=in(1);"));
+  EXPECT_TRUE(Montage<float>::checkSyntax("out = in(\"Fp1\") - in(\"F3\");"));
+  EXPECT_TRUE(Montage<float>::checkSyntax("out = sumAll() / IN_COUNT;"));
+  EXPECT_TRUE(Montage<float>::checkSyntax(
+      "float a = 1.5e-3f; /* scale */ out = a*in(0);"));
+  EXPECT_TRUE(Montage<float>::checkSyntax(
+      "for (int i = 0; i < 3; ++i)\n  out += in(i);"));
+  EXPECT_TRUE(Montage<float>::checkSyntax("out = x(0) < 0 ? -in(0) : in(0);"));
+  EXPECT_TRUE(Montage<float>::checkSyntax("out = dist(\"Fp1\", \"F3\");"));
+}
+
+TEST(montage_syntax_test, invalid) {
+  EXPECT_FALSE(Montage<float>::checkSyntax("out = in(1)"));
+  EXPECT_FALSE(Montage<float>::checkSyntax("out = (in(1);"));
+  EXPECT_FALSE(Montage<float>::checkSyntax("out = in(1));"));
+  EXPECT_FALSE(Montage<float>::checkSyntax("out = in(1) +;"));
+  EXPECT_FALSE(Montage<float>::checkSyntax("out = ();"));
+  EXPECT_FALSE(Montage<float>::checkSyntax("out = \"Fp1\";"));
+  EXPECT_FALSE(Montage<float>::checkSyntax("out = in(1) @ 2;"));
+  EXPECT_FALSE(Montage<float>::checkSyntax("out = in(1); /* unterminated"));
+  EXPECT_FALSE(Montage<float>::checkSyntax("out = in(\"Fp1);"));
+}
+
+TEST(montage_syntax_test, error_position) {
+  string message;
+  EXPECT_FALSE(
+      Montage<float>::checkSyntax("out = 0;\nout = in(1) +;", &message));
+  EXPECT_NE(message.find("Line 2, column 13"), string::npos);
+}
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 
+#include "../../Alenka-Signal/include/AlenkaSignal/cpumontageprocessor.h"
 #include "../../Alenka-Signal/include/AlenkaSignal/montage.h"
 #include "../../Alenka-Signal/include/AlenkaSignal/montageprocessor.h"
 #include "../../Alenka-Signal/include/AlenkaSignal/openclcontext.h"
@@ -26,12 +27,21 @@ template <class T> bool testMontage(const string &src, OpenCLContext *context) {
   return res;
 }
 
-template <class T> void test(function<void(T, T)> compare, int outputCopies) {
+template <class T>
+void test(function<void(T, T)> compare, int outputCopies,
+          bool specialize = false) {
   int n = 20;
   int inChannels = 3;
   int offset = 5;
   cl_int err;
 
+  MontageLayout layout;
+  if (specialize) {
+    layout.inputRowLength = n;
+    layout.inputRowCount = inChannels;
+    layout.outputCopyCount = outputCopies;
+  }
+
   OpenCLContext context(OPENCL_PLATFORM, OPENCL_DEVICE);
   MontageProcessor<T> processor(n, inChannels, outputCopies);
 
@@ -41,23 +51,23 @@ template <class T> void test(function<void(T, T)> compare, int outputCopies) {
 
   string src = "out = in(0);";
   ASSERT_TRUE(testMontage<T>(src, &context));
-  Montage<T> m1(src, &context);
+  Montage<T> m1(src, &context, "", {}, layout);
 
   src = "out = in(1);";
   ASSERT_TRUE(testMontage<T>(src, &context));
-  Montage<T> m2(src, &context);
+  Montage<T> m2(src, &context, "", {}, layout);
 
   src = "out = in(0) + in(1);";
   ASSERT_TRUE(testMontage<T>(src, &context));
-  Montage<T> m3(src, &context);
+  Montage<T> m3(src, &context, "", {}, layout);
 
   src = "out = in(2)*3.14;";
   ASSERT_TRUE(testMontage<T>(src, &context));
-  Montage<T> m4(src, &context);
+  Montage<T> m4(src, &context, "", {}, layout);
 
   src = "out = -1;";
   ASSERT_TRUE(testMontage<T>(src, &context));
-  Montage<T> m5(src, &context);
+  Montage<T> m5(src, &context, "", {}, layout);
 
   vector<Montage<T> *> montage = {&m1, &m2, &m3, &m4, &m5};
   vector<T> signal;
@@ -81,7 +91,7 @@ template <class T> void test(function<void(T, T)> compare, int outputCopies) {
                                     outBufferSize, nullptr, &err);
   checkClErrorCode(err, "clCreateBuffer");
 
-  vector<T> xyz(montage.size() * 3);
+  vector<T> xyz = MontageProcessor<T>::buildXyzBuffer({}, inChannels);
   cl_mem xyzBuffer =
       clCreateBuffer(context.getCLContext(), flags | CL_MEM_COPY_HOST_PTR,
                      xyz.size() * sizeof(T), xyz.data(), &err);
@@ -117,10 +127,79 @@ template <class T> void test(function<void(T, T)> compare, int outputCopies) {
       compare(output[outputCopies * ((n - offset) * 4 + i) + j], -1);
     }
   }
+
+  // The CPU backend must give the same result for the same formulas.
+  vector<unique_ptr<CpuMontage<T>>> cpuMontage;
+  for (const char *e :
+       {"out = in(0);", "out = in(1);", "out = in(0) + in(1);",
+        "out = in(2)*3.14;", "out = -1;"}) {
+    string msg;
+    cpuMontage.push_back(CpuMontage<T>::parse(e, {}, -1, &msg));
+    ASSERT_TRUE(cpuMontage.back()) << msg;
+  }
+
+  CpuMontageProcessor<T> cpuProcessor(n, inChannels, outputCopies);
+  vector<T> cpuOutput(output.size());
+  cpuProcessor.process(cpuMontage.begin(), cpuMontage.end(), signal.data(),
+                       cpuOutput.data(), xyz.data(), n - offset);
+
+  for (unsigned int i = 0; i < output.size(); ++i)
+    compare(cpuOutput[i], output[i]);
 }
 
 } // namespace
 
+TEST(simple_montage_test, cpu_bytecode) {
+  const int n = 4, inChannels = 4;
+  const vector<string> labels = {"A", "B", "C", "D"};
+  const vector<float> xyz = {0, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 3};
+
+  vector<float> signal;
+  for (int j = 0; j < inChannels; ++j)
+    for (int i = 1; i <= n; ++i)
+      signal.push_back(static_cast<float>(10 * pow(10, j) + i));
+
+  auto compute = [&](const string &src) {
+    string msg;
+    vector<unique_ptr<CpuMontage<float>>> montage;
+    montage.push_back(CpuMontage<float>::parse(src, labels, 2, &msg));
+    EXPECT_TRUE(montage[0]) << msg;
+
+    vector<float> output(n, NAN);
+    if (montage[0]) {
+      CpuMontageProcessor<float> processor(n, inChannels);
+      processor.process(montage.begin(), montage.end(), signal.data(),
+                        output.data(), xyz.data(), n);
+    }
+    return output[0];
+  };
+
+  EXPECT_FLOAT_EQ(compute("out = in(0)*in(1);"), 11 * 101);
+  EXPECT_FLOAT_EQ(compute("out = 1/2 + 1.0/4;"), 0.25);
+  EXPECT_FLOAT_EQ(compute("out = (int)2.7*in(0) + (float)1/2;"), 22.5);
+  EXPECT_FLOAT_EQ(compute("out = in(0); out *= 2; out -= in(\"B\");"), -79);
+  EXPECT_FLOAT_EQ(compute("float a = average(); out = in(0) - a;"),
+                  11 - 11114 / 4.);
+  EXPECT_FLOAT_EQ(compute("out = sumAll();"), 11114);
+  EXPECT_FLOAT_EQ(compute("out = sum(1, 2);"), 1102);
+  EXPECT_FLOAT_EQ(compute("out = in(0) > 5 ? in(1) : -in(1);"), 101);
+  EXPECT_FLOAT_EQ(compute("out = sqrt(fabs(in(0) - in(1)));"), sqrt(90.f));
+  EXPECT_FLOAT_EQ(compute("out = pow(in(0), 2)/IN_COUNT;"), 121 / 4.);
+  EXPECT_FLOAT_EQ(compute("out = dist(0, 3);"), 3);
+  EXPECT_FLOAT_EQ(compute("out = distAverage(0, 1);"), -2872.5);
+  EXPECT_FLOAT_EQ(compute("out = distAverageLinear(0, 3);"), -390);
+  EXPECT_FLOAT_EQ(compute("out = x(1) + y(2) + z(3) + INDEX;"), 8);
+
+  // These must be left to Montage.
+  string msg;
+  EXPECT_FALSE(CpuMontage<float>::parse("if (in(0) > 0) out = 1;", labels, -1,
+                                        &msg));
+  EXPECT_FALSE(msg.empty());
+  EXPECT_FALSE(CpuMontage<float>::parse("int a = 1; out = a;"));
+  EXPECT_FALSE(CpuMontage<float>::parse("out = in(IN_COUNT);"));
+  EXPECT_FALSE(CpuMontage<float>::parse("out = in(0;"));
+}
+
 TEST(simple_montage_test, float_1) { test<float>(&compareFloat, 1); }
 
 TEST(simple_montage_test, double_1) { test<double>(&compareDouble, 1); }
@@ -129,6 +208,26 @@ TEST(simple_montage_test, float_2) { test<float>(&compareFloat, 2); }
 
 TEST(simple_montage_test, double_2) { test<double>(&compareDouble, 2); }
 
+TEST(simple_montage_test, float_specialized) {
+  test<float>(&compareFloat, 1, true);
+  test<float>(&compareFloat, 3, true);
+}
+
+TEST(simple_montage_test, double_specialized) {
+  test<double>(&compareDouble, 2, true);
+}
+
+TEST(simple_montage_test, specialized_source) {
+  OpenCLContext context(OPENCL_PLATFORM, OPENCL_DEVICE);
+  MontageLayout layout;
+  layout.inputRowCount = 3;
+
+  // The layout must be a part of the KernelCache key.
+  Montage<float> m1("out = in(0) + in(1);", &context);
+  Montage<float> m2("out = in(0) + in(1);", &context, "", {}, layout);
+  EXPECT_NE(m1.getSource(), m2.getSource());
+}
+
 TEST(simple_montage_test, float_n) {
   for (int i = 3; i < 10; ++i)
     test<float>(&compareFloat, i);